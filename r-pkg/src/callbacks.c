@@ -2,8 +2,10 @@
 #include "device.h"
 #include "display_list.h"
 #include "color.h"
+#include "inbound.h"
 #include "metrics.h"
 #include "png_encoder.h"
+#include "raster_delta.h"
 #include "cJSON.h"
 #include <stdint.h>
 
@@ -20,10 +22,29 @@ static jgd_state_t *get_state(pDevDesc dd) {
     return (jgd_state_t *)dd->deviceSpecific;
 }
 
+/* transport_send with byte and time accounting for jgd_stats().  Frames
+ * are also teed to the archive sinks.  Only sends the transport accepted
+ * count towards bytes_sent, so a dead viewer doesn't inflate it. */
+static void send_counted(jgd_state_t *st, const char *json, size_t len,
+                         int frame) {
+    JGD_TRACE_BEGIN(st, "transport_send");
+    double t0 = jgd_stats_now_ms();
+    int rc = frame ? transport_send_frame(&st->transport, json, len)
+                   : transport_send(&st->transport, json, len);
+    st->stats.send_ms += jgd_stats_now_ms() - t0;
+    JGD_TRACE_END(st, "transport_send");
+    if (rc == 0) st->stats.bytes_sent += (double)len + 1;
+}
+
 /** Capture a display list snapshot for historical plot resizing. */
 void jgd_capture_snapshot(jgd_state_t *st) {
     pGEDevDesc gdd = (pGEDevDesc)st->ge_dev;
+    JGD_TRACE_BEGIN(st, "capture_snapshot");
+    double t0 = jgd_stats_now_ms();
     SEXP snap = GEcreateSnapshot(gdd);
+    st->stats.snapshots++;
+    st->stats.snapshot_ms += jgd_stats_now_ms() - t0;
+    JGD_TRACE_END(st, "capture_snapshot");
     if (snap != R_NilValue) {
         PROTECT(snap);
         if (st->debug_frames) {
@@ -44,9 +65,57 @@ void jgd_capture_snapshot(jgd_state_t *st) {
     }
 }
 
+/* Splice a "timing" object into a serialized frame.  The serialize-end
+ * and send stamps can only be known after cJSON has printed the frame,
+ * so rather than re-serialize, the closing brace is replaced in place.
+ * Takes ownership of json; returns the (possibly reallocated) string. */
+static char *append_frame_timing(jgd_state_t *st, char *json, double ser_start) {
+    size_t len = strlen(json);
+    if (len == 0 || json[len - 1] != '}') return json;
+    double ser_end = jgd_wall_ms();
+    char tail[256];
+    int n = snprintf(tail, sizeof(tail),
+                     ",\"timing\":{\"id\":\"%s-%u\",\"rSerializeStart\":%.3f,"
+                     "\"rSerializeEnd\":%.3f,\"rSend\":%.3f}}",
+                     st->session_id, ++st->frame_seq, ser_start, ser_end,
+                     jgd_wall_ms());
+    if (n <= 0 || (size_t)n >= sizeof(tail)) return json;
+    char *out = (char *)realloc(json, len + (size_t)n);
+    if (!out) return json;
+    memcpy(out + len - 1, tail, (size_t)n + 1);
+    return out;
+}
+
 void jgd_flush_frame(jgd_state_t *st, int incremental) {
-    int np = (!incremental && st->new_page && !st->replaying) ? 1 : 0;
+    JGD_TRACE_BEGIN(st, "flush_frame");
+    /* Pacing: hold the frame back if the last one went out too recently.
+     * Resize replays answer the renderer and are never held.  A held
+     * page is replaced by the next one or sent whole by the idle tick,
+     * so the renderer never sees a delta against a page it did not get. */
+    if (st->frame_interval_ms > 0 && !st->replaying && !st->resize_replay) {
+        if (jgd_stats_now_ms() - st->last_frame_ms < st->frame_interval_ms) {
+            st->frame_pending = 1;
+            st->stats.frames_paced++;
+            JGD_TRACE_END(st, "flush_frame");
+            return;
+        }
+    }
+    /* Only a flush of the current page sends the held page; a resize
+     * replay answered meanwhile (a historical plot, or the current one
+     * tagged to update in place) leaves it pending for the idle tick. */
+    if (st->frame_pending && !st->replaying && !st->resize_replay) {
+        incremental = 0;
+        st->frame_pending = 0;
+    }
+    /* In streaming mode the start of the page may already be released.
+     * The renderer has those ops, so the frame carries the rest as a
+     * delta; only a replay rebuilds the page in full. */
+    if (!incremental && st->page.released > 0)
+        incremental = 1;
     int rr = st->resize_replay;
+    /* The held page's own frame carries newPage, not a replay sent first. */
+    int np = (!incremental && st->new_page && !st->replaying &&
+              !(rr && st->frame_pending)) ? 1 : 0;
     int pi = st->flush_plot_index;
     if (st->debug_frames) {
         REprintf("[jgd] flush_frame: incr=%d new_page=%d replaying=%d np=%d "
@@ -58,11 +127,31 @@ void jgd_flush_frame(jgd_state_t *st, int incremental) {
     /* plotNumber identifies new plots; suppress for resize replays
      * (which already carry plotIndex) to avoid sending a misleading value. */
     int pn = (st->page_count > 0 && pi < 0) ? st->page_count - 1 : -1;
+    JGD_TRACE_BEGIN(st, "serialize");
+    double wall0 = st->frame_timing ? jgd_wall_ms() : 0;
+    double t0 = jgd_stats_now_ms();
     char *json = page_serialize_frame(&st->page, st->session_id, incremental,
                                       np, rr, pi, pn);
+    st->stats.serialize_ms += jgd_stats_now_ms() - t0;
+    JGD_TRACE_END(st, "serialize");
+    if (json && st->frame_timing)
+        json = append_frame_timing(st, json, wall0);
     if (json) {
-        transport_send(&st->transport, json, strlen(json));
+        size_t len = strlen(json);
+        st->stats.bytes_serialized += (double)len;
+        if (incremental)
+            st->stats.frames_incremental++;
+        else
+            st->stats.frames_complete++;
+        if (rr)
+            st->stats.frames_replay++;
+        send_counted(st, json, len, 1);
+        st->last_frame_ms = jgd_stats_now_ms();
         free(json);
+        /* A failed send leaves the transport disconnected for good, so
+         * no later frame could resend these ops either. */
+        jgd_release_flushed(st);
+        jgd_raster_delta_commit(&st->raster_delta);
         if (np)
             st->new_page = 0;
         st->resize_replay = 0;
@@ -73,6 +162,51 @@ void jgd_flush_frame(jgd_state_t *st, int incremental) {
         st->resize_replay = 0;
         st->flush_plot_index = -1;
     }
+    JGD_TRACE_END(st, "flush_frame");
+}
+
+void jgd_release_flushed(jgd_state_t *st) {
+    if (!st->streaming) return;
+    int before = st->page.released;
+    page_release_flushed(&st->page);
+    st->stats.ops_released += st->page.released - before;
+}
+
+void jgd_pacing_tick(jgd_state_t *st) {
+    if (!st->frame_pending || st->drawing || st->replaying || st->recording)
+        return;
+    if (jgd_stats_now_ms() - st->last_frame_ms < st->frame_interval_ms)
+        return;
+    jgd_flush_frame(st, 0);
+}
+
+/* Send everything drawn since the last flush outside dev.hold, then
+ * capture a snapshot so the latest display list state is available for
+ * historical plot resizing. */
+static void flush_unheld(jgd_state_t *st) {
+    /* First flush on a new page must be a complete frame so the
+     * browser creates a new plot entry (addPlot) rather than
+     * appending to the previous plot. */
+    int incr = (st->last_flushed_ops > 0) ? 1 : 0;
+    jgd_flush_frame(st, incr);
+    st->last_flushed_ops = st->page.op_count;
+    /* Note: a snapshot taken from cb_mode(0) may be one DL entry short
+     * because R's GErecordGraphicOperation runs AFTER mode(0).  For
+     * base→base transitions, cb_holdflush (dev.hold 0→1) re-captures the
+     * complete DL.  For base→grid transitions, cb_newPage uses GE's
+     * savedSnapshot to fix this up.  Coalesced flushes run from the idle
+     * tick, after the DL is complete. */
+    jgd_capture_snapshot(st);
+}
+
+void jgd_coalesce_tick(jgd_state_t *st) {
+    if (st->coalesce_ms <= 0 || st->drawing || st->replaying ||
+        st->recording || st->hold_level > 0 ||
+        st->page.op_count <= st->last_flushed_ops)
+        return;
+    if (jgd_stats_now_ms() - st->coalesce_mark_ms < st->coalesce_ms)
+        return;
+    flush_unheld(st);
 }
 
 /* --- Device callbacks --- */
@@ -82,6 +216,7 @@ static void cb_deactivate(const pDevDesc dd) { (void)dd; }
 
 static void cb_newPage(const pGEcontext gc, pDevDesc dd) {
     jgd_state_t *st = get_state(dd);
+    JGD_TRACE_BEGIN(st, "cb_newPage");
 
     if (st->debug_frames) {
         REprintf("[jgd] cb_newPage: page_count=%d ops=%d last_flushed=%d "
@@ -201,9 +336,15 @@ static void cb_newPage(const pGEcontext gc, pDevDesc dd) {
         if (st->debug_frames)
             REprintf("[jgd] cb_newPage: skipping page reset during replay "
                      "(ops=%d)\n", st->page.op_count);
+        JGD_TRACE_END(st, "cb_newPage");
         return;
     }
 
+    /* A page still held back by pacing is replaced unsent, and so are
+     * its rasters. */
+    if (st->frame_pending && !st->replaying)
+        jgd_raster_delta_rollback(&st->raster_delta);
+
     /* Always free the previous page's ops.  The page is initialized in
      * C_jgd via page_init(), so even on the first cb_newPage (page_count==0)
      * there is a valid ops array to free. */
@@ -215,10 +356,14 @@ static void cb_newPage(const pGEcontext gc, pDevDesc dd) {
     double w_px = st->width * st->dpi;
     double h_px = st->height * st->dpi;
     page_init(&st->page, w_px, h_px, st->dpi, gc->fill);
-    if (st->replaying)
+    st->page.resize = st->resize_mode;
+    jgd_resources_reset(&st->resources);
+    if (st->replaying) {
         st->replay_newpage_done = 1;
-    else
+    } else {
         st->page_count++;
+        jgd_prerender_invalidate(&st->prerender);
+    }
     st->last_flushed_ops = 0;
     st->group_depth = 0;
     if (!st->replaying)
@@ -243,6 +388,7 @@ static void cb_newPage(const pGEcontext gc, pDevDesc dd) {
     st->page.frame_ext = (st->page_frame_ext_json && st->page_frame_ext_json[0])
                               ? cJSON_Parse(st->page_frame_ext_json)
                               : NULL;
+    JGD_TRACE_END(st, "cb_newPage");
 }
 
 static void cb_close(pDevDesc dd) {
@@ -251,6 +397,11 @@ static void cb_close(pDevDesc dd) {
     /* Remove R input handler before closing the transport fd */
     jgd_remove_input_handler(st);
 
+    /* Historical replays still running in forked children are sent
+     * before the close message. */
+    jgd_fork_replay_collect(st, 1);
+    jgd_fork_replay_close(st);
+
     /* Auto-close unclosed groups before the final flush. */
     if (st->group_depth > 0) {
         Rf_warning("jgd: %d unclosed group(s) at device close", st->group_depth);
@@ -262,10 +413,20 @@ static void cb_close(pDevDesc dd) {
         }
     }
 
-    if (st->page.op_count > st->last_flushed_ops) {
+    if (st->page.op_count > st->last_flushed_ops || st->frame_pending) {
+        /* The last page goes out regardless of the pacing budget. */
+        st->frame_interval_ms = 0;
         jgd_flush_frame(st, 0);
     }
 
+    if (st->trace.events && st->trace.path &&
+        jgd_trace_write(&st->trace, st->trace.path) != 0)
+        Rf_warning("jgd: could not write trace file '%s'", st->trace.path);
+    jgd_trace_free(&st->trace);
+    jgd_resources_free(&st->resources);
+    jgd_prerender_free(&st->prerender);
+    jgd_raster_delta_free(&st->raster_delta);
+
     /* Notify renderer that device is closing */
     const char *close_msg = "{\"type\":\"close\"}";
     transport_send(&st->transport, close_msg, strlen(close_msg));
@@ -290,6 +451,8 @@ static void cb_close(pDevDesc dd) {
 
 static void cb_clip(double x0, double x1, double y0, double y1, pDevDesc dd) {
     jgd_state_t *st = get_state(dd);
+    st->stats.ops[JGD_OP_CLIP]++;
+    JGD_TRACE_BEGIN(st, "cb_clip");
     cJSON *op = cJSON_CreateObject();
     cJSON_AddStringToObject(op, "op", "clip");
     cJSON_AddNumberToObject(op, "x0", x0);
@@ -297,6 +460,7 @@ static void cb_clip(double x0, double x1, double y0, double y1, pDevDesc dd) {
     cJSON_AddNumberToObject(op, "x1", x1);
     cJSON_AddNumberToObject(op, "y1", y1);
     page_add_op(&st->page, op);
+    JGD_TRACE_END(st, "cb_clip");
 
     dd->clipLeft = x0;
     dd->clipRight = x1;
@@ -307,6 +471,8 @@ static void cb_clip(double x0, double x1, double y0, double y1, pDevDesc dd) {
 static void cb_line(double x1, double y1, double x2, double y2,
                     const pGEcontext gc, pDevDesc dd) {
     jgd_state_t *st = get_state(dd);
+    st->stats.ops[JGD_OP_LINE]++;
+    JGD_TRACE_BEGIN(st, "cb_line");
     cJSON *op = cJSON_CreateObject();
     cJSON_AddStringToObject(op, "op", "line");
     cJSON_AddNumberToObject(op, "x1", x1);
@@ -315,33 +481,42 @@ static void cb_line(double x1, double y1, double x2, double y2,
     cJSON_AddNumberToObject(op, "y2", y2);
     cJSON_AddItemToObject(op, "gc", gc_to_cjson(gc, st->page_ext_parsed));
     page_add_op(&st->page, op);
+    JGD_TRACE_END(st, "cb_line");
 }
 
 static void cb_polyline(int n, double *x, double *y,
                         const pGEcontext gc, pDevDesc dd) {
     jgd_state_t *st = get_state(dd);
+    st->stats.ops[JGD_OP_POLYLINE]++;
+    JGD_TRACE_BEGIN(st, "cb_polyline");
     cJSON *op = cJSON_CreateObject();
     cJSON_AddStringToObject(op, "op", "polyline");
     cJSON_AddItemToObject(op, "x", cJSON_CreateDoubleArray(x, n));
     cJSON_AddItemToObject(op, "y", cJSON_CreateDoubleArray(y, n));
     cJSON_AddItemToObject(op, "gc", gc_to_cjson(gc, st->page_ext_parsed));
     page_add_op(&st->page, op);
+    JGD_TRACE_END(st, "cb_polyline");
 }
 
 static void cb_polygon(int n, double *x, double *y,
                        const pGEcontext gc, pDevDesc dd) {
     jgd_state_t *st = get_state(dd);
+    st->stats.ops[JGD_OP_POLYGON]++;
+    JGD_TRACE_BEGIN(st, "cb_polygon");
     cJSON *op = cJSON_CreateObject();
     cJSON_AddStringToObject(op, "op", "polygon");
     cJSON_AddItemToObject(op, "x", cJSON_CreateDoubleArray(x, n));
     cJSON_AddItemToObject(op, "y", cJSON_CreateDoubleArray(y, n));
     cJSON_AddItemToObject(op, "gc", gc_to_cjson(gc, st->page_ext_parsed));
     page_add_op(&st->page, op);
+    JGD_TRACE_END(st, "cb_polygon");
 }
 
 static void cb_rect(double x0, double y0, double x1, double y1,
                     const pGEcontext gc, pDevDesc dd) {
     jgd_state_t *st = get_state(dd);
+    st->stats.ops[JGD_OP_RECT]++;
+    JGD_TRACE_BEGIN(st, "cb_rect");
     cJSON *op = cJSON_CreateObject();
     cJSON_AddStringToObject(op, "op", "rect");
     cJSON_AddNumberToObject(op, "x0", x0);
@@ -350,11 +525,14 @@ static void cb_rect(double x0, double y0, double x1, double y1,
     cJSON_AddNumberToObject(op, "y1", y1);
     cJSON_AddItemToObject(op, "gc", gc_to_cjson(gc, st->page_ext_parsed));
     page_add_op(&st->page, op);
+    JGD_TRACE_END(st, "cb_rect");
 }
 
 static void cb_circle(double x, double y, double r,
                       const pGEcontext gc, pDevDesc dd) {
     jgd_state_t *st = get_state(dd);
+    st->stats.ops[JGD_OP_CIRCLE]++;
+    JGD_TRACE_BEGIN(st, "cb_circle");
     cJSON *op = cJSON_CreateObject();
     cJSON_AddStringToObject(op, "op", "circle");
     cJSON_AddNumberToObject(op, "x", x);
@@ -362,12 +540,15 @@ static void cb_circle(double x, double y, double r,
     cJSON_AddNumberToObject(op, "r", r);
     cJSON_AddItemToObject(op, "gc", gc_to_cjson(gc, st->page_ext_parsed));
     page_add_op(&st->page, op);
+    JGD_TRACE_END(st, "cb_circle");
 }
 
 static void cb_text(double x, double y, const char *str,
                     double rot, double hadj,
                     const pGEcontext gc, pDevDesc dd) {
     jgd_state_t *st = get_state(dd);
+    st->stats.ops[JGD_OP_TEXT]++;
+    JGD_TRACE_BEGIN(st, "cb_text");
     cJSON *op = cJSON_CreateObject();
     cJSON_AddStringToObject(op, "op", "text");
     cJSON_AddNumberToObject(op, "x", x);
@@ -377,6 +558,7 @@ static void cb_text(double x, double y, const char *str,
     cJSON_AddNumberToObject(op, "hadj", hadj);
     cJSON_AddItemToObject(op, "gc", gc_to_cjson(gc, st->page_ext_parsed));
     page_add_op(&st->page, op);
+    JGD_TRACE_END(st, "cb_text");
 }
 
 /* Helper: build gc font info for metrics request */
@@ -459,63 +641,68 @@ static void mcache_store(unsigned int hash, double v1, double v2, double v3) {
  * (The server caps the queue at MAX_PENDING_RESIZES and clears it
  * when the session disconnects, so orphaned entries cannot grow
  * unboundedly.) */
-static int recv_metrics_response(jgd_state_t *st, char *buf, size_t bufsize) {
+static int recv_metrics_response(jgd_state_t *st, jgd_inbound_t *resp) {
+    char buf[1024];
     for (int attempts = 0; attempts < 5; attempts++) {
-        int n = transport_recv_line(&st->transport, buf, bufsize, 500);
+        JGD_TRACE_BEGIN(st, "metrics_wait");
+        double t0 = jgd_stats_now_ms();
+        int n = transport_recv_line(&st->transport, buf, sizeof(buf), 500);
+        st->stats.recv_wait_ms += jgd_stats_now_ms() - t0;
+        JGD_TRACE_END(st, "metrics_wait");
         if (n <= 0) return -1;
 
-        cJSON *msg = cJSON_Parse(buf);
-        if (!msg) continue;
+        jgd_inbound_t *msg = resp;
+        if (!jgd_inbound_parse(buf, msg)) continue;
 
-        cJSON *type = cJSON_GetObjectItem(msg, "type");
-        if (cJSON_IsString(type)) {
-            if (strcmp(type->valuestring, "metrics_response") == 0) {
-                cJSON_Delete(msg);
-                return n;
-            }
-            if (strcmp(type->valuestring, "resize") == 0) {
-                cJSON *w = cJSON_GetObjectItem(msg, "width");
-                cJSON *h = cJSON_GetObjectItem(msg, "height");
-                cJSON *pi = cJSON_GetObjectItem(msg, "plotIndex");
-                if (cJSON_IsNumber(w) && cJSON_IsNumber(h) &&
-                    w->valuedouble > 0 && h->valuedouble > 0) {
-                    if (cJSON_IsNumber(pi)) {
-                        /* plotIndex resize — buffer for poll_resize_impl,
-                         * same as check_incoming does.  Preserve the first
-                         * buffered resize (FIFO matches server's queue). */
-                        if (st->has_buffered_resize) {
-                            if (st->debug_frames)
-                                REprintf("[jgd] recv_metrics_response: "
-                                         "skipping plotIndex resize "
-                                         "(pi=%d, already buffered pi=%d)\n",
-                                         (int)pi->valuedouble,
-                                         st->buffered_plot_index);
-                        } else {
-                            st->has_buffered_resize = 1;
-                            st->buffered_w = w->valuedouble;
-                            st->buffered_h = h->valuedouble;
-                            st->buffered_plot_index = (int)pi->valuedouble;
-                        }
-                    } else {
-                        st->pending_w = w->valuedouble;
-                        st->pending_h = h->valuedouble;
-                    }
+        if (msg->type == JGD_MSG_METRICS_RESPONSE) {
+            /* A late answer to a request that already timed out would be
+             * taken for this one; skip it if it says so. */
+            if ((msg->has & JGD_IN_ID) && msg->id != (double)metrics_id_counter)
+                continue;
+            return n;
+        }
+        double w, h;
+        int pi;
+        if (jgd_inbound_resize(msg, &w, &h, &pi)) {
+            if (pi >= 0) {
+                /* plotIndex resize — buffer for poll_resize_impl,
+                 * same as check_incoming does.  Preserve the first
+                 * buffered resize (FIFO matches server's queue). */
+                if (st->has_buffered_resize) {
+                    if (st->debug_frames)
+                        REprintf("[jgd] recv_metrics_response: "
+                                 "skipping plotIndex resize "
+                                 "(pi=%d, already buffered pi=%d)\n",
+                                 pi, st->buffered_plot_index);
+                } else {
+                    st->has_buffered_resize = 1;
+                    st->buffered_w = w;
+                    st->buffered_h = h;
+                    st->buffered_plot_index = pi;
                 }
+            } else {
+                st->pending_w = w;
+                st->pending_h = h;
             }
         }
-        cJSON_Delete(msg);
     }
     return -1;
 }
 
 static double cb_strWidth(const char *str, const pGEcontext gc, pDevDesc dd) {
     jgd_state_t *st = get_state(dd);
-    if (!st->transport.connected)
-        return metrics_str_width(str, gc, st->dpi);
 
+    /* Cached renderer metrics beat approximations even when offline (e.g.
+     * in a forked replay child, which must not touch the transport). */
     unsigned int h = mcache_hash(str, (int)strlen(str), gc);
     mcache_entry_t *cached = mcache_lookup(h);
-    if (cached) return cached->v1;
+    if (cached) {
+        st->stats.metrics_hits++;
+        return cached->v1;
+    }
+    if (!st->transport.connected)
+        return metrics_str_width(str, gc, st->dpi);
+    st->stats.metrics_misses++;
 
     cJSON *req = cJSON_CreateObject();
     cJSON_AddStringToObject(req, "type", "metrics_request");
@@ -527,23 +714,20 @@ static double cb_strWidth(const char *str, const pGEcontext gc, pDevDesc dd) {
     char *json = cJSON_PrintUnformatted(req);
     cJSON_Delete(req);
     if (!json) return metrics_str_width(str, gc, st->dpi);
-    transport_send(&st->transport, json, strlen(json));
+    send_counted(st, json, strlen(json), 0);
     free(json);
 
-    char buf[1024];
-    int n = recv_metrics_response(st, buf, sizeof(buf));
-    if (n <= 0)
+    jgd_inbound_t resp;
+    int n = recv_metrics_response(st, &resp);
+    if (n <= 0) {
+        st->stats.metrics_timeouts++;
         return metrics_str_width(str, gc, st->dpi);
+    }
 
-    cJSON *resp = cJSON_Parse(buf);
-    if (resp) {
-        cJSON *wj = cJSON_GetObjectItem(resp, "width");
-        double width = cJSON_IsNumber(wj) ? wj->valuedouble : 0.0;
-        cJSON_Delete(resp);
-        if (width > 0) {
-            mcache_store(h, width, 0, 0);
-            return width;
-        }
+    double width = (resp.has & JGD_IN_WIDTH) ? resp.width : 0.0;
+    if (width > 0) {
+        mcache_store(h, width, 0, 0);
+        return width;
     }
     return metrics_str_width(str, gc, st->dpi);
 }
@@ -552,10 +736,6 @@ static void cb_metricInfo(int c, const pGEcontext gc,
                           double *ascent, double *descent, double *width,
                           pDevDesc dd) {
     jgd_state_t *st = get_state(dd);
-    if (!st->transport.connected) {
-        metrics_char_info(c, gc, st->dpi, ascent, descent, width);
-        return;
-    }
 
     unsigned int cc = c < 0 ? -(unsigned int)c : (unsigned int)c;
     char key[16];
@@ -563,11 +743,17 @@ static void cb_metricInfo(int c, const pGEcontext gc,
     unsigned int h = mcache_hash(key, (int)strlen(key), gc);
     mcache_entry_t *cached = mcache_lookup(h);
     if (cached) {
+        st->stats.metrics_hits++;
         *ascent = cached->v1;
         *descent = cached->v2;
         *width = cached->v3;
         return;
     }
+    if (!st->transport.connected) {
+        metrics_char_info(c, gc, st->dpi, ascent, descent, width);
+        return;
+    }
+    st->stats.metrics_misses++;
 
     cJSON *req = cJSON_CreateObject();
     cJSON_AddStringToObject(req, "type", "metrics_request");
@@ -582,32 +768,26 @@ static void cb_metricInfo(int c, const pGEcontext gc,
         metrics_char_info(c, gc, st->dpi, ascent, descent, width);
         return;
     }
-    transport_send(&st->transport, json, strlen(json));
+    send_counted(st, json, strlen(json), 0);
     free(json);
 
-    char buf[1024];
-    int n = recv_metrics_response(st, buf, sizeof(buf));
+    jgd_inbound_t resp;
+    int n = recv_metrics_response(st, &resp);
     if (n <= 0) {
+        st->stats.metrics_timeouts++;
         metrics_char_info(c, gc, st->dpi, ascent, descent, width);
         return;
     }
 
-    cJSON *resp = cJSON_Parse(buf);
-    if (resp) {
-        cJSON *aj = cJSON_GetObjectItem(resp, "ascent");
-        cJSON *dj = cJSON_GetObjectItem(resp, "descent");
-        cJSON *wj = cJSON_GetObjectItem(resp, "width");
-        double a = cJSON_IsNumber(aj) ? aj->valuedouble : 0.0;
-        double d = cJSON_IsNumber(dj) ? dj->valuedouble : 0.0;
-        double ww = cJSON_IsNumber(wj) ? wj->valuedouble : 0.0;
-        cJSON_Delete(resp);
-        if (a > 0 || d > 0 || ww > 0) {
-            *ascent = a;
-            *descent = d;
-            *width = ww;
-            mcache_store(h, a, d, ww);
-            return;
-        }
+    double a = (resp.has & JGD_IN_ASCENT) ? resp.ascent : 0.0;
+    double d = (resp.has & JGD_IN_DESCENT) ? resp.descent : 0.0;
+    double ww = (resp.has & JGD_IN_WIDTH) ? resp.width : 0.0;
+    if (a > 0 || d > 0 || ww > 0) {
+        *ascent = a;
+        *descent = d;
+        *width = ww;
+        mcache_store(h, a, d, ww);
+        return;
     }
     metrics_char_info(c, gc, st->dpi, ascent, descent, width);
 }
@@ -623,7 +803,7 @@ static void check_incoming(jgd_state_t *st, pDevDesc dd) {
      * buffer is single-entry, so we cannot overwrite it.  Drawing is
      * typically fast, and poll_resize_impl will drain both the buffer
      * and any pending transport messages once R becomes idle. */
-    if (st->has_buffered_resize)
+    if (st->has_buffered_resize || st->prerender.active)
         return;
 
     if (transport_has_data(&st->transport)) {
@@ -650,13 +830,12 @@ static void check_incoming(jgd_state_t *st, pDevDesc dd) {
 }
 
 static void apply_pending_resize(jgd_state_t *st, pDevDesc dd) {
+    /* A speculative replay must not consume a real resize; it stays
+     * pending until the replay is over (see jgd_prerender_step). */
+    if (st->prerender.active) return;
     if (st->pending_w > 0 && st->pending_h > 0) {
-        st->width = st->pending_w / st->dpi;
-        st->height = st->pending_h / st->dpi;
-        dd->right = st->pending_w;
-        dd->bottom = st->pending_h;
-        dd->clipRight = st->pending_w;
-        dd->clipBottom = st->pending_h;
+        jgd_set_size_px(st, dd, st->pending_w, st->pending_h);
+        jgd_prerender_note_size(&st->prerender, st->pending_w, st->pending_h);
         st->pending_w = 0;
         st->pending_h = 0;
     }
@@ -665,29 +844,27 @@ static void apply_pending_resize(jgd_state_t *st, pDevDesc dd) {
 static void cb_mode(int mode, pDevDesc dd) {
     jgd_state_t *st = get_state(dd);
     if (st->replaying) return;
+    /* Drawing inside a pattern/clip-path/mask function goes into the
+     * resource definition, not the page; never flush it on its own. */
+    if (st->recording) return;
     if (mode == 1) {
         st->drawing = 1;
+        jgd_prerender_invalidate(&st->prerender);
     } else if (mode == 0) {
         st->drawing = 0;
         /* Only flush when display is not held.  High-level plot functions
          * (plot, hist, …) bracket drawing with dev.hold/dev.flush, so
          * cb_holdflush handles the single flush at the end.  Without hold
-         * (e.g. interactive lines()/points()), we flush immediately. */
+         * (e.g. interactive lines()/points()), we flush immediately, or
+         * with coalescing on, once drawing pauses (jgd_coalesce_tick). */
         if (!st->replaying && st->hold_level == 0 && st->page.op_count > st->last_flushed_ops) {
-            /* First flush on a new page must be a complete frame so the
-             * browser creates a new plot entry (addPlot) rather than
-             * appending to the previous plot. */
-            int incr = (st->last_flushed_ops > 0) ? 1 : 0;
-            jgd_flush_frame(st, incr);
-            st->last_flushed_ops = st->page.op_count;
-            /* Capture a snapshot after every flush so the latest display
-             * list state is always available for historical plot resizing.
-             * Note: this snapshot may be one DL entry short because R's
-             * GErecordGraphicOperation runs AFTER mode(0).  For base→base
-             * transitions, cb_holdflush (dev.hold 0→1) re-captures the
-             * complete DL.  For base→grid transitions, cb_newPage uses
-             * GE's savedSnapshot to fix this up. */
-            jgd_capture_snapshot(st);
+            if (st->coalesce_ms > 0 &&
+                st->page.op_count - st->last_flushed_ops < JGD_COALESCE_MAX_OPS) {
+                st->coalesce_mark_ms = jgd_stats_now_ms();
+                st->stats.flushes_coalesced++;
+                return;
+            }
+            flush_unheld(st);
         }
     }
 }
@@ -697,7 +874,7 @@ static int cb_holdflush(pDevDesc dd, int level) {
     if (st->debug_frames)
         REprintf("[jgd] cb_holdflush: level=%d hold=%d replaying=%d\n",
                  level, st->hold_level, st->replaying);
-    if (st->replaying) return st->hold_level;
+    if (st->replaying || st->recording) return st->hold_level;
     int old = st->hold_level;
     /* R passes level as a delta: dev.hold() passes +1, dev.flush() passes -1. */
     int new_level = old + level;
@@ -744,6 +921,8 @@ static void cb_size(double *left, double *right, double *bottom, double *top,
 static void cb_path(double *x, double *y, int npoly, int *nper,
                     Rboolean winding, const pGEcontext gc, pDevDesc dd) {
     jgd_state_t *st = get_state(dd);
+    st->stats.ops[JGD_OP_PATH]++;
+    JGD_TRACE_BEGIN(st, "cb_path");
     cJSON *op = cJSON_CreateObject();
     cJSON_AddStringToObject(op, "op", "path");
     cJSON_AddStringToObject(op, "winding", winding ? "nonzero" : "evenodd");
@@ -764,44 +943,98 @@ static void cb_path(double *x, double *y, int npoly, int *nper,
 
     cJSON_AddItemToObject(op, "gc", gc_to_cjson(gc, st->page_ext_parsed));
     page_add_op(&st->page, op);
+    JGD_TRACE_END(st, "cb_path");
 }
 
-static void cb_raster(unsigned int *raster, int w, int h,
-                      double x, double y, double width, double height,
-                      double rot, Rboolean interpolate,
-                      const pGEcontext gc, pDevDesc dd) {
-    jgd_state_t *st = get_state(dd);
-    if (w <= 0 || h <= 0) return;
-
+/* PNG data URI for the w x h block of raster (row stride `stride`)
+ * whose top-left pixel is (x0, y0), or NULL. */
+static char *raster_data_uri(const unsigned int *raster, int stride,
+                             int x0, int y0, int w, int h) {
     size_t npix = (size_t)w * (size_t)h;
-    if (npix > SIZE_MAX / 4) return;  /* overflow guard */
+    if (npix > SIZE_MAX / 4) return NULL;  /* overflow guard */
     unsigned char *rgba = (unsigned char *)malloc(npix * 4);
-    if (!rgba) return;
-    for (size_t i = 0; i < npix; i++) {
-        unsigned int c = raster[i];
-        rgba[i * 4 + 0] = R_RED(c);
-        rgba[i * 4 + 1] = R_GREEN(c);
-        rgba[i * 4 + 2] = R_BLUE(c);
-        rgba[i * 4 + 3] = R_ALPHA(c);
+    if (!rgba) return NULL;
+    unsigned char *out = rgba;
+    for (int y = y0; y < y0 + h; y++) {
+        const unsigned int *row = raster + (size_t)y * (size_t)stride;
+        for (int x = x0; x < x0 + w; x++) {
+            unsigned int c = row[x];
+            *out++ = R_RED(c);
+            *out++ = R_GREEN(c);
+            *out++ = R_BLUE(c);
+            *out++ = R_ALPHA(c);
+        }
     }
 
     size_t png_len = 0;
     unsigned char *png = png_encode_rgba(rgba, w, h, &png_len);
     free(rgba);
-    if (!png) return;
+    if (!png) return NULL;
 
     size_t b64_len = 0;
     char *b64 = base64_encode(png, png_len, &b64_len);
     free(png);
-    if (!b64) return;
+    if (!b64) return NULL;
 
     size_t uri_len = 22 + b64_len;
     char *uri = (char *)malloc(uri_len + 1);
-    if (!uri) { free(b64); return; }
+    if (!uri) { free(b64); return NULL; }
     memcpy(uri, "data:image/png;base64,", 22);
     memcpy(uri + 22, b64, b64_len);
     uri[uri_len] = '\0';
     free(b64);
+    return uri;
+}
+
+/* Changed tiles of a raster patch (see raster_delta.h). */
+static cJSON *raster_tiles(const unsigned int *raster, int w, int h,
+                           const jgd_raster_diff_t *diff) {
+    cJSON *tiles = cJSON_CreateArray();
+    for (int j = 0; j < diff->tiles_y; j++) {
+        for (int i = 0; i < diff->tiles_x; i++) {
+            if (!diff->changed[j * diff->tiles_x + i]) continue;
+            int x0 = i * JGD_RASTER_TILE, y0 = j * JGD_RASTER_TILE;
+            int tw = w - x0 < JGD_RASTER_TILE ? w - x0 : JGD_RASTER_TILE;
+            int th = h - y0 < JGD_RASTER_TILE ? h - y0 : JGD_RASTER_TILE;
+            char *uri = raster_data_uri(raster, w, x0, y0, tw, th);
+            if (!uri) {
+                cJSON_Delete(tiles);
+                return NULL;
+            }
+            cJSON *tile = cJSON_CreateObject();
+            cJSON_AddNumberToObject(tile, "x", x0);
+            cJSON_AddNumberToObject(tile, "y", y0);
+            cJSON_AddStringToObject(tile, "data", uri);
+            free(uri);
+            cJSON_AddItemToArray(tiles, tile);
+        }
+    }
+    return tiles;
+}
+
+static void raster_to_op(jgd_state_t *st, unsigned int *raster, int w, int h,
+                         double x, double y, double width, double height,
+                         double rot, Rboolean interpolate) {
+    if (w <= 0 || h <= 0) return;
+
+    /* Replays and resource definitions draw plain rasters; only live
+     * drawing moves the raster slots on. */
+    jgd_raster_diff_t diff;
+    int slotted = st->raster_delta.enabled && !st->replaying && !st->recording &&
+        jgd_raster_delta_diff(&st->raster_delta, raster, w, h, x, y,
+                              width, height, rot, interpolate, &diff);
+    cJSON *tiles = NULL;
+    char *uri = NULL;
+    if (slotted && diff.base)
+        tiles = raster_tiles(raster, w, h, &diff);
+    if (!tiles) {
+        uri = raster_data_uri(raster, w, 0, 0, w, h);
+        if (!uri) {
+            /* The renderer will not get this image. */
+            if (slotted) jgd_raster_delta_forget(&st->raster_delta, diff.slot);
+            return;
+        }
+    }
 
     cJSON *op = cJSON_CreateObject();
     cJSON_AddStringToObject(op, "op", "raster");
@@ -813,33 +1046,128 @@ static void cb_raster(unsigned int *raster, int w, int h,
     cJSON_AddBoolToObject(op, "interpolate", interpolate);
     cJSON_AddNumberToObject(op, "pw", w);
     cJSON_AddNumberToObject(op, "ph", h);
-    cJSON_AddStringToObject(op, "data", uri);
-    free(uri);
+    if (slotted) {
+        cJSON_AddNumberToObject(op, "slot", diff.slot);
+        cJSON_AddNumberToObject(op, "seq", diff.seq);
+    }
+    if (tiles) {
+        cJSON_AddNumberToObject(op, "base", diff.base);
+        cJSON_AddItemToObject(op, "tiles", tiles);
+        st->page.raster_patches++;
+        st->stats.raster_patches++;
+    } else {
+        cJSON_AddStringToObject(op, "data", uri);
+        free(uri);
+    }
 
+    st->stats.ops[JGD_OP_RASTER]++;
     page_add_op(&st->page, op);
 }
 
-/* No-op stubs for R >= 4.1 pattern/mask/clip-path/group callbacks */
-static SEXP cb_setPattern(SEXP pattern, pDevDesc dd) { return R_NilValue; }
-static void cb_releasePattern(SEXP ref, pDevDesc dd) { }
-static SEXP cb_setClipPath(SEXP path, SEXP ref, pDevDesc dd) { return R_NilValue; }
-static void cb_releaseClipPath(SEXP ref, pDevDesc dd) { }
-static SEXP cb_setMask(SEXP path, SEXP ref, pDevDesc dd) { return R_NilValue; }
-static void cb_releaseMask(SEXP ref, pDevDesc dd) { }
+static void cb_raster(unsigned int *raster, int w, int h,
+                      double x, double y, double width, double height,
+                      double rot, Rboolean interpolate,
+                      const pGEcontext gc, pDevDesc dd) {
+    jgd_state_t *st = get_state(dd);
+    JGD_TRACE_BEGIN(st, "cb_raster");
+    raster_to_op(st, raster, w, h, x, y, width, height, rot, interpolate);
+    JGD_TRACE_END(st, "cb_raster");
+}
+
+/* R >= 4.1 pattern/clip-path/mask definitions (see resources.c) */
+static SEXP cb_setPattern(SEXP pattern, pDevDesc dd) {
+    jgd_state_t *st = get_state(dd);
+    JGD_TRACE_BEGIN(st, "cb_setPattern");
+    SEXP ref = jgd_set_pattern(st, pattern);
+    JGD_TRACE_END(st, "cb_setPattern");
+    return ref;
+}
+
+static void cb_releasePattern(SEXP ref, pDevDesc dd) {
+    jgd_release_pattern(get_state(dd), ref);
+}
+
+static SEXP cb_setClipPath(SEXP path, SEXP ref, pDevDesc dd) {
+    jgd_state_t *st = get_state(dd);
+    JGD_TRACE_BEGIN(st, "cb_setClipPath");
+    SEXP out = jgd_set_clip_path(st, path, ref);
+    JGD_TRACE_END(st, "cb_setClipPath");
+    return out;
+}
+
+static void cb_releaseClipPath(SEXP ref, pDevDesc dd) {
+    jgd_release_clip_path(get_state(dd), ref);
+}
+
+static SEXP cb_setMask(SEXP path, SEXP ref, pDevDesc dd) {
+    jgd_state_t *st = get_state(dd);
+    JGD_TRACE_BEGIN(st, "cb_setMask");
+    SEXP out = jgd_set_mask(st, path, ref);
+    JGD_TRACE_END(st, "cb_setMask");
+    return out;
+}
+
+static void cb_releaseMask(SEXP ref, pDevDesc dd) {
+    jgd_release_mask(get_state(dd), ref);
+}
 
 #if R_GE_version >= 15
-static SEXP cb_defineGroup(SEXP source, int op, SEXP destination, pDevDesc dd) { return R_NilValue; }
-static void cb_useGroup(SEXP ref, SEXP trans, pDevDesc dd) { }
-static void cb_releaseGroup(SEXP ref, pDevDesc dd) { }
-static void cb_stroke(SEXP path, const pGEcontext gc, pDevDesc dd) { }
-static void cb_fill_path(SEXP path, int rule, const pGEcontext gc, pDevDesc dd) { }
-static void cb_fillStroke(SEXP path, int rule, const pGEcontext gc, pDevDesc dd) { }
-static SEXP cb_capabilities(SEXP cap) { return cap; }
+/* R >= 4.2 compositing groups and path stroke/fill (see resources.c) */
+static SEXP cb_defineGroup(SEXP source, int op, SEXP destination, pDevDesc dd) {
+    jgd_state_t *st = get_state(dd);
+    JGD_TRACE_BEGIN(st, "cb_defineGroup");
+    SEXP ref = jgd_define_group(st, source, op, destination);
+    JGD_TRACE_END(st, "cb_defineGroup");
+    return ref;
+}
+
+static void cb_useGroup(SEXP ref, SEXP trans, pDevDesc dd) {
+    jgd_state_t *st = get_state(dd);
+    st->stats.ops[JGD_OP_GROUP]++;
+    jgd_use_group(st, ref, trans);
+}
+
+static void cb_releaseGroup(SEXP ref, pDevDesc dd) {
+    jgd_release_group(get_state(dd), ref);
+}
+
+static void cb_stroke(SEXP path, const pGEcontext gc, pDevDesc dd) {
+    jgd_state_t *st = get_state(dd);
+    st->stats.ops[JGD_OP_PATH]++;
+    JGD_TRACE_BEGIN(st, "cb_stroke");
+    jgd_draw_path(st, path, "stroke", R_GE_nonZeroWindingRule, gc);
+    JGD_TRACE_END(st, "cb_stroke");
+}
+
+static void cb_fill_path(SEXP path, int rule, const pGEcontext gc, pDevDesc dd) {
+    jgd_state_t *st = get_state(dd);
+    st->stats.ops[JGD_OP_PATH]++;
+    JGD_TRACE_BEGIN(st, "cb_fill");
+    jgd_draw_path(st, path, "fill", rule, gc);
+    JGD_TRACE_END(st, "cb_fill");
+}
+
+static void cb_fillStroke(SEXP path, int rule, const pGEcontext gc, pDevDesc dd) {
+    jgd_state_t *st = get_state(dd);
+    st->stats.ops[JGD_OP_PATH]++;
+    JGD_TRACE_BEGIN(st, "cb_fillStroke");
+    jgd_draw_path(st, path, "fillStroke", rule, gc);
+    JGD_TRACE_END(st, "cb_fillStroke");
+}
+
+static SEXP cb_capabilities(SEXP cap) { return jgd_capabilities(cap); }
 #endif
 
 #if R_GE_version >= 16
+/* R >= 4.3 glyph runs (systemfonts/textshaping), see resources.c */
 static void cb_glyph(int n, int *glyphs, double *x, double *y,
-                     SEXP font, double size, int colour, double rot, pDevDesc dd) { }
+                     SEXP font, double size, int colour, double rot, pDevDesc dd) {
+    jgd_state_t *st = get_state(dd);
+    st->stats.ops[JGD_OP_TEXT]++;
+    JGD_TRACE_BEGIN(st, "cb_glyph");
+    jgd_draw_glyphs(st, n, glyphs, x, y, font, size, colour, rot);
+    JGD_TRACE_END(st, "cb_glyph");
+}
 #endif
 
 void jgd_set_callbacks(pDevDesc dd) {
@@ -1,5 +1,6 @@
 #include "device.h"
 #include "callbacks.h"
+#include "inbound.h"
 #include "png_encoder.h"
 
 #include <R.h>
@@ -7,12 +8,15 @@
 #include <Rversion.h>
 #include <R_ext/GraphicsDevice.h>
 #include <R_ext/GraphicsEngine.h>
+#include <R_ext/Callbacks.h>
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #else
 #include <R_ext/eventloop.h>
+#include <fcntl.h>
+#include <poll.h>
 #endif
 
 #include <string.h>
@@ -22,27 +26,6 @@
 #include <limits.h>
 #include <unistd.h>
 
-static int jgd_parse_resize_message(cJSON *msg, double *w, double *h, int *plot_index) {
-    cJSON *type = cJSON_GetObjectItem(msg, "type");
-    if (!cJSON_IsString(type) || strcmp(type->valuestring, "resize") != 0) {
-        return 0;
-    }
-    cJSON *wj = cJSON_GetObjectItem(msg, "width");
-    cJSON *hj = cJSON_GetObjectItem(msg, "height");
-    if (!cJSON_IsNumber(wj) || !cJSON_IsNumber(hj) ||
-        wj->valuedouble <= 0 || hj->valuedouble <= 0 ||
-        !R_FINITE(wj->valuedouble) || !R_FINITE(hj->valuedouble)) {
-        return 0;
-    }
-    *w = wj->valuedouble;
-    *h = hj->valuedouble;
-    if (plot_index) {
-        cJSON *pi = cJSON_GetObjectItem(msg, "plotIndex");
-        *plot_index = cJSON_IsNumber(pi) ? (int)pi->valuedouble : -1;
-    }
-    return 1;
-}
-
 static long long jgd_now_ms(void) {
 #ifdef _WIN32
     typedef ULONGLONG(WINAPI *jgd_get_tick_count64_fn)(void);
@@ -89,9 +72,16 @@ static long long jgd_now_ms(void) {
 
 /* Read server_info welcome message after connecting.
    The server defers the welcome until it receives R's first message,
-   so we send a ping to trigger it, then read back within a bounded timeout. */
+   so we send a ping to trigger it, then read back within a bounded timeout.
+   The ping also carries the device's resize mode when it is not the
+   default, so the server stops forwarding live resizes right away. */
 static void jgd_read_welcome(jgd_state_t *st) {
-    const char *ping = "{\"type\":\"ping\"}";
+    char ping[64];
+    if (st->resize_mode)
+        snprintf(ping, sizeof(ping), "{\"type\":\"ping\",\"resize\":\"%s\"}",
+                 st->resize_mode);
+    else
+        snprintf(ping, sizeof(ping), "{\"type\":\"ping\"}");
     if (transport_send(&st->transport, ping, strlen(ping)) != 0)
         return;
 
@@ -127,10 +117,11 @@ static void jgd_read_welcome(jgd_state_t *st) {
         }
         if (n == 0) continue; /* empty line — skip */
 
-        cJSON *msg = cJSON_Parse(buf);
-        if (!msg) {
+        jgd_inbound_t in;
+        if (!jgd_inbound_parse(buf, &in)) continue;
+        if (in.type != JGD_MSG_SERVER_INFO) {
             double w = 0.0, h = 0.0;
-            if (jgd_try_parse_resize(buf, &w, &h, NULL)) {
+            if (jgd_inbound_resize(&in, &w, &h, NULL)) {
                 st->pending_w = w;
                 st->pending_h = h;
                 /* Welcome-time resize must target current page only.
@@ -140,19 +131,9 @@ static void jgd_read_welcome(jgd_state_t *st) {
             continue;
         }
 
-        cJSON *type = cJSON_GetObjectItem(msg, "type");
-        if (!cJSON_IsString(type) || strcmp(type->valuestring, "server_info") != 0) {
-            double w = 0.0, h = 0.0;
-            if (jgd_parse_resize_message(msg, &w, &h, NULL)) {
-                st->pending_w = w;
-                st->pending_h = h;
-                /* Welcome-time resize must target current page only.
-                   Ignore plotIndex here to avoid stale historical state. */
-                st->pending_plot_index = -1;
-            }
-            cJSON_Delete(msg);
-            continue;
-        }
+        /* server_info arrives once, with nested fields: use cJSON. */
+        cJSON *msg = cJSON_Parse(buf);
+        if (!msg) continue;
 
         cJSON *name = cJSON_GetObjectItem(msg, "serverName");
         if (cJSON_IsString(name)) {
@@ -189,11 +170,13 @@ static void jgd_read_welcome(jgd_state_t *st) {
     }
 }
 
-/* Called from R: .Call(C_jgd, width, height, dpi, socket) */
-SEXP C_jgd(SEXP s_width, SEXP s_height, SEXP s_dpi, SEXP s_socket) {
+/* Called from R: .Call(C_jgd, width, height, dpi, socket, max_fps, resize) */
+SEXP C_jgd(SEXP s_width, SEXP s_height, SEXP s_dpi, SEXP s_socket,
+           SEXP s_max_fps, SEXP s_resize) {
     double width = Rf_asReal(s_width);
     double height = Rf_asReal(s_height);
     double dpi = Rf_asReal(s_dpi);
+    double max_fps = Rf_asReal(s_max_fps);
 
     if (width <= 0) width = 7.0;
     if (height <= 0) height = 7.0;
@@ -208,6 +191,21 @@ SEXP C_jgd(SEXP s_width, SEXP s_height, SEXP s_dpi, SEXP s_socket) {
     st->width = width;
     st->height = height;
     st->dpi = dpi;
+    st->frame_interval_ms = (R_FINITE(max_fps) && max_fps > 0) ? 1000.0 / max_fps : 0;
+    st->last_frame_ms = jgd_stats_now_ms() - st->frame_interval_ms;
+    /* resize = "scale" or "reflow": the renderer scales the plot and the
+     * server forwards only explicit re-layout requests. */
+    {
+        const char *mode = Rf_isString(s_resize) && Rf_length(s_resize) == 1 &&
+                                   STRING_ELT(s_resize, 0) != NA_STRING
+                               ? CHAR(STRING_ELT(s_resize, 0)) : "replay";
+        if (strcmp(mode, "scale") == 0)
+            st->resize_mode = "scale";
+        else if (strcmp(mode, "reflow") == 0)
+            st->resize_mode = "reflow";
+        else
+            st->resize_mode = NULL;
+    }
     st->page_count = 0;
     st->drawing = 0;
     st->pending_plot_index = -1;
@@ -224,6 +222,63 @@ SEXP C_jgd(SEXP s_width, SEXP s_height, SEXP s_dpi, SEXP s_socket) {
         SEXP dbg = Rf_GetOption1(Rf_install("jgd.debug"));
         st->debug_frames = (dbg != R_NilValue && Rf_asLogical(dbg) == TRUE) ? 1 : 0;
     }
+    /* options(jgd.timing = TRUE) stamps every frame with a trace id and
+     * serialize/send times for end-to-end latency accounting. */
+    {
+        SEXP tm = Rf_GetOption1(Rf_install("jgd.timing"));
+        st->frame_timing = (tm != R_NilValue && Rf_asLogical(tm) == TRUE) ? 1 : 0;
+    }
+    /* options(jgd.fork_replay = TRUE) replays historical plots in forked
+     * children (ignored on Windows). */
+    {
+        SEXP fr = Rf_GetOption1(Rf_install("jgd.fork_replay"));
+        st->fork_replay = (fr != R_NilValue && Rf_asLogical(fr) == TRUE) ? 1 : 0;
+    }
+    /* options(jgd.prerender = TRUE) replays the current plot at recently
+     * requested sizes while R is idle. */
+    {
+        SEXP pr = Rf_GetOption1(Rf_install("jgd.prerender"));
+        st->prerender.enabled = (pr != R_NilValue && Rf_asLogical(pr) == TRUE) ? 1 : 0;
+    }
+    /* options(jgd.raster_delta = TRUE) sends redrawn rasters as tile
+     * patches. */
+    {
+        SEXP rd = Rf_GetOption1(Rf_install("jgd.raster_delta"));
+        st->raster_delta.enabled = (rd != R_NilValue && Rf_asLogical(rd) == TRUE) ? 1 : 0;
+    }
+    /* options(jgd.streaming = TRUE) releases ops once they are flushed. */
+    {
+        SEXP sm = Rf_GetOption1(Rf_install("jgd.streaming"));
+        st->streaming = (sm != R_NilValue && Rf_asLogical(sm) == TRUE) ? 1 : 0;
+    }
+    /* options(jgd.coalesce = TRUE) or a number of milliseconds defers
+     * flushes outside dev.hold until drawing pauses. */
+    {
+        SEXP co = Rf_GetOption1(Rf_install("jgd.coalesce"));
+        st->coalesce_ms = 0;
+        if (TYPEOF(co) == LGLSXP && LENGTH(co) == 1 && LOGICAL(co)[0] == TRUE)
+            st->coalesce_ms = JGD_COALESCE_DEFAULT_MS;
+        else if ((TYPEOF(co) == REALSXP || TYPEOF(co) == INTSXP) && LENGTH(co) == 1) {
+            double ms = Rf_asReal(co);
+            if (R_FINITE(ms) && ms > 0) st->coalesce_ms = ms;
+        }
+    }
+    /* options(jgd.trace = "file.json") records spans and writes them at
+     * close; options(jgd.trace = TRUE) records for jgd_trace_write() only. */
+    {
+        SEXP tr = Rf_GetOption1(Rf_install("jgd.trace"));
+        const char *tpath = NULL;
+        int on = 0;
+        if (TYPEOF(tr) == STRSXP && LENGTH(tr) == 1 &&
+            STRING_ELT(tr, 0) != NA_STRING && CHAR(STRING_ELT(tr, 0))[0]) {
+            tpath = CHAR(STRING_ELT(tr, 0));
+            on = 1;
+        } else if (TYPEOF(tr) == LGLSXP && Rf_asLogical(tr) == TRUE) {
+            on = 1;
+        }
+        if (on && jgd_trace_init(&st->trace, tpath) != 0)
+            Rf_warning("jgd: could not allocate trace buffer; tracing disabled");
+    }
     /* Each device instance gets a unique sessionId so the browser can
      * separate plot histories across dev.off()/jgd() cycles within the
      * same R process.  PID alone is not sufficient — multiple devices
@@ -236,12 +291,28 @@ SEXP C_jgd(SEXP s_width, SEXP s_height, SEXP s_dpi, SEXP s_socket) {
 
     transport_init(&st->transport);
 
-    /* If socket path provided from R, use it directly (skips C-side discovery) */
-    if (s_socket != R_NilValue && TYPEOF(s_socket) == STRSXP && LENGTH(s_socket) > 0) {
-        const char *sock = CHAR(STRING_ELT(s_socket, 0));
-        if (sock && sock[0]) {
+    /* If socket path provided from R, use it directly (skips C-side
+     * discovery).  file:// entries are archive sinks that get a copy of
+     * every frame sent; the first other entry is the live server. */
+    if (s_socket != R_NilValue && TYPEOF(s_socket) == STRSXP) {
+        for (R_xlen_t i = 0; i < XLENGTH(s_socket); i++) {
+            const char *sock = CHAR(STRING_ELT(s_socket, i));
+            if (!sock || !sock[0]) continue;
+            if (jgd_sink_is_uri(sock)) {
+                if (transport_add_sink(&st->transport, sock) != 0) {
+                    transport_close(&st->transport);
+                    R_ReleaseObject(st->snapshot_store);
+                    jgd_trace_free(&st->trace);
+                    free(st);
+                    Rf_error("jgd: could not open archive '%s'", sock);
+                }
+                continue;
+            }
+            if (st->transport.socket_path[0]) continue;
             if (strlen(sock) >= sizeof(st->transport.socket_path)) {
+                transport_close(&st->transport);
                 R_ReleaseObject(st->snapshot_store);
+                jgd_trace_free(&st->trace);
                 free(st);
                 Rf_error("jgd: socket path too long (max %zu characters)",
                          sizeof(st->transport.socket_path) - 1);
@@ -252,6 +323,7 @@ SEXP C_jgd(SEXP s_width, SEXP s_height, SEXP s_dpi, SEXP s_socket) {
     }
 
     page_init(&st->page, width * dpi, height * dpi, dpi, R_RGB(255, 255, 255));
+    st->page.resize = st->resize_mode;
 
     if (transport_connect(&st->transport) != 0) {
         Rf_warning("jgd: could not connect to renderer. "
@@ -277,6 +349,7 @@ SEXP C_jgd(SEXP s_width, SEXP s_height, SEXP s_dpi, SEXP s_socket) {
         transport_close(&st->transport);
         page_free(&st->page);
         R_ReleaseObject(st->snapshot_store);
+        jgd_trace_free(&st->trace);
         free(st);
         Rf_error("jgd: failed to allocate DevDesc");
     }
@@ -337,7 +410,18 @@ SEXP C_jgd(SEXP s_width, SEXP s_height, SEXP s_dpi, SEXP s_socket) {
     dd->haveCapture = 1;
     dd->haveLocator = 1;
 
+#if R_GE_version >= 16
+    /* Patterns, clip paths, masks, groups, paths and glyphs (resources.c). */
+    dd->deviceVersion = R_GE_glyphs;
+#elif R_GE_version >= 15
+    /* Patterns, clip paths, masks, groups and paths (resources.c). */
+    dd->deviceVersion = R_GE_group;
+#elif R_GE_version >= 13
+    /* Patterns, clip paths and masks are implemented (resources.c). */
+    dd->deviceVersion = R_GE_definitions;
+#else
     dd->deviceVersion = 0;
+#endif
 
 #if R_GE_version >= 13
     dd->deviceClip = FALSE;
@@ -489,6 +573,7 @@ SEXP C_jgd_begin_group(SEXP s_ext) {
         (TYPEOF(s_ext) != STRSXP || LENGTH(s_ext) != 1))
         Rf_error("group ext must be a single JSON string or NULL");
 
+    st->stats.ops[JGD_OP_GROUP]++;
     cJSON *op = cJSON_CreateObject();
     cJSON_AddStringToObject(op, "op", "beginGroup");
 
@@ -531,6 +616,7 @@ SEXP C_jgd_end_group(void) {
     if (st->group_depth <= 0)
         Rf_error("endGroup without matching beginGroup");
 
+    st->stats.ops[JGD_OP_GROUP]++;
     cJSON *op = cJSON_CreateObject();
     cJSON_AddStringToObject(op, "op", "endGroup");
     page_add_op(&st->page, op);
@@ -663,6 +749,9 @@ static void restore_grid_dl_from_snapshot(jgd_state_t *st, SEXP snap,
 }
 
 static void replay_snapshot(jgd_state_t *st, SEXP snap, pGEDevDesc gdd) {
+    JGD_TRACE_BEGIN(st, "replay_snapshot");
+    double t0 = jgd_stats_now_ms();
+    st->stats.replays++;
     st->replaying = 1;
     st->replay_newpage_done = 0;
 
@@ -702,11 +791,15 @@ static void replay_snapshot(jgd_state_t *st, SEXP snap, pGEDevDesc gdd) {
     }
 
     replay_snapshot_args_t args = { snap, gdd };
+    JGD_TRACE_BEGIN(st, "GEplaySnapshot");
     Rboolean ok = R_ToplevelExec(do_play_snapshot, &args);
+    JGD_TRACE_END(st, "GEplaySnapshot");
     if (!ok) {
         REprintf("[jgd] replay_snapshot: GEplaySnapshot failed (longjmp caught)\n");
         UNPROTECT(1);
         st->replaying = 0;
+        st->stats.replay_ms += jgd_stats_now_ms() - t0;
+        JGD_TRACE_END(st, "replay_snapshot");
         return;
     }
 
@@ -740,7 +833,9 @@ static void replay_snapshot(jgd_state_t *st, SEXP snap, pGEDevDesc gdd) {
             SEXP refresh_sym = Rf_install("grid.refresh");
             SEXP call = PROTECT(Rf_lang1(refresh_sym));
             int err = 0;
+            JGD_TRACE_BEGIN(st, "grid.refresh");
             R_tryEval(call, grid_ns, &err);
+            JGD_TRACE_END(st, "grid.refresh");
             UNPROTECT(1);
             if (st->debug_frames)
                 REprintf("[jgd] replay_snapshot: grid.refresh() -> ops=%d err=%d\n",
@@ -751,6 +846,181 @@ static void replay_snapshot(jgd_state_t *st, SEXP snap, pGEDevDesc gdd) {
 
     UNPROTECT(1);
     st->replaying = 0;
+    st->stats.replay_ms += jgd_stats_now_ms() - t0;
+    JGD_TRACE_END(st, "replay_snapshot");
+}
+
+/* ---- Stored plots ---- */
+
+/* plot_number is the absolute plot number (plotNumber) R assigned.
+ * Convert to a snapshot_store index by subtracting the number of
+ * evicted snapshots. */
+int jgd_has_stored_plot(jgd_state_t *st, int plot_number) {
+    int store_idx = plot_number - st->evicted_count;
+    return plot_number >= 0 && store_idx >= 0 && store_idx < st->snapshot_count;
+}
+
+void jgd_with_stored_plot(jgd_state_t *st, pGEDevDesc gdd, int plot_number,
+                          void (*fn)(jgd_state_t *st, void *data), void *data) {
+    int store_idx = plot_number - st->evicted_count;
+    if (!jgd_has_stored_plot(st, plot_number)) return;
+
+    /* GEplaySnapshot restores the display list from the snapshot
+     * and replays it through device callbacks.  replaying=1 suppresses
+     * intermediate flushes (cb_mode) and snapshot saving (cb_newPage)
+     * during the replay. */
+    SEXP snap = VECTOR_ELT(st->snapshot_store, store_idx);
+    SEXP current = PROTECT(GEcreateSnapshot(gdd));
+    /* Unsent rasters are redrawn plain by the replay of the current plot. */
+    jgd_raster_delta_rollback(&st->raster_delta);
+    /* Ops of the current page the renderer has not received yet (e.g.
+     * under dev.hold); they must still be unflushed after the restore. */
+    int unflushed = st->page.op_count - st->last_flushed_ops;
+
+    if (st->debug_frames) {
+        REprintf("[jgd] with_stored_plot: plot=%d store_idx=%d "
+                 "snap_count=%d at %.0fx%.0f\n",
+                 plot_number, store_idx, st->snapshot_count,
+                 st->width * st->dpi, st->height * st->dpi);
+        if (TYPEOF(snap) == VECSXP && LENGTH(snap) >= 1) {
+            SEXP dl = VECTOR_ELT(snap, 0);
+            if (dl != R_NilValue && TYPEOF(dl) == LISTSXP) {
+                int dl_len = 0;
+                for (SEXP p = dl; p != R_NilValue; p = CDR(p)) dl_len++;
+                REprintf("[jgd] with_stored_plot: snapshot DL pairlist entries=%d\n",
+                         dl_len);
+            } else {
+                REprintf("[jgd] with_stored_plot: snapshot DL is NULL or type=%d\n",
+                         dl == R_NilValue ? 0 : TYPEOF(dl));
+            }
+        } else {
+            REprintf("[jgd] with_stored_plot: snap type=%d len=%d\n",
+                     TYPEOF(snap), LENGTH(snap));
+        }
+    }
+
+    /* Save current page ext before the historical replay overwrites
+     * page_ext_json.  We need this to restore the current plot's ext
+     * when replaying the current snapshot afterwards. */
+    char *saved_ext = st->ext_json;
+    char *current_page_ext = st->page_ext_json
+                                 ? strdup(st->page_ext_json) : NULL;
+    char *saved_frame_ext = st->frame_ext_json;
+    char *current_page_frame_ext = st->page_frame_ext_json
+                                       ? strdup(st->page_frame_ext_json) : NULL;
+
+    /* Set ext_json/frame_ext_json to the historical snapshot's ext so that
+     * cb_newPage (during replay) captures the correct page_ext_json. */
+    st->ext_json = st->snapshot_ext[store_idx]
+                       ? strdup(st->snapshot_ext[store_idx]) : NULL;
+    st->frame_ext_json = st->snapshot_frame_ext[store_idx]
+                             ? strdup(st->snapshot_frame_ext[store_idx]) : NULL;
+
+    replay_snapshot(st, snap, gdd);
+
+    if (st->debug_frames)
+        REprintf("[jgd] with_stored_plot: after replay ops=%d "
+                 "last_flushed=%d\n",
+                 st->page.op_count, st->last_flushed_ops);
+
+    fn(st, data);
+
+    /* Restore the current plot state.  Set ext_json to the current
+     * page's ext (not saved_ext, which may be NULL after with_jgd_ext
+     * cleanup) so cb_newPage captures the correct page_ext_json. */
+    free(st->ext_json);
+    st->ext_json = current_page_ext;
+    free(st->frame_ext_json);
+    st->frame_ext_json = current_page_frame_ext;
+
+    if (current != R_NilValue) {
+        replay_snapshot(st, current, gdd);
+    }
+
+    /* Now restore ext_json/frame_ext_json to their real values. */
+    free(st->ext_json);
+    st->ext_json = saved_ext;
+    free(st->frame_ext_json);
+    st->frame_ext_json = saved_frame_ext;
+
+    jgd_mark_flushed(st, unflushed);
+
+    UNPROTECT(1);
+}
+
+void jgd_mark_flushed(jgd_state_t *st, int unflushed) {
+    /* Suppress re-flushing the restored current plot, and point the
+     * delta tail at the last op the renderer already has so the next
+     * incremental frame does not resend the whole page. */
+    int flushed = st->page.op_count - (unflushed > 0 ? unflushed : 0);
+    if (flushed < 0) flushed = 0;
+    st->last_flushed_ops = flushed;
+    /* Released ops are no longer in the array (the replay was a no-op
+     * and left a streaming page as it was). */
+    int idx = flushed - 1 - st->page.released;
+    st->page.last_flush_tail = idx >= 0
+        ? cJSON_GetArrayItem(st->page.ops, idx) : NULL;
+    jgd_release_flushed(st);
+}
+
+/* jgd_with_stored_plot callback for a plotIndex resize: send the
+ * replayed plot tagged with its plotIndex. */
+static void flush_stored_plot(jgd_state_t *st, void *data) {
+    int pi = *(int *)data;
+    if (st->page.op_count > st->last_flushed_ops) {
+        if (st->debug_frames)
+            REprintf("[jgd] poll_resize: flushing plotIndex replay frame "
+                     "(ops=%d, last_flushed=%d)\n",
+                     st->page.op_count, st->last_flushed_ops);
+        st->resize_replay = 1;
+        st->flush_plot_index = pi;
+        jgd_flush_frame(st, 0);
+        st->last_flushed_ops = st->page.op_count;
+    }
+}
+
+int jgd_replay_current_plot(jgd_state_t *st, pGEDevDesc gdd) {
+    /* Temporarily restore ext_json/frame_ext_json from page copies so that
+     * cb_newPage (during replay) captures the correct ext. */
+    char *saved_ext = st->ext_json;
+    st->ext_json = st->page_ext_json ? strdup(st->page_ext_json) : NULL;
+    char *saved_frame_ext = st->frame_ext_json;
+    st->frame_ext_json = st->page_frame_ext_json
+                             ? strdup(st->page_frame_ext_json) : NULL;
+
+    /* Replay the display list at the current dimensions.
+     * All intermediate flushes (cb_holdflush, cb_mode) are suppressed while
+     * replaying=1 so that the caller emits exactly one complete frame
+     * afterwards.  This prevents the browser from receiving untagged
+     * incremental frames that would be misrouted (appendOps to the wrong
+     * history slot). */
+    /* Unsent rasters are redrawn plain by the replay. */
+    jgd_raster_delta_rollback(&st->raster_delta);
+    st->replaying = 1;
+    st->replay_newpage_done = 0;
+    double t0 = jgd_stats_now_ms();
+    st->stats.replays++;
+    JGD_TRACE_BEGIN(st, "GEplayDisplayList");
+    Rboolean ok = R_ToplevelExec(do_play_display_list, gdd);
+    JGD_TRACE_END(st, "GEplayDisplayList");
+    st->stats.replay_ms += jgd_stats_now_ms() - t0;
+    st->replaying = 0;
+
+    /* Restore ext_json/frame_ext_json to what they were before the replay. */
+    free(st->ext_json);
+    st->ext_json = saved_ext;
+    free(st->frame_ext_json);
+    st->frame_ext_json = saved_frame_ext;
+    return ok ? 1 : 0;
+}
+
+void jgd_set_size_px(jgd_state_t *st, pDevDesc dd, double w, double h) {
+    st->width = w / st->dpi;
+    st->height = h / st->dpi;
+    dd->right = w;
+    dd->bottom = h;
+    dd->clipRight = w;
+    dd->clipBottom = h;
 }
 
 /* ---- Resize polling (shared by R callable and input handler) ---- */
@@ -758,6 +1028,9 @@ static void replay_snapshot(jgd_state_t *st, SEXP snap, pGEDevDesc gdd) {
 /* Drain resize messages from the transport socket into pending_w/pending_h.
    Returns 1 if a resize was applied and the display list replayed, 0 otherwise. */
 static int poll_resize_impl(jgd_state_t *st, pDevDesc dd, pGEDevDesc gdd) {
+    /* Forward frames from forked replays that have finished. */
+    jgd_fork_replay_collect(st, 0);
+
     /* Drain at most ONE resize into pending_w/pending_h per call.
      * The caller invokes us repeatedly (via C_jgd_poll_resize or the R
      * input handler), so each resize produces its own frame.  This keeps
@@ -788,148 +1061,46 @@ static int poll_resize_impl(jgd_state_t *st, pDevDesc dd, pGEDevDesc gdd) {
         return 0;
 
     /* Apply the resize */
-    st->width = st->pending_w / st->dpi;
-    st->height = st->pending_h / st->dpi;
-    dd->right = st->pending_w;
-    dd->bottom = st->pending_h;
-    dd->clipRight = st->pending_w;
-    dd->clipBottom = st->pending_h;
+    double w_px = st->pending_w, h_px = st->pending_h;
+    jgd_set_size_px(st, dd, w_px, h_px);
+    jgd_prerender_note_size(&st->prerender, w_px, h_px);
     st->pending_w = 0;
     st->pending_h = 0;
 
     int pi = st->pending_plot_index;
     st->pending_plot_index = -1;
 
-    /* plotIndex from the browser is an absolute plot number (plotNumber)
-     * that R assigned.  Convert to a snapshot_store index by subtracting
-     * the number of evicted snapshots. */
-    int store_idx = pi - st->evicted_count;
-    if (pi >= 0 && store_idx >= 0 && store_idx < st->snapshot_count) {
-        /* Historical plot resize: replay the snapshot at new dimensions,
-         * flush its frame, then restore the current display list.
-         *
-         * GEplaySnapshot restores the display list from the snapshot
-         * and replays it through device callbacks.  replaying=1 suppresses
-         * intermediate flushes (cb_mode) and snapshot saving (cb_newPage)
-         * during the replay. */
-        SEXP snap = VECTOR_ELT(st->snapshot_store, store_idx);
-        SEXP current = PROTECT(GEcreateSnapshot(gdd));
-
-        if (st->debug_frames) {
-            REprintf("[jgd] poll_resize: plotIndex replay pi=%d store_idx=%d "
-                     "snap_count=%d at %.0fx%.0f\n",
-                     pi, store_idx, st->snapshot_count,
-                     st->width * st->dpi, st->height * st->dpi);
-            if (TYPEOF(snap) == VECSXP && LENGTH(snap) >= 1) {
-                SEXP dl = VECTOR_ELT(snap, 0);
-                if (dl != R_NilValue && TYPEOF(dl) == LISTSXP) {
-                    int dl_len = 0;
-                    for (SEXP p = dl; p != R_NilValue; p = CDR(p)) dl_len++;
-                    REprintf("[jgd] poll_resize: snapshot DL pairlist entries=%d\n",
-                             dl_len);
-                } else {
-                    REprintf("[jgd] poll_resize: snapshot DL is NULL or type=%d\n",
-                             dl == R_NilValue ? 0 : TYPEOF(dl));
-                }
-            } else {
-                REprintf("[jgd] poll_resize: snap type=%d len=%d\n",
-                         TYPEOF(snap), LENGTH(snap));
-            }
+    if (pi >= 0 && jgd_has_stored_plot(st, pi)) {
+        /* Historical plot resize: replay the snapshot at new dimensions
+         * and flush its frame; jgd_with_stored_plot then restores the
+         * current display list.  In fork mode a child does the replay
+         * and the current display list is left as it is. */
+        if (!jgd_fork_replay(st, gdd, pi)) {
+            jgd_fork_replay_supersede(st, pi);
+            jgd_with_stored_plot(st, gdd, pi, flush_stored_plot, &pi);
         }
-
-        /* Save current page ext before the historical replay overwrites
-         * page_ext_json.  We need this to restore the current plot's ext
-         * when replaying the current snapshot afterwards. */
-        char *saved_ext = st->ext_json;
-        char *current_page_ext = st->page_ext_json
-                                     ? strdup(st->page_ext_json) : NULL;
-        char *saved_frame_ext = st->frame_ext_json;
-        char *current_page_frame_ext = st->page_frame_ext_json
-                                           ? strdup(st->page_frame_ext_json) : NULL;
-
-        /* Set ext_json/frame_ext_json to the historical snapshot's ext so that
-         * cb_newPage (during replay) captures the correct page_ext_json. */
-        st->ext_json = st->snapshot_ext[store_idx]
-                           ? strdup(st->snapshot_ext[store_idx]) : NULL;
-        st->frame_ext_json = st->snapshot_frame_ext[store_idx]
-                                 ? strdup(st->snapshot_frame_ext[store_idx]) : NULL;
-
-        replay_snapshot(st, snap, gdd);
-
-        if (st->debug_frames)
-            REprintf("[jgd] poll_resize: after plotIndex replay ops=%d "
-                     "last_flushed=%d\n",
-                     st->page.op_count, st->last_flushed_ops);
-
-        if (st->page.op_count > st->last_flushed_ops) {
-            if (st->debug_frames)
-                REprintf("[jgd] poll_resize: flushing plotIndex replay frame "
-                         "(ops=%d, last_flushed=%d)\n",
-                         st->page.op_count, st->last_flushed_ops);
-            st->resize_replay = 1;
-            st->flush_plot_index = pi;
-            jgd_flush_frame(st, 0);
-            st->last_flushed_ops = st->page.op_count;
-        }
-
-        /* Restore the current plot state.  Set ext_json to the current
-         * page's ext (not saved_ext, which may be NULL after with_jgd_ext
-         * cleanup) so cb_newPage captures the correct page_ext_json. */
-        free(st->ext_json);
-        st->ext_json = current_page_ext;
-        free(st->frame_ext_json);
-        st->frame_ext_json = current_page_frame_ext;
-
-        if (current != R_NilValue) {
-            replay_snapshot(st, current, gdd);
-        }
-
-        /* Now restore ext_json/frame_ext_json to their real values. */
-        free(st->ext_json);
-        st->ext_json = saved_ext;
-        free(st->frame_ext_json);
-        st->frame_ext_json = saved_frame_ext;
-
-        /* Suppress re-flushing the restored current plot */
-        st->last_flushed_ops = st->page.op_count;
-
-        UNPROTECT(1);
     } else {
-        /* Current plot resize (normal path) */
+        /* Current plot resize (normal path).  A frame prerendered at
+         * this size goes out straight away; the replay then only brings
+         * R's graphics state to the new size. */
+        int sent = jgd_prerender_send(st, w_px, h_px);
 
         if (st->debug_frames)
             REprintf("[jgd] poll_resize: current plot replay at %.0fx%.0f\n",
-                     st->width * st->dpi, st->height * st->dpi);
-
-        /* Temporarily restore ext_json/frame_ext_json from page copies so that
-         * cb_newPage (during replay) captures the correct ext. */
-        char *saved_ext = st->ext_json;
-        st->ext_json = st->page_ext_json ? strdup(st->page_ext_json) : NULL;
-        char *saved_frame_ext = st->frame_ext_json;
-        st->frame_ext_json = st->page_frame_ext_json
-                                 ? strdup(st->page_frame_ext_json) : NULL;
-
-        /* Replay the display list at new dimensions.
-         * All intermediate flushes (cb_holdflush, cb_mode) are suppressed while
-         * replaying=1 so that we emit exactly one complete frame afterwards.
-         * This prevents the browser from receiving untagged incremental frames
-         * that would be misrouted (appendOps to the wrong history slot). */
-        st->replaying = 1;
-        st->replay_newpage_done = 0;
-        Rboolean ok = R_ToplevelExec(do_play_display_list, gdd);
-        st->replaying = 0;
-
-        /* Restore ext_json/frame_ext_json to what they were before the replay. */
-        free(st->ext_json);
-        st->ext_json = saved_ext;
-        free(st->frame_ext_json);
-        st->frame_ext_json = saved_frame_ext;
+                     w_px, h_px);
 
-        if (!ok) {
+        if (!jgd_replay_current_plot(st, gdd)) {
             REprintf("[jgd] poll_resize: GEplayDisplayList failed (longjmp caught)\n");
             return 1;
         }
 
+        if (sent) {
+            st->last_flushed_ops = st->page.op_count;
+            st->page.last_flush_tail = st->page.ops_tail;
+            jgd_release_flushed(st);
+            return 1;
+        }
+
         /* Send the complete replayed frame as a single flush.  The server will
          * tag this frame with resize:true so the browser does replaceLatest
          * instead of addPlot.
@@ -1048,17 +1219,174 @@ SEXP C_jgd_server_info(SEXP s_path) {
     return result;
 }
 
+/* Closure frames on the stack that count as the prompt; nonzero only in
+ * tests (see C_jgd_set_idle_frames). */
+static int jgd_idle_frames = 0;
+
+/* Called from R: .Call(C_jgd_set_idle_frames, n) — treat a wait with n
+ * closure frames on the stack as the prompt, so tests (which never reach
+ * the prompt) can drive prompt-time prerendering from inside Sys.sleep().
+ * Returns the previous value. */
+SEXP C_jgd_set_idle_frames(SEXP n) {
+    int prev = jgd_idle_frames;
+    jgd_idle_frames = Rf_asInteger(n);
+    if (jgd_idle_frames < 0) jgd_idle_frames = 0;  /* NA too */
+    return Rf_ScalarInteger(prev);
+}
+
 /* ---- R input handler (POSIX) ---- */
 
 #ifndef _WIN32
 
 #define JGD_INPUT_HANDLER_ACTIVITY 42
+#define JGD_PRERENDER_ACTIVITY 43
+
+/* ---- Prompt-time prerendering ----
+ *
+ * Prerendering replays the current plot twice per size, so it runs only
+ * while R waits at the prompt, one size at a time.  R services input
+ * handlers only while it waits in select(): at the prompt, and in waits
+ * such as Sys.sleep() inside user code, which are told apart by the
+ * closures on the stack.  The idle tick (R_PolledEvents, which also runs
+ * while code executes) does no work itself: it makes a wake pipe readable
+ * while a size is waiting.  The pipe's handler runs one step if R is at
+ * the prompt and neither the console nor the transport has input, then
+ * rearms the pipe, so R reads its input between steps.  Windows has no
+ * such hook and does not prerender. */
+#define JGD_MAX_PRERENDERING 64
+static jgd_state_t *jgd_prerendering[JGD_MAX_PRERENDERING];
+static int jgd_n_prerendering = 0;
+static int jgd_wake_fd[2] = {-1, -1};
+static InputHandler *jgd_wake_handler = NULL;
+static int jgd_wake_armed = 0;
+
+/* 1 if R is waiting at the prompt rather than running user code that
+ * happens to service input handlers. */
+static int jgd_at_prompt(void) {
+    SEXP call = PROTECT(Rf_lang1(Rf_install("sys.nframe")));
+    int err = 0;
+    SEXP res = R_tryEvalSilent(call, R_BaseEnv, &err);
+    int idle = !err && Rf_asInteger(res) == jgd_idle_frames;
+    UNPROTECT(1);
+    return idle;
+}
+
+/* 1 if a line typed at the console is waiting to be read. */
+static int jgd_console_has_input(void) {
+    int fd = fileno(stdin);
+    if (fd < 0 || !isatty(fd)) return 0;
+    struct pollfd pfd = {fd, POLLIN, 0};
+    return poll(&pfd, 1, 0) > 0;
+}
+
+/* Make the wake pipe readable if some device has a size to prerender. */
+static void jgd_prerender_arm(void) {
+    if (jgd_wake_armed || jgd_wake_fd[1] < 0) return;
+    for (int i = 0; i < jgd_n_prerendering; i++) {
+        if (jgd_prerender_pending(jgd_prerendering[i])) {
+            char c = 0;
+            if (write(jgd_wake_fd[1], &c, 1) == 1) jgd_wake_armed = 1;
+            return;
+        }
+    }
+}
+
+typedef struct {
+    jgd_state_t *st;
+    int done;
+} jgd_prerender_call_t;
+
+static void prerender_step_cb(void *data) {
+    jgd_prerender_call_t *c = (jgd_prerender_call_t *)data;
+    c->done = jgd_prerender_step(c->st, (pGEDevDesc)c->st->ge_dev);
+}
+
+/* One prerender step for st if R is idle at the prompt, then answer any
+ * resize that arrived meanwhile.  Returns 1 if a size was prerendered. */
+static int jgd_prerender_idle(jgd_state_t *st) {
+    if (!st->prerender.enabled || st->replaying || st->drawing ||
+        !st->transport.connected)
+        return 0;
+    pGEDevDesc gdd = (pGEDevDesc)st->ge_dev;
+    if (!gdd || !gdd->dev) return 0;
+    if (!jgd_prerender_pending(st) || transport_has_data(&st->transport) ||
+        jgd_console_has_input() || !jgd_at_prompt())
+        return 0;
+
+    jgd_prerender_call_t c = {st, 0};
+    if (!R_ToplevelExec(prerender_step_cb, &c)) {
+        /* A replay errored; the next resize restores the size. */
+        st->prerender.active = 0;
+        return 0;
+    }
+    if (st->pending_w > 0 || st->has_buffered_resize)
+        poll_resize_impl(st, gdd->dev, gdd);
+    return c.done;
+}
+
+static void jgd_prerender_wake_cb(void *data) {
+    (void)data;
+    char buf[16];
+    while (read(jgd_wake_fd[0], buf, sizeof(buf)) > 0) {}
+    jgd_wake_armed = 0;
+    for (int i = 0; i < jgd_n_prerendering; i++) {
+        if (jgd_prerender_idle(jgd_prerendering[i])) {
+            jgd_prerender_arm();
+            return;
+        }
+    }
+}
+
+static void jgd_prerender_register(jgd_state_t *st) {
+    if (!st->prerender.enabled || jgd_n_prerendering >= JGD_MAX_PRERENDERING)
+        return;
+    if (jgd_n_prerendering == 0) {
+        if (pipe(jgd_wake_fd) != 0) {
+            jgd_wake_fd[0] = jgd_wake_fd[1] = -1;
+            return;
+        }
+        for (int i = 0; i < 2; i++) {
+            fcntl(jgd_wake_fd[i], F_SETFD, FD_CLOEXEC);
+            fcntl(jgd_wake_fd[i], F_SETFL,
+                  fcntl(jgd_wake_fd[i], F_GETFL) | O_NONBLOCK);
+        }
+        jgd_wake_handler = addInputHandler(R_InputHandlers, jgd_wake_fd[0],
+                                           jgd_prerender_wake_cb,
+                                           JGD_PRERENDER_ACTIVITY);
+        if (!jgd_wake_handler) {
+            close(jgd_wake_fd[0]);
+            close(jgd_wake_fd[1]);
+            jgd_wake_fd[0] = jgd_wake_fd[1] = -1;
+            return;
+        }
+    }
+    jgd_prerendering[jgd_n_prerendering++] = st;
+}
+
+static void jgd_prerender_unregister(jgd_state_t *st) {
+    for (int i = 0; i < jgd_n_prerendering; i++) {
+        if (jgd_prerendering[i] == st) {
+            jgd_prerendering[i] = jgd_prerendering[--jgd_n_prerendering];
+            if (jgd_n_prerendering == 0) {
+                removeInputHandler(&R_InputHandlers, jgd_wake_handler);
+                jgd_wake_handler = NULL;
+                close(jgd_wake_fd[0]);
+                close(jgd_wake_fd[1]);
+                jgd_wake_fd[0] = jgd_wake_fd[1] = -1;
+                jgd_wake_armed = 0;
+            }
+            return;
+        }
+    }
+}
 
 /* Callback invoked by R's event loop when data arrives on the transport fd. */
 static void jgd_input_handler_cb(void *data) {
     jgd_state_t *st = (jgd_state_t *)data;
     if (!st || st->replaying || st->drawing) return;
 
+    transport_poll_sinks(&st->transport);
+
     /* If transport disconnected (server died), just bail out.
        The handler stays registered but returns immediately until
        the device is closed and cb_close removes it. */
@@ -1067,7 +1395,77 @@ static void jgd_input_handler_cb(void *data) {
     pGEDevDesc gdd = (pGEDevDesc)st->ge_dev;
     if (!gdd || !gdd->dev) return;
 
+    jgd_pacing_tick(st);
+    jgd_coalesce_tick(st);
     poll_resize_impl(st, gdd->dev, gdd);
+
+    /* At the prompt, speculate once the messages read so far are done. */
+    if (jgd_prerender_idle(st)) jgd_prerender_arm();
+}
+
+/* Paced, coalescing, archiving and prerendering devices get an idle tick
+ * from R_PolledEvents, which R runs every R_wait_usec while waiting for
+ * input.  The previous hook and wait are chained, and restored when the
+ * last such device closes unless another hook was installed since. */
+#define JGD_MAX_PACED 64
+static jgd_state_t *jgd_paced[JGD_MAX_PACED];
+static int jgd_n_paced = 0;
+static void (*jgd_prev_polled_events)(void) = NULL;
+static int jgd_prev_wait_usec = 0;
+/* 1 while jgd_polled_events is in R's hook chain, which can outlive the
+ * last paced device if another hook was installed on top of it. */
+static int jgd_hooked = 0;
+
+static void jgd_polled_events(void) {
+    for (int i = 0; i < jgd_n_paced; i++) {
+        jgd_state_t *st = jgd_paced[i];
+        transport_poll_sinks(&st->transport);
+        if (!st->transport.connected) continue;
+        jgd_pacing_tick(st);
+        jgd_coalesce_tick(st);
+    }
+    jgd_prerender_arm();
+    if (jgd_prev_polled_events) jgd_prev_polled_events();
+}
+
+static void jgd_pacing_register(jgd_state_t *st) {
+    if ((st->frame_interval_ms <= 0 && st->coalesce_ms <= 0 &&
+         st->transport.n_sinks == 0 && !st->prerender.enabled) ||
+        jgd_n_paced >= JGD_MAX_PACED)
+        return;
+    if (jgd_n_paced == 0 && !jgd_hooked) {
+        jgd_prev_polled_events = R_PolledEvents;
+        jgd_prev_wait_usec = R_wait_usec;
+        R_PolledEvents = jgd_polled_events;
+        jgd_hooked = 1;
+    }
+    jgd_paced[jgd_n_paced++] = st;
+    /* Tick at half the frame interval or coalescing pause, capped at
+     * 100 ms. */
+    int usec = st->frame_interval_ms > 0
+                   ? (int)(st->frame_interval_ms * 500.0) : 100000;
+    if (st->coalesce_ms > 0 && st->coalesce_ms * 500.0 < usec)
+        usec = (int)(st->coalesce_ms * 500.0);
+    if (usec > 100000) usec = 100000;
+    if (usec < 1000) usec = 1000;
+    if (R_wait_usec <= 0 || R_wait_usec > usec) R_wait_usec = usec;
+}
+
+static void jgd_pacing_unregister(jgd_state_t *st) {
+    for (int i = 0; i < jgd_n_paced; i++) {
+        if (jgd_paced[i] == st) {
+            jgd_paced[i] = jgd_paced[--jgd_n_paced];
+            /* Unhook only if no one hooked in after us; otherwise leave
+             * their hook (and wait) in place and keep forwarding to the
+             * previous one from jgd_polled_events. */
+            if (jgd_n_paced == 0 && R_PolledEvents == jgd_polled_events) {
+                R_PolledEvents = jgd_prev_polled_events;
+                R_wait_usec = jgd_prev_wait_usec;
+                jgd_hooked = 0;
+            }
+            return;
+        }
+    }
 }
 
 void jgd_register_input_handler(jgd_state_t *st) {
@@ -1080,9 +1478,13 @@ void jgd_register_input_handler(jgd_state_t *st) {
         ih->userData = (void *)st;
         st->input_handler = ih;
     }
+    jgd_pacing_register(st);
+    jgd_prerender_register(st);
 }
 
 void jgd_remove_input_handler(jgd_state_t *st) {
+    jgd_pacing_unregister(st);
+    jgd_prerender_unregister(st);
     if (!st->input_handler) return;
 
     removeInputHandler(&R_InputHandlers, (InputHandler *)st->input_handler);
@@ -1100,11 +1502,15 @@ static int jgd_wnd_class_registered = 0;
 static LRESULT CALLBACK jgd_wndproc(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp) {
     if (msg == WM_TIMER && wp == JGD_TIMER_ID) {
         jgd_state_t *st = (jgd_state_t *)GetWindowLongPtr(hwnd, GWLP_USERDATA);
-        if (!st || st->replaying || st->drawing || !st->transport.connected) return 0;
+        if (!st || st->replaying || st->drawing) return 0;
+        transport_poll_sinks(&st->transport);
+        if (!st->transport.connected) return 0;
 
         pGEDevDesc gdd = (pGEDevDesc)st->ge_dev;
         if (!gdd || !gdd->dev) return 0;
 
+        jgd_pacing_tick(st);
+        jgd_coalesce_tick(st);
         poll_resize_impl(st, gdd->dev, gdd);
         return 0;
     }
@@ -1134,7 +1540,14 @@ void jgd_register_input_handler(jgd_state_t *st) {
 
     SetWindowLongPtr(hwnd, GWLP_USERDATA, (LONG_PTR)st);
 
-    if (!SetTimer(hwnd, JGD_TIMER_ID, JGD_POLL_INTERVAL_MS, NULL)) {
+    /* Paced and coalescing devices also send held-back frames from this
+     * timer, so tick at least at half the frame interval or pause. */
+    UINT interval = JGD_POLL_INTERVAL_MS;
+    if (st->frame_interval_ms > 0 && st->frame_interval_ms / 2 < interval)
+        interval = (UINT)(st->frame_interval_ms / 2) > 0 ? (UINT)(st->frame_interval_ms / 2) : 1;
+    if (st->coalesce_ms > 0 && st->coalesce_ms / 2 < interval)
+        interval = (UINT)(st->coalesce_ms / 2) > 0 ? (UINT)(st->coalesce_ms / 2) : 1;
+    if (!SetTimer(hwnd, JGD_TIMER_ID, interval, NULL)) {
         DestroyWindow(hwnd);
         return;
     }
@@ -1157,9 +1570,6 @@ void jgd_remove_input_handler(jgd_state_t *st) {
 /* ---- Shared resize message parser ---- */
 
 int jgd_try_parse_resize(const char *buf, double *w, double *h, int *plot_index) {
-    cJSON *msg = cJSON_Parse(buf);
-    if (!msg) return 0;
-    int ok = jgd_parse_resize_message(msg, w, h, plot_index);
-    cJSON_Delete(msg);
-    return ok;
+    jgd_inbound_t in;
+    return jgd_inbound_parse(buf, &in) && jgd_inbound_resize(&in, w, h, plot_index);
 }
@@ -3,6 +3,12 @@
 
 #include "display_list.h"
 #include "transport.h"
+#include "stats.h"
+#include "trace.h"
+#include "resources.h"
+#include "fork_replay.h"
+#include "prerender.h"
+#include "raster_delta.h"
 
 #include <Rinternals.h>
 
@@ -10,13 +16,17 @@
 #define JGD_MAX_SNAPSHOTS 50
 #define JGD_INFO_KEY_LEN 64
 #define JGD_INFO_VAL_LEN 256
+/* Flush coalescing: default pause (options(jgd.coalesce = TRUE)) and
+ * the number of waiting ops that forces a flush mid-burst. */
+#define JGD_COALESCE_DEFAULT_MS 20.0
+#define JGD_COALESCE_MAX_OPS 1000
 
 typedef struct {
     char key[JGD_INFO_KEY_LEN];
     char val[JGD_INFO_VAL_LEN];
 } jgd_info_pair_t;
 
-typedef struct {
+typedef struct jgd_state {
     jgd_transport_t transport;
     jgd_page_t page;
     char session_id[64];
@@ -60,6 +70,21 @@ typedef struct {
     void *input_handler;      /* InputHandler* for R event-loop resize polling */
 #endif
     int debug_frames;         /* 1 to log frame details to stderr */
+    int frame_timing;         /* 1 to stamp frames with a timing object (jgd.timing) */
+    unsigned int frame_seq;   /* per-device counter for timing ids */
+    /* Frame pacing (jgd(max_fps =)).  Frames flushed sooner than
+     * frame_interval_ms after the last one are held back; the page
+     * stays in the outbound slot (frame_pending) until it is replaced
+     * by the next page or sent by jgd_pacing_tick(). */
+    double frame_interval_ms; /* 0 = unpaced */
+    double last_frame_ms;     /* jgd_stats_now_ms() when the last frame was sent */
+    int frame_pending;
+    /* Flush coalescing (options(jgd.coalesce)).  Unheld flushes from
+     * cb_mode(0) are deferred until drawing has paused for coalesce_ms
+     * or JGD_COALESCE_MAX_OPS ops are waiting; jgd_coalesce_tick() then
+     * sends them as one incremental frame with one snapshot. */
+    double coalesce_ms;       /* 0 = flush after every drawing call */
+    double coalesce_mark_ms;  /* jgd_stats_now_ms() of the last deferred flush */
     /* Experimental extended graphics context (gc.ext).
      * A pre-serialized JSON string provided by the user via .Call(C_jgd_set_ext).
      * When non-NULL, gc_to_cjson() embeds it as the "ext" field in every gc object.
@@ -90,6 +115,27 @@ typedef struct {
     char *page_frame_ext_json;
     /* Per-snapshot frame ext, parallel to snapshot_store. */
     char *snapshot_frame_ext[JGD_MAX_SNAPSHOTS];
+    /* Performance counters and timers reported by jgd_stats().  Zeroed by
+     * calloc in C_jgd; only reset on request from R. */
+    jgd_stats_t stats;
+    /* Span ring buffer for options(jgd.trace); trace.events is NULL when
+     * tracing is off, which is all JGD_TRACE_BEGIN/END test. */
+    jgd_trace_t trace;
+    /* Patterns, clip paths and masks defined on the current page. */
+    jgd_resources_t resources;
+    int recording;            /* >0 while a resource's R function is drawing */
+    int fork_replay;          /* 1 to replay historical plots in forked children */
+    jgd_replay_children_t replay_children;
+    jgd_prerender_t prerender;  /* idle-time frames at recent sizes */
+    /* options(jgd.streaming = TRUE): ops are released from the page once
+     * they have been flushed (page_release_flushed), so memory is bounded
+     * by the unflushed tail.  Complete frames come from display list
+     * replay. */
+    int streaming;
+    jgd_raster_delta_t raster_delta;  /* options(jgd.raster_delta) slots */
+    /* jgd(resize =): "scale" or "reflow" when the renderer scales plots
+     * instead of asking R to replay them; NULL for the default replay. */
+    const char *resize_mode;
 } jgd_state_t;
 
 /* Flush the current frame over the transport. */
@@ -98,13 +144,51 @@ void jgd_flush_frame(jgd_state_t *st, int incremental);
 /* Capture a display list snapshot for historical plot resizing. */
 void jgd_capture_snapshot(jgd_state_t *st);
 
+/* 1 if plot_number (an absolute plotNumber) still has a stored
+ * snapshot. */
+int jgd_has_stored_plot(jgd_state_t *st, int plot_number);
+
+/* Replay stored plot plot_number into st->page (without sending it),
+ * call fn(st, data), then replay the current plot back.  Only safe
+ * while R is idle; a no-op if the plot is not stored. */
+void jgd_with_stored_plot(jgd_state_t *st, pGEDevDesc gdd, int plot_number,
+                          void (*fn)(jgd_state_t *st, void *data), void *data);
+
+/* Set the device size in pixels (st->width/height and the DevDesc
+ * extents).  Does not replay anything. */
+void jgd_set_size_px(jgd_state_t *st, pDevDesc dd, double w, double h);
+
+/* Replay the current display list into st->page at the device's current
+ * size, without sending it.  Returns 0 if the replay failed (longjmp
+ * caught).  Only safe while R is idle. */
+int jgd_replay_current_plot(jgd_state_t *st, pGEDevDesc gdd);
+
+/* In streaming mode, release the page's flushed ops.  Call whenever
+ * page.last_flush_tail has moved to ops the renderer has received. */
+void jgd_release_flushed(jgd_state_t *st);
+
+/* After a replay rebuilt the current page, mark all but its last
+ * `unflushed` ops as already received by the renderer. */
+void jgd_mark_flushed(jgd_state_t *st, int unflushed);
+
+/* Send a frame held back by pacing once its interval has elapsed.
+ * Called from the event loop while R is idle. */
+void jgd_pacing_tick(jgd_state_t *st);
+
+/* Send unheld drawing deferred by flush coalescing once drawing has
+ * paused.  Called from the event loop while R is idle. */
+void jgd_coalesce_tick(jgd_state_t *st);
+
 /* Register/remove the R input handler that watches the transport socket
-   for incoming resize messages.  Called from C_jgd (open) and cb_close. */
+   for incoming resize messages, and the idle tick for frame pacing and
+   prerendering.
+   Called from C_jgd (open) and cb_close. */
 void jgd_register_input_handler(jgd_state_t *st);
 void jgd_remove_input_handler(jgd_state_t *st);
 
-/* Parse a JSON message; if it's a resize, store dimensions in *w, *h and
-   optionally extract plotIndex into *plot_index (-1 if absent).  Returns 1. */
+/* Decode an inbound line (inbound.h); if it's a resize, store dimensions in
+   *w, *h and optionally extract plotIndex into *plot_index (-1 if absent).
+   Returns 1. */
 int jgd_try_parse_resize(const char *buf, double *w, double *h, int *plot_index);
 
 /* Find grid state in a GEcreateSnapshot SEXP by looking for the
@@ -19,11 +19,14 @@ void page_init(jgd_page_t *p, double width, double height, double dpi, int bg) {
     p->ops_tail = NULL;
     p->last_flush_tail = NULL;
     p->op_count = 0;
+    p->released = 0;
+    p->raster_patches = 0;
     p->width = width;
     p->height = height;
     p->dpi = dpi;
     p->bg = bg;
     p->frame_ext = NULL;
+    p->resize = NULL;
 }
 
 void page_free(jgd_page_t *p) {
@@ -42,6 +45,51 @@ void page_add_op(jgd_page_t *p, cJSON *op) {
     p->op_count++;
 }
 
+void page_release_flushed(jgd_page_t *p) {
+    if (!p->ops || !p->last_flush_tail) return;
+    cJSON *head = p->ops->child;
+    cJSON *rest = p->last_flush_tail->next;
+    int n = 0;
+    for (cJSON *cur = head; cur != rest; cur = cur->next) n++;
+
+    /* Unlink the flushed prefix in one step.  cJSON keeps the array's
+     * last item in child->prev. */
+    p->ops->child = rest;
+    if (rest)
+        rest->prev = head->prev;
+    else
+        p->ops_tail = NULL;
+    p->last_flush_tail->next = NULL;
+    head->prev = NULL;
+    cJSON_Delete(head);  /* frees head and its following siblings */
+
+    p->last_flush_tail = NULL;
+    p->released += n;
+}
+
+void page_capture_begin(jgd_page_t *p, jgd_page_capture_t *saved) {
+    saved->ops = p->ops;
+    saved->ops_tail = p->ops_tail;
+    saved->last_flush_tail = p->last_flush_tail;
+    saved->op_count = p->op_count;
+    saved->released = p->released;
+    p->ops = cJSON_CreateArray();
+    p->ops_tail = NULL;
+    p->last_flush_tail = NULL;
+    p->op_count = 0;
+    p->released = 0;
+}
+
+cJSON *page_capture_end(jgd_page_t *p, const jgd_page_capture_t *saved) {
+    cJSON *captured = p->ops;
+    p->ops = saved->ops;
+    p->ops_tail = saved->ops_tail;
+    p->last_flush_tail = saved->last_flush_tail;
+    p->op_count = saved->op_count;
+    p->released = saved->released;
+    return captured;
+}
+
 static const char *lend_str(int lend) {
     switch (lend) {
         case GE_ROUND_CAP:  return "round";
@@ -81,6 +129,12 @@ cJSON *gc_to_cjson(const pGEcontext gc, const cJSON *ext_parsed) {
     cJSON_AddStringToObject(g, "lend", lend_str((int)gc->lend));
     cJSON_AddStringToObject(g, "ljoin", ljoin_str((int)gc->ljoin));
     cJSON_AddNumberToObject(g, "lmitre", gc->lmitre);
+#if R_GE_version >= 13
+    /* Pattern fills reference a defPattern op by id (see resources.c). */
+    if (gc->patternFill != R_NilValue && TYPEOF(gc->patternFill) == INTSXP &&
+        LENGTH(gc->patternFill) == 1)
+        cJSON_AddNumberToObject(g, "pattern", INTEGER(gc->patternFill)[0]);
+#endif
 
     cJSON *font = cJSON_AddObjectToObject(g, "font");
     cJSON_AddStringToObject(font, "family", gc->fontfamily[0] ? gc->fontfamily : "");
@@ -130,6 +184,8 @@ char *page_serialize_frame(jgd_page_t *p, const char *session_id, int incrementa
     cJSON_AddNumberToObject(device, "height", p->height);
     cJSON_AddNumberToObject(device, "dpi", p->dpi);
     cJSON_AddItemToObject(device, "bg", color_to_cjson(p->bg));
+    if (p->resize)
+        cJSON_AddStringToObject(device, "resize", p->resize);
 
     /* Build ops array: delta (incremental) or full */
     cJSON *ops_arr = cJSON_CreateArray();
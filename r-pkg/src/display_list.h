@@ -10,17 +10,40 @@ typedef struct {
     cJSON *ops;             /* cJSON array of drawing operations */
     cJSON *ops_tail;        /* last item in ops (O(1) append tracking) */
     cJSON *last_flush_tail; /* tail at time of last flush (delta starts at ->next) */
-    int op_count;
+    int op_count;           /* ops added to the page, including released ones */
+    int released;           /* ops dropped by page_release_flushed() */
+    int raster_patches;     /* raster ops that carry only changed tiles */
     double width;
     double height;
     double dpi;
     int bg;
     cJSON *frame_ext;       /* pre-parsed frame-level ext, or NULL */
+    const char *resize;     /* device resize mode ("scale", "reflow"), or
+                             * NULL for replay; not owned */
 } jgd_page_t;
 
+/* Saved op-list position while drawing is redirected into a resource
+ * definition (tiling pattern, clip path, mask). */
+typedef struct {
+    cJSON *ops;
+    cJSON *ops_tail;
+    cJSON *last_flush_tail;
+    int op_count;
+    int released;
+} jgd_page_capture_t;
+
 void page_init(jgd_page_t *p, double width, double height, double dpi, int bg);
 void page_free(jgd_page_t *p);
 void page_add_op(jgd_page_t *p, cJSON *op);
+/* Delete the ops up to and including last_flush_tail, which the renderer
+ * already has.  Afterwards the page holds only the unflushed tail, and an
+ * incremental frame still sends exactly that tail; a complete frame can
+ * only be rebuilt by replaying the display list. */
+void page_release_flushed(jgd_page_t *p);
+/* Redirect page_add_op into a fresh array until page_capture_end, which
+ * restores the page and returns the captured ops (caller owns them). */
+void page_capture_begin(jgd_page_t *p, jgd_page_capture_t *saved);
+cJSON *page_capture_end(jgd_page_t *p, const jgd_page_capture_t *saved);
 /* Returns a malloc'd JSON string (caller must free).
  * new_page: if 1, adds "newPage":true so the server knows this is a
  * new plot, not a resize replay.
@@ -0,0 +1,312 @@
+#include "fork_replay.h"
+#include "device.h"
+#include "display_list.h"
+
+#include <R.h>
+#include <Rinternals.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+#include <R_ext/eventloop.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Distinct from the transport handler's activity id. */
+#define JGD_REPLAY_ACTIVITY 43
+/* How long device close waits for in-flight replays before killing them. */
+#define JGD_REPLAY_CLOSE_WAIT_MS 5000.0
+
+typedef struct {
+    jgd_state_t *st;
+    pGEDevDesc gdd;
+    int plot_number;
+    int fd;
+} replay_job_t;
+
+static int write_all(int fd, const char *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+/* jgd_with_stored_plot callback in the child: send the replayed plot
+ * down the pipe, tagged as flush_stored_plot would tag it, and exit
+ * without replaying the current plot back. */
+static void child_send_and_exit(jgd_state_t *st, void *data) {
+    replay_job_t *job = (replay_job_t *)data;
+    char *json = page_serialize_frame(&st->page, st->session_id, 0, 0, 1,
+                                      job->plot_number, -1);
+    int ok = json && write_all(job->fd, json, strlen(json)) == 0 &&
+             write_all(job->fd, "\n", 1) == 0;
+    _exit(ok ? 0 : 1);
+}
+
+static void child_replay(void *data) {
+    replay_job_t *job = (replay_job_t *)data;
+    jgd_with_stored_plot(job->st, job->gdd, job->plot_number,
+                         child_send_and_exit, job);
+}
+
+static void replay_input_cb(void *data) {
+    jgd_state_t *st = (jgd_state_t *)data;
+    if (!st || st->replaying || st->drawing) return;
+    jgd_fork_replay_collect(st, 0);
+}
+
+/* Register slot's input handler on first use.  The slot fd starts as a
+ * dup of the idle pipe; jgd_fork_replay points it at a child's pipe. */
+static int setup_slot(jgd_state_t *st, int slot) {
+    jgd_replay_children_t *rc = &st->replay_children;
+    if (rc->slot_handler[slot]) return 1;
+    if (!rc->have_idle) {
+        if (pipe(rc->idle_fd) != 0) return 0;
+        fcntl(rc->idle_fd[0], F_SETFD, FD_CLOEXEC);
+        fcntl(rc->idle_fd[1], F_SETFD, FD_CLOEXEC);
+        rc->have_idle = 1;
+    }
+    int fd = dup(rc->idle_fd[0]);
+    if (fd < 0) return 0;
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    InputHandler *ih = addInputHandler(R_InputHandlers, fd, replay_input_cb,
+                                       JGD_REPLAY_ACTIVITY);
+    if (!ih) {
+        close(fd);
+        return 0;
+    }
+    ih->userData = (void *)st;
+    rc->slot_fd[slot] = fd;
+    rc->slot_handler[slot] = ih;
+    return 1;
+}
+
+/* Point a finished child's slot back at the idle pipe.  dup2 closes the
+ * child's pipe, so an EOF fd is never left for select() to report. */
+static void park_slot(jgd_replay_children_t *rc, int slot) {
+    dup2(rc->idle_fd[0], rc->slot_fd[slot]);
+    fcntl(rc->slot_fd[slot], F_SETFD, FD_CLOEXEC);
+}
+
+int jgd_fork_replay(jgd_state_t *st, pGEDevDesc gdd, int plot_number) {
+    jgd_replay_children_t *rc = &st->replay_children;
+    if (!st->fork_replay || rc->n >= JGD_MAX_REPLAY_CHILDREN ||
+        !st->transport.connected)
+        return 0;
+
+    int slot = 0;
+    while (slot < JGD_MAX_REPLAY_CHILDREN && rc->slot_busy[slot]) slot++;
+    if (slot == JGD_MAX_REPLAY_CHILDREN || !setup_slot(st, slot)) return 0;
+
+    int fds[2];
+    if (pipe(fds) != 0) return 0;
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return 0;
+    }
+    if (pid == 0) {
+        /* Child.  Like parallel's mcfork children it only computes and
+         * leaves through _exit(), never returning to R's event loop or
+         * REPL.  It must not read from the parent's connection (resize
+         * and metrics messages belong to the parent), so the transport
+         * is disconnected and metrics come from the inherited cache or
+         * the approximations.  Archive sinks are dropped too: the parent
+         * writes the forwarded frame to them. */
+        close(fds[0]);
+        for (int i = 0; i < JGD_MAX_REPLAY_CHILDREN; i++)
+            if (rc->slot_handler[i]) close(rc->slot_fd[i]);
+        close(rc->idle_fd[0]);
+        close(rc->idle_fd[1]);
+        close(STDIN_FILENO);
+        if (st->transport.fd >= 0) close(st->transport.fd);
+        st->transport.fd = -1;
+        st->transport.connected = 0;
+        st->transport.n_sinks = 0;
+        replay_job_t job = { st, gdd, plot_number, fds[1] };
+        R_ToplevelExec(child_replay, &job);
+        _exit(1);
+    }
+
+    close(fds[1]);
+    /* Move the pipe onto the slot's fd so its registered handler sees it.
+     * dup2 clears FD_CLOEXEC on the target; O_NONBLOCK lives on the open
+     * file and carries over. */
+    dup2(fds[0], rc->slot_fd[slot]);
+    close(fds[0]);
+    fcntl(rc->slot_fd[slot], F_SETFD, FD_CLOEXEC);
+    fcntl(rc->slot_fd[slot], F_SETFL,
+          fcntl(rc->slot_fd[slot], F_GETFL) | O_NONBLOCK);
+
+    jgd_replay_child_t *c = &rc->children[rc->n++];
+    memset(c, 0, sizeof(*c));
+    c->pid = (int)pid;
+    c->slot = slot;
+    c->plot_number = plot_number;
+    rc->slot_busy[slot] = 1;
+    st->stats.replays_forked++;
+    if (st->debug_frames)
+        REprintf("[jgd] fork_replay: plot=%d pid=%d in flight=%d\n",
+                 plot_number, c->pid, rc->n);
+    return 1;
+}
+
+/* Drain whatever the child has written so far; sets done at EOF and
+ * parks the slot at once, so a finished child that is not yet at the
+ * head of the queue does not keep select() waking up. */
+static void read_child(jgd_replay_children_t *rc, jgd_replay_child_t *c) {
+    while (!c->done) {
+        if (c->cap - c->len < 65536) {
+            size_t cap = c->cap ? c->cap * 2 : 65536;
+            char *buf = (char *)realloc(c->buf, cap);
+            if (!buf) {
+                c->done = 1;
+                c->len = 0;
+                break;
+            }
+            c->buf = buf;
+            c->cap = cap;
+        }
+        ssize_t n = read(rc->slot_fd[c->slot], c->buf + c->len,
+                         c->cap - c->len);
+        if (n > 0) {
+            c->len += (size_t)n;
+        } else if (n == 0) {
+            c->done = 1;
+        } else if (errno == EINTR) {
+            continue;
+        } else {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) c->done = 1;
+            break;
+        }
+    }
+    if (c->done) park_slot(rc, c->slot);
+}
+
+/* Forward a finished child's frame and release its slot. */
+static void finish_child(jgd_state_t *st, jgd_replay_child_t *c, int forward) {
+    jgd_replay_children_t *rc = &st->replay_children;
+    if (!c->done) park_slot(rc, c->slot);
+    rc->slot_busy[c->slot] = 0;
+    /* The child exits right after closing the pipe.  waitpid fails with
+     * ECHILD if another SIGCHLD handler reaped it first, which is fine:
+     * success is judged by the frame being complete. */
+    while (waitpid((pid_t)c->pid, NULL, 0) < 0 && errno == EINTR) {}
+
+    if (forward && !c->stale && c->len > 1 && c->buf[c->len - 1] == '\n' &&
+        st->transport.connected) {
+        size_t len = c->len - 1;
+        double t0 = jgd_stats_now_ms();
+        int rc = transport_send_frame(&st->transport, c->buf, len);
+        st->stats.send_ms += jgd_stats_now_ms() - t0;
+        st->stats.bytes_serialized += (double)len;
+        if (rc == 0) st->stats.bytes_sent += (double)len + 1;
+        st->stats.frames_complete++;
+        st->stats.frames_replay++;
+    } else if (st->debug_frames) {
+        REprintf("[jgd] fork_replay: pid=%d plot=%d %s\n", c->pid,
+                 c->plot_number, c->stale ? "superseded" : "produced no frame");
+    }
+    free(c->buf);
+    memset(c, 0, sizeof(*c));
+}
+
+void jgd_fork_replay_collect(jgd_state_t *st, int wait) {
+    jgd_replay_children_t *rc = &st->replay_children;
+    double deadline = jgd_stats_now_ms() + JGD_REPLAY_CLOSE_WAIT_MS;
+
+    while (rc->n > 0) {
+        for (int i = 0; i < rc->n; i++) read_child(rc, &rc->children[i]);
+
+        while (rc->n > 0 && rc->children[0].done) {
+            finish_child(st, &rc->children[0], 1);
+            memmove(&rc->children[0], &rc->children[1],
+                    (size_t)(rc->n - 1) * sizeof(rc->children[0]));
+            rc->n--;
+        }
+        if (!wait || rc->n == 0) return;
+
+        double left = deadline - jgd_stats_now_ms();
+        if (left <= 0) {
+            for (int i = 0; i < rc->n; i++) {
+                kill((pid_t)rc->children[i].pid, SIGKILL);
+                finish_child(st, &rc->children[i], 0);
+            }
+            rc->n = 0;
+            return;
+        }
+        struct pollfd pfd[JGD_MAX_REPLAY_CHILDREN];
+        int np = 0;
+        for (int i = 0; i < rc->n; i++) {
+            if (rc->children[i].done) continue;
+            pfd[np].fd = rc->slot_fd[rc->children[i].slot];
+            pfd[np].events = POLLIN;
+            np++;
+        }
+        poll(pfd, (nfds_t)np, (int)left);
+    }
+}
+
+void jgd_fork_replay_supersede(jgd_state_t *st, int plot_number) {
+    jgd_replay_children_t *rc = &st->replay_children;
+    for (int i = 0; i < rc->n; i++)
+        if (rc->children[i].plot_number == plot_number)
+            rc->children[i].stale = 1;
+}
+
+void jgd_fork_replay_close(jgd_state_t *st) {
+    jgd_replay_children_t *rc = &st->replay_children;
+    for (int i = 0; i < JGD_MAX_REPLAY_CHILDREN; i++) {
+        if (!rc->slot_handler[i]) continue;
+        removeInputHandler(&R_InputHandlers,
+                           (InputHandler *)rc->slot_handler[i]);
+        close(rc->slot_fd[i]);
+        rc->slot_handler[i] = NULL;
+    }
+    if (rc->have_idle) {
+        close(rc->idle_fd[0]);
+        close(rc->idle_fd[1]);
+        rc->have_idle = 0;
+    }
+}
+
+#else /* _WIN32 */
+
+/* No fork(): historical replays always run in-process. */
+int jgd_fork_replay(struct jgd_state *st, pGEDevDesc gdd, int plot_number) {
+    (void)st;
+    (void)gdd;
+    (void)plot_number;
+    return 0;
+}
+
+void jgd_fork_replay_collect(struct jgd_state *st, int wait) {
+    (void)st;
+    (void)wait;
+}
+
+void jgd_fork_replay_supersede(struct jgd_state *st, int plot_number) {
+    (void)st;
+    (void)plot_number;
+}
+
+void jgd_fork_replay_close(struct jgd_state *st) {
+    (void)st;
+}
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef JGD_FORK_REPLAY_H
+#define JGD_FORK_REPLAY_H
+
+#include <stddef.h>
+#include <R_ext/GraphicsEngine.h>
+
+/* options(jgd.fork_replay = TRUE) moves historical plot replays (plotIndex
+ * resizes) into forked children on POSIX systems.  A child replays one
+ * snapshot at the requested size, writes the frame to a pipe and exits;
+ * the parent forwards it over the transport when it arrives.  The
+ * parent's display list is never touched, and several replays can run on
+ * different cores while R keeps serving the user. */
+#define JGD_MAX_REPLAY_CHILDREN 4
+
+typedef struct {
+    int pid;                  /* 0 = slot unused */
+    int slot;                 /* index into slot_fd / slot_handler */
+    int plot_number;
+    int stale;                /* superseded by a newer in-process replay */
+    char *buf;                /* frame JSON received so far */
+    size_t len;
+    size_t cap;
+    int done;                 /* child closed its end of the pipe */
+} jgd_replay_child_t;
+
+typedef struct {
+    /* Children in fork order.  Frames are forwarded in this order, so a
+     * quick replay never overtakes an earlier, slower one. */
+    jgd_replay_child_t children[JGD_MAX_REPLAY_CHILDREN];
+    int n;
+    /* One input handler per slot, registered on first use and removed
+     * only at device close: R's handler loop tolerates a handler removing
+     * itself but not others.  While a slot is idle its fd is a dup of
+     * idle_fd[0], a pipe that is never written, so select() ignores it. */
+    int slot_fd[JGD_MAX_REPLAY_CHILDREN];
+    void *slot_handler[JGD_MAX_REPLAY_CHILDREN];
+    int slot_busy[JGD_MAX_REPLAY_CHILDREN];
+    int idle_fd[2];
+    int have_idle;
+} jgd_replay_children_t;
+
+struct jgd_state;
+
+/* Start a forked replay of stored plot plot_number at the device's
+ * current size.  Returns 1 if a child took it over, 0 if the caller must
+ * replay in-process (fork mode off or unsupported, all slots busy, or
+ * fork failed). */
+int jgd_fork_replay(struct jgd_state *st, pGEDevDesc gdd, int plot_number);
+
+/* Forward the frames of finished children, oldest first.  With wait = 1,
+ * block (up to a few seconds) until every child has finished; used at
+ * device close so in-flight replays are not lost. */
+void jgd_fork_replay_collect(struct jgd_state *st, int wait);
+
+/* Record an in-process replay of plot_number.  Forked replays of that
+ * plot still in flight are now stale and their frames are dropped, so an
+ * older size can never overwrite the newer result. */
+void jgd_fork_replay_supersede(struct jgd_state *st, int plot_number);
+
+/* Remove the slot input handlers and close their fds.  Called at device
+ * close after jgd_fork_replay_collect(st, 1). */
+void jgd_fork_replay_close(struct jgd_state *st);
+
+#endif
@@ -0,0 +1,211 @@
+#include "inbound.h"
+#include "cJSON.h"
+
+#include <R.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+static const char *skip_ws(const char *p) {
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') p++;
+    return p;
+}
+
+/* p is at the opening quote.  Sets the contents' span and whether it
+ * contains escapes; returns the position after the closing quote, or
+ * NULL if the string is unterminated or has raw control characters. */
+static const char *scan_string(const char *p, const char **s, size_t *len,
+                               int *escaped) {
+    const char *q = ++p;
+    *escaped = 0;
+    for (;;) {
+        unsigned char c = (unsigned char)*q;
+        if (c == '"') break;
+        if (c < 0x20) return NULL;
+        if (c == '\\') {
+            *escaped = 1;
+            if (!q[1]) return NULL;
+            q++;
+        }
+        q++;
+    }
+    *s = p;
+    *len = (size_t)(q - p);
+    return q + 1;
+}
+
+static int is_digit(char c) { return c >= '0' && c <= '9'; }
+
+/* Strict JSON number grammar; cJSON accepts more (leading '+' or zeros),
+ * and such numbers are left to it.  Returns the position after the
+ * number, or NULL. */
+static const char *scan_number(const char *p, double *out) {
+    const char *q = p;
+    if (*q == '-') q++;
+    if (*q == '0') {
+        q++;
+    } else if (is_digit(*q)) {
+        while (is_digit(*q)) q++;
+    } else {
+        return NULL;
+    }
+    if (*q == '.') {
+        q++;
+        if (!is_digit(*q)) return NULL;
+        while (is_digit(*q)) q++;
+    }
+    if (*q == 'e' || *q == 'E') {
+        q++;
+        if (*q == '+' || *q == '-') q++;
+        if (!is_digit(*q)) return NULL;
+        while (is_digit(*q)) q++;
+    }
+    /* R runs with LC_NUMERIC = "C", so strtod's decimal point is '.'. */
+    char *end;
+    *out = strtod(p, &end);
+    return end == q ? q : NULL;
+}
+
+static int span_is(const char *s, size_t len, const char *lit) {
+    return strlen(lit) == len && memcmp(s, lit, len) == 0;
+}
+
+static char ascii_lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+}
+
+/* Keys match ignoring ASCII case, as cJSON_GetObjectItem does; values
+ * such as the type name are compared exactly with span_is. */
+static int key_is(const char *s, size_t len, const char *lit) {
+    if (strlen(lit) != len) return 0;
+    for (size_t i = 0; i < len; i++)
+        if (ascii_lower(s[i]) != ascii_lower(lit[i])) return 0;
+    return 1;
+}
+
+/* Record a known field.  Only the first occurrence of a key counts, as
+ * with cJSON_GetObjectItem, even if that one is not a number. */
+static void set_field(jgd_inbound_t *m, unsigned int *seen, const char *key,
+                      size_t klen, int is_number, double v) {
+    static const struct { const char *name; unsigned int bit; } fields[] = {
+        { "width", JGD_IN_WIDTH },   { "height", JGD_IN_HEIGHT },
+        { "plotIndex", JGD_IN_PLOT_INDEX }, { "id", JGD_IN_ID },
+        { "ascent", JGD_IN_ASCENT }, { "descent", JGD_IN_DESCENT }
+    };
+    double *slots[] = { &m->width, &m->height, &m->plot_index, &m->id,
+                        &m->ascent, &m->descent };
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        if (!key_is(key, klen, fields[i].name)) continue;
+        if (*seen & fields[i].bit) return;
+        *seen |= fields[i].bit;
+        if (is_number) {
+            *slots[i] = v;
+            m->has |= fields[i].bit;
+        }
+        return;
+    }
+}
+
+static jgd_msg_type_t type_from_name(const char *s, size_t len) {
+    if (span_is(s, len, "resize")) return JGD_MSG_RESIZE;
+    if (span_is(s, len, "metrics_response")) return JGD_MSG_METRICS_RESPONSE;
+    if (span_is(s, len, "server_info")) return JGD_MSG_SERVER_INFO;
+    return JGD_MSG_OTHER;
+}
+
+/* Single pass over a flat object.  Returns 0 for anything outside the
+ * fast path, which the caller then gives to cJSON. */
+static int decode_flat(const char *line, jgd_inbound_t *m) {
+    int have_type = 0;
+    unsigned int seen = 0;
+    const char *p = skip_ws(line);
+    if (*p++ != '{') return 0;
+    p = skip_ws(p);
+    if (*p == '}') return 1;
+
+    for (;;) {
+        const char *key, *s;
+        size_t klen, slen;
+        int escaped;
+        double v;
+
+        if (*p != '"') return 0;
+        p = scan_string(p, &key, &klen, &escaped);
+        if (!p || escaped) return 0;
+        p = skip_ws(p);
+        if (*p++ != ':') return 0;
+        p = skip_ws(p);
+
+        if (*p == '"') {
+            p = scan_string(p, &s, &slen, &escaped);
+            if (!p) return 0;
+            if (key_is(key, klen, "type") && !have_type) {
+                if (escaped) return 0;
+                m->type = type_from_name(s, slen);
+            }
+            set_field(m, &seen, key, klen, 0, 0);
+        } else if (*p == '-' || is_digit(*p)) {
+            p = scan_number(p, &v);
+            if (!p) return 0;
+            set_field(m, &seen, key, klen, 1, v);
+        } else if (strncmp(p, "true", 4) == 0 || strncmp(p, "null", 4) == 0) {
+            p += 4;
+            set_field(m, &seen, key, klen, 0, 0);
+        } else if (strncmp(p, "false", 5) == 0) {
+            p += 5;
+            set_field(m, &seen, key, klen, 0, 0);
+        } else {
+            return 0;         /* nested object or array, or malformed */
+        }
+        if (key_is(key, klen, "type")) have_type = 1;
+
+        p = skip_ws(p);
+        if (*p == ',') {
+            p = skip_ws(p + 1);
+            continue;
+        }
+        /* Like cJSON_Parse, ignore whatever follows the object. */
+        return *p == '}';
+    }
+}
+
+static void decode_tree(const cJSON *msg, jgd_inbound_t *m) {
+    cJSON *type = cJSON_GetObjectItem(msg, "type");
+    if (cJSON_IsString(type))
+        m->type = type_from_name(type->valuestring, strlen(type->valuestring));
+    static const char *names[] = { "width", "height", "plotIndex", "id",
+                                   "ascent", "descent" };
+    unsigned int seen = 0;
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        cJSON *v = cJSON_GetObjectItem(msg, names[i]);
+        if (cJSON_IsNumber(v))
+            set_field(m, &seen, names[i], strlen(names[i]), 1, v->valuedouble);
+    }
+}
+
+int jgd_inbound_parse(const char *line, jgd_inbound_t *m) {
+    memset(m, 0, sizeof(*m));
+    if (decode_flat(line, m)) return 1;
+
+    memset(m, 0, sizeof(*m));
+    cJSON *msg = cJSON_Parse(line);
+    if (!msg) return 0;
+    int ok = cJSON_IsObject(msg);
+    if (ok) decode_tree(msg, m);
+    cJSON_Delete(msg);
+    return ok;
+}
+
+int jgd_inbound_resize(const jgd_inbound_t *m, double *w, double *h,
+                       int *plot_index) {
+    if (m->type != JGD_MSG_RESIZE ||
+        (m->has & (JGD_IN_WIDTH | JGD_IN_HEIGHT)) != (JGD_IN_WIDTH | JGD_IN_HEIGHT) ||
+        m->width <= 0 || m->height <= 0 ||
+        !R_FINITE(m->width) || !R_FINITE(m->height))
+        return 0;
+    *w = m->width;
+    *h = m->height;
+    if (plot_index)
+        *plot_index = (m->has & JGD_IN_PLOT_INDEX) ? (int)m->plot_index : -1;
+    return 1;
+}
@@ -0,0 +1,42 @@
+#ifndef JGD_INBOUND_H
+#define JGD_INBOUND_H
+
+/* Decoder for the messages R receives from the server.  The messages R
+ * acts on (resize, metrics_response) are flat JSON objects with a few
+ * numeric fields, so they are scanned once in place into a fixed struct
+ * without allocating.  Anything else (nested values, escapes in keys or
+ * in the type, numbers outside strict JSON syntax) is handed to
+ * cJSON_Parse, so every line cJSON accepts decodes the same way.  Keys
+ * match ignoring case on both paths, as with cJSON_GetObjectItem. */
+
+typedef enum {
+    JGD_MSG_OTHER = 0,        /* no type, or one R does not act on */
+    JGD_MSG_RESIZE,
+    JGD_MSG_METRICS_RESPONSE,
+    JGD_MSG_SERVER_INFO
+} jgd_msg_type_t;
+
+/* Bits of jgd_inbound_t.has: numeric fields that were present. */
+#define JGD_IN_WIDTH      (1u << 0)
+#define JGD_IN_HEIGHT     (1u << 1)
+#define JGD_IN_PLOT_INDEX (1u << 2)
+#define JGD_IN_ID         (1u << 3)
+#define JGD_IN_ASCENT     (1u << 4)
+#define JGD_IN_DESCENT    (1u << 5)
+
+typedef struct {
+    jgd_msg_type_t type;
+    unsigned int has;
+    double width, height, plot_index, id, ascent, descent;
+} jgd_inbound_t;
+
+/* Decode one line.  Returns 1 if it is a JSON object, 0 otherwise. */
+int jgd_inbound_parse(const char *line, jgd_inbound_t *m);
+
+/* If m is a valid resize (positive, finite width and height), store the
+ * size in *w, *h and, if plot_index is non-NULL, its plotIndex (-1 if
+ * absent) and return 1. */
+int jgd_inbound_resize(const jgd_inbound_t *m, double *w, double *h,
+                       int *plot_index);
+
+#endif
@@ -2,8 +2,10 @@
 #include <Rinternals.h>
 #include <R_ext/Rdynload.h>
 
-SEXP C_jgd(SEXP s_width, SEXP s_height, SEXP s_dpi, SEXP s_socket);
+SEXP C_jgd(SEXP s_width, SEXP s_height, SEXP s_dpi, SEXP s_socket,
+           SEXP s_max_fps, SEXP s_resize);
 SEXP C_jgd_poll_resize(void);
+SEXP C_jgd_set_idle_frames(SEXP n);
 SEXP C_jgd_server_info(SEXP s_path);
 SEXP C_jgd_set_ext(SEXP s_json);
 SEXP C_jgd_set_frame_ext(SEXP s_json);
@@ -11,10 +13,14 @@ SEXP C_jgd_begin_group(SEXP s_ext);
 SEXP C_jgd_end_group(void);
 SEXP C_jgd_update_snapshot(void);
 SEXP C_jgd_discover(SEXP s_path);
+SEXP C_jgd_stats(SEXP s_reset);
+SEXP C_jgd_trace_write(SEXP s_path);
+SEXP C_jgd_save_svg(SEXP s_file, SEXP s_plot);
 
 static const R_CallMethodDef CallEntries[] = {
-    {"C_jgd",               (DL_FUNC) &C_jgd,               4},
+    {"C_jgd",               (DL_FUNC) &C_jgd,               6},
     {"C_jgd_poll_resize",   (DL_FUNC) &C_jgd_poll_resize,   0},
+    {"C_jgd_set_idle_frames", (DL_FUNC) &C_jgd_set_idle_frames, 1},
     {"C_jgd_server_info",   (DL_FUNC) &C_jgd_server_info,   1},
     {"C_jgd_set_ext",       (DL_FUNC) &C_jgd_set_ext,       1},
     {"C_jgd_set_frame_ext", (DL_FUNC) &C_jgd_set_frame_ext, 1},
@@ -22,6 +28,9 @@ static const R_CallMethodDef CallEntries[] = {
     {"C_jgd_end_group",     (DL_FUNC) &C_jgd_end_group,     0},
     {"C_jgd_update_snapshot", (DL_FUNC) &C_jgd_update_snapshot, 0},
     {"C_jgd_discover",      (DL_FUNC) &C_jgd_discover,      1},
+    {"C_jgd_stats",         (DL_FUNC) &C_jgd_stats,         1},
+    {"C_jgd_trace_write",   (DL_FUNC) &C_jgd_trace_write,   1},
+    {"C_jgd_save_svg",      (DL_FUNC) &C_jgd_save_svg,      2},
     {NULL, NULL, 0}
 };
 
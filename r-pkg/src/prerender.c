@@ -0,0 +1,135 @@
+#include "prerender.h"
+#include "device.h"
+#include "display_list.h"
+
+#include <R.h>
+#include <Rinternals.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int same_size(double w1, double h1, double w2, double h2) {
+    return fabs(w1 - w2) < 0.5 && fabs(h1 - h2) < 0.5;
+}
+
+void jgd_prerender_note_size(jgd_prerender_t *p, double w, double h) {
+    if (!p->enabled || w <= 0 || h <= 0) return;
+    int i = 0;
+    while (i < p->n && !same_size(p->entries[i].w, p->entries[i].h, w, h)) i++;
+    jgd_prerender_entry_t e;
+    if (i < p->n) {
+        e = p->entries[i];
+    } else {
+        if (p->n == JGD_PRERENDER_SIZES) free(p->entries[--p->n].json);
+        e.w = w;
+        e.h = h;
+        e.json = NULL;
+        i = p->n++;
+    }
+    memmove(&p->entries[1], &p->entries[0], (size_t)i * sizeof(p->entries[0]));
+    p->entries[0] = e;
+}
+
+void jgd_prerender_invalidate(jgd_prerender_t *p) {
+    for (int i = 0; i < p->n; i++) {
+        free(p->entries[i].json);
+        p->entries[i].json = NULL;
+    }
+}
+
+void jgd_prerender_free(jgd_prerender_t *p) {
+    jgd_prerender_invalidate(p);
+    p->n = 0;
+}
+
+int jgd_prerender_send(jgd_state_t *st, double w, double h) {
+    jgd_prerender_t *p = &st->prerender;
+    for (int i = 0; i < p->n; i++) {
+        jgd_prerender_entry_t *e = &p->entries[i];
+        if (!e->json || !same_size(e->w, e->h, w, h)) continue;
+        size_t len = strlen(e->json);
+        JGD_TRACE_BEGIN(st, "transport_send");
+        double t0 = jgd_stats_now_ms();
+        int rc = transport_send_frame(&st->transport, e->json, len);
+        st->stats.send_ms += jgd_stats_now_ms() - t0;
+        JGD_TRACE_END(st, "transport_send");
+        if (rc == 0) st->stats.bytes_sent += (double)len + 1;
+        st->stats.frames_complete++;
+        st->stats.frames_replay++;
+        st->stats.prerender_hits++;
+        st->last_frame_ms = jgd_stats_now_ms();
+        if (st->debug_frames)
+            REprintf("[jgd] prerender: sent stored frame for %.0fx%.0f\n", w, h);
+        /* The frame is only valid until the next drawing, which replaces
+         * the page it was rendered from; drop it now that it is used. */
+        free(e->json);
+        e->json = NULL;
+        return 1;
+    }
+    return 0;
+}
+
+/* The requested size to prerender next, or NULL if there is none or the
+ * device is not in a state to replay. */
+static jgd_prerender_entry_t *next_entry(jgd_state_t *st) {
+    jgd_prerender_t *p = &st->prerender;
+    if (!p->enabled || p->active || st->drawing || st->replaying ||
+        st->recording || st->hold_level > 0 || st->frame_pending ||
+        st->new_page || st->page_count == 0 ||
+        st->page.op_count == 0 || st->page.op_count != st->last_flushed_ops ||
+        st->has_buffered_resize || st->pending_w > 0 ||
+        !st->transport.connected)
+        return NULL;
+
+    double cur_w = st->width * st->dpi, cur_h = st->height * st->dpi;
+    for (int i = 0; i < p->n; i++) {
+        if (!p->entries[i].json &&
+            !same_size(p->entries[i].w, p->entries[i].h, cur_w, cur_h))
+            return &p->entries[i];
+    }
+    return NULL;
+}
+
+int jgd_prerender_pending(jgd_state_t *st) {
+    return next_entry(st) != NULL;
+}
+
+int jgd_prerender_step(jgd_state_t *st, pGEDevDesc gdd) {
+    jgd_prerender_t *p = &st->prerender;
+    jgd_prerender_entry_t *e = next_entry(st);
+    if (!e || transport_has_data(&st->transport) ||
+        gdd->displayList == R_NilValue)
+        return 0;
+    double cur_w = st->width * st->dpi, cur_h = st->height * st->dpi;
+
+    if (st->debug_frames)
+        REprintf("[jgd] prerender: current plot at %.0fx%.0f\n", e->w, e->h);
+
+    /* Resizes read while the speculative replays wait for font metrics
+     * are left pending (check_incoming and apply_pending_resize skip
+     * them while active), so they are answered by poll_resize_impl. */
+    p->active = 1;
+    JGD_TRACE_BEGIN(st, "prerender");
+    jgd_set_size_px(st, gdd->dev, e->w, e->h);
+    char *json = NULL;
+    if (jgd_replay_current_plot(st, gdd) && st->page.op_count > 0)
+        json = page_serialize_frame(&st->page, st->session_id, 0, 0, 1, -1,
+                                    st->page_count - 1);
+
+    /* Bring R's graphics state back to the real size.  The renderer
+     * already has this page, so nothing is sent. */
+    jgd_set_size_px(st, gdd->dev, cur_w, cur_h);
+    jgd_replay_current_plot(st, gdd);
+    st->last_flushed_ops = st->page.op_count;
+    st->page.last_flush_tail = st->page.ops_tail;
+    jgd_release_flushed(st);
+    JGD_TRACE_END(st, "prerender");
+    p->active = 0;
+
+    if (!json) return 0;
+    st->stats.prerenders++;
+    free(e->json);
+    e->json = json;
+    return 1;
+}
@@ -0,0 +1,52 @@
+#ifndef JGD_PRERENDER_H
+#define JGD_PRERENDER_H
+
+#include <R_ext/GraphicsEngine.h>
+
+/* options(jgd.prerender = TRUE): while R waits at the prompt, replay
+ * the current plot at the sizes browsers most recently asked for and keep
+ * the serialized frames.  A later resize to one of those sizes is answered
+ * with the stored frame at once; the replay that brings R's graphics
+ * state to the new size runs after it has been sent. */
+#define JGD_PRERENDER_SIZES 3
+
+typedef struct {
+    double w, h;              /* requested size in pixels */
+    char *json;               /* frame for the current plot at w x h, or NULL */
+} jgd_prerender_entry_t;
+
+typedef struct {
+    int enabled;
+    int active;               /* 1 while a speculative replay is running */
+    /* Requested sizes, most recent first. */
+    jgd_prerender_entry_t entries[JGD_PRERENDER_SIZES];
+    int n;
+} jgd_prerender_t;
+
+struct jgd_state;
+
+/* Remember a size requested by a browser. */
+void jgd_prerender_note_size(jgd_prerender_t *p, double w, double h);
+
+/* Drop all prerendered frames; called whenever the current plot changes. */
+void jgd_prerender_invalidate(jgd_prerender_t *p);
+
+void jgd_prerender_free(jgd_prerender_t *p);
+
+/* Send the prerendered frame for w x h, if there is one.  Returns 1 if a
+ * frame was sent. */
+int jgd_prerender_send(struct jgd_state *st, double w, double h);
+
+/* 1 if a step would prerender a size now.  Cheap; the idle tick uses it
+ * to decide whether to wake the prompt-time handler in device.c. */
+int jgd_prerender_pending(struct jgd_state *st);
+
+/* Prerender the current plot at one requested size that has no frame
+ * yet.  Does nothing unless the renderer has everything drawn so far.
+ * Returns 1 if a frame was prerendered.  Callers must make sure R is
+ * waiting at the prompt (see jgd_prerender_wake_cb in device.c), never
+ * running user code.  One size per call, so a caller can stop as soon as
+ * input arrives. */
+int jgd_prerender_step(struct jgd_state *st, pGEDevDesc gdd);
+
+#endif
@@ -0,0 +1,144 @@
+#include "raster_delta.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* FNV-1a over one tile's colours. */
+static uint64_t tile_hash(const unsigned int *raster, int w, int x0, int y0,
+                          int tw, int th) {
+    uint64_t h = 14695981039346656037ULL;
+    for (int y = y0; y < y0 + th; y++) {
+        const unsigned int *row = raster + (size_t)y * (size_t)w;
+        for (int x = x0; x < x0 + tw; x++) {
+            unsigned int c = row[x];
+            for (int b = 0; b < 4; b++) {
+                h ^= (c >> (8 * b)) & 0xFF;
+                h *= 1099511628211ULL;
+            }
+        }
+    }
+    return h;
+}
+
+static void slot_clear(jgd_raster_slot_t *s) {
+    free(s->hashes);
+    free(s->sent_hashes);
+    free(s->changed);
+    memset(s, 0, sizeof(*s));
+}
+
+static int same_placement(const jgd_raster_slot_t *s, int w, int h, double x,
+                          double y, double width, double height, double rot,
+                          int interpolate) {
+    return s->id && s->w == w && s->h == h && s->x == x && s->y == y &&
+           s->width == width && s->height == height && s->rot == rot &&
+           s->interpolate == interpolate;
+}
+
+/* The slot for a placement: an existing one, a free one or the least
+ * recently used, with tile buffers for a w x h raster. */
+static jgd_raster_slot_t *find_slot(jgd_raster_delta_t *d, int w, int h,
+                                    double x, double y, double width,
+                                    double height, double rot,
+                                    int interpolate) {
+    jgd_raster_slot_t *victim = &d->slots[0];
+    for (int i = 0; i < JGD_RASTER_SLOTS; i++) {
+        jgd_raster_slot_t *s = &d->slots[i];
+        if (same_placement(s, w, h, x, y, width, height, rot, interpolate))
+            return s;
+        if (victim->id && (!s->id || s->used < victim->used)) victim = s;
+    }
+
+    slot_clear(victim);
+    int tx = (w + JGD_RASTER_TILE - 1) / JGD_RASTER_TILE;
+    int ty = (h + JGD_RASTER_TILE - 1) / JGD_RASTER_TILE;
+    size_t n = (size_t)tx * (size_t)ty;
+    victim->hashes = (uint64_t *)calloc(n, sizeof(uint64_t));
+    victim->sent_hashes = (uint64_t *)calloc(n, sizeof(uint64_t));
+    victim->changed = (unsigned char *)calloc(n, 1);
+    if (!victim->hashes || !victim->sent_hashes || !victim->changed) {
+        slot_clear(victim);
+        return NULL;
+    }
+    victim->id = ++d->next_id;
+    victim->x = x;
+    victim->y = y;
+    victim->width = width;
+    victim->height = height;
+    victim->rot = rot;
+    victim->interpolate = interpolate;
+    victim->w = w;
+    victim->h = h;
+    victim->ntiles = (int)n;
+    return victim;
+}
+
+int jgd_raster_delta_diff(jgd_raster_delta_t *d, const unsigned int *raster,
+                          int w, int h, double x, double y, double width,
+                          double height, double rot, int interpolate,
+                          jgd_raster_diff_t *out) {
+    jgd_raster_slot_t *s = find_slot(d, w, h, x, y, width, height, rot,
+                                     interpolate);
+    if (!s) return 0;
+    s->used = ++d->clock;
+
+    int tx = (w + JGD_RASTER_TILE - 1) / JGD_RASTER_TILE;
+    int ty = (h + JGD_RASTER_TILE - 1) / JGD_RASTER_TILE;
+    int had_image = s->seq != 0;
+    double changed_px = 0;
+    for (int j = 0; j < ty; j++) {
+        int y0 = j * JGD_RASTER_TILE;
+        int th = h - y0 < JGD_RASTER_TILE ? h - y0 : JGD_RASTER_TILE;
+        for (int i = 0; i < tx; i++) {
+            int x0 = i * JGD_RASTER_TILE;
+            int tw = w - x0 < JGD_RASTER_TILE ? w - x0 : JGD_RASTER_TILE;
+            int k = j * tx + i;
+            uint64_t hash = tile_hash(raster, w, x0, y0, tw, th);
+            s->changed[k] = !had_image || hash != s->hashes[k];
+            if (s->changed[k]) changed_px += (double)tw * th;
+            s->hashes[k] = hash;
+        }
+    }
+
+    out->slot = s->id;
+    out->tiles_x = tx;
+    out->tiles_y = ty;
+    out->changed = s->changed;
+    /* Once half the image has changed, one PNG of it is about as small
+     * as the tiles and cheaper to decode. */
+    out->base = had_image && changed_px * 2 <= (double)w * h ? s->seq : 0;
+    if (++d->next_seq == 0) d->next_seq = 1;
+    s->seq = out->seq = d->next_seq;
+    return 1;
+}
+
+void jgd_raster_delta_commit(jgd_raster_delta_t *d) {
+    for (int i = 0; i < JGD_RASTER_SLOTS; i++) {
+        jgd_raster_slot_t *s = &d->slots[i];
+        if (!s->id || s->sent_seq == s->seq) continue;
+        memcpy(s->sent_hashes, s->hashes, (size_t)s->ntiles * sizeof(uint64_t));
+        s->sent_seq = s->seq;
+    }
+}
+
+void jgd_raster_delta_rollback(jgd_raster_delta_t *d) {
+    for (int i = 0; i < JGD_RASTER_SLOTS; i++) {
+        jgd_raster_slot_t *s = &d->slots[i];
+        if (!s->id || s->sent_seq == s->seq) continue;
+        if (s->sent_seq == 0) {
+            slot_clear(s);
+            continue;
+        }
+        memcpy(s->hashes, s->sent_hashes, (size_t)s->ntiles * sizeof(uint64_t));
+        s->seq = s->sent_seq;
+    }
+}
+
+void jgd_raster_delta_forget(jgd_raster_delta_t *d, int slot) {
+    for (int i = 0; i < JGD_RASTER_SLOTS; i++)
+        if (d->slots[i].id == slot) slot_clear(&d->slots[i]);
+}
+
+void jgd_raster_delta_free(jgd_raster_delta_t *d) {
+    for (int i = 0; i < JGD_RASTER_SLOTS; i++) slot_clear(&d->slots[i]);
+}
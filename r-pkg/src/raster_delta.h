@@ -0,0 +1,71 @@
+#ifndef JGD_RASTER_DELTA_H
+#define JGD_RASTER_DELTA_H
+
+#include <stdint.h>
+
+/* options(jgd.raster_delta = TRUE): a raster drawn again at the same
+ * placement (position, size, rotation, interpolation and pixel
+ * dimensions) is sent as a patch.  Rasters are split into square tiles
+ * whose hashes are kept per placement, or "slot"; the next raster in a
+ * slot carries only the tiles whose hash changed, and the renderer draws
+ * them over its copy of the slot's previous image.
+ *
+ * Slot state moves on as rasters are drawn but is committed only once
+ * the frame carrying them has been sent.  Rasters the renderer never
+ * gets (a page dropped by pacing, or drawing superseded by a replay)
+ * roll the slots back to what was last sent.  Replays draw plain
+ * rasters and leave the slots alone. */
+#define JGD_RASTER_SLOTS 8
+#define JGD_RASTER_TILE 32
+
+typedef struct {
+    int id;                   /* 0 = free */
+    double x, y, width, height, rot;
+    int interpolate, w, h;
+    int ntiles;
+    uint64_t *hashes;         /* per tile, as last drawn */
+    uint64_t *sent_hashes;    /* per tile, as last sent */
+    unsigned char *changed;   /* per tile, from the last diff */
+    unsigned int seq;         /* image last drawn */
+    unsigned int sent_seq;    /* image last sent, 0 if none */
+    unsigned long used;       /* LRU stamp */
+} jgd_raster_slot_t;
+
+typedef struct {
+    int enabled;
+    jgd_raster_slot_t slots[JGD_RASTER_SLOTS];
+    int next_id;
+    unsigned int next_seq;
+    unsigned long clock;
+} jgd_raster_delta_t;
+
+/* How to send one raster. */
+typedef struct {
+    int slot;                 /* slot id */
+    unsigned int seq;         /* id of the image this raster produces */
+    unsigned int base;        /* image the patch applies to; 0 = send whole */
+    int tiles_x, tiles_y;     /* tile grid */
+    const unsigned char *changed;  /* per tile (row-major) when base != 0 */
+} jgd_raster_diff_t;
+
+/* Find or create the slot for a raster's placement and diff its tiles
+ * against the slot's last image.  Returns 0 (on allocation failure) if
+ * the raster should be sent plainly, without a slot. */
+int jgd_raster_delta_diff(jgd_raster_delta_t *d, const unsigned int *raster,
+                          int w, int h, double x, double y, double width,
+                          double height, double rot, int interpolate,
+                          jgd_raster_diff_t *out);
+
+/* The frame holding every raster drawn so far has been sent. */
+void jgd_raster_delta_commit(jgd_raster_delta_t *d);
+
+/* Rasters drawn since the last commit will never reach the renderer. */
+void jgd_raster_delta_rollback(jgd_raster_delta_t *d);
+
+/* Drop a slot whose latest raster could not be sent; the next raster at
+ * its placement starts a new slot. */
+void jgd_raster_delta_forget(jgd_raster_delta_t *d, int slot);
+
+void jgd_raster_delta_free(jgd_raster_delta_t *d);
+
+#endif
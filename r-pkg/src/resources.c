@@ -0,0 +1,446 @@
+#include "resources.h"
+#include "device.h"
+#include "display_list.h"
+#include "color.h"
+#include "cJSON.h"
+
+#include <R.h>
+#include <Rinternals.h>
+#include <R_ext/GraphicsEngine.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void free_fonts(jgd_resources_t *r) {
+    for (int i = 0; i < r->nfonts; i++)
+        free(r->fonts[i].file);
+    r->nfonts = 0;
+}
+
+void jgd_resources_reset(jgd_resources_t *r) {
+    if (r->kind && r->cap > 0)
+        memset(r->kind, 0, (size_t)r->cap);
+    r->next_id = 1;
+    r->mask = 0;
+    free_fonts(r);
+}
+
+void jgd_resources_free(jgd_resources_t *r) {
+    free_fonts(r);
+    free(r->fonts);
+    r->fonts = NULL;
+    r->fonts_cap = 0;
+    free(r->kind);
+    r->kind = NULL;
+    r->cap = 0;
+    r->next_id = 1;
+    r->mask = 0;
+}
+
+/* Returns a new id, or -1 on allocation failure. */
+static int res_alloc(jgd_resources_t *r, jgd_res_kind_t kind) {
+    if (r->next_id < 1) r->next_id = 1;
+    int id = r->next_id;
+    if (id >= r->cap) {
+        int cap = r->cap ? r->cap * 2 : 64;
+        while (cap <= id) cap *= 2;
+        unsigned char *k = (unsigned char *)realloc(r->kind, (size_t)cap);
+        if (!k) return -1;
+        memset(k + r->cap, 0, (size_t)(cap - r->cap));
+        r->kind = k;
+        r->cap = cap;
+    }
+    r->kind[id] = (unsigned char)kind;
+    r->next_id++;
+    return id;
+}
+
+/* Id held in an R reference, or -1 if ref is not a live resource of kind. */
+static int res_lookup(const jgd_resources_t *r, SEXP ref, jgd_res_kind_t kind) {
+    if (ref == R_NilValue || TYPEOF(ref) != INTSXP || LENGTH(ref) != 1)
+        return -1;
+    int id = INTEGER(ref)[0];
+    if (id < 1 || id >= r->cap || r->kind[id] != (unsigned char)kind)
+        return -1;
+    return id;
+}
+
+/* Release one resource, or every resource of kind when ref is NULL.
+ * Returns the released id, or -1 for release-all or unknown refs. */
+static int res_release(jgd_resources_t *r, SEXP ref, jgd_res_kind_t kind) {
+    if (ref == R_NilValue) {
+        for (int i = 0; i < r->cap; i++)
+            if (r->kind[i] == (unsigned char)kind) r->kind[i] = JGD_RES_FREE;
+        return -1;
+    }
+    int id = res_lookup(r, ref, kind);
+    if (id > 0) r->kind[id] = JGD_RES_FREE;
+    return id;
+}
+
+/* Run an R drawing function (tile, clip path or mask content) with the
+ * device's output redirected into a fresh op array.  Frames are not
+ * flushed while recording (see cb_mode).  Errors in the function are
+ * reported by R_tryEval and yield whatever was drawn before them. */
+static cJSON *record_ops(jgd_state_t *st, SEXP fn) {
+    jgd_page_capture_t saved;
+    /* Masks set and cleared inside the function belong to the recording. */
+    int saved_mask = st->resources.mask;
+    page_capture_begin(&st->page, &saved);
+    st->recording++;
+    if (Rf_isFunction(fn)) {
+        int err = 0;
+        SEXP call = PROTECT(Rf_lang1(fn));
+        R_tryEval(call, R_GlobalEnv, &err);
+        UNPROTECT(1);
+    }
+    st->recording--;
+    st->resources.mask = saved_mask;
+    return page_capture_end(&st->page, &saved);
+}
+
+static const char *extend_str(int extend) {
+    switch (extend) {
+        case R_GE_patternExtendRepeat:  return "repeat";
+        case R_GE_patternExtendReflect: return "reflect";
+        case R_GE_patternExtendNone:    return "none";
+        default:                        return "pad";
+    }
+}
+
+/* [[offset, colour], ...] for a linear or radial gradient. */
+static cJSON *gradient_stops(SEXP pattern, int radial) {
+    cJSON *stops = cJSON_CreateArray();
+    int n = radial ? R_GE_radialGradientNumStops(pattern)
+                   : R_GE_linearGradientNumStops(pattern);
+    for (int i = 0; i < n; i++) {
+        double offset = radial ? R_GE_radialGradientStop(pattern, i)
+                               : R_GE_linearGradientStop(pattern, i);
+        int colour = (int)(radial ? R_GE_radialGradientColour(pattern, i)
+                                  : R_GE_linearGradientColour(pattern, i));
+        cJSON *s = cJSON_CreateArray();
+        cJSON_AddItemToArray(s, cJSON_CreateNumber(offset));
+        cJSON *col = color_to_cjson(colour);
+        /* Fully transparent stops still matter for interpolation. */
+        if (cJSON_IsNull(col)) {
+            cJSON_Delete(col);
+            col = cJSON_CreateString("rgba(0,0,0,0)");
+        }
+        cJSON_AddItemToArray(s, col);
+        cJSON_AddItemToArray(stops, s);
+    }
+    return stops;
+}
+
+SEXP jgd_set_pattern(jgd_state_t *st, SEXP pattern) {
+    int type = R_GE_patternType(pattern);
+    cJSON *op = cJSON_CreateObject();
+    cJSON_AddStringToObject(op, "op", "defPattern");
+
+    switch (type) {
+    case R_GE_linearGradientPattern:
+        cJSON_AddStringToObject(op, "type", "linear");
+        cJSON_AddNumberToObject(op, "x1", R_GE_linearGradientX1(pattern));
+        cJSON_AddNumberToObject(op, "y1", R_GE_linearGradientY1(pattern));
+        cJSON_AddNumberToObject(op, "x2", R_GE_linearGradientX2(pattern));
+        cJSON_AddNumberToObject(op, "y2", R_GE_linearGradientY2(pattern));
+        cJSON_AddItemToObject(op, "stops", gradient_stops(pattern, 0));
+        cJSON_AddStringToObject(op, "extend",
+                                extend_str(R_GE_linearGradientExtend(pattern)));
+        break;
+    case R_GE_radialGradientPattern:
+        cJSON_AddStringToObject(op, "type", "radial");
+        cJSON_AddNumberToObject(op, "cx1", R_GE_radialGradientCX1(pattern));
+        cJSON_AddNumberToObject(op, "cy1", R_GE_radialGradientCY1(pattern));
+        cJSON_AddNumberToObject(op, "r1", R_GE_radialGradientR1(pattern));
+        cJSON_AddNumberToObject(op, "cx2", R_GE_radialGradientCX2(pattern));
+        cJSON_AddNumberToObject(op, "cy2", R_GE_radialGradientCY2(pattern));
+        cJSON_AddNumberToObject(op, "r2", R_GE_radialGradientR2(pattern));
+        cJSON_AddItemToObject(op, "stops", gradient_stops(pattern, 1));
+        cJSON_AddStringToObject(op, "extend",
+                                extend_str(R_GE_radialGradientExtend(pattern)));
+        break;
+    case R_GE_tilingPattern:
+        cJSON_AddStringToObject(op, "type", "tiling");
+        cJSON_AddNumberToObject(op, "x", R_GE_tilingPatternX(pattern));
+        cJSON_AddNumberToObject(op, "y", R_GE_tilingPatternY(pattern));
+        cJSON_AddNumberToObject(op, "w", R_GE_tilingPatternWidth(pattern));
+        cJSON_AddNumberToObject(op, "h", R_GE_tilingPatternHeight(pattern));
+        cJSON_AddStringToObject(op, "extend",
+                                extend_str(R_GE_tilingPatternExtend(pattern)));
+        cJSON_AddItemToObject(op, "ops",
+            record_ops(st, R_GE_tilingPatternFunction(pattern)));
+        break;
+    default:
+        cJSON_Delete(op);
+        return R_NilValue;
+    }
+
+    int id = res_alloc(&st->resources, JGD_RES_PATTERN);
+    if (id < 0) {
+        cJSON_Delete(op);
+        return R_NilValue;
+    }
+    cJSON_AddNumberToObject(op, "id", id);
+    page_add_op(&st->page, op);
+    return Rf_ScalarInteger(id);
+}
+
+/* Release ops let the renderer drop cached objects for long pages.
+ * Release-all (NULL ref) comes from GEinitDisplayList at a new page,
+ * where the renderer starts a fresh plot anyway, so it emits nothing. */
+static void emit_release(jgd_state_t *st, const char *kind, int id) {
+    if (id < 1) return;
+    cJSON *op = cJSON_CreateObject();
+    cJSON_AddStringToObject(op, "op", "release");
+    cJSON_AddStringToObject(op, "kind", kind);
+    cJSON_AddNumberToObject(op, "id", id);
+    page_add_op(&st->page, op);
+}
+
+void jgd_release_pattern(jgd_state_t *st, SEXP ref) {
+    emit_release(st, "pattern", res_release(&st->resources, ref, JGD_RES_PATTERN));
+}
+
+static void emit_use(jgd_state_t *st, const char *name, int id) {
+    cJSON *op = cJSON_CreateObject();
+    cJSON_AddStringToObject(op, "op", name);
+    if (id > 0)
+        cJSON_AddNumberToObject(op, "id", id);
+    else
+        cJSON_AddNullToObject(op, "id");
+    page_add_op(&st->page, op);
+}
+
+SEXP jgd_set_clip_path(jgd_state_t *st, SEXP path, SEXP ref) {
+    /* A live ref means R is re-applying a clip path defined earlier. */
+    int id = res_lookup(&st->resources, ref, JGD_RES_CLIP_PATH);
+    if (id < 0) {
+        id = res_alloc(&st->resources, JGD_RES_CLIP_PATH);
+        if (id < 0) return R_NilValue;
+        cJSON *op = cJSON_CreateObject();
+        cJSON_AddStringToObject(op, "op", "defClipPath");
+        cJSON_AddNumberToObject(op, "id", id);
+        const char *rule = "nonzero";
+#if R_GE_version >= 15
+        if (R_GE_clipPathFillRule(path) == R_GE_evenOddRule)
+            rule = "evenodd";
+#endif
+        cJSON_AddStringToObject(op, "rule", rule);
+        cJSON_AddItemToObject(op, "ops", record_ops(st, path));
+        page_add_op(&st->page, op);
+    }
+    emit_use(st, "clipPath", id);
+    return Rf_ScalarInteger(id);
+}
+
+void jgd_release_clip_path(jgd_state_t *st, SEXP ref) {
+    emit_release(st, "clipPath", res_release(&st->resources, ref, JGD_RES_CLIP_PATH));
+}
+
+SEXP jgd_set_mask(jgd_state_t *st, SEXP path, SEXP ref) {
+    /* NULL path clears the mask for subsequent drawing.  grid clears
+     * after every grob, so only emit when a mask is actually active. */
+    if (path == R_NilValue) {
+        if (st->resources.mask > 0)
+            emit_use(st, "mask", -1);
+        st->resources.mask = 0;
+        return R_NilValue;
+    }
+    int id = res_lookup(&st->resources, ref, JGD_RES_MASK);
+    if (id < 0) {
+        id = res_alloc(&st->resources, JGD_RES_MASK);
+        if (id < 0) return R_NilValue;
+        cJSON *op = cJSON_CreateObject();
+        cJSON_AddStringToObject(op, "op", "defMask");
+        cJSON_AddNumberToObject(op, "id", id);
+        const char *type = "alpha";
+#if R_GE_version >= 15
+        if (R_GE_maskType(path) == R_GE_luminanceMask)
+            type = "luminance";
+#endif
+        cJSON_AddStringToObject(op, "type", type);
+        cJSON_AddItemToObject(op, "ops", record_ops(st, path));
+        page_add_op(&st->page, op);
+    }
+    emit_use(st, "mask", id);
+    st->resources.mask = id;
+    return Rf_ScalarInteger(id);
+}
+
+void jgd_release_mask(jgd_state_t *st, SEXP ref) {
+    emit_release(st, "mask", res_release(&st->resources, ref, JGD_RES_MASK));
+}
+
+#if R_GE_version >= 15
+
+/* grid's names for the compositing operators, indexed by R_GE_composite*. */
+static const char *composite_str(int op) {
+    static const char *names[] = {
+        NULL, "clear", "source", "over", "in", "out", "atop",
+        "dest", "dest.over", "dest.in", "dest.out", "dest.atop", "xor",
+        "add", "saturate", "multiply", "screen", "overlay", "darken",
+        "lighten", "color.dodge", "color.burn", "hard.light",
+        "soft.light", "difference", "exclusion"
+    };
+    if (op < R_GE_compositeClear || op > R_GE_compositeExclusion)
+        return "over";
+    return names[op];
+}
+
+SEXP jgd_define_group(jgd_state_t *st, SEXP source, int op, SEXP destination) {
+    int id = res_alloc(&st->resources, JGD_RES_GROUP);
+    if (id < 0) return R_NilValue;
+    cJSON *def = cJSON_CreateObject();
+    cJSON_AddStringToObject(def, "op", "defGroup");
+    cJSON_AddNumberToObject(def, "id", id);
+    cJSON_AddStringToObject(def, "composite", composite_str(op));
+    /* The destination is drawn first, then the source is composited
+     * onto it with the group's operator. */
+    if (destination != R_NilValue)
+        cJSON_AddItemToObject(def, "dst", record_ops(st, destination));
+    cJSON_AddItemToObject(def, "src", record_ops(st, source));
+    page_add_op(&st->page, def);
+    return Rf_ScalarInteger(id);
+}
+
+void jgd_use_group(jgd_state_t *st, SEXP ref, SEXP trans) {
+    int id = res_lookup(&st->resources, ref, JGD_RES_GROUP);
+    if (id < 0) return;
+    cJSON *op = cJSON_CreateObject();
+    cJSON_AddStringToObject(op, "op", "useGroup");
+    cJSON_AddNumberToObject(op, "id", id);
+    /* trans is a 3x3 column-major affine matrix in device coordinates;
+     * send it as the Canvas2D [a, b, c, d, e, f] tuple. */
+    if (trans != R_NilValue && TYPEOF(trans) == REALSXP && LENGTH(trans) >= 9) {
+        const double *m = REAL(trans);
+        double t[6] = { m[0], m[1], m[3], m[4], m[6], m[7] };
+        cJSON_AddItemToObject(op, "transform", cJSON_CreateDoubleArray(t, 6));
+    }
+    page_add_op(&st->page, op);
+}
+
+void jgd_release_group(jgd_state_t *st, SEXP ref) {
+    emit_release(st, "group", res_release(&st->resources, ref, JGD_RES_GROUP));
+}
+
+void jgd_draw_path(jgd_state_t *st, SEXP path, const char *mode, int rule,
+                   const pGEcontext gc) {
+    cJSON *op = cJSON_CreateObject();
+    cJSON_AddStringToObject(op, "op", "drawPath");
+    cJSON_AddStringToObject(op, "mode", mode);
+    cJSON_AddStringToObject(op, "rule",
+                            rule == R_GE_evenOddRule ? "evenodd" : "nonzero");
+    cJSON_AddItemToObject(op, "ops", record_ops(st, path));
+    cJSON_AddItemToObject(op, "gc", gc_to_cjson(gc, st->page_ext_parsed));
+    page_add_op(&st->page, op);
+}
+
+SEXP jgd_capabilities(SEXP cap) {
+    SEXP patterns = PROTECT(Rf_allocVector(INTSXP, 3));
+    INTEGER(patterns)[0] = R_GE_linearGradientPattern;
+    INTEGER(patterns)[1] = R_GE_radialGradientPattern;
+    INTEGER(patterns)[2] = R_GE_tilingPattern;
+    SET_VECTOR_ELT(cap, R_GE_capability_patterns, patterns);
+
+    SET_VECTOR_ELT(cap, R_GE_capability_clippingPaths, Rf_ScalarInteger(1));
+
+    SEXP masks = PROTECT(Rf_allocVector(INTSXP, 2));
+    INTEGER(masks)[0] = R_GE_alphaMask;
+    INTEGER(masks)[1] = R_GE_luminanceMask;
+    SET_VECTOR_ELT(cap, R_GE_capability_masks, masks);
+
+    /* Every operator except saturate has a Canvas2D equivalent. */
+    int n = R_GE_compositeExclusion - R_GE_compositeClear;
+    SEXP ops = PROTECT(Rf_allocVector(INTSXP, n));
+    for (int i = 0, op = R_GE_compositeClear; op <= R_GE_compositeExclusion; op++)
+        if (op != R_GE_compositeSaturate) INTEGER(ops)[i++] = op;
+    SET_VECTOR_ELT(cap, R_GE_capability_compositing, ops);
+
+    SET_VECTOR_ELT(cap, R_GE_capability_transformations, Rf_ScalarInteger(1));
+    SET_VECTOR_ELT(cap, R_GE_capability_paths, Rf_ScalarInteger(1));
+#if R_GE_version >= 16
+    SET_VECTOR_ELT(cap, R_GE_capability_glyphs, Rf_ScalarInteger(1));
+#endif
+    UNPROTECT(3);
+    return cap;
+}
+
+#endif
+
+#if R_GE_version >= 16
+
+static const char *glyph_style_str(int style) {
+    switch (style) {
+        case R_GE_glyphStyleItalic:  return "italic";
+        case R_GE_glyphStyleOblique: return "oblique";
+        default:                     return "normal";
+    }
+}
+
+/* Id of the page's font for (file, index, size), emitting a defFont op
+ * the first time it is seen.  Pages rarely use more than a handful of
+ * fonts, so a linear scan is fine.  Returns -1 on allocation failure. */
+static int font_ref(jgd_state_t *st, SEXP font, double size) {
+    jgd_resources_t *r = &st->resources;
+    const char *file = R_GE_glyphFontFile(font);
+    int index = R_GE_glyphFontIndex(font);
+    if (!file) file = "";
+    for (int i = r->nfonts - 1; i >= 0; i--) {
+        jgd_font_t *f = &r->fonts[i];
+        if (f->index == index && f->size == size && strcmp(f->file, file) == 0)
+            return f->id;
+    }
+    if (r->nfonts == r->fonts_cap) {
+        int cap = r->fonts_cap ? r->fonts_cap * 2 : 8;
+        jgd_font_t *fonts = (jgd_font_t *)realloc(r->fonts, (size_t)cap * sizeof(jgd_font_t));
+        if (!fonts) return -1;
+        r->fonts = fonts;
+        r->fonts_cap = cap;
+    }
+    char *dup = strdup(file);
+    if (!dup) return -1;
+    int id = res_alloc(r, JGD_RES_FONT);
+    if (id < 0) {
+        free(dup);
+        return -1;
+    }
+    jgd_font_t *f = &r->fonts[r->nfonts++];
+    f->id = id;
+    f->file = dup;
+    f->index = index;
+    f->size = size;
+
+    /* family/weight/style let renderers fall back to CSS fonts when the
+     * font file cannot be loaded. */
+    const char *family = R_GE_glyphFontFamily(font);
+    cJSON *op = cJSON_CreateObject();
+    cJSON_AddStringToObject(op, "op", "defFont");
+    cJSON_AddNumberToObject(op, "id", id);
+    cJSON_AddStringToObject(op, "file", file);
+    cJSON_AddNumberToObject(op, "index", index);
+    cJSON_AddNumberToObject(op, "size", size);
+    cJSON_AddStringToObject(op, "family", family ? family : "");
+    cJSON_AddNumberToObject(op, "weight", R_GE_glyphFontWeight(font));
+    cJSON_AddStringToObject(op, "style", glyph_style_str(R_GE_glyphFontStyle(font)));
+    page_add_op(&st->page, op);
+    return id;
+}
+
+void jgd_draw_glyphs(jgd_state_t *st, int n, const int *glyphs,
+                     const double *x, const double *y, SEXP font,
+                     double size, int colour, double rot) {
+    if (n <= 0 || R_TRANSPARENT(colour)) return;
+    int id = font_ref(st, font, size);
+    if (id < 0) return;
+    cJSON *op = cJSON_CreateObject();
+    cJSON_AddStringToObject(op, "op", "glyphs");
+    cJSON_AddNumberToObject(op, "font", id);
+    cJSON_AddItemToObject(op, "col", color_to_cjson(colour));
+    cJSON_AddNumberToObject(op, "rot", rot);
+    cJSON_AddItemToObject(op, "glyphs", cJSON_CreateIntArray(glyphs, n));
+    cJSON_AddItemToObject(op, "x", cJSON_CreateDoubleArray(x, n));
+    cJSON_AddItemToObject(op, "y", cJSON_CreateDoubleArray(y, n));
+    page_add_op(&st->page, op);
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef JGD_RESOURCES_H
+#define JGD_RESOURCES_H
+
+#include <R.h>
+#include <Rinternals.h>
+#include <R_ext/GraphicsEngine.h>
+
+/* Page-scoped resources defined once and referenced by id: patterns
+ * (gradients and tiles), clip paths, masks and compositing groups.  Each definition is a
+ * def* op in the page's op stream; later ops refer to it by id, so a
+ * gradient reused across thousands of bars is sent once.  Ids restart
+ * at 1 on every new page, matching R, which releases all resources
+ * when it initialises the display list. */
+typedef enum {
+    JGD_RES_FREE = 0,
+    JGD_RES_PATTERN,
+    JGD_RES_CLIP_PATH,
+    JGD_RES_MASK,
+    JGD_RES_GROUP,
+    JGD_RES_FONT
+} jgd_res_kind_t;
+
+/* A glyph font as referenced by glyph runs: the font file, face index
+ * within it and size.  Defined once per page by a defFont op. */
+typedef struct {
+    int id;
+    char *file;
+    int index;
+    double size;
+} jgd_font_t;
+
+typedef struct {
+    unsigned char *kind;      /* kind[id], JGD_RES_FREE once released */
+    int cap;
+    int next_id;              /* next id to hand out, >= 1 */
+    int mask;                 /* id of the active mask, 0 = none */
+    jgd_font_t *fonts;        /* fonts defined on this page */
+    int nfonts;
+    int fonts_cap;
+} jgd_resources_t;
+
+void jgd_resources_reset(jgd_resources_t *r);
+void jgd_resources_free(jgd_resources_t *r);
+
+/* Forward declaration; device.h includes this header. */
+struct jgd_state;
+
+/* Device callbacks for R >= 4.1 definitions (R_GE_definitions). */
+SEXP jgd_set_pattern(struct jgd_state *st, SEXP pattern);
+void jgd_release_pattern(struct jgd_state *st, SEXP ref);
+SEXP jgd_set_clip_path(struct jgd_state *st, SEXP path, SEXP ref);
+void jgd_release_clip_path(struct jgd_state *st, SEXP ref);
+SEXP jgd_set_mask(struct jgd_state *st, SEXP path, SEXP ref);
+void jgd_release_mask(struct jgd_state *st, SEXP ref);
+
+#if R_GE_version >= 15
+/* Device callbacks for R >= 4.2 groups and paths (R_GE_group). */
+SEXP jgd_define_group(struct jgd_state *st, SEXP source, int op, SEXP destination);
+void jgd_use_group(struct jgd_state *st, SEXP ref, SEXP trans);
+void jgd_release_group(struct jgd_state *st, SEXP ref);
+void jgd_draw_path(struct jgd_state *st, SEXP path, const char *mode, int rule,
+                   const pGEcontext gc);
+SEXP jgd_capabilities(SEXP cap);
+#endif
+
+#if R_GE_version >= 16
+/* Device callback for R >= 4.3 glyph runs (R_GE_glyphs). */
+void jgd_draw_glyphs(struct jgd_state *st, int n, const int *glyphs,
+                     const double *x, const double *y, SEXP font,
+                     double size, int colour, double rot);
+#endif
+
+#endif
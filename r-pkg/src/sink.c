@@ -0,0 +1,215 @@
+#include "sink.h"
+
+#include <R.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+typedef CRITICAL_SECTION jgd_mutex_t;
+typedef CONDITION_VARIABLE jgd_cond_t;
+typedef HANDLE jgd_thread_t;
+#define mutex_init(m) InitializeCriticalSection(m)
+#define mutex_destroy(m) DeleteCriticalSection(m)
+#define mutex_lock(m) EnterCriticalSection(m)
+#define mutex_unlock(m) LeaveCriticalSection(m)
+#define cond_init(c) InitializeConditionVariable(c)
+#define cond_destroy(c) ((void)(c))
+#define cond_wait(c, m) SleepConditionVariableCS(c, m, INFINITE)
+#define cond_signal(c) WakeConditionVariable(c)
+#else
+#include <pthread.h>
+typedef pthread_mutex_t jgd_mutex_t;
+typedef pthread_cond_t jgd_cond_t;
+typedef pthread_t jgd_thread_t;
+#define mutex_init(m) pthread_mutex_init(m, NULL)
+#define mutex_destroy(m) pthread_mutex_destroy(m)
+#define mutex_lock(m) pthread_mutex_lock(m)
+#define mutex_unlock(m) pthread_mutex_unlock(m)
+#define cond_init(c) pthread_cond_init(c, NULL)
+#define cond_destroy(c) pthread_cond_destroy(c)
+#define cond_wait(c, m) pthread_cond_wait(c, m)
+#define cond_signal(c) pthread_cond_signal(c)
+#endif
+
+/* Everything the writer thread touches.  R's thread appends to buf; the
+ * writer swaps it for spare, writes it outside the lock and keeps it as
+ * the next spare, so the two never share a buffer. */
+struct jgd_sink_writer {
+    FILE *f;
+    jgd_mutex_t lock;
+    jgd_cond_t wake;
+    jgd_thread_t thread;
+    char *buf;                /* queued bytes: buf[0, len) */
+    size_t len, cap;
+    char *spare;
+    size_t spare_cap;
+    int stop;                 /* set by jgd_sink_close */
+    int error;                /* set by the writer when a write fails */
+};
+
+int jgd_sink_is_uri(const char *uri) {
+    return uri && strncmp(uri, "file://", 7) == 0;
+}
+
+static void writer_loop(jgd_sink_writer_t *w) {
+    mutex_lock(&w->lock);
+    for (;;) {
+        while (w->len == 0 && !w->stop) cond_wait(&w->wake, &w->lock);
+        if (w->len == 0) break;
+
+        char *out = w->buf;
+        size_t n = w->len, cap = w->cap;
+        w->buf = w->spare;
+        w->cap = w->spare_cap;
+        w->len = 0;
+        w->spare = NULL;
+        w->spare_cap = 0;
+        mutex_unlock(&w->lock);
+
+        int ok = fwrite(out, 1, n, w->f) == n && fflush(w->f) == 0;
+
+        mutex_lock(&w->lock);
+        if (!w->spare) {
+            w->spare = out;
+            w->spare_cap = cap;
+        } else {
+            free(out);
+        }
+        if (!ok) {
+            w->error = 1;
+            break;
+        }
+    }
+    mutex_unlock(&w->lock);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI writer_main(LPVOID arg) {
+    writer_loop((jgd_sink_writer_t *)arg);
+    return 0;
+}
+#else
+static void *writer_main(void *arg) {
+    writer_loop((jgd_sink_writer_t *)arg);
+    return NULL;
+}
+#endif
+
+int jgd_sink_open(jgd_sink_t *s, const char *uri) {
+    memset(s, 0, sizeof(*s));
+    const char *path = uri + 7;
+#ifdef _WIN32
+    /* file:///C:/dir/file -> C:/dir/file */
+    if (path[0] == '/' && path[1] && path[2] == ':') path++;
+#endif
+    if (!path[0] || strlen(path) >= sizeof(s->path)) {
+        errno = EINVAL;
+        return -1;
+    }
+    snprintf(s->path, sizeof(s->path), "%s", path);
+
+    jgd_sink_writer_t *w = (jgd_sink_writer_t *)calloc(1, sizeof(*w));
+    if (!w) return -1;
+    w->f = fopen(s->path, "ab");
+    if (!w->f) {
+        free(w);
+        return -1;
+    }
+    mutex_init(&w->lock);
+    cond_init(&w->wake);
+#ifdef _WIN32
+    w->thread = CreateThread(NULL, 0, writer_main, w, 0, NULL);
+    int started = w->thread != NULL;
+#else
+    int started = pthread_create(&w->thread, NULL, writer_main, w) == 0;
+#endif
+    if (!started) {
+        cond_destroy(&w->wake);
+        mutex_destroy(&w->lock);
+        fclose(w->f);
+        free(w);
+        errno = EAGAIN;
+        return -1;
+    }
+    s->w = w;
+    return 0;
+}
+
+static void sink_fail(jgd_sink_t *s, const char *why) {
+    REprintf("jgd: archive '%s' %s; no further frames will be written to it\n",
+             s->path, why);
+    s->failed = 1;
+}
+
+void jgd_sink_enqueue(jgd_sink_t *s, const char *data, size_t len) {
+    jgd_sink_writer_t *w = s->w;
+    if (!w || s->failed) return;
+    mutex_lock(&w->lock);
+    size_t need = w->len + len + 1;
+    if (w->error || need > JGD_SINK_HIGH_WATER) {
+        mutex_unlock(&w->lock);
+        s->dropped++;
+        return;
+    }
+    if (need > w->cap) {
+        size_t cap = w->cap ? w->cap : 4096;
+        while (cap < need) cap *= 2;
+        char *buf = (char *)realloc(w->buf, cap);
+        if (!buf) {
+            mutex_unlock(&w->lock);
+            s->dropped++;
+            return;
+        }
+        w->buf = buf;
+        w->cap = cap;
+    }
+    memcpy(w->buf + w->len, data, len);
+    w->buf[w->len + len] = '\n';
+    w->len += len + 1;
+    cond_signal(&w->wake);
+    mutex_unlock(&w->lock);
+}
+
+void jgd_sink_poll(jgd_sink_t *s) {
+    jgd_sink_writer_t *w = s->w;
+    if (!w || s->failed) return;
+    mutex_lock(&w->lock);
+    int error = w->error;
+    mutex_unlock(&w->lock);
+    if (error) {
+        sink_fail(s, "could not be written");
+        return;
+    }
+    if (s->dropped > 0) {
+        REprintf("jgd: archive '%s' fell behind; %lu frame(s) not written\n",
+                 s->path, (unsigned long)s->dropped);
+        s->dropped = 0;
+    }
+}
+
+void jgd_sink_close(jgd_sink_t *s) {
+    jgd_sink_writer_t *w = s->w;
+    if (!w) return;
+    mutex_lock(&w->lock);
+    w->stop = 1;
+    cond_signal(&w->wake);
+    mutex_unlock(&w->lock);
+#ifdef _WIN32
+    WaitForSingleObject(w->thread, INFINITE);
+    CloseHandle(w->thread);
+#else
+    pthread_join(w->thread, NULL);
+#endif
+    jgd_sink_poll(s);
+    fclose(w->f);
+    cond_destroy(&w->wake);
+    mutex_destroy(&w->lock);
+    free(w->buf);
+    free(w->spare);
+    free(w);
+    s->w = NULL;
+}
@@ -0,0 +1,44 @@
+#ifndef JGD_SINK_H
+#define JGD_SINK_H
+
+#include <stddef.h>
+
+/* Archive sinks: `socket = c("unix:///...", "file:///path/archive.jsonl")`
+ * tees every frame sent to the live server into a file as well.  Frames
+ * are copied into a per-sink queue when they are sent and written out by
+ * a writer thread, so neither a slow disk nor fflush ever blocks R.
+ * While the queue holds JGD_SINK_HIGH_WATER bytes, further frames are
+ * dropped from the archive (and counted in a warning).  A sink that
+ * fails to write is abandoned with a warning; the live connection is
+ * unaffected. */
+#define JGD_MAX_SINKS 4
+#define JGD_SINK_HIGH_WATER ((size_t)64 * 1024 * 1024)
+
+typedef struct jgd_sink_writer jgd_sink_writer_t;
+
+typedef struct {
+    char path[512];
+    jgd_sink_writer_t *w;     /* file, queue and writer thread; NULL if closed */
+    size_t dropped;           /* frames dropped since the last warning */
+    int failed;
+} jgd_sink_t;
+
+/* 1 if uri names an archive sink (file://...). */
+int jgd_sink_is_uri(const char *uri);
+
+/* Open the file named by a file:// URI for appending and start its
+ * writer thread.  Returns 0 on success, -1 (with errno set) otherwise. */
+int jgd_sink_open(jgd_sink_t *s, const char *uri);
+
+/* Queue one line (a newline is appended) for the writer thread. */
+void jgd_sink_enqueue(jgd_sink_t *s, const char *data, size_t len);
+
+/* Report dropped frames and write errors.  R's warning functions are not
+ * thread-safe, so the writer thread only records them; this runs from
+ * the device's idle tick on R's main thread. */
+void jgd_sink_poll(jgd_sink_t *s);
+
+/* Let the writer thread write whatever is queued, then close the file. */
+void jgd_sink_close(jgd_sink_t *s);
+
+#endif
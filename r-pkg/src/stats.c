@@ -0,0 +1,117 @@
+#include "stats.h"
+#include "device.h"
+#include "callbacks.h"
+
+#include <R_ext/GraphicsEngine.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+static const char *jgd_op_type_names[JGD_OP_NTYPES] = {
+    "clip", "line", "polyline", "polygon", "rect",
+    "circle", "text", "path", "raster", "group"
+};
+
+double jgd_stats_now_ms(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER freq = {0};
+    LARGE_INTEGER counter;
+    if (freq.QuadPart == 0 && !QueryPerformanceFrequency(&freq))
+        return (double)GetTickCount();
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart * 1000.0 / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+#endif
+}
+
+double jgd_wall_ms(void) {
+#ifdef _WIN32
+    FILETIME ft;
+    ULARGE_INTEGER t;
+    GetSystemTimeAsFileTime(&ft);
+    t.LowPart = ft.dwLowDateTime;
+    t.HighPart = ft.dwHighDateTime;
+    /* 100 ns ticks since 1601-01-01 -> ms since 1970-01-01 */
+    return (double)(t.QuadPart - 116444736000000000ULL) / 10000.0;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+#endif
+}
+
+void jgd_stats_reset(jgd_stats_t *s) {
+    memset(s, 0, sizeof(*s));
+}
+
+SEXP jgd_stats_to_list(const jgd_stats_t *s) {
+    static const char *names[] = {
+        "ops", "frames_complete", "frames_incremental", "frames_replay",
+        "frames_paced", "flushes_coalesced",
+        "bytes_serialized", "bytes_sent",
+        "serialize_ms", "send_ms", "recv_wait_ms",
+        "metrics_hits", "metrics_misses", "metrics_timeouts",
+        "snapshots", "snapshot_ms", "replays", "replay_ms",
+        "replays_forked", "prerenders", "prerender_hits", "ops_released",
+        "raster_patches"
+    };
+    const double scalars[] = {
+        s->frames_complete, s->frames_incremental, s->frames_replay,
+        s->frames_paced, s->flushes_coalesced,
+        s->bytes_serialized, s->bytes_sent,
+        s->serialize_ms, s->send_ms, s->recv_wait_ms,
+        s->metrics_hits, s->metrics_misses, s->metrics_timeouts,
+        s->snapshots, s->snapshot_ms, s->replays, s->replay_ms,
+        s->replays_forked, s->prerenders, s->prerender_hits, s->ops_released,
+        s->raster_patches
+    };
+    int n = (int)(sizeof(names) / sizeof(names[0]));
+
+    SEXP out = PROTECT(Rf_allocVector(VECSXP, n));
+    SEXP nms = PROTECT(Rf_allocVector(STRSXP, n));
+
+    SEXP ops = PROTECT(Rf_allocVector(REALSXP, JGD_OP_NTYPES));
+    SEXP ops_nms = PROTECT(Rf_allocVector(STRSXP, JGD_OP_NTYPES));
+    for (int i = 0; i < JGD_OP_NTYPES; i++) {
+        REAL(ops)[i] = s->ops[i];
+        SET_STRING_ELT(ops_nms, i, Rf_mkChar(jgd_op_type_names[i]));
+    }
+    Rf_setAttrib(ops, R_NamesSymbol, ops_nms);
+    SET_VECTOR_ELT(out, 0, ops);
+    UNPROTECT(2);
+
+    for (int i = 0; i < n; i++) {
+        SET_STRING_ELT(nms, i, Rf_mkChar(names[i]));
+        if (i > 0)
+            SET_VECTOR_ELT(out, i, Rf_ScalarReal(scalars[i - 1]));
+    }
+    Rf_setAttrib(out, R_NamesSymbol, nms);
+    UNPROTECT(2);
+    return out;
+}
+
+/* Called from R: .Call(C_jgd_stats, reset) */
+SEXP C_jgd_stats(SEXP s_reset) {
+    pGEDevDesc gdd = GEcurrentDevice();
+    if (!gdd || !gdd->dev) Rf_error("no active graphics device");
+
+    pDevDesc dd = gdd->dev;
+    if (!jgd_is_jgd_device(dd)) Rf_error("current device is not a jgd device");
+
+    jgd_state_t *st = (jgd_state_t *)dd->deviceSpecific;
+    if (!st) Rf_error("jgd device state is NULL");
+
+    SEXP out = PROTECT(jgd_stats_to_list(&st->stats));
+    if (Rf_asLogical(s_reset) == TRUE)
+        jgd_stats_reset(&st->stats);
+    UNPROTECT(1);
+    return out;
+}
@@ -0,0 +1,67 @@
+#ifndef JGD_STATS_H
+#define JGD_STATS_H
+
+#include <R.h>
+#include <Rinternals.h>
+
+/* Op categories counted by jgd_stats().  Order must match
+ * jgd_op_type_names in stats.c. */
+typedef enum {
+    JGD_OP_CLIP = 0,
+    JGD_OP_LINE,
+    JGD_OP_POLYLINE,
+    JGD_OP_POLYGON,
+    JGD_OP_RECT,
+    JGD_OP_CIRCLE,
+    JGD_OP_TEXT,
+    JGD_OP_PATH,
+    JGD_OP_RASTER,
+    JGD_OP_GROUP,             /* beginGroup + endGroup */
+    JGD_OP_NTYPES
+} jgd_op_type_t;
+
+/* Cumulative counters and timers kept on jgd_state_t.  Everything is a
+ * double so byte counts and long-running sessions cannot overflow, and
+ * so the R side can return them without conversion.  Timers are in
+ * milliseconds from jgd_stats_now_ms(). */
+typedef struct {
+    double ops[JGD_OP_NTYPES];
+    double frames_complete;
+    double frames_incremental;
+    double frames_replay;     /* resize replays (subset of complete frames) */
+    double frames_paced;      /* flushes held back by max_fps pacing */
+    double flushes_coalesced; /* unheld flushes deferred by jgd.coalesce */
+    double bytes_serialized;  /* frame JSON produced by page_serialize_frame */
+    double bytes_sent;        /* sends the transport accepted */
+    double serialize_ms;
+    double send_ms;
+    double recv_wait_ms;      /* blocked in transport_recv_line for metrics */
+    double metrics_hits;      /* served from the metrics cache */
+    double metrics_misses;    /* round-trips to the renderer */
+    double metrics_timeouts;  /* round-trips that fell back to approximations */
+    double snapshots;
+    double snapshot_ms;
+    double replays;           /* display list / snapshot replays */
+    double replay_ms;
+    double replays_forked;    /* historical replays run in forked children */
+    double prerenders;        /* frames prerendered at a likely size while idle */
+    double prerender_hits;    /* resizes answered with a prerendered frame */
+    double ops_released;      /* flushed ops dropped in streaming mode */
+    double raster_patches;    /* rasters sent as changed tiles */
+} jgd_stats_t;
+
+/* Monotonic clock in fractional milliseconds, for interval timing only. */
+double jgd_stats_now_ms(void);
+
+/* Wall clock in fractional milliseconds since the Unix epoch.  Used for
+ * frame timing stamps that are compared across processes (R, hub,
+ * browser) on the same machine, where a per-process monotonic clock
+ * has no shared origin. */
+double jgd_wall_ms(void);
+
+void jgd_stats_reset(jgd_stats_t *s);
+
+/* Build the named list returned by jgd_stats(). */
+SEXP jgd_stats_to_list(const jgd_stats_t *s);
+
+#endif
@@ -0,0 +1,1008 @@
+#include "svg.h"
+#include "device.h"
+#include "callbacks.h"
+#include "cJSON.h"
+
+#include <R.h>
+#include <Rinternals.h>
+#include <R_ext/GraphicsEngine.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Native SVG export of a page's op list.  The output mirrors the
+ * browser renderer's semantics (see plotToSvg and renderOps in
+ * server/web_assets.ts), but is written straight from the cJSON ops the
+ * device already holds, so batch exports never touch the transport.
+ *
+ * Shape styles go through CSS classes: a first pass interns the style
+ * declaration of every gc into a class table and emits one rule per
+ * distinct style, the second pass writes elements that reference them
+ * by class.  Element output is streamed through a fixed-size buffer. */
+
+/* ---- Buffered writer ---- */
+
+#define SVG_BUF_SIZE 65536
+
+typedef struct {
+    FILE *fp;
+    size_t len;
+    int err;
+    char buf[SVG_BUF_SIZE];
+} svg_writer_t;
+
+static void sw_flush(svg_writer_t *w) {
+    if (w->len > 0 && !w->err && fwrite(w->buf, 1, w->len, w->fp) != w->len)
+        w->err = 1;
+    w->len = 0;
+}
+
+static void sw_write(svg_writer_t *w, const char *s, size_t n) {
+    if (n > SVG_BUF_SIZE - w->len) {
+        sw_flush(w);
+        if (n > SVG_BUF_SIZE) {
+            /* Raster data URIs can exceed the buffer; write them through. */
+            if (!w->err && fwrite(s, 1, n, w->fp) != n)
+                w->err = 1;
+            return;
+        }
+    }
+    memcpy(w->buf + w->len, s, n);
+    w->len += n;
+}
+
+static void sw_puts(svg_writer_t *w, const char *s) {
+    sw_write(w, s, strlen(s));
+}
+
+/* Only for short, bounded output (ids, numbers, fixed attribute names). */
+static void sw_printf(svg_writer_t *w, const char *fmt, ...) {
+    char tmp[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(tmp, sizeof(tmp), fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    if ((size_t)n >= sizeof(tmp)) n = (int)sizeof(tmp) - 1;
+    sw_write(w, tmp, (size_t)n);
+}
+
+/* Device coordinates are pixels: three decimals is far below anything
+ * visible, and trimming trailing zeros keeps integer coordinates short. */
+static int fmt_num(char *out, double v) {
+    if (!isfinite(v)) v = 0;
+    if (v > 1e9) v = 1e9;
+    if (v < -1e9) v = -1e9;
+    int n = snprintf(out, 32, "%.3f", v);
+    while (n > 0 && out[n - 1] == '0') n--;
+    if (n > 0 && out[n - 1] == '.') n--;
+    if (n == 2 && out[0] == '-' && out[1] == '0') {
+        out[0] = '0';
+        n = 1;
+    }
+    out[n] = '\0';
+    return n;
+}
+
+static void sw_num(svg_writer_t *w, double v) {
+    char b[32];
+    sw_write(w, b, (size_t)fmt_num(b, v));
+}
+
+/* XML-escape a UTF-8 string.  Control characters other than tab and
+ * newline are not allowed in XML 1.0 and are dropped. */
+static void sw_esc(svg_writer_t *w, const char *s) {
+    const char *run = s;
+    for (; *s; s++) {
+        const char *rep;
+        unsigned char ch = (unsigned char)*s;
+        switch (ch) {
+            case '&': rep = "&amp;"; break;
+            case '<': rep = "&lt;"; break;
+            case '>': rep = "&gt;"; break;
+            case '"': rep = "&quot;"; break;
+            default:  rep = (ch < 0x20 && ch != '\t' && ch != '\n') ? "" : NULL;
+        }
+        if (rep) {
+            sw_write(w, run, (size_t)(s - run));
+            sw_puts(w, rep);
+            run = s + 1;
+        }
+    }
+    sw_write(w, run, (size_t)(s - run));
+}
+
+/* ---- Style table ---- */
+
+typedef struct {
+    char s[512];
+    int n;
+} svg_sbuf_t;
+
+static void sb_add(svg_sbuf_t *b, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(b->s + b->n, sizeof(b->s) - (size_t)b->n, fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    b->n += n;
+    if (b->n >= (int)sizeof(b->s)) b->n = (int)sizeof(b->s) - 1;
+}
+
+/* Distinct style declarations, indexed by class number.  slots is an
+ * open-addressing table of class number + 1 (0 = empty). */
+typedef struct {
+    char **keys;
+    int n;
+    int cap;
+    int *slots;
+    int nslots;
+} svg_styles_t;
+
+static unsigned int str_hash(const char *s) {
+    unsigned int h = 2166136261u;
+    for (; *s; s++) h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
+
+static int styles_grow(svg_styles_t *t) {
+    int nslots = t->nslots ? t->nslots * 2 : 64;
+    int *slots = (int *)calloc((size_t)nslots, sizeof(int));
+    if (!slots) return -1;
+    for (int i = 0; i < t->n; i++) {
+        unsigned int j = str_hash(t->keys[i]) & (unsigned int)(nslots - 1);
+        while (slots[j]) j = (j + 1) & (unsigned int)(nslots - 1);
+        slots[j] = i + 1;
+    }
+    free(t->slots);
+    t->slots = slots;
+    t->nslots = nslots;
+    return 0;
+}
+
+/* Class number for a style declaration, adding it if new; -1 on OOM. */
+static int styles_intern(svg_styles_t *t, const char *key) {
+    if ((t->n + 1) * 2 > t->nslots && styles_grow(t) != 0)
+        return -1;
+    unsigned int mask = (unsigned int)(t->nslots - 1);
+    unsigned int j = str_hash(key) & mask;
+    for (; t->slots[j]; j = (j + 1) & mask) {
+        if (strcmp(t->keys[t->slots[j] - 1], key) == 0)
+            return t->slots[j] - 1;
+    }
+    if (t->n == t->cap) {
+        int cap = t->cap ? t->cap * 2 : 32;
+        char **keys = (char **)realloc(t->keys, (size_t)cap * sizeof(char *));
+        if (!keys) return -1;
+        t->keys = keys;
+        t->cap = cap;
+    }
+    char *copy = strdup(key);
+    if (!copy) return -1;
+    t->keys[t->n] = copy;
+    t->slots[j] = ++t->n;
+    return t->n - 1;
+}
+
+static void styles_free(svg_styles_t *t) {
+    for (int i = 0; i < t->n; i++) free(t->keys[i]);
+    free(t->keys);
+    free(t->slots);
+}
+
+/* Page resource id -> SVG element serial.  Ids are reused after a
+ * release, so each definition gets a fresh serial. */
+typedef struct {
+    int *v;
+    int n;
+} svg_idmap_t;
+
+static void idmap_set(svg_idmap_t *m, int id, int serial) {
+    if (id < 0) return;
+    if (id >= m->n) {
+        int n = id * 2 + 8;
+        int *v = (int *)realloc(m->v, (size_t)n * sizeof(int));
+        if (!v) return;
+        memset(v + m->n, 0, (size_t)(n - m->n) * sizeof(int));
+        m->v = v;
+        m->n = n;
+    }
+    m->v[id] = serial;
+}
+
+static int idmap_get(const svg_idmap_t *m, const cJSON *id) {
+    if (!cJSON_IsNumber(id)) return 0;
+    int i = id->valueint;
+    return (i >= 0 && i < m->n) ? m->v[i] : 0;
+}
+
+/* ---- Writer context ---- */
+
+enum { SVG_STROKE = 1, SVG_FILL = 2, SVG_TEXT = 4 };
+enum { EL_CLIP = 1, EL_MASK, EL_GROUP };
+
+typedef struct {
+    svg_writer_t w;
+    svg_styles_t styles;
+    svg_idmap_t patterns, clips, masks, groups;
+    int serial;         /* last id suffix handed out */
+    char *els;          /* open <g> elements, innermost last */
+    int nels;
+    int els_cap;
+    int base;           /* first element owned by the op list being written */
+    int mask;           /* serial of the active mask, 0 = none */
+    int in_clip;        /* writing the children of a <clipPath> */
+    double width;
+    double height;
+} svg_ctx_t;
+
+static double num(const cJSON *o, const char *key) {
+    const cJSON *v = cJSON_GetObjectItemCaseSensitive(o, key);
+    return cJSON_IsNumber(v) ? v->valuedouble : 0;
+}
+
+static const char *str(const cJSON *o, const char *key) {
+    const cJSON *v = cJSON_GetObjectItemCaseSensitive(o, key);
+    return cJSON_IsString(v) ? v->valuestring : NULL;
+}
+
+/* Colours arrive as "rgba(r,g,b,a)" strings from color_to_cjson, or
+ * null for transparent.  Returns 0 if there is nothing to paint. */
+static int parse_colour(const cJSON *c, char hex[8], double *alpha) {
+    int r, g, b;
+    double a = 1;
+    if (!cJSON_IsString(c) ||
+        sscanf(c->valuestring, "rgba(%d,%d,%d,%lf)", &r, &g, &b, &a) < 3)
+        return 0;
+    snprintf(hex, 8, "#%02x%02x%02x", r & 255, g & 255, b & 255);
+    *alpha = a;
+    return 1;
+}
+
+/* Returns 0 if the paint is none. */
+static int style_paint(svg_sbuf_t *b, const char *prop, const cJSON *col) {
+    char hex[8], an[32];
+    double a;
+    if (!parse_colour(col, hex, &a) || a <= 0) {
+        sb_add(b, "%s:none;", prop);
+        return 0;
+    }
+    sb_add(b, "%s:%s;", prop, hex);
+    if (a < 1) {
+        fmt_num(an, a);
+        sb_add(b, "%s-opacity:%s;", prop, an);
+    }
+    return 1;
+}
+
+/* Same mapping as the renderer's mapFontFamily().  Family names are
+ * restricted to a CSS-safe character set. */
+static void style_font_family(svg_sbuf_t *b, const char *family) {
+    if (!family || !family[0] || strcmp(family, "sans") == 0) {
+        sb_add(b, "font-family:sans-serif;");
+    } else if (strcmp(family, "serif") == 0 || strcmp(family, "Times") == 0) {
+        sb_add(b, "font-family:serif;");
+    } else if (strcmp(family, "mono") == 0 || strcmp(family, "Courier") == 0) {
+        sb_add(b, "font-family:monospace;");
+    } else {
+        char safe[128];
+        int n = 0;
+        for (const char *p = family; *p && n < (int)sizeof(safe) - 1; p++) {
+            unsigned char ch = (unsigned char)*p;
+            if (ch >= 0x80 || ch == ' ' || ch == '-' || ch == '_' || ch == '.' ||
+                (ch >= '0' && ch <= '9') || ((ch | 0x20) >= 'a' && (ch | 0x20) <= 'z'))
+                safe[n++] = (char)ch;
+        }
+        safe[n] = '\0';
+        sb_add(b, "font-family:'%s',sans-serif;", safe);
+    }
+}
+
+static int op_paint(const cJSON *op) {
+    const char *type = str(op, "op");
+    if (!type) return 0;
+    if (strcmp(type, "line") == 0 || strcmp(type, "polyline") == 0)
+        return SVG_STROKE;
+    if (strcmp(type, "rect") == 0 || strcmp(type, "circle") == 0 ||
+        strcmp(type, "polygon") == 0 || strcmp(type, "path") == 0)
+        return SVG_STROKE | SVG_FILL;
+    if (strcmp(type, "text") == 0)
+        return SVG_TEXT;
+    if (strcmp(type, "drawPath") == 0) {
+        const char *mode = str(op, "mode");
+        if (mode && strcmp(mode, "stroke") == 0) return SVG_STROKE;
+        if (mode && strcmp(mode, "fill") == 0) return SVG_FILL;
+        return SVG_STROKE | SVG_FILL;
+    }
+    return 0;
+}
+
+/* CSS declaration for an op's gc.  Pattern fills are left out: they
+ * reference a definition serial and go in an inline style instead. */
+static void gc_style(svg_sbuf_t *b, const cJSON *gc, int paint) {
+    const cJSON *col = cJSON_GetObjectItemCaseSensitive(gc, "col");
+    char tmp[32];
+    b->n = 0;
+    b->s[0] = '\0';
+
+    if (paint & SVG_TEXT) {
+        const cJSON *font = cJSON_GetObjectItemCaseSensitive(gc, "font");
+        double size = num(font, "size");
+        int face = (int)num(font, "face");
+        style_paint(b, "fill", col);
+        style_font_family(b, str(font, "family"));
+        fmt_num(tmp, size > 0 ? size : 12);
+        sb_add(b, "font-size:%spx;", tmp);
+        if (face == 2 || face == 4) sb_add(b, "font-weight:bold;");
+        if (face == 3 || face == 4) sb_add(b, "font-style:italic;");
+        return;
+    }
+
+    if (!(paint & SVG_FILL))
+        sb_add(b, "fill:none;");
+    else if (!cJSON_IsNumber(cJSON_GetObjectItemCaseSensitive(gc, "pattern")))
+        style_paint(b, "fill", cJSON_GetObjectItemCaseSensitive(gc, "fill"));
+
+    if (!(paint & SVG_STROKE))
+        return;
+    if (!style_paint(b, "stroke", col))
+        return;
+    double lwd = num(gc, "lwd");
+    fmt_num(tmp, lwd > 0 ? lwd : 1);
+    sb_add(b, "stroke-width:%s;", tmp);
+    const char *lend = str(gc, "lend");
+    const char *ljoin = str(gc, "ljoin");
+    sb_add(b, "stroke-linecap:%s;", lend ? lend : "round");
+    sb_add(b, "stroke-linejoin:%s;", ljoin ? ljoin : "round");
+    if (ljoin && strcmp(ljoin, "miter") == 0) {
+        fmt_num(tmp, num(gc, "lmitre"));
+        sb_add(b, "stroke-miterlimit:%s;", tmp);
+    }
+    const cJSON *lty = cJSON_GetObjectItemCaseSensitive(gc, "lty");
+    if (cJSON_IsArray(lty) && lty->child) {
+        sb_add(b, "stroke-dasharray:");
+        for (const cJSON *d = lty->child; d; d = d->next) {
+            fmt_num(tmp, cJSON_IsNumber(d) ? d->valuedouble : 0);
+            sb_add(b, d->next ? "%s," : "%s;", tmp);
+        }
+    }
+}
+
+/* Pass 1: intern the style of every op, including those nested in
+ * resource definitions, so the <style> block can precede the shapes. */
+static void collect_styles(svg_ctx_t *c, const cJSON *ops) {
+    static const char *nested[] = { "ops", "src", "dst" };
+    svg_sbuf_t b;
+    for (const cJSON *op = ops ? ops->child : NULL; op; op = op->next) {
+        int paint = op_paint(op);
+        if (paint) {
+            gc_style(&b, cJSON_GetObjectItemCaseSensitive(op, "gc"), paint);
+            styles_intern(&c->styles, b.s);
+        }
+        for (int i = 0; i < 3; i++) {
+            const cJSON *sub = cJSON_GetObjectItemCaseSensitive(op, nested[i]);
+            if (cJSON_IsArray(sub))
+                collect_styles(c, sub);
+        }
+    }
+}
+
+/* class="sN" (or an inline style if interning ran out of memory), plus
+ * an inline fill for pattern references. */
+static void write_paint_attrs(svg_ctx_t *c, const cJSON *op, int paint) {
+    if (c->in_clip) return;
+    const cJSON *gc = cJSON_GetObjectItemCaseSensitive(op, "gc");
+    svg_sbuf_t b;
+    gc_style(&b, gc, paint);
+    int pattern = (paint & SVG_FILL)
+        ? idmap_get(&c->patterns, cJSON_GetObjectItemCaseSensitive(gc, "pattern"))
+        : 0;
+    int cls = styles_intern(&c->styles, b.s);
+    if (cls >= 0)
+        sw_printf(&c->w, " class=\"s%d\"", cls);
+    if (cls < 0 || pattern > 0) {
+        sw_puts(&c->w, " style=\"");
+        if (cls < 0) sw_esc(&c->w, b.s);
+        if (pattern > 0) sw_printf(&c->w, "fill:url(#p%d)", pattern);
+        sw_puts(&c->w, "\"");
+    }
+}
+
+/* ---- Element stack ---- */
+
+static void el_open(svg_ctx_t *c, int kind) {
+    if (c->nels == c->els_cap) {
+        int cap = c->els_cap ? c->els_cap * 2 : 16;
+        char *els = (char *)realloc(c->els, (size_t)cap);
+        if (!els) {
+            /* Keep the document well formed: close what we just opened. */
+            sw_puts(&c->w, "</g>\n");
+            return;
+        }
+        c->els = els;
+        c->els_cap = cap;
+    }
+    c->els[c->nels++] = (char)kind;
+}
+
+static void el_close(svg_ctx_t *c) {
+    c->nels--;
+    sw_puts(&c->w, "</g>\n");
+}
+
+static int el_top(const svg_ctx_t *c) {
+    return c->nels > c->base ? c->els[c->nels - 1] : 0;
+}
+
+static void open_mask(svg_ctx_t *c) {
+    if (c->mask <= 0 || c->in_clip) return;
+    sw_printf(&c->w, "<g mask=\"url(#m%d)\">\n", c->mask);
+    el_open(c, EL_MASK);
+}
+
+/* Close the current clip (and a mask nested in it), stopping at a group
+ * boundary so clips inside groups do not escape. */
+static void close_clip(svg_ctx_t *c) {
+    while (el_top(c) == EL_MASK || el_top(c) == EL_CLIP) {
+        int kind = el_top(c);
+        el_close(c);
+        if (kind == EL_CLIP) break;
+    }
+}
+
+/* ---- Shapes ---- */
+
+static void write_points(svg_writer_t *w, const cJSON *op) {
+    const cJSON *x = cJSON_GetObjectItemCaseSensitive(op, "x");
+    const cJSON *y = cJSON_GetObjectItemCaseSensitive(op, "y");
+    const cJSON *xi = x ? x->child : NULL;
+    const cJSON *yi = y ? y->child : NULL;
+    for (int first = 1; xi && yi; xi = xi->next, yi = yi->next, first = 0) {
+        if (!first) sw_puts(w, " ");
+        sw_num(w, xi->valuedouble);
+        sw_puts(w, ",");
+        sw_num(w, yi->valuedouble);
+    }
+}
+
+static void write_moveto(svg_writer_t *w, char cmd, double x, double y) {
+    char b[2] = { cmd, '\0' };
+    sw_puts(w, b);
+    sw_num(w, x);
+    sw_puts(w, " ");
+    sw_num(w, y);
+}
+
+/* Path data for one op, as the renderer's opsToPath2D builds it.  Open
+ * lines only contribute when the outline is stroked. */
+static void write_path_data(svg_writer_t *w, const cJSON *o, int with_lines) {
+    const char *type = str(o, "op");
+    if (!type) return;
+    if (strcmp(type, "line") == 0) {
+        if (!with_lines) return;
+        write_moveto(w, 'M', num(o, "x1"), num(o, "y1"));
+        write_moveto(w, 'L', num(o, "x2"), num(o, "y2"));
+    } else if (strcmp(type, "polyline") == 0 || strcmp(type, "polygon") == 0) {
+        int closed = type[4] == 'g';
+        if (!closed && !with_lines) return;
+        const cJSON *xi = cJSON_GetObjectItemCaseSensitive(o, "x");
+        const cJSON *yi = cJSON_GetObjectItemCaseSensitive(o, "y");
+        xi = xi ? xi->child : NULL;
+        yi = yi ? yi->child : NULL;
+        if (!xi || !yi) return;
+        for (char cmd = 'M'; xi && yi; xi = xi->next, yi = yi->next, cmd = 'L')
+            write_moveto(w, cmd, xi->valuedouble, yi->valuedouble);
+        if (closed) sw_puts(w, "Z");
+    } else if (strcmp(type, "rect") == 0) {
+        double x0 = fmin(num(o, "x0"), num(o, "x1")), x1 = fmax(num(o, "x0"), num(o, "x1"));
+        double y0 = fmin(num(o, "y0"), num(o, "y1")), y1 = fmax(num(o, "y0"), num(o, "y1"));
+        write_moveto(w, 'M', x0, y0);
+        sw_puts(w, "H"); sw_num(w, x1);
+        sw_puts(w, "V"); sw_num(w, y1);
+        sw_puts(w, "H"); sw_num(w, x0);
+        sw_puts(w, "Z");
+    } else if (strcmp(type, "circle") == 0) {
+        double x = num(o, "x"), y = num(o, "y"), r = num(o, "r");
+        write_moveto(w, 'M', x + r, y);
+        for (int half = 0; half < 2; half++) {
+            sw_puts(w, "A");
+            sw_num(w, r);
+            sw_puts(w, " ");
+            sw_num(w, r);
+            sw_puts(w, " 0 1 0 ");
+            sw_num(w, half ? x + r : x - r);
+            sw_puts(w, " ");
+            sw_num(w, y);
+        }
+        sw_puts(w, "Z");
+    } else if (strcmp(type, "path") == 0) {
+        const cJSON *subs = cJSON_GetObjectItemCaseSensitive(o, "subpaths");
+        for (const cJSON *sub = subs ? subs->child : NULL; sub; sub = sub->next) {
+            char cmd = 'M';
+            for (const cJSON *pt = sub->child; pt; pt = pt->next, cmd = 'L') {
+                if (!pt->child || !pt->child->next) continue;
+                write_moveto(w, cmd, pt->child->valuedouble, pt->child->next->valuedouble);
+            }
+            if (sub->child) sw_puts(w, "Z");
+        }
+    }
+}
+
+static void write_text(svg_ctx_t *c, const cJSON *op) {
+    const cJSON *gc = cJSON_GetObjectItemCaseSensitive(op, "gc");
+    const char *s = str(op, "str");
+    if (!s || !cJSON_IsString(cJSON_GetObjectItemCaseSensitive(gc, "col")))
+        return;
+    double hadj = num(op, "hadj"), rot = num(op, "rot");
+    svg_writer_t *w = &c->w;
+    sw_puts(w, "<text");
+    write_paint_attrs(c, op, SVG_TEXT);
+    sw_puts(w, " transform=\"translate(");
+    sw_num(w, num(op, "x"));
+    sw_puts(w, ",");
+    sw_num(w, num(op, "y"));
+    sw_puts(w, ")");
+    if (rot != 0) {
+        sw_puts(w, " rotate(");
+        sw_num(w, -rot);
+        sw_puts(w, ")");
+    }
+    sw_puts(w, "\"");
+    if (hadj == 0.5) sw_puts(w, " text-anchor=\"middle\"");
+    else if (hadj == 1) sw_puts(w, " text-anchor=\"end\"");
+    sw_puts(w, ">");
+    sw_esc(w, s);
+    sw_puts(w, "</text>\n");
+}
+
+static void write_raster(svg_writer_t *w, const cJSON *op) {
+    static const char prefix[] = "data:image/png;base64,";
+    const char *data = str(op, "data");
+    if (!data || strncmp(data, prefix, sizeof(prefix) - 1) != 0)
+        return;
+    double ww = num(op, "w"), hh = num(op, "h"), rot = num(op, "rot");
+    double aw = fabs(ww), ah = fabs(hh);
+    double dx = ww >= 0 ? num(op, "x") : num(op, "x") + ww;
+    double dy = num(op, "y") - ah;
+    sw_puts(w, "<image x=\"");
+    sw_num(w, dx);
+    sw_puts(w, "\" y=\"");
+    sw_num(w, dy);
+    sw_puts(w, "\" width=\"");
+    sw_num(w, aw);
+    sw_puts(w, "\" height=\"");
+    sw_num(w, ah);
+    sw_puts(w, "\" preserveAspectRatio=\"none\"");
+    if (!cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(op, "interpolate")))
+        sw_puts(w, " image-rendering=\"pixelated\"");
+    if (rot != 0) {
+        sw_puts(w, " transform=\"rotate(");
+        sw_num(w, -rot);
+        sw_puts(w, ",");
+        sw_num(w, dx + aw / 2);
+        sw_puts(w, ",");
+        sw_num(w, dy + ah / 2);
+        sw_puts(w, ")\"");
+    }
+    /* Base64 needs no escaping. */
+    sw_puts(w, " xlink:href=\"");
+    sw_puts(w, data);
+    sw_puts(w, "\"/>\n");
+}
+
+static void write_rect_attrs(svg_writer_t *w, double x0, double y0, double x1, double y1) {
+    sw_puts(w, " x=\"");
+    sw_num(w, fmin(x0, x1));
+    sw_puts(w, "\" y=\"");
+    sw_num(w, fmin(y0, y1));
+    sw_puts(w, "\" width=\"");
+    sw_num(w, fabs(x1 - x0));
+    sw_puts(w, "\" height=\"");
+    sw_num(w, fabs(y1 - y0));
+    sw_puts(w, "\"");
+}
+
+/* ---- Resource definitions ---- */
+
+static void write_ops(svg_ctx_t *c, const cJSON *ops);
+
+static void write_stops(svg_writer_t *w, const cJSON *stops) {
+    for (const cJSON *s = stops ? stops->child : NULL; s; s = s->next) {
+        char hex[8];
+        double a = 1;
+        if (!s->child || !parse_colour(s->child->next, hex, &a)) continue;
+        sw_puts(w, "<stop offset=\"");
+        sw_num(w, cJSON_IsNumber(s->child) ? s->child->valuedouble : 0);
+        sw_printf(w, "\" stop-color=\"%s\"", hex);
+        if (a < 1) {
+            sw_puts(w, " stop-opacity=\"");
+            sw_num(w, a);
+            sw_puts(w, "\"");
+        }
+        sw_puts(w, "/>");
+    }
+}
+
+/* Gradients map to SVG gradients in user space; SVG has no "none"
+ * extend, which pads as it does on canvas.  Tiles become a <pattern>
+ * whose content is shifted so the tile's corner is the origin. */
+static void write_def_pattern(svg_ctx_t *c, const cJSON *op) {
+    svg_writer_t *w = &c->w;
+    const char *type = str(op, "type");
+    const char *extend = str(op, "extend");
+    if (!type) return;
+    int serial = ++c->serial;
+    if (strcmp(type, "linear") == 0 || strcmp(type, "radial") == 0) {
+        int linear = type[0] == 'l';
+        const char *spread = extend && strcmp(extend, "repeat") == 0 ? "repeat"
+                           : extend && strcmp(extend, "reflect") == 0 ? "reflect"
+                           : "pad";
+        sw_printf(w, "<defs><%sGradient id=\"p%d\" gradientUnits=\"userSpaceOnUse\" "
+                     "spreadMethod=\"%s\"", linear ? "linear" : "radial", serial, spread);
+        static const char *lin[] = { "x1", "y1", "x2", "y2" };
+        static const char *rad_in[] = { "cx1", "cy1", "r1", "cx2", "cy2", "r2" };
+        static const char *rad_out[] = { "fx", "fy", "fr", "cx", "cy", "r" };
+        int n = linear ? 4 : 6;
+        for (int i = 0; i < n; i++) {
+            sw_printf(w, " %s=\"", linear ? lin[i] : rad_out[i]);
+            sw_num(w, num(op, linear ? lin[i] : rad_in[i]));
+            sw_puts(w, "\"");
+        }
+        sw_puts(w, ">");
+        write_stops(w, cJSON_GetObjectItemCaseSensitive(op, "stops"));
+        sw_printf(w, "</%sGradient></defs>\n", linear ? "linear" : "radial");
+    } else if (strcmp(type, "tiling") == 0) {
+        double x = num(op, "x"), y = num(op, "y"), tw = num(op, "w"), th = num(op, "h");
+        double left = fmin(x, x + tw), top = fmin(y, y + th);
+        sw_printf(w, "<defs><pattern id=\"p%d\" patternUnits=\"userSpaceOnUse\"", serial);
+        write_rect_attrs(w, left, top, left + fabs(tw), top + fabs(th));
+        sw_puts(w, "><g transform=\"translate(");
+        sw_num(w, -left);
+        sw_puts(w, ",");
+        sw_num(w, -top);
+        sw_puts(w, ")\">\n");
+        write_ops(c, cJSON_GetObjectItemCaseSensitive(op, "ops"));
+        sw_puts(w, "</g></pattern></defs>\n");
+    } else {
+        return;
+    }
+    idmap_set(&c->patterns, (int)num(op, "id"), serial);
+}
+
+static void write_def_clip_path(svg_ctx_t *c, const cJSON *op) {
+    svg_writer_t *w = &c->w;
+    int serial = ++c->serial;
+    const char *rule = str(op, "rule");
+    sw_printf(w, "<defs><clipPath id=\"cp%d\"%s>\n", serial,
+              rule && strcmp(rule, "evenodd") == 0 ? " clip-rule=\"evenodd\"" : "");
+    int in_clip = c->in_clip;
+    c->in_clip = 1;
+    write_ops(c, cJSON_GetObjectItemCaseSensitive(op, "ops"));
+    c->in_clip = in_clip;
+    sw_puts(w, "</clipPath></defs>\n");
+    idmap_set(&c->clips, (int)num(op, "id"), serial);
+}
+
+/* Masks cover the whole page; the default mask region (the bounding box
+ * plus 10%) would otherwise crop large content. */
+static void write_def_mask(svg_ctx_t *c, const cJSON *op) {
+    svg_writer_t *w = &c->w;
+    int serial = ++c->serial;
+    const char *type = str(op, "type");
+    sw_printf(w, "<defs><mask id=\"m%d\" maskUnits=\"userSpaceOnUse\"%s", serial,
+              type && strcmp(type, "luminance") == 0 ? "" : " mask-type=\"alpha\"");
+    write_rect_attrs(w, 0, 0, c->width, c->height);
+    sw_puts(w, ">\n");
+    write_ops(c, cJSON_GetObjectItemCaseSensitive(op, "ops"));
+    sw_puts(w, "</mask></defs>\n");
+    idmap_set(&c->masks, (int)num(op, "id"), serial);
+}
+
+/* CSS blend modes for R's blending operators.  Porter-Duff operators
+ * other than source/dest/clear have no SVG equivalent and draw "over". */
+static const char *blend_mode(const char *composite) {
+    static const char *modes[][2] = {
+        { "multiply", "multiply" }, { "screen", "screen" },
+        { "overlay", "overlay" }, { "darken", "darken" },
+        { "lighten", "lighten" }, { "color.dodge", "color-dodge" },
+        { "color.burn", "color-burn" }, { "hard.light", "hard-light" },
+        { "soft.light", "soft-light" }, { "difference", "difference" },
+        { "exclusion", "exclusion" }
+    };
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++)
+        if (strcmp(composite, modes[i][0]) == 0) return modes[i][1];
+    return NULL;
+}
+
+static void write_def_group(svg_ctx_t *c, const cJSON *op) {
+    svg_writer_t *w = &c->w;
+    int serial = ++c->serial;
+    const char *composite = str(op, "composite");
+    if (!composite) composite = "over";
+    sw_printf(w, "<defs><g id=\"gr%d\">\n", serial);
+    if (strcmp(composite, "clear") != 0) {
+        if (strcmp(composite, "source") != 0)
+            write_ops(c, cJSON_GetObjectItemCaseSensitive(op, "dst"));
+        if (strcmp(composite, "dest") != 0) {
+            const char *mode = blend_mode(composite);
+            if (mode) sw_printf(w, "<g style=\"mix-blend-mode:%s\">\n", mode);
+            write_ops(c, cJSON_GetObjectItemCaseSensitive(op, "src"));
+            if (mode) sw_puts(w, "</g>\n");
+        }
+    }
+    sw_puts(w, "</g></defs>\n");
+    idmap_set(&c->groups, (int)num(op, "id"), serial);
+}
+
+static void write_use_group(svg_ctx_t *c, const cJSON *op) {
+    svg_writer_t *w = &c->w;
+    int serial = idmap_get(&c->groups, cJSON_GetObjectItemCaseSensitive(op, "id"));
+    if (serial <= 0) return;
+    sw_printf(w, "<use xlink:href=\"#gr%d\"", serial);
+    const cJSON *t = cJSON_GetObjectItemCaseSensitive(op, "transform");
+    if (cJSON_GetArraySize(t) == 6) {
+        sw_puts(w, " transform=\"matrix(");
+        for (const cJSON *v = t->child; v; v = v->next) {
+            sw_num(w, v->valuedouble);
+            if (v->next) sw_puts(w, ",");
+        }
+        sw_puts(w, ")\"");
+    }
+    sw_puts(w, "/>\n");
+}
+
+/* ---- Op list ---- */
+
+static void write_op(svg_ctx_t *c, const cJSON *op) {
+    svg_writer_t *w = &c->w;
+    const char *type = str(op, "op");
+    if (!type) return;
+
+    /* Clip path children are geometry only. */
+    if (c->in_clip && strcmp(type, "rect") != 0 && strcmp(type, "circle") != 0 &&
+        strcmp(type, "polygon") != 0 && strcmp(type, "path") != 0 &&
+        strcmp(type, "drawPath") != 0)
+        return;
+
+    if (strcmp(type, "line") == 0) {
+        sw_puts(w, "<line");
+        write_paint_attrs(c, op, SVG_STROKE);
+        sw_puts(w, " x1=\""); sw_num(w, num(op, "x1"));
+        sw_puts(w, "\" y1=\""); sw_num(w, num(op, "y1"));
+        sw_puts(w, "\" x2=\""); sw_num(w, num(op, "x2"));
+        sw_puts(w, "\" y2=\""); sw_num(w, num(op, "y2"));
+        sw_puts(w, "\"/>\n");
+    } else if (strcmp(type, "polyline") == 0 || strcmp(type, "polygon") == 0) {
+        int closed = type[4] == 'g';
+        if (!closed && cJSON_GetArraySize(cJSON_GetObjectItemCaseSensitive(op, "x")) < 2)
+            return;
+        sw_puts(w, closed ? "<polygon" : "<polyline");
+        write_paint_attrs(c, op, closed ? SVG_STROKE | SVG_FILL : SVG_STROKE);
+        sw_puts(w, " points=\"");
+        write_points(w, op);
+        sw_puts(w, "\"/>\n");
+    } else if (strcmp(type, "rect") == 0) {
+        sw_puts(w, "<rect");
+        write_paint_attrs(c, op, SVG_STROKE | SVG_FILL);
+        write_rect_attrs(w, num(op, "x0"), num(op, "y0"), num(op, "x1"), num(op, "y1"));
+        sw_puts(w, "/>\n");
+    } else if (strcmp(type, "circle") == 0) {
+        sw_puts(w, "<circle");
+        write_paint_attrs(c, op, SVG_STROKE | SVG_FILL);
+        sw_puts(w, " cx=\""); sw_num(w, num(op, "x"));
+        sw_puts(w, "\" cy=\""); sw_num(w, num(op, "y"));
+        sw_puts(w, "\" r=\""); sw_num(w, num(op, "r"));
+        sw_puts(w, "\"/>\n");
+    } else if (strcmp(type, "path") == 0 || strcmp(type, "drawPath") == 0) {
+        int draw = type[0] == 'd';
+        int paint = op_paint(op);
+        const char *rule = str(op, draw ? "rule" : "winding");
+        sw_puts(w, "<path");
+        write_paint_attrs(c, op, paint);
+        if (rule && strcmp(rule, "evenodd") == 0)
+            sw_puts(w, c->in_clip ? " clip-rule=\"evenodd\"" : " fill-rule=\"evenodd\"");
+        sw_puts(w, " d=\"");
+        if (draw) {
+            const cJSON *sub = cJSON_GetObjectItemCaseSensitive(op, "ops");
+            for (sub = sub ? sub->child : NULL; sub; sub = sub->next)
+                write_path_data(w, sub, !c->in_clip && (paint & SVG_STROKE));
+        } else {
+            write_path_data(w, op, 0);
+        }
+        sw_puts(w, "\"/>\n");
+    } else if (strcmp(type, "text") == 0) {
+        write_text(c, op);
+    } else if (strcmp(type, "raster") == 0) {
+        write_raster(w, op);
+    } else if (strcmp(type, "clip") == 0) {
+        close_clip(c);
+        double x0 = fmin(num(op, "x0"), num(op, "x1")), x1 = fmax(num(op, "x0"), num(op, "x1"));
+        double y0 = fmin(num(op, "y0"), num(op, "y1")), y1 = fmax(num(op, "y0"), num(op, "y1"));
+        /* R resets the clip to the whole device at every new plot
+         * region; that needs no clipping element. */
+        if (!(x0 <= 0 && y0 <= 0 && x1 >= c->width && y1 >= c->height)) {
+            int serial = ++c->serial;
+            sw_printf(w, "<defs><clipPath id=\"c%d\"><rect", serial);
+            write_rect_attrs(w, x0, y0, x1, y1);
+            sw_printf(w, "/></clipPath></defs>\n<g clip-path=\"url(#c%d)\">\n", serial);
+            el_open(c, EL_CLIP);
+        }
+        open_mask(c);
+    } else if (strcmp(type, "clipPath") == 0) {
+        close_clip(c);
+        int serial = idmap_get(&c->clips, cJSON_GetObjectItemCaseSensitive(op, "id"));
+        if (serial > 0) {
+            sw_printf(w, "<g clip-path=\"url(#cp%d)\">\n", serial);
+            el_open(c, EL_CLIP);
+        }
+        open_mask(c);
+    } else if (strcmp(type, "mask") == 0) {
+        if (el_top(c) == EL_MASK) el_close(c);
+        c->mask = idmap_get(&c->masks, cJSON_GetObjectItemCaseSensitive(op, "id"));
+        open_mask(c);
+    } else if (strcmp(type, "defPattern") == 0) {
+        write_def_pattern(c, op);
+    } else if (strcmp(type, "defClipPath") == 0) {
+        write_def_clip_path(c, op);
+    } else if (strcmp(type, "defMask") == 0) {
+        write_def_mask(c, op);
+    } else if (strcmp(type, "defGroup") == 0) {
+        write_def_group(c, op);
+    } else if (strcmp(type, "useGroup") == 0) {
+        write_use_group(c, op);
+    } else if (strcmp(type, "beginGroup") == 0) {
+        const cJSON *ext = cJSON_GetObjectItemCaseSensitive(op, "ext");
+        const cJSON *opacity = cJSON_GetObjectItemCaseSensitive(ext, "opacity");
+        sw_puts(w, "<g");
+        if (cJSON_IsNumber(opacity)) {
+            sw_puts(w, " opacity=\"");
+            sw_num(w, fmax(0, fmin(1, opacity->valuedouble)));
+            sw_puts(w, "\"");
+        }
+        sw_puts(w, ">\n");
+        el_open(c, EL_GROUP);
+    } else if (strcmp(type, "endGroup") == 0) {
+        /* Close clips and masks opened within the group, then the group. */
+        while (el_top(c) == EL_CLIP || el_top(c) == EL_MASK)
+            el_close(c);
+        if (el_top(c) == EL_GROUP)
+            el_close(c);
+    }
+    /* release, defFont and glyphs have no SVG output: definitions are
+     * emitted where they occur, and glyph runs need the font outlines. */
+}
+
+/* Write an op list, closing any elements it opens.  Nested lists
+ * (pattern tiles, masks, groups) start unclipped and unmasked. */
+static void write_ops(svg_ctx_t *c, const cJSON *ops) {
+    int base = c->base, mask = c->mask;
+    c->base = c->nels;
+    c->mask = 0;
+    for (const cJSON *op = ops ? ops->child : NULL; op; op = op->next)
+        write_op(c, op);
+    while (c->nels > c->base)
+        el_close(c);
+    c->base = base;
+    c->mask = mask;
+}
+
+int jgd_svg_write_page(const jgd_page_t *page, FILE *fp) {
+    svg_ctx_t *c = (svg_ctx_t *)calloc(1, sizeof(svg_ctx_t));
+    if (!c) return -1;
+    svg_writer_t *w = &c->w;
+    w->fp = fp;
+    c->width = page->width;
+    c->height = page->height;
+
+    collect_styles(c, page->ops);
+
+    sw_puts(w, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+               "<svg xmlns=\"http://www.w3.org/2000/svg\" "
+               "xmlns:xlink=\"http://www.w3.org/1999/xlink\" width=\"");
+    sw_num(w, page->width);
+    sw_puts(w, "\" height=\"");
+    sw_num(w, page->height);
+    sw_puts(w, "\" viewBox=\"0 0 ");
+    sw_num(w, page->width);
+    sw_puts(w, " ");
+    sw_num(w, page->height);
+    sw_puts(w, "\">\n<style>\ntext{white-space:pre}\n");
+    for (int i = 0; i < c->styles.n; i++) {
+        sw_printf(w, ".s%d{", i);
+        sw_esc(w, c->styles.keys[i]);
+        sw_puts(w, "}\n");
+    }
+    sw_puts(w, "</style>\n");
+
+    if (!R_TRANSPARENT(page->bg)) {
+        sw_puts(w, "<rect width=\"100%\" height=\"100%\"");
+        sw_printf(w, " fill=\"#%02x%02x%02x\"",
+                  R_RED(page->bg), R_GREEN(page->bg), R_BLUE(page->bg));
+        if (!R_OPAQUE(page->bg)) {
+            sw_puts(w, " fill-opacity=\"");
+            sw_num(w, R_ALPHA(page->bg) / 255.0);
+            sw_puts(w, "\"");
+        }
+        sw_puts(w, "/>\n");
+    }
+
+    write_ops(c, page->ops);
+    sw_puts(w, "</svg>\n");
+    sw_flush(w);
+
+    int rc = w->err ? -1 : 0;
+    styles_free(&c->styles);
+    free(c->patterns.v);
+    free(c->clips.v);
+    free(c->masks.v);
+    free(c->groups.v);
+    free(c->els);
+    free(c);
+    return rc;
+}
+
+/* ---- R entry point ---- */
+
+typedef struct {
+    FILE *fp;
+    int rc;
+} svg_save_args_t;
+
+static void save_current_page(jgd_state_t *st, void *data) {
+    svg_save_args_t *args = (svg_save_args_t *)data;
+    args->rc = jgd_svg_write_page(&st->page, args->fp);
+}
+
+/* Called from R: .Call(C_jgd_save_svg, file, plot)
+ * plot is an absolute plot number (the frame's plotNumber), or -1 for
+ * the current page.  Stored plots are replayed through the device; the
+ * replay is not sent to the renderer. */
+SEXP C_jgd_save_svg(SEXP s_file, SEXP s_plot) {
+    pGEDevDesc gdd = GEcurrentDevice();
+    if (!gdd || !gdd->dev) Rf_error("no active graphics device");
+
+    pDevDesc dd = gdd->dev;
+    if (!jgd_is_jgd_device(dd)) Rf_error("current device is not a jgd device");
+
+    jgd_state_t *st = (jgd_state_t *)dd->deviceSpecific;
+    if (!st) Rf_error("jgd device state is NULL");
+    if (st->drawing || st->replaying || st->recording)
+        Rf_error("jgd: cannot save while the device is drawing");
+
+    if (TYPEOF(s_file) != STRSXP || LENGTH(s_file) != 1 ||
+        STRING_ELT(s_file, 0) == NA_STRING)
+        Rf_error("file must be a single string");
+    const char *path = CHAR(STRING_ELT(s_file, 0));
+
+    int current = st->page_count - 1;
+    int plot = Rf_asInteger(s_plot);
+    if (plot == NA_INTEGER || plot < -1)
+        Rf_error("plot must be -1 or a plot number");
+    if (plot == -1) plot = current;
+    if (plot != current && !jgd_has_stored_plot(st, plot))
+        Rf_error("jgd: plot %d is no longer stored (stored plots: %d to %d)",
+                 plot, st->evicted_count, current);
+
+    FILE *fp = fopen(path, "wb");
+    if (!fp) Rf_error("jgd: could not open '%s' for writing", path);
+
+    svg_save_args_t args = { fp, -1 };
+    if (plot != current) {
+        jgd_with_stored_plot(st, gdd, plot, save_current_page, &args);
+    } else if (st->page.released > 0 || st->page.raster_patches > 0) {
+        /* Streaming mode has released the start of the page, or rasters
+         * were sent as patches; replay the display list to rebuild the
+         * page with whole ops, then release it again. */
+        int unflushed = st->page.op_count - st->last_flushed_ops;
+        if (jgd_replay_current_plot(st, gdd))
+            save_current_page(st, &args);
+        jgd_mark_flushed(st, unflushed);
+    } else {
+        save_current_page(st, &args);
+    }
+
+    if (fclose(fp) != 0) args.rc = -1;
+    if (args.rc != 0) Rf_error("jgd: could not write SVG file '%s'", path);
+    return Rf_mkString(path);
+}
@@ -0,0 +1,13 @@
+#ifndef JGD_SVG_H
+#define JGD_SVG_H
+
+#include "display_list.h"
+#include <stdio.h>
+
+/* Write a page's op list to fp as a standalone SVG document.  Graphics
+ * contexts are interned into CSS classes, so a scatter plot of 10k
+ * points in one colour carries its style once.  Returns 0 on success,
+ * -1 on a write error. */
+int jgd_svg_write_page(const jgd_page_t *page, FILE *fp);
+
+#endif
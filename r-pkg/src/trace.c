@@ -0,0 +1,135 @@
+#include "trace.h"
+#include "stats.h"
+#include "device.h"
+#include "callbacks.h"
+
+#include <R.h>
+#include <Rinternals.h>
+#include <R_ext/GraphicsEngine.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define jgd_getpid _getpid
+#define jgd_getcwd _getcwd
+#else
+#include <unistd.h>
+#define jgd_getpid getpid
+#define jgd_getcwd getcwd
+#endif
+
+static int is_absolute(const char *p) {
+#ifdef _WIN32
+    if (((p[0] >= 'A' && p[0] <= 'Z') || (p[0] >= 'a' && p[0] <= 'z')) &&
+        p[1] == ':')
+        return 1;
+    if (p[0] == '\\') return 1;
+#endif
+    return p[0] == '/';
+}
+
+/* path as R resolves it now: ~ expanded, and a relative path anchored at
+ * the current working directory, which may have changed by the time the
+ * device closes and the trace is written. */
+static char *absolute_path(const char *path) {
+    const char *p = R_ExpandFileName(path);
+    char cwd[4096];
+    if (is_absolute(p) || !jgd_getcwd(cwd, sizeof(cwd))) return strdup(p);
+    size_t n = strlen(cwd) + strlen(p) + 2;
+    char *out = (char *)malloc(n);
+    if (out) snprintf(out, n, "%s/%s", cwd, p);
+    return out;
+}
+
+int jgd_trace_init(jgd_trace_t *t, const char *path) {
+    memset(t, 0, sizeof(*t));
+    t->events = (jgd_trace_event_t *)malloc(
+        JGD_TRACE_CAPACITY * sizeof(jgd_trace_event_t));
+    if (!t->events) return -1;
+    if (path && path[0]) {
+        t->path = absolute_path(path);
+        if (!t->path) {
+            free(t->events);
+            t->events = NULL;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void jgd_trace_free(jgd_trace_t *t) {
+    free(t->events);
+    free(t->path);
+    memset(t, 0, sizeof(*t));
+}
+
+void jgd_trace_emit(jgd_trace_t *t, const char *name, char ph) {
+    jgd_trace_event_t *e = &t->events[t->next];
+    e->name = name;
+    e->ph = ph;
+    e->ts_us = jgd_stats_now_ms() * 1000.0;
+    t->next = (t->next + 1) % JGD_TRACE_CAPACITY;
+    if (t->count < JGD_TRACE_CAPACITY)
+        t->count++;
+}
+
+int jgd_trace_write(const jgd_trace_t *t, const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+
+    int pid = (int)jgd_getpid();
+    size_t start = (t->next + JGD_TRACE_CAPACITY - t->count) % JGD_TRACE_CAPACITY;
+    /* After wrap-around the oldest events may be 'E' records whose 'B'
+     * was overwritten; skip them so viewers don't see unbalanced spans. */
+    int depth = 0;
+    int first = 1;
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", f);
+    for (size_t i = 0; i < t->count; i++) {
+        const jgd_trace_event_t *e = &t->events[(start + i) % JGD_TRACE_CAPACITY];
+        if (e->ph == 'B') {
+            depth++;
+        } else {
+            if (depth == 0) continue;
+            depth--;
+        }
+        fprintf(f, "%s\n{\"name\":\"%s\",\"cat\":\"jgd\",\"ph\":\"%c\","
+                   "\"ts\":%.3f,\"pid\":%d,\"tid\":1}",
+                first ? "" : ",", e->name, e->ph, e->ts_us, pid);
+        first = 0;
+    }
+    fputs("\n]}\n", f);
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+/* Called from R: .Call(C_jgd_trace_write, path_or_null) */
+SEXP C_jgd_trace_write(SEXP s_path) {
+    pGEDevDesc gdd = GEcurrentDevice();
+    if (!gdd || !gdd->dev) Rf_error("no active graphics device");
+
+    pDevDesc dd = gdd->dev;
+    if (!jgd_is_jgd_device(dd)) Rf_error("current device is not a jgd device");
+
+    jgd_state_t *st = (jgd_state_t *)dd->deviceSpecific;
+    if (!st) Rf_error("jgd device state is NULL");
+
+    if (!st->trace.events)
+        Rf_error("jgd: tracing is not enabled; set options(jgd.trace = \"file.json\") "
+                 "before opening the device");
+
+    const char *path = st->trace.path;
+    if (s_path != R_NilValue) {
+        if (TYPEOF(s_path) != STRSXP || LENGTH(s_path) != 1 ||
+            STRING_ELT(s_path, 0) == NA_STRING)
+            Rf_error("file must be a single string or NULL");
+        path = CHAR(STRING_ELT(s_path, 0));
+    }
+    if (!path || !path[0])
+        Rf_error("jgd: no trace file given and options(jgd.trace) is not a path");
+
+    if (jgd_trace_write(&st->trace, path) != 0)
+        Rf_error("jgd: could not write trace file '%s'", path);
+    return Rf_mkString(path);
+}
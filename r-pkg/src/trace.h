@@ -0,0 +1,42 @@
+#ifndef JGD_TRACE_H
+#define JGD_TRACE_H
+
+#include <stddef.h>
+
+/* Number of begin/end events kept in the ring buffer.  When full, the
+ * oldest events are overwritten, so a long session keeps its most recent
+ * history.  24 bytes per event. */
+#define JGD_TRACE_CAPACITY 65536
+
+typedef struct {
+    const char *name;         /* static string literal; never freed */
+    double ts_us;             /* monotonic timestamp, microseconds */
+    char ph;                  /* 'B' (begin) or 'E' (end) */
+} jgd_trace_event_t;
+
+typedef struct {
+    jgd_trace_event_t *events; /* NULL when tracing is disabled */
+    size_t next;              /* slot for the next event */
+    size_t count;             /* valid events, <= JGD_TRACE_CAPACITY */
+    char *path;               /* options(jgd.trace) output file, or NULL */
+} jgd_trace_t;
+
+/* Allocate the ring buffer and remember the output path, with ~ expanded
+ * and made absolute against the working directory at open.  Returns 0 on
+ * success, -1 on allocation failure (tracing stays disabled). */
+int jgd_trace_init(jgd_trace_t *t, const char *path);
+void jgd_trace_free(jgd_trace_t *t);
+
+void jgd_trace_emit(jgd_trace_t *t, const char *name, char ph);
+
+/* Write the buffered events as Chrome trace-event JSON (loadable in
+ * chrome://tracing or Perfetto).  Returns 0 on success, -1 on I/O error. */
+int jgd_trace_write(const jgd_trace_t *t, const char *path);
+
+/* Span markers.  With tracing disabled each is a single NULL check. */
+#define JGD_TRACE_BEGIN(st, name) \
+    do { if ((st)->trace.events) jgd_trace_emit(&(st)->trace, (name), 'B'); } while (0)
+#define JGD_TRACE_END(st, name) \
+    do { if ((st)->trace.events) jgd_trace_emit(&(st)->trace, (name), 'E'); } while (0)
+
+#endif
@@ -33,6 +33,7 @@ static void ensure_wsa(void) {
 #include <unistd.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <signal.h>   /* kill(pid, 0) */
 #include <strings.h>  /* strncasecmp */
 typedef int sock_t;
 #define SOCK_INVALID (-1)
@@ -113,6 +114,7 @@ void transport_init(jgd_transport_t *t) {
     t->pipe_handle = INVALID_HANDLE_VALUE;
     t->overlap_event = NULL;
 #endif
+    t->n_sinks = 0;
 }
 
 /* Build the discovery file path: <cache_dir>/jgd/discovery.json
@@ -171,23 +173,85 @@ static cJSON *read_json_file(const char *path) {
     return json;
 }
 
-static int discover_socket_path(char *out, size_t outsize) {
+/* Servers tried from one discovery file, at most. */
+#define JGD_MAX_DISCOVERED 16
+
+/* A server listed in the discovery file. */
+typedef struct {
+    char socket_path[sizeof(((jgd_transport_t *)0)->socket_path)];
+    double load;
+    int sessions;
+} discovered_server_t;
+
+/* Whether a process with this pid exists (a permission error means it
+ * does, under another user). */
+static int pid_alive(int pid) {
+#ifdef _WIN32
+    HANDLE h = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, (DWORD)pid);
+    if (!h) return GetLastError() == ERROR_ACCESS_DENIED;
+    DWORD code = 0;
+    int alive = GetExitCodeProcess(h, &code) && code == STILL_ACTIVE;
+    CloseHandle(h);
+    return alive;
+#else
+    return kill((pid_t)pid, 0) == 0 || errno == EPERM;
+#endif
+}
+
+/* Least loaded first; fewer sessions breaks ties. */
+static int compare_servers(const void *a, const void *b) {
+    const discovered_server_t *x = a, *y = b;
+    if (x->load != y->load) return x->load < y->load ? -1 : 1;
+    return (x->sessions > y->sessions) - (x->sessions < y->sessions);
+}
+
+/* Append a socket path to out[] unless it is empty, too long or already
+ * there.  Returns the new count. */
+static int add_server(discovered_server_t *out, int n, const char *path,
+                      double load, int sessions) {
+    size_t plen = path ? strlen(path) : 0;
+    if (plen == 0 || plen >= sizeof(out[0].socket_path)) return n;
+    for (int i = 0; i < n; i++)
+        if (strcmp(out[i].socket_path, path) == 0) return n;
+    memcpy(out[n].socket_path, path, plen + 1);
+    out[n].load = load;
+    out[n].sessions = sessions;
+    return n + 1;
+}
+
+/* Read the servers to try from the discovery file, in the order to try
+ * them: the live entries of its "servers" list, least loaded first, then
+ * the top-level socketPath (the only entry in files written by older
+ * servers, whose pid is not checked, as before).  Returns the count. */
+static int discover_servers(discovered_server_t *out, int max) {
     char disc_path[1024];
-    if (discovery_path(disc_path, sizeof(disc_path)) != 0) return -1;
+    if (discovery_path(disc_path, sizeof(disc_path)) != 0) return 0;
     cJSON *json = read_json_file(disc_path);
-    if (!json) return -1;
+    if (!json) return 0;
+
+    int n = 0;
+    cJSON *servers = cJSON_GetObjectItem(json, "servers");
+    cJSON *entry;
+    if (!cJSON_IsArray(servers)) servers = NULL;
+    cJSON_ArrayForEach(entry, servers) {
+        if (n == max - 1) break;   /* keep a slot for the top level */
+        cJSON *sp = cJSON_GetObjectItem(entry, "socketPath");
+        cJSON *pid = cJSON_GetObjectItem(entry, "pid");
+        cJSON *load = cJSON_GetObjectItem(entry, "load");
+        cJSON *sessions = cJSON_GetObjectItem(entry, "sessions");
+        if (!cJSON_IsString(sp) || !cJSON_IsNumber(pid) ||
+            pid->valueint <= 0 || !pid_alive(pid->valueint))
+            continue;
+        n = add_server(out, n, sp->valuestring,
+                       cJSON_IsNumber(load) ? load->valuedouble : 0,
+                       cJSON_IsNumber(sessions) ? sessions->valueint : 0);
+    }
+    qsort(out, (size_t)n, sizeof(out[0]), compare_servers);
 
     cJSON *sp = cJSON_GetObjectItem(json, "socketPath");
-    if (cJSON_IsString(sp) && sp->valuestring) {
-        size_t plen = strlen(sp->valuestring);
-        if (plen > 0 && plen < outsize) {
-            memcpy(out, sp->valuestring, plen + 1);
-            cJSON_Delete(json);
-            return 0;
-        }
-    }
+    if (cJSON_IsString(sp)) n = add_server(out, n, sp->valuestring, 0, 0);
     cJSON_Delete(json);
-    return -1;
+    return n;
 }
 
 /* Called from R: .Call(C_jgd_discover, path)
@@ -365,11 +429,20 @@ int transport_connect(jgd_transport_t *t) {
     if (t->connected) return 0;
 
     if (t->socket_path[0] == '\0') {
-        if (discover_socket_path(t->socket_path, sizeof(t->socket_path)) != 0) {
+        discovered_server_t found[JGD_MAX_DISCOVERED];
+        int n = discover_servers(found, JGD_MAX_DISCOVERED);
+        if (n == 0) {
             REprintf("jgd: cannot find socket path. "
                      "Pass socket= to jgd() or start the rendering server.\n");
             return -1;
         }
+        /* Fall back to the next server when one refuses the connection. */
+        for (int i = 0; i < n; i++) {
+            memcpy(t->socket_path, found[i].socket_path, sizeof(t->socket_path));
+            if (try_connect(t) == 0) return 0;
+            REprintf("jgd: connect(%s) failed: %d\n", t->socket_path, SOCK_ERR);
+        }
+        return -1;
     }
 
     if (try_connect(t) == 0) return 0;
@@ -378,7 +451,7 @@ int transport_connect(jgd_transport_t *t) {
     return -1;
 }
 
-int transport_send(jgd_transport_t *t, const char *data, size_t len) {
+static int send_live(jgd_transport_t *t, const char *data, size_t len) {
     if (!t->connected) return -1;
 
 #ifdef _WIN32
@@ -451,6 +524,34 @@ int transport_send(jgd_transport_t *t, const char *data, size_t len) {
     return 0;
 }
 
+/* Send one line to the server. */
+int transport_send(jgd_transport_t *t, const char *data, size_t len) {
+    return send_live(t, data, len);
+}
+
+/* Send a frame to the server and queue it for every archive sink.  The
+ * line is serialized once by the caller; each sink keeps its own copy,
+ * written by its writer thread.  Other traffic (pings, metrics requests,
+ * close) goes through transport_send and is not archived. */
+int transport_send_frame(jgd_transport_t *t, const char *data, size_t len) {
+    int rc = send_live(t, data, len);
+    for (int i = 0; i < t->n_sinks; i++)
+        jgd_sink_enqueue(&t->sinks[i], data, len);
+    return rc;
+}
+
+int transport_add_sink(jgd_transport_t *t, const char *uri) {
+    if (t->n_sinks >= JGD_MAX_SINKS) return -1;
+    if (jgd_sink_open(&t->sinks[t->n_sinks], uri) != 0) return -1;
+    t->n_sinks++;
+    return 0;
+}
+
+void transport_poll_sinks(jgd_transport_t *t) {
+    for (int i = 0; i < t->n_sinks; i++)
+        jgd_sink_poll(&t->sinks[i]);
+}
+
 int transport_has_data(jgd_transport_t *t) {
     if (!t->connected) return 0;
     /* A complete line already buffered? */
@@ -668,4 +769,7 @@ void transport_close(jgd_transport_t *t) {
     }
     t->connected = 0;
     t->readbuf_len = 0;
+    for (int i = 0; i < t->n_sinks; i++)
+        jgd_sink_close(&t->sinks[i]);
+    t->n_sinks = 0;
 }
@@ -3,6 +3,8 @@
 
 #include <stddef.h>
 
+#include "sink.h"
+
 typedef struct {
     int fd;
     char socket_path[512];  /* URI (tcp://host:port, unix:///path, npipe:////./pipe/name) or raw path */
@@ -13,11 +15,16 @@ typedef struct {
     void *pipe_handle;  /* HANDLE; INVALID_HANDLE_VALUE when unused */
     void *overlap_event;  /* HANDLE for overlapped I/O event; NULL when unused */
 #endif
+    jgd_sink_t sinks[JGD_MAX_SINKS];  /* file:// archives teed from transport_send_frame */
+    int n_sinks;
 } jgd_transport_t;
 
 void transport_init(jgd_transport_t *t);
 int transport_connect(jgd_transport_t *t);
 int transport_send(jgd_transport_t *t, const char *data, size_t len);
+int transport_send_frame(jgd_transport_t *t, const char *data, size_t len);
+int transport_add_sink(jgd_transport_t *t, const char *uri);
+void transport_poll_sinks(jgd_transport_t *t);
 int transport_has_data(jgd_transport_t *t);
 int transport_recv_line(jgd_transport_t *t, char *buf, size_t bufsize, int timeout_ms);
 void transport_close(jgd_transport_t *t);
@@ -0,0 +1,167 @@
+// HTTP serving of the embedded web assets (web_assets.ts).
+//
+// Everything that depends only on the asset text is computed once at
+// startup: a content hash, gzip and brotli variants, and a copy of
+// index.html whose script and stylesheet references point at
+// content-hashed URLs (e.g. /app.3f2a9c1e0b7d.js).  Those URLs change
+// whenever the asset does, so browsers may cache them forever; the plain
+// paths (and index.html itself) are revalidated with If-None-Match.
+
+import { createHash } from "node:crypto";
+import { brotliCompressSync, constants, gzipSync } from "node:zlib";
+
+type Encoding = "br" | "gzip" | "identity";
+
+/** One encoded representation of an asset. */
+interface Variant {
+  body: Uint8Array;
+  etag: string;
+}
+
+/** An asset with its precomputed representations. */
+export interface CachedAsset {
+  type: string;
+  hash: string;
+  variants: Record<Encoding, Variant | undefined>;
+  /** Served under its content-hashed URL, so it never changes. */
+  immutable: boolean;
+}
+
+/** Cache-Control for content-hashed URLs. */
+const IMMUTABLE = "public, max-age=31536000, immutable";
+/** Cache-Control for stable URLs: keep a copy but revalidate every time. */
+const REVALIDATE = "no-cache";
+
+/** Length of the hex content hash used in ETags and hashed URLs. */
+const HASH_LENGTH = 12;
+
+/** Map from URL path to cached asset, built by buildAssetCache(). */
+export type AssetCache = Map<string, CachedAsset>;
+
+function contentHash(body: Uint8Array): string {
+  return createHash("sha256").update(body).digest("hex").slice(0, HASH_LENGTH);
+}
+
+function encode(
+  type: string,
+  body: Uint8Array,
+  immutable: boolean,
+): CachedAsset {
+  const hash = contentHash(body);
+  const variants: Record<Encoding, Variant | undefined> = {
+    identity: { body, etag: `"${hash}"` },
+    gzip: undefined,
+    br: undefined,
+  };
+  const gz = new Uint8Array(gzipSync(body, { level: 9 }));
+  if (gz.length < body.length) variants.gzip = { body: gz, etag: `"${hash}-gz"` };
+  const br = new Uint8Array(brotliCompressSync(body, {
+    params: {
+      [constants.BROTLI_PARAM_QUALITY]: constants.BROTLI_MAX_QUALITY,
+      [constants.BROTLI_PARAM_SIZE_HINT]: body.length,
+    },
+  }));
+  if (br.length < body.length) variants.br = { body: br, etag: `"${hash}-br"` };
+  return { type, hash, variants, immutable };
+}
+
+/** "/app.js" + "3f2a…" → "/app.3f2a….js" */
+function hashedPath(path: string, hash: string): string {
+  const dot = path.lastIndexOf(".");
+  return dot > path.lastIndexOf("/")
+    ? `${path.slice(0, dot)}.${hash}${path.slice(dot)}`
+    : `${path}.${hash}`;
+}
+
+/**
+ * Precompute every representation of the embedded assets.  Each asset
+ * other than index.html is also registered under its content-hashed URL,
+ * and index.html is rewritten to reference those URLs.
+ */
+export function buildAssetCache(
+  assets: Record<string, { body: string; type: string }>,
+): AssetCache {
+  const cache: AssetCache = new Map();
+  const te = new TextEncoder();
+  const renames: [string, string][] = [];
+
+  for (const [path, asset] of Object.entries(assets)) {
+    if (path === "/index.html") continue;
+    const cached = encode(asset.type, te.encode(asset.body), false);
+    cache.set(path, cached);
+    const hashed = hashedPath(path, cached.hash);
+    cache.set(hashed, { ...cached, immutable: true });
+    renames.push([path.slice(1), hashed.slice(1)]);
+  }
+
+  const index = assets["/index.html"];
+  if (index) {
+    let html = index.body;
+    for (const [from, to] of renames) {
+      html = html.replaceAll(`src="${from}"`, `src="${to}"`)
+        .replaceAll(`href="${from}"`, `href="${to}"`);
+    }
+    cache.set("/index.html", encode(index.type, te.encode(html), false));
+  }
+  return cache;
+}
+
+/**
+ * Pick the best encoding the client accepts: brotli, then gzip, then
+ * identity.  Honours q-values, including "q=0" to refuse an encoding, and
+ * the "*" wildcard.
+ */
+export function selectEncoding(
+  acceptEncoding: string | null,
+  asset: CachedAsset,
+): Encoding {
+  const q = new Map<string, number>();
+  for (const part of (acceptEncoding ?? "").split(",")) {
+    const [name, ...params] = part.trim().toLowerCase().split(";");
+    if (!name) continue;
+    let weight = 1;
+    for (const p of params) {
+      const m = /^\s*q\s*=\s*([0-9.]+)\s*$/.exec(p);
+      if (m) weight = parseFloat(m[1]);
+    }
+    q.set(name, weight);
+  }
+  const accepts = (enc: string) => (q.get(enc) ?? q.get("*") ?? 0) > 0;
+  if (asset.variants.br && accepts("br")) return "br";
+  if (asset.variants.gzip && accepts("gzip")) return "gzip";
+  return "identity";
+}
+
+/** True if an If-None-Match header value matches etag (weak comparison). */
+function etagMatches(ifNoneMatch: string, etag: string): boolean {
+  if (ifNoneMatch.trim() === "*") return true;
+  return ifNoneMatch.split(",").some((t) => t.trim().replace(/^W\//, "") === etag);
+}
+
+/** Serve an embedded asset, or null if path is not one. */
+export function serveAsset(
+  req: Request,
+  cache: AssetCache,
+  path: string,
+): Response | null {
+  const asset = cache.get(path);
+  if (!asset) return null;
+
+  const encoding = selectEncoding(req.headers.get("accept-encoding"), asset);
+  const variant = asset.variants[encoding]!;
+  const headers = new Headers({
+    "content-type": asset.type,
+    "cache-control": asset.immutable ? IMMUTABLE : REVALIDATE,
+    "etag": variant.etag,
+    "vary": "Accept-Encoding",
+  });
+  if (encoding !== "identity") headers.set("content-encoding", encoding);
+
+  const ifNoneMatch = req.headers.get("if-none-match");
+  if (ifNoneMatch !== null && etagMatches(ifNoneMatch, variant.etag)) {
+    headers.delete("content-type");
+    headers.delete("content-encoding");
+    return new Response(null, { status: 304, headers });
+  }
+  return new Response(variant.body, { headers });
+}
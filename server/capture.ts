@@ -0,0 +1,167 @@
+// Session capture for reproducible benchmarks (`--capture <file>`).
+//
+// Every message crossing the hub is appended to a JSONL file together
+// with its direction, the connection it belongs to, and a timestamp
+// relative to the start of the capture.  tests/bench/replay.ts reads the
+// file back and drives a fresh server with the recorded R and browser
+// streams.
+//
+// File layout: one header line, then one record per line.
+//
+//   {"jgdCapture":1,"startedAt":1700000000000}
+//   {"t":12.5,"dir":"r_open","conn":"r1"}
+//   {"t":13.1,"dir":"r2s","conn":"r1","msg":"{\"type\":\"ping\"}"}
+//
+// `msg` holds the raw line exactly as sent, so replays are byte-identical.
+
+export const CAPTURE_VERSION = 1;
+
+/**
+ * Record direction.  `r2s`/`s2r` are R ↔ server lines, `b2s`/`s2b` are
+ * browser ↔ server WebSocket messages; the `_open`/`_close` records
+ * mark connection lifetimes and carry no message.
+ */
+export type CaptureDir =
+  | "r_open"
+  | "r_close"
+  | "r2s"
+  | "s2r"
+  | "b_open"
+  | "b_close"
+  | "b2s"
+  | "s2b";
+
+export interface CaptureHeader {
+  jgdCapture: number;
+  startedAt: number;
+}
+
+export interface CaptureRecord {
+  /** Milliseconds since the capture started. */
+  t: number;
+  dir: CaptureDir;
+  /** Connection id, `r<n>` for R sessions and `b<n>` for browsers. */
+  conn: string;
+  msg?: string;
+}
+
+/** Flush once this many bytes are buffered, or on the periodic timer. */
+const FLUSH_BYTES = 64 * 1024;
+const FLUSH_INTERVAL_MS = 250;
+
+/**
+ * Append-only capture writer.  Records are buffered in memory and written
+ * in batches by async writes chained one after another, so capture order
+ * matches hub order and the hot path neither awaits nor blocks on file
+ * I/O.
+ */
+export class Capture {
+  readonly path: string;
+  private file: Deno.FsFile;
+  private encoder = new TextEncoder();
+  private start = performance.now();
+  private buffer: string[] = [];
+  private bufferedBytes = 0;
+  private timer: number;
+  private rConns = 0;
+  private bConns = 0;
+  private bIds = new WeakMap<object, string>();
+  private closed = false;
+  /** Tail of the chain of pending writes. */
+  private writing: Promise<void> = Promise.resolve();
+  private failed = false;
+
+  constructor(path: string) {
+    this.path = path;
+    this.file = Deno.openSync(path, { write: true, create: true, truncate: true });
+    const header: CaptureHeader = {
+      jgdCapture: CAPTURE_VERSION,
+      startedAt: Date.now(),
+    };
+    this.push(JSON.stringify(header));
+    this.timer = setInterval(() => this.flush(), FLUSH_INTERVAL_MS);
+    Deno.unrefTimer(this.timer);
+  }
+
+  /** Allocate a connection id for a new R session. */
+  newRConn(): string {
+    return `r${++this.rConns}`;
+  }
+
+  /** Stable connection id for a browser client object. */
+  browserConn(client: object): string {
+    let id = this.bIds.get(client);
+    if (!id) {
+      id = `b${++this.bConns}`;
+      this.bIds.set(client, id);
+    }
+    return id;
+  }
+
+  record(dir: CaptureDir, conn: string, msg?: string): void {
+    if (this.closed) return;
+    const rec: CaptureRecord = { t: +(performance.now() - this.start).toFixed(3), dir, conn };
+    if (msg !== undefined) rec.msg = msg;
+    this.push(JSON.stringify(rec));
+  }
+
+  private push(line: string): void {
+    this.buffer.push(line);
+    this.bufferedBytes += line.length + 1;
+    if (this.bufferedBytes >= FLUSH_BYTES) this.flush();
+  }
+
+  /**
+   * Queue the buffered records for writing.  The returned promise
+   * resolves once they (and everything queued before) are written.
+   */
+  flush(): Promise<void> {
+    if (this.buffer.length === 0 || this.failed) return this.writing;
+    const bytes = this.encoder.encode(this.buffer.join("\n") + "\n");
+    this.buffer = [];
+    this.bufferedBytes = 0;
+    this.writing = this.writing.then(async () => {
+      if (this.failed) return;
+      try {
+        let written = 0;
+        while (written < bytes.byteLength) {
+          written += await this.file.write(bytes.subarray(written));
+        }
+      } catch (e) {
+        this.failed = true;
+        console.error(`capture: write to ${this.path} failed, capture stopped: ${e}`);
+      }
+    });
+    return this.writing;
+  }
+
+  async close(): Promise<void> {
+    if (this.closed) return;
+    this.closed = true;
+    clearInterval(this.timer);
+    await this.flush();
+    try {
+      this.file.close();
+    } catch { /* ignore */ }
+  }
+}
+
+/** Parse a capture file into its header and records. */
+export function parseCapture(text: string): { header: CaptureHeader; records: CaptureRecord[] } {
+  const lines = text.split("\n").filter((l) => l.length > 0);
+  if (lines.length === 0) throw new Error("empty capture file");
+  const header = JSON.parse(lines[0]) as CaptureHeader;
+  if (header.jgdCapture !== CAPTURE_VERSION) {
+    throw new Error(`unsupported capture version: ${header.jgdCapture}`);
+  }
+  const records: CaptureRecord[] = [];
+  for (let i = 1; i < lines.length; i++) {
+    try {
+      records.push(JSON.parse(lines[i]));
+    } catch {
+      // A server killed mid-flush can leave a truncated last line.
+      if (i !== lines.length - 1) throw new Error(`malformed capture line ${i + 1}`);
+    }
+  }
+  return { header, records };
+}
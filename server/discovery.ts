@@ -3,14 +3,47 @@ import { homedir } from "node:os";
 
 const DISCOVERY_FILENAME = "discovery.json";
 const DISCOVERY_DIR = "jgd";
+/** How often a running server refreshes its entry (see updateDiscovery). */
+export const DISCOVERY_REFRESH_MS = 5000;
+/** Entries not refreshed for this long belong to servers that died. */
+const DISCOVERY_STALE_MS = 3 * DISCOVERY_REFRESH_MS;
 
+/** A server's current load, as advertised in its discovery entry. */
+export interface DiscoveryStatus {
+  /** R transport: "tcp", "unix" or "npipe". */
+  transport: string;
+  /** Connected R sessions. */
+  sessions: number;
+  /** Messages from R per second over the last refresh interval. */
+  load: number;
+}
+
+/** One server in the discovery file's `servers` list. */
+interface DiscoveryEntry extends DiscoveryStatus {
+  serverName: string;
+  socketPath: string;
+  pid: number;
+  serverInfo?: Record<string, string>;
+  /** When the entry was last refreshed (ms since the epoch). */
+  updated: number;
+}
+
+/**
+ * The discovery file.  The top-level fields describe one server (the
+ * most recently started one still running), which is all that older
+ * clients read; `servers` lists every running server with its load.
+ */
 interface DiscoveryInfo {
   serverName: string;
   socketPath: string;
   pid: number;
   serverInfo?: Record<string, string>;
+  servers?: DiscoveryEntry[];
 }
 
+/** This process's entry, once writeDiscovery() has succeeded. */
+let ownEntry: DiscoveryEntry | null = null;
+
 /** Atomic file write via temp file + rename. */
 async function atomicWrite(path: string, data: Uint8Array): Promise<void> {
   const dir = dirname(path);
@@ -59,8 +92,39 @@ export function discoveryLocation(cacheDirOverride?: string): string {
   return join(base, DISCOVERY_DIR, DISCOVERY_FILENAME);
 }
 
+/** Read and parse the discovery file, or null if missing or invalid. */
+async function readDiscovery(path: string): Promise<DiscoveryInfo | null> {
+  try {
+    const info = JSON.parse(await Deno.readTextFile(path));
+    return typeof info === "object" && info !== null ? info : null;
+  } catch {
+    return null;
+  }
+}
+
+/** Other servers' entries that are still being refreshed. */
+function otherLiveEntries(info: DiscoveryInfo | null): DiscoveryEntry[] {
+  const now = Date.now();
+  const servers = info?.servers;
+  return (Array.isArray(servers) ? servers : []).filter((e) =>
+    typeof e === "object" && e !== null && e.pid !== Deno.pid &&
+    typeof e.updated === "number" && now - e.updated < DISCOVERY_STALE_MS
+  );
+}
+
+/** The top-level (single-server) fields for an entry. */
+function topLevel(e: Omit<DiscoveryInfo, "servers">): Omit<DiscoveryInfo, "servers"> {
+  return {
+    serverName: e.serverName,
+    socketPath: e.socketPath,
+    pid: e.pid,
+    ...(e.serverInfo !== undefined && { serverInfo: e.serverInfo }),
+  };
+}
+
 /**
- * Write discovery file so R can find the server.
+ * Write discovery file so R can find the server, adding this server to
+ * the list of running servers and making it the top-level entry.
  * Returns the path that was written.
  */
 export async function writeDiscovery(
@@ -68,6 +132,7 @@ export async function writeDiscovery(
   serverName: string,
   serverInfo?: Record<string, string>,
   cacheDirOverride?: string,
+  status: DiscoveryStatus = { transport: "", sessions: 0, load: 0 },
 ): Promise<string | null> {
   if (typeof serverName !== "string" || serverName.trim().length === 0) {
     throw new Error("serverName must be a non-empty string");
@@ -82,17 +147,21 @@ export async function writeDiscovery(
       }
     }
   }
-  const disc: DiscoveryInfo = {
+  const entry: DiscoveryEntry = {
     serverName,
     socketPath,
     pid: Deno.pid,
     ...(serverInfo !== undefined && { serverInfo }),
+    ...status,
+    updated: Date.now(),
   };
-  const content = new TextEncoder().encode(JSON.stringify(disc));
   try {
     const loc = discoveryLocation(cacheDirOverride);
     await Deno.mkdir(dirname(loc), { recursive: true });
-    await atomicWrite(loc, content);
+    const others = otherLiveEntries(await readDiscovery(loc));
+    const disc: DiscoveryInfo = { ...topLevel(entry), servers: [entry, ...others] };
+    await atomicWrite(loc, new TextEncoder().encode(JSON.stringify(disc)));
+    ownEntry = entry;
     console.error(`wrote discovery file: ${loc}`);
     return loc;
   } catch (e) {
@@ -101,21 +170,56 @@ export async function writeDiscovery(
   }
 }
 
-/** Remove the discovery file written during startup, but only if it
- *  still belongs to this process (another instance may have overwritten). */
-export async function removeDiscovery(path: string | null): Promise<void> {
-  if (!path) return;
-  let info: DiscoveryInfo;
+/**
+ * Refresh this server's entry with its current load, dropping entries of
+ * servers that stopped refreshing theirs.  Servers update the file
+ * without locking, so an entry lost to a concurrent write is restored at
+ * the next refresh.
+ */
+export async function updateDiscovery(
+  path: string | null,
+  status: DiscoveryStatus,
+): Promise<void> {
+  if (!path || !ownEntry) return;
+  const entry: DiscoveryEntry = { ...ownEntry, ...status, updated: Date.now() };
+  ownEntry = entry;
+  const info = await readDiscovery(path);
+  // removeDiscovery() ran while the file was being read.
+  if (ownEntry !== entry) return;
+  const servers = [entry, ...otherLiveEntries(info)];
+  // Keep the top-level server unless it has gone.
+  const top = servers.find((e) => e.pid === info?.pid) ?? entry;
+  const disc: DiscoveryInfo = { ...topLevel(top), servers };
   try {
-    const raw = await Deno.readTextFile(path);
-    info = JSON.parse(raw);
-  } catch {
-    // File missing, unreadable, or corrupt JSON — skip
-    return;
+    await atomicWrite(path, new TextEncoder().encode(JSON.stringify(disc)));
+  } catch (e) {
+    console.error(`warning: failed to update discovery file: ${e}`);
   }
-  if (typeof info !== "object" || info === null || info.pid !== Deno.pid) return;
+}
+
+/** Remove this process from the discovery file written during startup.
+ *  The file is deleted when no other running server is listed in it, and
+ *  left alone if this process is no longer in it (another instance may
+ *  have overwritten it). */
+export async function removeDiscovery(path: string | null): Promise<void> {
+  if (!path) return;
+  ownEntry = null;
+  // File missing, unreadable, or corrupt JSON — skip
+  const info = await readDiscovery(path);
+  if (!info) return;
+  const listed = Array.isArray(info.servers) &&
+    info.servers.some((e) => e?.pid === Deno.pid);
+  if (info.pid !== Deno.pid && !listed) return;
+
+  const others = otherLiveEntries(info);
   try {
-    await Deno.remove(path);
+    if (info.pid === Deno.pid && others.length === 0) {
+      await Deno.remove(path);
+      return;
+    }
+    const top = info.pid === Deno.pid ? topLevel(others[0]) : topLevel(info);
+    const disc: DiscoveryInfo = { ...top, servers: others };
+    await atomicWrite(path, new TextEncoder().encode(JSON.stringify(disc)));
   } catch (e) {
     if (!(e instanceof Deno.errors.NotFound)) {
       console.error(`warning: failed to remove discovery file ${path}: ${e}`);
@@ -1,12 +1,42 @@
 import type { RSession } from "./r_session.ts";
-import { extractType } from "./types.ts";
+import { extractType, parseResizeMode } from "./types.ts";
+import { type FrameTiming, LatencyStats, wallMs } from "./latency.ts";
+import type { Capture } from "./capture.ts";
+import { PlotStore, type StoredPlot } from "./plot_store.ts";
+import { hasSlottedRaster, SentRasters } from "./raster_slots.ts";
+import type { Relay } from "./relay.ts";
+import { FontRegistry } from "./static.ts";
 
 /** Placeholder for browser clients (implemented in be2.2). */
 export interface BrowserClient {
   send(data: string): void;
+  /**
+   * Send latency-sensitive control traffic (metrics requests) ahead of
+   * queued frames, on a separate channel if the client has one.
+   */
+  sendControl?(data: string): void;
+  /** A relay server mirroring this one (`?relay=1`), not a browser. */
+  relay?: boolean;
   close(): void;
 }
 
+/**
+ * The sessions a browser receives frames for, set by its `subscribe`
+ * message.  Clients that never subscribe receive every frame.
+ */
+interface Subscription {
+  sessions: Set<string>;
+  /** Switch to whichever session draws next (the renderer's default). */
+  follow: boolean;
+}
+
+/** A frame's keyframe, worked out by Hub.frameFor for the first client that needs it. */
+interface Keyframe {
+  /** Whether the frame has slotted rasters at all. */
+  rasters?: boolean;
+  data?: Promise<string>;
+}
+
 /**
  * Hub routes messages between R sessions and browser clients.
  * JS is single-threaded so no mutex is needed — Map/Set suffice.
@@ -37,6 +67,27 @@ export class Hub {
   /** R transport type: "tcp", "unix", or "npipe". */
   transport: "tcp" | "unix" | "npipe" = "tcp";
   verbose = false;
+  /** Per-stage frame latency, fed by renderer `frame_timing` reports. */
+  latency = new LatencyStats();
+  /** Message recorder for `--capture <file>`, or null when disabled. */
+  capture: Capture | null = null;
+  /** Every session's plot history, for server-side PNG rendering. */
+  plots = new PlotStore();
+  /** Browser subscriptions; see subscribe(). */
+  subscriptions = new Map<BrowserClient, Subscription>();
+  /**
+   * Per client, the last send still waiting for its rasters to be
+   * composed; later sends queue behind it (see deliver()).
+   */
+  private outbox = new Map<BrowserClient, Promise<void>>();
+  /** Per client, the slotted raster images it has been sent. */
+  private sentRasters = new Map<BrowserClient, SentRasters>();
+  /** Font files served at /font, registered from defFont ops. */
+  fonts = new FontRegistry();
+  /** The server this one mirrors in relay mode (`-relay`), else null. */
+  upstream: Relay | null = null;
+  /** Messages received from R sessions, for the discovery file's load. */
+  rMessages = 0;
 
   registerSession(session: RSession): void {
     this.sessions.set(session.id, session);
@@ -96,17 +147,222 @@ export class Hub {
     }
   }
 
+  /** Broadcast control traffic to all connected browser clients. */
+  broadcastControlToClients(data: string): void {
+    for (const client of this.clients) {
+      try {
+        if (client.sendControl) client.sendControl(data);
+        else client.send(data);
+      } catch {
+        // Slow/dead client — ignore
+      }
+    }
+  }
+
   /** Broadcast a message string to all connected browser clients. */
   broadcastToClients(data: string): void {
     for (const client of this.clients) {
       try {
-        client.send(data);
+        this.deliver(client, data);
+      } catch {
+        // Slow/dead client — ignore
+      }
+    }
+  }
+
+  /**
+   * Send a message to a client after anything already queued for it.
+   * A promise (a message whose rasters are being composed) holds back
+   * the client's later messages until it resolves.
+   */
+  private deliver(client: BrowserClient, data: string | Promise<string>): void {
+    const queued = this.outbox.get(client);
+    if (!queued && typeof data === "string") {
+      client.send(data);
+      return;
+    }
+    const next: Promise<void> = (queued ?? Promise.resolve())
+      .then(() => data)
+      .then((message) => {
+        if (this.clients.has(client)) client.send(message);
+      })
+      .catch(() => {
+        // Slow/dead client — ignore
+      })
+      .finally(() => {
+        if (this.outbox.get(client) === next) this.outbox.delete(client);
+      });
+    this.outbox.set(client, next);
+  }
+
+  private sentTo(client: BrowserClient): SentRasters {
+    let sent = this.sentRasters.get(client);
+    if (!sent) {
+      sent = new SentRasters();
+      this.sentRasters.set(client, sent);
+    }
+    return sent;
+  }
+
+  /**
+   * A frame as a client can draw it.  If it carries a raster patch whose
+   * base the client was never sent (it connected or switched sessions
+   * after the base went out), the patches are composed into whole
+   * rasters: a keyframe, built once per frame and shared.
+   */
+  private frameFor(
+    client: BrowserClient,
+    sessionId: string,
+    data: string,
+    // deno-lint-ignore no-explicit-any
+    msg: Record<string, any>,
+    keyframe: Keyframe,
+  ): string | Promise<string> {
+    const ops = msg.plot?.ops;
+    if (!Array.isArray(ops)) return data;
+    keyframe.rasters ??= hasSlottedRaster(ops);
+    if (!keyframe.rasters || this.sentTo(client).add(sessionId, ops)) return data;
+    keyframe.data ??= this.plots.composePatches(ops)
+      .then((composed) => JSON.stringify({ ...msg, plot: { ...msg.plot, ops: composed } }));
+    return keyframe.data;
+  }
+
+  /**
+   * Send a frame to the clients displaying its session.  Other clients
+   * get a `session_activity` notice instead, except that clients
+   * following the latest session switch to this one when it draws.
+   */
+  // deno-lint-ignore no-explicit-any
+  private broadcastFrame(sessionId: string, data: string, msg: Record<string, any>): void {
+    let notice: string | null = null;
+    let latest: Promise<string> | null = null;
+    const keyframe: Keyframe = {};
+    for (const client of this.clients) {
+      const sub = this.subscriptions.get(client);
+      try {
+        if (!sub || sub.sessions.has(sessionId)) {
+          this.deliver(client, this.frameFor(client, sessionId, data, msg, keyframe));
+        } else if (sub.follow && !msg.resize) {
+          // Only the plot being drawn: the full history is sent on an
+          // explicit subscribe, not each time another session draws.
+          // The store already holds this frame, so an incremental one
+          // arrives with the ops the client missed.
+          sub.sessions = new Set([sessionId]);
+          const ref = this.plots.get(sessionId);
+          if (ref) {
+            latest ??= this.plotFrame(sessionId, ref.plot, ref.stored);
+            this.sentTo(client).add(sessionId, ref.stored.ops);
+            this.deliver(client, latest);
+          } else {
+            this.deliver(client, this.frameFor(client, sessionId, data, msg, keyframe));
+          }
+        } else {
+          notice ??= this.activityNotice(sessionId);
+          this.deliver(client, notice);
+        }
       } catch {
         // Slow/dead client — ignore
       }
     }
   }
 
+  /** A stored plot as one complete new-page frame, rasters composed. */
+  private plotFrame(sessionId: string, plotNumber: number, stored: StoredPlot): Promise<string> {
+    const { device } = stored;
+    return this.plots.composedOps(stored).then((ops) =>
+      JSON.stringify({
+        type: "frame",
+        newPage: true,
+        plotNumber,
+        plot: { sessionId, device, ops },
+      })
+    );
+  }
+
+  /** `session_activity`: a session's latest plot number and op count. */
+  private activityNotice(sessionId: string): string {
+    const ref = this.plots.get(sessionId);
+    return JSON.stringify({
+      type: "session_activity",
+      sessionId,
+      plotNumber: ref?.plot ?? null,
+      ops: ref?.stored.ops.length ?? 0,
+    });
+  }
+
+  /**
+   * Send a relay client the state of every stored session.  Relays never
+   * subscribe, so all frames follow.
+   */
+  sendStoredState(client: BrowserClient): void {
+    try {
+      for (const { sessionId } of this.plots.list()) {
+        this.sendSessionState(client, sessionId);
+      }
+    } catch {
+      // Slow/dead client — ignore
+    }
+  }
+
+  /**
+   * `session_state`: every stored plot of a session, as full frames would
+   * carry them, with raster patches composed.
+   */
+  private sendSessionState(client: BrowserClient, sessionId: string): void {
+    const sent = this.sentTo(client);
+    const plots = this.plots.plotsOf(sessionId).map((ref) => {
+      sent.add(sessionId, ref.stored.ops);
+      const { device } = ref.stored;
+      return this.plots.composedOps(ref.stored).then((ops) => ({
+        plotNumber: ref.plot,
+        plot: { sessionId, device, ops },
+      }));
+    });
+    this.deliver(
+      client,
+      Promise.all(plots).then((plots) => JSON.stringify({ type: "session_state", sessionId, plots })),
+    );
+  }
+
+  /**
+   * Handle a browser's `subscribe` message:
+   * `{"type":"subscribe","sessions":[...]}` to receive frames for the
+   * named sessions, and/or `"follow":true` to follow whichever session
+   * draws.  The client is sent the stored state of each session it newly
+   * subscribes to, and a `session_activity` notice for each other stored
+   * session.
+   */
+  subscribe(client: BrowserClient, line: string): void {
+    let sessions: string[] = [];
+    let follow = false;
+    try {
+      const msg = JSON.parse(line);
+      if (Array.isArray(msg?.sessions)) {
+        sessions = msg.sessions.filter((s: unknown) => typeof s === "string");
+      }
+      follow = msg?.follow === true;
+    } catch {
+      return;
+    }
+    const stored = this.plots.list().map((s) => s.sessionId);
+    if (follow && sessions.length === 0 && stored.length > 0) {
+      sessions = [stored[stored.length - 1]];
+    }
+
+    const previous = this.subscriptions.get(client);
+    this.subscriptions.set(client, { sessions: new Set(sessions), follow });
+    try {
+      for (const id of sessions) {
+        if (!previous?.sessions.has(id)) this.sendSessionState(client, id);
+      }
+      for (const id of stored) {
+        if (!sessions.includes(id)) this.deliver(client, this.activityNotice(id));
+      }
+    } catch {
+      // Slow/dead client — ignore
+    }
+  }
+
   /** Broadcast a message string to all connected R sessions. */
   broadcastToR(data: string): void {
     for (const session of this.sessions.values()) {
@@ -120,6 +376,8 @@ export class Hub {
    * Duplicate normal resizes with identical dimensions are silently dropped.
    * plotIndex resizes bypass dedup and are routed only to the session that
    * owns the target plot (identified by sessionId in the message).
+   * Sessions opened with `jgd(resize = "scale")` are skipped unless the
+   * renderer explicitly asks for a re-layout (`relayout: true`).
    */
   broadcastResizeToR(data: string): void {
     let dims: {
@@ -127,6 +385,7 @@ export class Hub {
       height: number;
       plotIndex?: number;
       sessionId?: string;
+      relayout: boolean;
     } | null = null;
     try {
       const parsed = JSON.parse(data);
@@ -142,6 +401,7 @@ export class Hub {
           plotIndex: (typeof pi === "number" && Number.isFinite(pi) &&
                       Number.isInteger(pi) && pi >= 0) ? pi : undefined,
           sessionId: typeof parsed.sessionId === "string" ? parsed.sessionId : undefined,
+          relayout: parsed.relayout === true,
         };
       }
     } catch { /* malformed — skip dedup, always forward */ }
@@ -154,6 +414,7 @@ export class Hub {
       if (!dims!.sessionId) return; // no session to route to
       const session = this.sessions.get(dims!.sessionId);
       if (!session) return; // target session is dead
+      if (session.resizeMode !== "replay" && !dims!.relayout) return;
       // Update lastResizeW/H: R's device.c poll_resize_impl applies the
       // new dimensions BEFORE the plotIndex/normal branch, so R's actual
       // device size changes after a plotIndex resize.  If we don't update
@@ -176,6 +437,22 @@ export class Hub {
       return;
     }
 
+    // Explicit re-layout of the current plot: only the named session,
+    // and never deduplicated (a scaled session's lastResize is stale).
+    if (dims?.relayout) {
+      const session = dims.sessionId ? this.sessions.get(dims.sessionId) : undefined;
+      if (!session) return;
+      session.lastResizeW = dims.width;
+      session.lastResizeH = dims.height;
+      session.lastResizeHadPlotIndex = false;
+      session.trySend(JSON.stringify({
+        type: "resize",
+        width: dims.width,
+        height: dims.height,
+      }));
+      return;
+    }
+
     if (this.verbose) {
       console.error(
         `[hub] resize from browser: ${dims?.width}x${dims?.height}`,
@@ -183,6 +460,8 @@ export class Hub {
     }
     // Normal resize — broadcast to all sessions with dedup.
     for (const session of this.sessions.values()) {
+      // Scaled sessions are resized by the renderer, not by R.
+      if (session.resizeMode !== "replay") continue;
       if (dims) {
         // When dimensions haven't changed, skip entirely — don't forward
         // to R.  This prevents duplicate resizes (ws.onopen +
@@ -215,9 +494,11 @@ export class Hub {
    */
   handleRMessage(session: RSession, line: string): void {
     const type = extractType(line);
+    this.rMessages++;
 
     switch (type) {
       case "frame": {
+        const recvAt = wallMs();
         const { msg, isResizeReplay, plotIndex } = parseFrame(line);
 
         // If parsing failed, forward the raw line unchanged.
@@ -236,6 +517,11 @@ export class Hub {
           msg.resize = true;
         }
 
+        // Frames repeat the device's resize mode, which covers
+        // transports that skip the opening ping (Windows named pipes).
+        const mode = msg.plot?.device?.resize;
+        if (mode !== undefined) session.resizeMode = parseResizeMode(mode);
+
         if (this.verbose) {
           let classification: string;
           if (isResizeReplay) {
@@ -267,8 +553,14 @@ export class Hub {
           }
         }
 
-        const data = JSON.stringify(msg);
-        this.broadcastToClients(data);
+        // options(jgd.timing = TRUE): add hub stamps so the renderer can
+        // report the full R → hub → browser breakdown.
+        if (msg.timing && typeof msg.timing === "object") {
+          msg.timing.hubRecv = recvAt;
+          msg.timing.hubBroadcast = wallMs();
+        }
+
+        const data = this.publishFrame(msg.plot?.sessionId || session.id || "default", msg);
         if (this.verbose) {
           console.error(
             `frame from R session ${session.id} (${data.length} bytes)`,
@@ -281,11 +573,25 @@ export class Hub {
         this.handleMetricsRequest(session, line);
         break;
 
+      case "ping": {
+        // The opening ping carries the device's resize mode when it is
+        // not the default.
+        try {
+          const msg = JSON.parse(line);
+          if (msg && typeof msg === "object" && "resize" in msg) {
+            session.resizeMode = parseResizeMode(msg.resize);
+          }
+        } catch { /* malformed — keep the current mode */ }
+        this.broadcastToClients(line);
+        break;
+      }
+
       case "close":
         if (this.verbose) {
           console.error(`device close from R session ${session.id}`);
         }
-        this.broadcastToClients(line);
+        // Control traffic: on the control lane, ahead of queued frames.
+        this.broadcastControlToClients(line);
         break;
 
       default:
@@ -295,6 +601,65 @@ export class Hub {
     }
   }
 
+  /** Record a frame in the plot store and send it to the browsers. */
+  // deno-lint-ignore no-explicit-any
+  private publishFrame(sessionId: string, msg: Record<string, any>): string {
+    this.fonts.tag(msg.plot?.ops);
+    this.plots.record(sessionId, msg);
+    const data = JSON.stringify(msg);
+    this.broadcastFrame(sessionId, data, msg);
+    return data;
+  }
+
+  /** Relay mode: publish a frame received from the upstream server. */
+  relayFrame(line: string): void {
+    const { msg } = parseFrame(line);
+    if (!msg) return;
+    this.publishFrame(msg.plot?.sessionId || "default", msg);
+  }
+
+  /**
+   * Relay mode: adopt a session's state from the upstream server and
+   * pass it on to the browsers showing that session.  A follower that
+   * has no session yet takes this one.
+   */
+  relaySessionState(line: string): void {
+    let sessionId: string;
+    // deno-lint-ignore no-explicit-any
+    let plots: any[];
+    try {
+      const msg = JSON.parse(line);
+      if (typeof msg?.sessionId !== "string" || !Array.isArray(msg.plots)) return;
+      sessionId = msg.sessionId;
+      // Font ids are the upstream server's; replace them with ours.
+      for (const entry of msg.plots) this.fonts.tag(entry?.plot?.ops);
+      this.plots.load(sessionId, msg.plots);
+      plots = msg.plots;
+      line = JSON.stringify(msg);
+    } catch {
+      return;
+    }
+    for (const client of this.clients) {
+      const sub = this.subscriptions.get(client);
+      try {
+        if (sub && !sub.sessions.has(sessionId)) {
+          if (!sub.follow || sub.sessions.size > 0) {
+            this.deliver(client, this.activityNotice(sessionId));
+            continue;
+          }
+          sub.sessions.add(sessionId);
+        }
+        const sent = this.sentTo(client);
+        for (const entry of plots) {
+          if (Array.isArray(entry?.plot?.ops)) sent.add(sessionId, entry.plot.ops);
+        }
+        this.deliver(client, line);
+      } catch {
+        // Slow/dead client — ignore
+      }
+    }
+  }
+
   /**
    * Route a metrics request from R to browsers, with timeout fallback.
    */
@@ -339,9 +704,21 @@ export class Hub {
       originalId: id,
     });
 
-    // Forward to browsers with the remapped ID
+    // Forward to browsers with the remapped ID, on their control lane so
+    // the request does not wait behind frames already being sent.  The
+    // first answer wins, so relays are asked only when no browser is
+    // attached here: a relay without viewers answers with zeros at once.
     msg.id = serverId;
-    this.broadcastToClients(JSON.stringify(msg));
+    const data = JSON.stringify(msg);
+    const browsers = [...this.clients].filter((c) => !c.relay);
+    for (const client of browsers.length > 0 ? browsers : this.clients) {
+      try {
+        if (client.sendControl) client.sendControl(data);
+        else client.send(data);
+      } catch {
+        // Slow/dead client — ignore
+      }
+    }
 
     // Timeout: if no response in 2s, send zero-value fallback.
     // Look up the entry from metricsRouting at fire time (not capture
@@ -373,6 +750,10 @@ export class Hub {
    * Route a metrics response from a browser to the originating R session.
    */
   handleMetricsResponse(line: string): void {
+    if (this.upstream) {
+      this.upstream.forwardMetricsResponse(line);
+      return;
+    }
     let msg: Record<string, unknown>;
     try {
       const parsed = JSON.parse(line);
@@ -406,6 +787,22 @@ export class Hub {
     }
   }
 
+  /**
+   * Record a `frame_timing` report from a browser (the frame's `timing`
+   * object with renderer stamps added).
+   */
+  recordFrameTiming(line: string): void {
+    let timing: FrameTiming;
+    try {
+      const parsed = JSON.parse(line);
+      timing = parsed?.timing;
+    } catch {
+      return;
+    }
+    if (typeof timing !== "object" || timing === null) return;
+    this.latency.record(timing);
+  }
+
   /** Register a browser client. */
   registerClient(client: BrowserClient): void {
     this.clients.add(client);
@@ -417,6 +814,9 @@ export class Hub {
   /** Unregister a browser client. */
   unregisterClient(client: BrowserClient): void {
     this.clients.delete(client);
+    this.subscriptions.delete(client);
+    this.outbox.delete(client);
+    this.sentRasters.delete(client);
     console.error(
       `browser client disconnected (total: ${this.clients.size})`,
     );
@@ -430,6 +830,9 @@ export class Hub {
       } catch { /* ignore */ }
     }
     this.clients.clear();
+    this.subscriptions.clear();
+    this.outbox.clear();
+    this.sentRasters.clear();
 
     for (const session of this.sessions.values()) {
       try {
@@ -0,0 +1,153 @@
+// Per-stage frame latency aggregation for options(jgd.timing = TRUE).
+//
+// R stamps serialize start/end and send time into a frame's `timing`
+// object, the hub adds receive and broadcast times, and the renderer adds
+// parse start/end and render completion before echoing the object back as
+// a `frame_timing` message.  All stamps are wall-clock milliseconds since
+// the Unix epoch so they can be compared across processes on one machine.
+//
+// Every viewer of a frame reports it, so only the first report of each
+// frame id is counted; otherwise a frame would weigh as many samples as it
+// has viewers.  `rSend` is stamped into the frame before R writes it, so
+// the time R spends writing (including blocking on a full socket) is part
+// of the rToHub stage rather than of anything measured inside R.
+
+/** Timing object carried by a frame and echoed back by the renderer. */
+export interface FrameTiming {
+  id?: string;
+  rSerializeStart?: number;
+  rSerializeEnd?: number;
+  rSend?: number;
+  hubRecv?: number;
+  hubBroadcast?: number;
+  browserParseStart?: number;
+  browserParseEnd?: number;
+  browserRenderDone?: number;
+}
+
+/** Stage name → [start stamp, end stamp]. */
+const STAGES: Record<string, [keyof FrameTiming, keyof FrameTiming]> = {
+  serialize: ["rSerializeStart", "rSerializeEnd"],
+  rToHub: ["rSend", "hubRecv"],
+  hub: ["hubRecv", "hubBroadcast"],
+  hubToBrowser: ["hubBroadcast", "browserParseStart"],
+  parse: ["browserParseStart", "browserParseEnd"],
+  render: ["browserParseEnd", "browserRenderDone"],
+  total: ["rSerializeStart", "browserRenderDone"],
+};
+
+/**
+ * Upper bucket bounds in ms, roughly logarithmic from 0.1 ms to 10 s.
+ * A final implicit bucket catches everything above the last bound.
+ */
+export const LATENCY_BUCKETS = [
+  0.1, 0.25, 0.5, 1, 2.5, 5, 10, 25, 50, 100, 250, 500, 1000, 2500, 10000,
+];
+
+/** Frame ids remembered for de-duplicating reports from several viewers. */
+const SEEN_IDS_LIMIT = 4096;
+
+/** Wall clock in ms since the epoch, matching R's jgd_wall_ms(). */
+export function wallMs(): number {
+  return performance.timeOrigin + performance.now();
+}
+
+class StageHistogram {
+  count = 0;
+  sum = 0;
+  min = Infinity;
+  max = 0;
+  buckets = new Array<number>(LATENCY_BUCKETS.length + 1).fill(0);
+
+  add(ms: number): void {
+    // Clock skew between processes can make a tiny interval negative.
+    if (ms < 0) ms = 0;
+    this.count++;
+    this.sum += ms;
+    if (ms < this.min) this.min = ms;
+    if (ms > this.max) this.max = ms;
+    let i = 0;
+    while (i < LATENCY_BUCKETS.length && ms > LATENCY_BUCKETS[i]) i++;
+    this.buckets[i]++;
+  }
+
+  /** Approximate quantile: the upper bound of the bucket holding it. */
+  quantile(q: number): number {
+    if (this.count === 0) return 0;
+    const rank = Math.ceil(q * this.count);
+    let seen = 0;
+    for (let i = 0; i < this.buckets.length; i++) {
+      seen += this.buckets[i];
+      if (seen >= rank) {
+        return i < LATENCY_BUCKETS.length
+          ? Math.min(LATENCY_BUCKETS[i], this.max)
+          : this.max;
+      }
+    }
+    return this.max;
+  }
+
+  snapshot() {
+    return {
+      count: this.count,
+      mean: this.count ? this.sum / this.count : 0,
+      min: this.count ? this.min : 0,
+      max: this.max,
+      p50: this.quantile(0.5),
+      p90: this.quantile(0.9),
+      p99: this.quantile(0.99),
+      buckets: this.buckets.slice(),
+    };
+  }
+}
+
+/** Aggregates `frame_timing` reports into per-stage histograms. */
+export class LatencyStats {
+  private stages = new Map<string, StageHistogram>();
+  /** Ids of recently recorded frames; Set order is oldest first. */
+  private seen = new Set<string>();
+  frames = 0;
+
+  constructor() {
+    for (const name of Object.keys(STAGES)) {
+      this.stages.set(name, new StageHistogram());
+    }
+  }
+
+  /**
+   * Record one completed frame.  Stages with missing stamps are skipped,
+   * and so are further reports of a frame id already recorded.
+   */
+  record(t: FrameTiming): void {
+    if (typeof t.id === "string") {
+      if (this.seen.has(t.id)) return;
+      this.seen.add(t.id);
+      if (this.seen.size > SEEN_IDS_LIMIT) {
+        this.seen.delete(this.seen.values().next().value!);
+      }
+    }
+    this.frames++;
+    for (const [name, [from, to]] of Object.entries(STAGES)) {
+      const a = t[from];
+      const b = t[to];
+      if (typeof a === "number" && typeof b === "number") {
+        this.stages.get(name)!.add(b - a);
+      }
+    }
+  }
+
+  reset(): void {
+    this.frames = 0;
+    this.seen.clear();
+    for (const name of this.stages.keys()) {
+      this.stages.set(name, new StageHistogram());
+    }
+  }
+
+  /** JSON-ready summary served at GET /latency. */
+  snapshot() {
+    const stages: Record<string, ReturnType<StageHistogram["snapshot"]>> = {};
+    for (const [name, h] of this.stages) stages[name] = h.snapshot();
+    return { frames: this.frames, bucketBounds: LATENCY_BUCKETS, stages };
+  }
+}
@@ -2,13 +2,23 @@ import { parseArgs } from "jsr:@std/cli@1/parse-args";
 import { dirname, join, resolve } from "jsr:@std/path@1";
 import { Hub } from "./hub.ts";
 import { RSession } from "./r_session.ts";
-import { writeDiscovery, removeDiscovery } from "./discovery.ts";
+import {
+  DISCOVERY_REFRESH_MS,
+  type DiscoveryStatus,
+  removeDiscovery,
+  updateDiscovery,
+  writeDiscovery,
+} from "./discovery.ts";
 import { SERVER_NAME } from "./types.ts";
 import { handleWebSocket } from "./websocket.ts";
-import { serveStaticFile } from "./static.ts";
+import { serveFontFile, serveStaticFile } from "./static.ts";
 import { assets } from "./web_assets.ts";
+import { buildAssetCache, serveAsset } from "./asset_cache.ts";
 import { PipeListener } from "./named_pipe.ts";
 import { parseSocketUri, socketUri } from "./socket_uri.ts";
+import { Capture } from "./capture.ts";
+import { MAX_RASTER_SIZE, RenderBusyError, stopRasterWorker } from "./raster.ts";
+import { Relay } from "./relay.ts";
 
 function printUsage(): void {
   console.log(`Usage: jgd-server [options]
@@ -21,6 +31,11 @@ Options:
                     connections (port 0 = auto-assign)
   -web <dir>        Serve static files from directory instead of
                     embedded assets (for development)
+  -capture <file>   Record all R and browser traffic to a JSONL file
+                    (replay with tests/bench/replay.ts)
+  -relay <url>      Mirror another jgd server (ws://host:port/ws) for
+                    this server's browsers instead of accepting R
+                    connections
   -v                Verbose logging
   -h, --help        Show this help message`);
 }
@@ -30,17 +45,19 @@ async function main(): Promise<void> {
   // Deno's parseArgs (minimist-style) only recognises --long-flags,
   // so normalise single-dash long options before parsing.
   const rawArgs = Deno.args.map((a) =>
-    /^-(?:socket|http|tcp|web|h|v)$/.test(a) ? "-" + a : a,
+    /^-(?:socket|http|tcp|web|capture|relay|h|v)$/.test(a) ? "-" + a : a,
   );
 
   const args = parseArgs(rawArgs, {
-    string: ["socket", "http", "tcp", "web"],
+    string: ["socket", "http", "tcp", "web", "capture", "relay"],
     boolean: ["v", "h", "help"],
     default: {
       socket: "",
       http: "127.0.0.1:0",
       tcp: "",
       web: "",
+      capture: "",
+      relay: "",
       v: false,
     },
   });
@@ -59,6 +76,10 @@ async function main(): Promise<void> {
 
   const hub = new Hub();
   hub.verbose = verbose;
+  if (args.capture) {
+    hub.capture = new Capture(resolve(args.capture));
+    console.error(`capturing traffic to ${hub.capture.path}`);
+  }
 
   const isWindows = Deno.build.os === "windows";
   const tcpRequested = args.tcp !== "";
@@ -66,10 +87,21 @@ async function main(): Promise<void> {
   const useTcp = tcpRequested;
   const useNamedPipe = isWindows && !useTcp;
 
-  let socketPath: string;
-  let rListener: Deno.Listener | PipeListener;
+  let socketPath = "";
+  let rListener: Deno.Listener | PipeListener | null = null;
+  let relay: Relay | null = null;
 
-  if (useTcp) {
+  if (args.relay) {
+    // Relay mode: sessions come from the upstream server, not from R.
+    try {
+      relay = new Relay(args.relay, hub);
+    } catch (e) {
+      console.error(`${(e as Error).message}`);
+      Deno.exit(1);
+    }
+    hub.upstream = relay;
+    relay.start();
+  } else if (useTcp) {
     // TCP listener — explicit --tcp flag (any OS)
     const listener = Deno.listen({
       transport: "tcp",
@@ -111,7 +143,11 @@ async function main(): Promise<void> {
     rListener = Deno.listen({ transport: "unix", path: unixPath });
     hub.transport = "unix";
   }
-  console.error(`R listener: ${socketPath}`);
+  if (relay) console.error(`relaying ${args.relay}`);
+  else console.error(`R listener: ${socketPath}`);
+
+  // Compress and hash the embedded assets once, up front.
+  const assetCache = buildAssetCache(assets);
 
   // Start HTTP server (port 0 = auto-assign)
   const [httpHost, httpPortStr] = splitHostPort(args.http);
@@ -122,18 +158,30 @@ async function main(): Promise<void> {
       if (url.pathname === "/ws") {
         return handleWebSocket(req, hub);
       }
+      if (url.pathname === "/latency") {
+        if (url.searchParams.has("reset")) hub.latency.reset();
+        return new Response(JSON.stringify(hub.latency.snapshot()), {
+          headers: { "content-type": "application/json" },
+        });
+      }
+      if (url.pathname === "/font") {
+        return serveFontFile(url.searchParams.get("id"), hub.fonts);
+      }
+      if (url.pathname === "/plots") {
+        return new Response(JSON.stringify(hub.plots.list()), {
+          headers: { "content-type": "application/json" },
+        });
+      }
+      if (url.pathname === "/plot.png") {
+        return servePlotPng(url, hub);
+      }
       if (webDir) {
         return serveStaticFile(req, webDir);
       }
       // Serve from embedded assets
       const pathname = url.pathname === "/" ? "/index.html" : url.pathname;
-      const asset = assets[pathname];
-      if (!asset) {
-        return new Response("not found", { status: 404 });
-      }
-      return new Response(asset.body, {
-        headers: { "content-type": asset.type },
-      });
+      return serveAsset(req, assetCache, pathname) ??
+        new Response("not found", { status: 404 });
     },
   );
   const httpPort = httpServer.addr.port;
@@ -144,21 +192,41 @@ async function main(): Promise<void> {
   const activeConnections = new Set<Promise<void>>();
 
   // Accept R connections (runs until listener is closed)
-  acceptLoop(rListener, hub, activeConnections).catch((e) => {
-    if (!(e instanceof Deno.errors.BadResource)) {
-      console.error(`accept loop error: ${e}`);
-    }
-  });
+  if (rListener) {
+    acceptLoop(rListener, hub, activeConnections).catch((e) => {
+      if (!(e instanceof Deno.errors.BadResource)) {
+        console.error(`accept loop error: ${e}`);
+      }
+    });
+  }
 
   // Write discovery file before announcing readiness so clients can
   // find the socket immediately after parsing the readiness message.
   // TODO: httpUrl should use the configured --http host instead of
   // hardcoding 127.0.0.1 (with special-case for wildcard 0.0.0.0/::).
-  const discoveryPath = await writeDiscovery(
+  // A relay takes no R connections, so it is not advertised.  Running
+  // servers are listed together with their load, which is refreshed
+  // periodically so R can pick the least loaded one.
+  let lastRMessages = 0;
+  const discoveryStatus = (): DiscoveryStatus => {
+    const load = (hub.rMessages - lastRMessages) * 1000 / DISCOVERY_REFRESH_MS;
+    lastRMessages = hub.rMessages;
+    return {
+      transport: hub.transport,
+      sessions: hub.sessions.size,
+      load: Math.round(load * 100) / 100,
+    };
+  };
+  const discoveryPath = relay ? null : await writeDiscovery(
     socketPath,
     SERVER_NAME,
     { httpUrl: `http://127.0.0.1:${httpPort}/` },
+    undefined,
+    discoveryStatus(),
   );
+  const discoveryTimer = discoveryPath
+    ? setInterval(() => updateDiscovery(discoveryPath, discoveryStatus()), DISCOVERY_REFRESH_MS)
+    : undefined;
 
   // Install signal listener BEFORE announcing readiness so that
   // SIGTERM sent immediately after "ready" is handled gracefully.
@@ -168,7 +236,8 @@ async function main(): Promise<void> {
 
   // Print readiness message to stdout (parsed by test infrastructure)
   console.log("jgd server ready");
-  console.log(`  R socket:  ${socketPath}`);
+  if (relay) console.log(`  Relay of:  ${args.relay}`);
+  else console.log(`  R socket:  ${socketPath}`);
   console.log(`  HTTP:      http://127.0.0.1:${httpPort}/`);
 
   // Wait for shutdown signal
@@ -177,14 +246,17 @@ async function main(): Promise<void> {
   console.error(`received signal ${sig}, shutting down...`);
 
   // 1. Remove discovery file immediately so new clients stop discovering us
+  clearInterval(discoveryTimer);
   await removeDiscovery(discoveryPath);
 
-  // 2. Close R listener (stop accepting new connections)
-  rListener.close();
+  // 2. Close R listener (stop accepting new connections), or the
+  // upstream connection of a relay
+  rListener?.close();
+  relay?.close();
 
   // 3. Cleanup socket file (listener already closed).
   // Named pipes are kernel objects and don't need file removal.
-  if (!useTcp && !useNamedPipe) {
+  if (rListener && !useTcp && !useNamedPipe) {
     try {
       const addr = parseSocketUri(socketPath);
       if (addr.transport === "unix") await Deno.remove(addr.path);
@@ -196,6 +268,7 @@ async function main(): Promise<void> {
 
   // 5. Close hub (close all connections)
   hub.close();
+  await hub.capture?.flush();
 
   // 6. Wait for active connections with timeout
   await Promise.race([
@@ -203,6 +276,8 @@ async function main(): Promise<void> {
     new Promise((r) => setTimeout(r, 5000)),
   ]);
 
+  await hub.capture?.close();
+  stopRasterWorker();
   console.error("shutdown complete");
 }
 
@@ -243,6 +318,45 @@ function waitForSignal(...signals: Deno.Signal[]): Promise<string> {
   });
 }
 
+/**
+ * GET /plot.png?session=&plot=&width=&height= renders a stored plot with
+ * the server-side rasterizer.  Session and plot default to the latest;
+ * the size defaults to the device size, and a single dimension keeps the
+ * plot's aspect ratio.
+ */
+async function servePlotPng(url: URL, hub: Hub): Promise<Response> {
+  const params = url.searchParams;
+  const dims: Array<number | undefined> = [];
+  for (const name of ["width", "height"]) {
+    const v = params.get(name);
+    if (v === null || v === "") {
+      dims.push(undefined);
+      continue;
+    }
+    const n = Number(v);
+    if (!Number.isInteger(n) || n < 1 || n > MAX_RASTER_SIZE) {
+      return new Response(`${name} must be an integer from 1 to ${MAX_RASTER_SIZE}`, { status: 400 });
+    }
+    dims.push(n);
+  }
+  const plotParam = params.get("plot");
+  const plot = plotParam === null || plotParam === "" ? null : Number(plotParam);
+  if (plot !== null && !(Number.isInteger(plot) && plot >= 0)) {
+    return new Response("plot must be a non-negative integer", { status: 400 });
+  }
+  const ref = hub.plots.get(params.get("session"), plot);
+  if (!ref) return new Response("no such plot", { status: 404 });
+  try {
+    const png = await hub.plots.png(ref, dims[0], dims[1]);
+    return new Response(png, { headers: { "content-type": "image/png" } });
+  } catch (e) {
+    if (e instanceof RenderBusyError) {
+      return new Response("busy", { status: 503, headers: { "retry-after": "1" } });
+    }
+    return new Response(`render failed: ${e}`, { status: 500 });
+  }
+}
+
 /** Split "host:port" into [host, port]. */
 function splitHostPort(addr: string): [string, string] {
   const lastColon = addr.lastIndexOf(":");
@@ -0,0 +1,206 @@
+// Server-side copy of each session's plot history, kept so plots can be
+// rendered without a browser (see raster.ts and the /plot.png endpoint).
+//
+// The store mirrors the renderer's history bookkeeping: a frame with
+// plotIndex replaces that plot, an incremental frame appends to the plot
+// named by plotNumber, and any other frame replaces it.  Raster patches
+// are stored as they arrive and composed when a plot is read (see
+// composedOps and raster_slots.ts).
+
+import { rasterizePlotInWorker } from "./raster.ts";
+import { RasterSlots } from "./raster_slots.ts";
+
+/** Number of plots kept per session, matching R's JGD_MAX_SNAPSHOTS. */
+const MAX_PLOTS = 50;
+/** Sessions kept, including ones whose R connection has closed. */
+const MAX_SESSIONS = 8;
+/** Rendered PNGs kept in the LRU cache. */
+const MAX_CACHED_PNGS = 32;
+
+/** A plot's device description and accumulated drawing operations. */
+export interface StoredPlot {
+  // deno-lint-ignore no-explicit-any
+  device: Record<string, any>;
+  // deno-lint-ignore no-explicit-any
+  ops: any[];
+  /** Bumped whenever the plot changes; part of the PNG cache key. */
+  version: number;
+}
+
+/** Identifies one plot in the store. */
+export interface PlotRef {
+  sessionId: string;
+  plot: number;
+}
+
+export class PlotStore {
+  /** sessionId → plotNumber → plot.  Map order is least recently updated first. */
+  private sessions = new Map<string, Map<number, StoredPlot>>();
+  private versionCounter = 0;
+  private pngCache = new Map<string, Promise<ArrayBuffer>>();
+  private rasters = new RasterSlots();
+
+  /**
+   * Record a frame message (already parsed, sessionId already resolved).
+   * Frames without a plot object are ignored.
+   */
+  // deno-lint-ignore no-explicit-any
+  record(sessionId: string, msg: Record<string, any>): void {
+    const plot = msg.plot;
+    if (!plot || !Array.isArray(plot.ops)) return;
+
+    let plots = this.sessions.get(sessionId);
+    if (plots) {
+      this.sessions.delete(sessionId);
+    } else {
+      plots = new Map();
+    }
+    this.sessions.set(sessionId, plots);
+    this.evictSessions();
+
+    const ops = plot.ops;
+    this.rasters.note(sessionId, ops);
+    let index: number | undefined;
+    if (isPlotNumber(msg.plotIndex)) index = msg.plotIndex;
+    else if (isPlotNumber(msg.plotNumber)) index = msg.plotNumber;
+    else index = latestPlot(plots);
+    if (index === undefined) index = 0;
+
+    const existing = plots.get(index);
+    const version = ++this.versionCounter;
+    if (msg.incremental && !isPlotNumber(msg.plotIndex) && existing) {
+      for (const op of ops) existing.ops.push(op);
+      if (plot.device) existing.device = plot.device;
+      existing.version = version;
+      return;
+    }
+    plots.set(index, { device: plot.device ?? {}, ops: ops.slice(), version });
+    while (plots.size > MAX_PLOTS) {
+      plots.delete(Math.min(...plots.keys()));
+    }
+  }
+
+  /**
+   * Look up a plot.  The session defaults to the most recently updated one
+   * and the plot to that session's latest.
+   */
+  get(sessionId?: string | null, plot?: number | null): (PlotRef & { stored: StoredPlot }) | null {
+    let id = sessionId ?? undefined;
+    if (id === undefined) {
+      for (const key of this.sessions.keys()) id = key;
+    }
+    if (id === undefined) return null;
+    const plots = this.sessions.get(id);
+    if (!plots) return null;
+    const index = plot ?? latestPlot(plots);
+    if (index === undefined) return null;
+    const stored = plots.get(index);
+    return stored ? { sessionId: id, plot: index, stored } : null;
+  }
+
+  /** Sessions and their stored plot numbers, most recently updated last. */
+  list(): Array<{ sessionId: string; plots: number[] }> {
+    return [...this.sessions].map(([sessionId, plots]) => ({
+      sessionId,
+      plots: [...plots.keys()].sort((a, b) => a - b),
+    }));
+  }
+
+  /**
+   * Replace a session's plots with a copy received from another server
+   * (a `session_state` message's plots).
+   */
+  // deno-lint-ignore no-explicit-any
+  load(sessionId: string, entries: Array<{ plotNumber: unknown; plot?: Record<string, any> }>): void {
+    const plots = new Map<number, StoredPlot>();
+    for (const { plotNumber, plot } of entries) {
+      if (!isPlotNumber(plotNumber) || !plot || !Array.isArray(plot.ops)) continue;
+      this.rasters.note(sessionId, plot.ops);
+      plots.set(plotNumber, {
+        device: plot.device ?? {},
+        ops: plot.ops,
+        version: ++this.versionCounter,
+      });
+    }
+    this.sessions.delete(sessionId);
+    this.sessions.set(sessionId, plots);
+    this.evictSessions();
+  }
+
+  private evictSessions(): void {
+    while (this.sessions.size > MAX_SESSIONS) {
+      const oldest = this.sessions.keys().next().value!;
+      this.sessions.delete(oldest);
+      this.rasters.drop(oldest);
+    }
+  }
+
+  /** A session's stored plots in plot-number order (empty if unknown). */
+  plotsOf(sessionId: string): Array<PlotRef & { stored: StoredPlot }> {
+    const plots = this.sessions.get(sessionId);
+    if (!plots) return [];
+    return [...plots.keys()].sort((a, b) => a - b)
+      .map((plot) => ({ sessionId, plot, stored: plots.get(plot)! }));
+  }
+
+  /**
+   * A frame's ops with its raster patches composed (ops itself if there
+   * are none the store can compose).
+   */
+  // deno-lint-ignore no-explicit-any
+  composePatches(ops: any[]): Promise<any[]> {
+    return this.rasters.resolve(ops);
+  }
+
+  /**
+   * A stored plot's ops as they are now, with raster patches composed.
+   * The composed ops replace the patches in the store, so each patch is
+   * composed once.
+   */
+  // deno-lint-ignore no-explicit-any
+  async composedOps(stored: StoredPlot): Promise<any[]> {
+    const ops = stored.ops.slice();
+    const composed = await this.rasters.resolve(ops);
+    if (composed === ops) return ops;
+    for (let i = 0; i < composed.length; i++) {
+      if (stored.ops[i] === ops[i]) stored.ops[i] = composed[i];
+    }
+    return composed;
+  }
+
+  /**
+   * Render a plot to PNG at the given size (device size when omitted).
+   * Renders run in a worker; results are cached by plot version and size,
+   * and concurrent requests for the same image share one render.
+   */
+  png(ref: PlotRef & { stored: StoredPlot }, width?: number, height?: number): Promise<ArrayBuffer> {
+    const key = `${ref.sessionId}\0${ref.plot}\0${ref.stored.version}\0${width ?? ""}x${height ?? ""}`;
+    const hit = this.pngCache.get(key);
+    if (hit) {
+      this.pngCache.delete(key);
+      this.pngCache.set(key, hit);
+      return hit;
+    }
+    const { device } = ref.stored;
+    const render = this.composedOps(ref.stored)
+      .then((ops) => rasterizePlotInWorker({ device, ops }, width, height));
+    this.pngCache.set(key, render);
+    render.catch(() => this.pngCache.delete(key));
+    if (this.pngCache.size > MAX_CACHED_PNGS) {
+      this.pngCache.delete(this.pngCache.keys().next().value!);
+    }
+    return render;
+  }
+}
+
+function isPlotNumber(v: unknown): v is number {
+  return typeof v === "number" && Number.isInteger(v) && v >= 0;
+}
+
+function latestPlot(plots: Map<number, StoredPlot>): number | undefined {
+  let latest: number | undefined;
+  for (const key of plots.keys()) {
+    if (latest === undefined || key > latest) latest = key;
+  }
+  return latest;
+}
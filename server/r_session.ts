@@ -1,6 +1,6 @@
 import type { Hub } from "./hub.ts";
 import { SERVER_NAME } from "./types.ts";
-import type { ServerInfoMessage } from "./types.ts";
+import type { ResizeMode, ServerInfoMessage } from "./types.ts";
 
 /**
  * Narrow interface covering only the members that RSession and test helpers
@@ -33,6 +33,13 @@ export class RSession {
   lastResizeHadPlotIndex = false;
   /** True when the server remapped this session's ID (retired ID dedup). */
   remappedSessionId = false;
+  /**
+   * The device's `jgd(resize =)` mode.  Scaled sessions ("scale",
+   * "reflow") only receive resizes the renderer marks as `relayout`.
+   */
+  resizeMode: ResizeMode = "replay";
+  /** Connection id in the capture file (empty when not capturing). */
+  private captureId: string;
   private conn: RConn;
   private hub: Hub;
   private encoder = new TextEncoder();
@@ -44,10 +51,12 @@ export class RSession {
     this.id = `conn-${sessionCounter}`;
     this.conn = conn;
     this.hub = hub;
+    this.captureId = hub.capture?.newRConn() ?? "";
   }
 
   /** Send a message string to R, followed by a newline. */
   send(data: string): Promise<void> {
+    this.hub.capture?.record("s2r", this.captureId, data);
     const bytes = this.encoder.encode(data + "\n");
     const p = this.writeQueue.then(() => writeAll(this.conn, bytes));
     // Keep the chain going even if a write fails, so subsequent
@@ -76,6 +85,7 @@ export class RSession {
    */
   async run(): Promise<void> {
     this.hub.registerSession(this);
+    this.hub.capture?.record("r_open", this.captureId);
 
     try {
       const reader = this.conn.readable
@@ -94,6 +104,7 @@ export class RSession {
           buffer = buffer.slice(newlineIdx + 1);
 
           if (line.length === 0) continue;
+          this.hub.capture?.record("r2s", this.captureId, line);
 
           // Send welcome after the first line is received.  On Windows
           // named pipes, writing to the socket before the first read
@@ -151,6 +162,7 @@ export class RSession {
         console.error(`R session ${this.id} disconnected`);
       }
     } finally {
+      this.hub.capture?.record("r_close", this.captureId);
       this.hub.unregisterSession(this.id);
     }
   }
@@ -0,0 +1,998 @@
+// Dependency-free software rasterizer for jgd plots.
+//
+// Renders a plot's op list to an RGBA buffer and encodes it as PNG, so the
+// server can produce thumbnails and exports without a browser.  Everything
+// is reduced to polygon fills: a scanline filler with 5 sub-rows per pixel
+// and exact horizontal coverage provides anti-aliasing, strokes are built
+// as unions of segment, join and cap polygons, and text is drawn with an
+// embedded 5x7 bitmap font.  The output approximates the browser renderer
+// rather than matching it pixel for pixel.
+//
+// Not drawn: pattern fills (the plain fill colour is used if present),
+// clip paths, masks, compositing groups, glyph runs and gc.ext effects.
+//
+// The hub renders through rasterizePlotInWorker, which runs the same code
+// in a worker (raster_worker.ts) so a render never blocks the event loop.
+
+/** Sub-rows sampled per pixel row. */
+const SUBSAMPLES = 5;
+/** Maximum chord error (output px) when flattening circles and round joins. */
+const ARC_TOLERANCE = 0.1;
+/** Numbers stored per edge in the scanline edge table. */
+const EDGE_FIELDS = 5;
+/** Largest image dimension the rasterizer will allocate. */
+export const MAX_RASTER_SIZE = 4096;
+
+// deno-lint-ignore no-explicit-any
+type Op = Record<string, any>;
+// deno-lint-ignore no-explicit-any
+type Gc = Record<string, any> | null | undefined;
+
+/** Non-premultiplied RGBA colour, components 0-255 (alpha 0-1). */
+type Color = [number, number, number, number];
+
+/** A closed polygon as a flat [x0, y0, x1, y1, ...] array in output px. */
+type Poly = number[];
+
+/** Axis-aligned clip rectangle in output px. */
+interface Clip {
+  x0: number;
+  y0: number;
+  x1: number;
+  y1: number;
+}
+
+/**
+ * Render a plot to PNG.  The output is the device size scaled to
+ * width × height; when only one is given the aspect ratio is kept.
+ */
+export async function rasterizePlot(
+  // deno-lint-ignore no-explicit-any
+  plot: { device?: Record<string, any>; ops: Op[] },
+  width?: number,
+  height?: number,
+): Promise<ArrayBuffer> {
+  const devW = positive(plot.device?.width) ?? 720;
+  const devH = positive(plot.device?.height) ?? 576;
+  let w = width ?? (height ? (height * devW) / devH : devW);
+  let h = height ?? (width ? (width * devH) / devW : devH);
+  w = Math.max(1, Math.min(MAX_RASTER_SIZE, Math.round(w)));
+  h = Math.max(1, Math.min(MAX_RASTER_SIZE, Math.round(h)));
+
+  const r = new Rasterizer(w, h, w / devW, h / devH);
+  const bg = parseColor(plot.device?.bg);
+  if (bg) r.fillPolys([[0, 0, w, 0, w, h, 0, h]], "nonzero", bg);
+  await r.drawOps(plot.ops);
+  return encodePng(r.pixels, w, h);
+}
+
+class Rasterizer {
+  readonly pixels: Uint8ClampedArray;
+  private clip: Clip;
+  /** Per-row coverage accumulators, reused across fills. */
+  private acc: Float32Array;
+  private run: Float32Array;
+  /** Scanline scratch: crossings, their winding directions, active edges. */
+  private xs = new Float64Array(64);
+  private dirs = new Int8Array(64);
+  private active = new Int32Array(64);
+
+  constructor(
+    readonly width: number,
+    readonly height: number,
+    readonly sx: number,
+    readonly sy: number,
+  ) {
+    this.pixels = new Uint8ClampedArray(width * height * 4);
+    this.clip = { x0: 0, y0: 0, x1: width, y1: height };
+    this.acc = new Float32Array(width + 2);
+    this.run = new Float32Array(width + 2);
+  }
+
+  /** Device-space coordinate pairs → output px. */
+  private tx(pts: number[]): Poly {
+    const out = new Array<number>(pts.length);
+    for (let i = 0; i < pts.length; i += 2) {
+      out[i] = pts[i] * this.sx;
+      out[i + 1] = pts[i + 1] * this.sy;
+    }
+    return out;
+  }
+
+  async drawOps(ops: Op[]): Promise<void> {
+    for (const op of ops) {
+      if (!op || typeof op !== "object") continue;
+      try {
+        await this.drawOp(op);
+      } catch {
+        // A malformed op skips itself, not the rest of the plot.
+      }
+    }
+  }
+
+  private async drawOp(op: Op): Promise<void> {
+    const gc: Gc = op.gc;
+    switch (op.op) {
+      case "line":
+        this.stroke([[op.x1, op.y1, op.x2, op.y2]], false, gc);
+        break;
+      case "polyline":
+        this.stroke([xyPairs(op.x, op.y)], false, gc);
+        break;
+      case "polygon": {
+        const pts = xyPairs(op.x, op.y);
+        this.fill([pts], "nonzero", gc);
+        this.stroke([pts], true, gc);
+        break;
+      }
+      case "rect": {
+        const pts = rectPoints(op);
+        this.fill([pts], "nonzero", gc);
+        this.stroke([pts], true, gc);
+        break;
+      }
+      case "circle": {
+        const pts = this.circlePoints(op.x, op.y, op.r);
+        this.fill([pts], "nonzero", gc);
+        this.strokeCircle(op.x, op.y, op.r, pts, gc);
+        break;
+      }
+      case "path": {
+        const subpaths = pathSubpaths(op.subpaths);
+        this.fill(subpaths, op.winding === "evenodd" ? "evenodd" : "nonzero", gc);
+        this.stroke(subpaths, true, gc);
+        break;
+      }
+      case "drawPath": {
+        const rule = op.rule === "evenodd" ? "evenodd" : "nonzero";
+        if (op.mode !== "stroke") {
+          this.fill(this.shapeSubpaths(op.ops, false).map((s) => s.pts), rule, gc);
+        }
+        if (op.mode !== "fill") {
+          for (const s of this.shapeSubpaths(op.ops, true)) this.stroke([s.pts], s.closed, gc);
+        }
+        break;
+      }
+      case "text":
+        this.text(op);
+        break;
+      case "raster":
+        await this.raster(op);
+        break;
+      case "clip": {
+        const x0 = Math.min(op.x0, op.x1) * this.sx;
+        const x1 = Math.max(op.x0, op.x1) * this.sx;
+        const y0 = Math.min(op.y0, op.y1) * this.sy;
+        const y1 = Math.max(op.y0, op.y1) * this.sy;
+        this.clip = {
+          x0: Math.max(0, x0),
+          y0: Math.max(0, y0),
+          x1: Math.min(this.width, x1),
+          y1: Math.min(this.height, y1),
+        };
+        break;
+      }
+    }
+  }
+
+  /** Subpaths of a drawPath's shape ops, in device space. */
+  private shapeSubpaths(ops: Op[] | undefined, withLines: boolean): Array<{ pts: number[]; closed: boolean }> {
+    const out: Array<{ pts: number[]; closed: boolean }> = [];
+    for (const o of ops ?? []) {
+      switch (o.op) {
+        case "line":
+          if (withLines) out.push({ pts: [o.x1, o.y1, o.x2, o.y2], closed: false });
+          break;
+        case "polyline":
+          if (withLines) out.push({ pts: xyPairs(o.x, o.y), closed: false });
+          break;
+        case "polygon":
+          out.push({ pts: xyPairs(o.x, o.y), closed: true });
+          break;
+        case "rect":
+          out.push({ pts: rectPoints(o), closed: true });
+          break;
+        case "circle":
+          out.push({ pts: this.circlePoints(o.x, o.y, o.r), closed: true });
+          break;
+        case "path":
+          for (const pts of pathSubpaths(o.subpaths)) out.push({ pts, closed: true });
+          break;
+      }
+    }
+    return out;
+  }
+
+  /** Circle outline in device space, flattened to the arc tolerance. */
+  private circlePoints(cx: number, cy: number, r: number): number[] {
+    const n = arcSegments(r * Math.max(this.sx, this.sy));
+    const pts = new Array<number>(n * 2);
+    for (let i = 0; i < n; i++) {
+      const a = (2 * Math.PI * i) / n;
+      pts[2 * i] = cx + r * Math.cos(a);
+      pts[2 * i + 1] = cy + r * Math.sin(a);
+    }
+    return pts;
+  }
+
+  /** Undashed circle outlines are a ring: outer circle minus inner circle. */
+  private strokeCircle(x: number, y: number, r: number, pts: number[], gc: Gc): void {
+    const hw = (positive(gc?.lwd) ?? 1) / 2;
+    if (!gc || (Array.isArray(gc.lty) && gc.lty.length > 0) || !(r > hw)) {
+      this.stroke([pts], true, gc);
+      return;
+    }
+    const col = parseColor(gc.col);
+    if (!col) return;
+    const outer = this.circlePoints(x, y, r + hw);
+    const inner = this.circlePoints(x, y, r - hw).reverse();
+    // reverse() swapped each pair's x and y; swap them back.
+    for (let i = 0; i < inner.length; i += 2) [inner[i], inner[i + 1]] = [inner[i + 1], inner[i]];
+    this.fillPolys([this.tx(outer), this.tx(inner)], "nonzero", col);
+  }
+
+  private fill(subpaths: number[][], rule: "nonzero" | "evenodd", gc: Gc): void {
+    if (!gc) return;
+    const col = parseColor(gc.fill);
+    if (!col) return;
+    this.fillPolys(subpaths.map((p) => this.tx(p)), rule, col);
+  }
+
+  /**
+   * Stroke polylines (device space).  The outline is a union of
+   * same-orientation segment quads, joins and caps, which a nonzero fill
+   * merges into one shape without double-blending the overlaps.
+   */
+  private stroke(lines: number[][], closed: boolean, gc: Gc): void {
+    if (!gc) return;
+    const col = parseColor(gc.col);
+    if (!col) return;
+    const hw = (positive(gc.lwd) ?? 1) / 2;
+    const cap = gc.lend === "butt" || gc.lend === "square" ? gc.lend : "round";
+    let join = gc.ljoin === "miter" || gc.ljoin === "bevel" ? gc.ljoin : "round";
+    const scale = Math.max(this.sx, this.sy);
+    // Sub-pixel lines: round joins are indistinguishable from bevels.
+    if (hw * scale < 1 && join === "round") join = "bevel";
+    const mitre = positive(gc.lmitre) ?? 10;
+    const dashes = Array.isArray(gc.lty) && gc.lty.length > 0 && gc.lty.every((d: unknown) => typeof d === "number" && d >= 0) &&
+        gc.lty.some((d: number) => d > 0)
+      ? gc.lty as number[]
+      : null;
+
+    const polys: Poly[] = [];
+    for (const raw of lines) {
+      let pts = dedupe(raw);
+      if (pts.length < 2) continue;
+      const isClosed = closed && pts.length >= 6;
+      if (isClosed && pts[0] === pts[pts.length - 2] && pts[1] === pts[pts.length - 1]) {
+        pts = pts.slice(0, -2);
+      }
+      if (dashes) {
+        const path = isClosed ? pts.concat(pts[0], pts[1]) : pts;
+        for (const dash of dashSplit(path, dashes)) {
+          this.strokePieces(dash, false, hw, cap, join, mitre, polys);
+        }
+      } else {
+        this.strokePieces(pts, isClosed, hw, cap, join, mitre, polys);
+      }
+    }
+    if (polys.length > 0) this.fillPolys(polys.map((p) => this.tx(p)), "nonzero", col);
+  }
+
+  private strokePieces(
+    pts: number[],
+    closed: boolean,
+    hw: number,
+    cap: string,
+    join: string,
+    mitre: number,
+    out: Poly[],
+  ): void {
+    const n = pts.length / 2;
+    if (n === 1) {
+      // Zero-length dash or segment: only round and square caps show.
+      const x = pts[0], y = pts[1];
+      if (cap === "round") out.push(this.circlePoints(x, y, hw));
+      else if (cap === "square") out.push([x - hw, y - hw, x + hw, y - hw, x + hw, y + hw, x - hw, y + hw]);
+      return;
+    }
+    const segs = closed ? n : n - 1;
+    for (let i = 0; i < segs; i++) {
+      const j = (i + 1) % n;
+      let x0 = pts[2 * i], y0 = pts[2 * i + 1];
+      let x1 = pts[2 * j], y1 = pts[2 * j + 1];
+      const len = Math.hypot(x1 - x0, y1 - y0);
+      const ux = (x1 - x0) / len, uy = (y1 - y0) / len;
+      if (!closed && cap === "square") {
+        if (i === 0) { x0 -= ux * hw; y0 -= uy * hw; }
+        if (i === segs - 1) { x1 += ux * hw; y1 += uy * hw; }
+      }
+      const nx = -uy * hw, ny = ux * hw;
+      out.push(oriented([x0 + nx, y0 + ny, x1 + nx, y1 + ny, x1 - nx, y1 - ny, x0 - nx, y0 - ny]));
+    }
+    const firstJoin = closed ? 0 : 1;
+    const lastJoin = closed ? n - 1 : n - 2;
+    for (let i = firstJoin; i <= lastJoin; i++) {
+      const p = (i - 1 + n) % n, q = (i + 1) % n;
+      this.joinPiece(pts[2 * p], pts[2 * p + 1], pts[2 * i], pts[2 * i + 1], pts[2 * q], pts[2 * q + 1], hw, join, mitre, out);
+    }
+    if (!closed && cap === "round") {
+      out.push(this.circlePoints(pts[0], pts[1], hw));
+      out.push(this.circlePoints(pts[2 * n - 2], pts[2 * n - 1], hw));
+    }
+  }
+
+  /** Fill the outer wedge at vertex (x, y) between segments a→v and v→b. */
+  private joinPiece(
+    ax: number, ay: number, x: number, y: number, bx: number, by: number,
+    hw: number, join: string, mitre: number, out: Poly[],
+  ): void {
+    if (join === "round") {
+      out.push(this.circlePoints(x, y, hw));
+      return;
+    }
+    const l0 = Math.hypot(x - ax, y - ay), l1 = Math.hypot(bx - x, by - y);
+    const d0x = (x - ax) / l0, d0y = (y - ay) / l0;
+    const d1x = (bx - x) / l1, d1y = (by - y) / l1;
+    const cross = d0x * d1y - d0y * d1x;
+    if (Math.abs(cross) < 1e-9 && d0x * d1x + d0y * d1y > 0) return; // straight on
+    // Offset towards the outside of the turn.
+    const s = cross > 0 ? -1 : 1;
+    const n0x = -d0y * hw * s, n0y = d0x * hw * s;
+    const n1x = -d1y * hw * s, n1y = d1x * hw * s;
+    if (join === "miter") {
+      const mx = n0x + n1x, my = n0y + n1y;
+      const ml = Math.hypot(mx, my);
+      // cos of half the angle between the offset normals.
+      const cosHalf = ml / (2 * hw);
+      if (cosHalf > 1e-9 && 1 / cosHalf <= mitre) {
+        const k = hw / cosHalf / ml;
+        out.push(oriented([x, y, x + n0x, y + n0y, x + mx * k, y + my * k, x + n1x, y + n1y]));
+        return;
+      }
+    }
+    out.push(oriented([x, y, x + n0x, y + n0y, x + n1x, y + n1y]));
+  }
+
+  /** Draw text with the built-in 5x7 bitmap font. */
+  private text(op: Op): void {
+    const gc: Gc = op.gc;
+    const col = parseColor(gc?.col);
+    const str = typeof op.str === "string" ? op.str : "";
+    if (!col || str.length === 0) return;
+    const em = positive(gc?.font?.size) ?? 12;
+    const unit = em / 10;
+    const chars = [...str];
+    const width = chars.length * 6 * unit;
+    const hadj = typeof op.hadj === "number" ? op.hadj : 0;
+    const a = (-(op.rot || 0) * Math.PI) / 180;
+    const cos = Math.cos(a), sin = Math.sin(a);
+    const ox = -hadj * width;
+    // Bold faces draw each column half a cell wider.
+    const bold = gc?.font?.face === 2 || gc?.font?.face === 4 ? 0.5 : 0;
+    const map = (u: number, v: number, out: number[]) => {
+      out.push(op.x + u * cos - v * sin, op.y + u * sin + v * cos);
+    };
+
+    const polys: Poly[] = [];
+    for (let c = 0; c < chars.length; c++) {
+      const glyph = glyphColumns(chars[c]);
+      for (let row = 0; row < 7; row++) {
+        // Merge horizontal runs of set bits into one rectangle.
+        let start = -1;
+        for (let col5 = 0; col5 <= 5; col5++) {
+          const on = col5 < 5 && (glyph[col5] >> row) & 1;
+          if (on && start < 0) start = col5;
+          if (!on && start >= 0) {
+            const u0 = ox + (c * 6 + start) * unit;
+            const u1 = ox + (c * 6 + col5 + bold) * unit;
+            const v0 = (row - 7) * unit, v1 = (row - 6) * unit;
+            const quad: number[] = [];
+            map(u0, v0, quad);
+            map(u1, v0, quad);
+            map(u1, v1, quad);
+            map(u0, v1, quad);
+            polys.push(oriented(quad));
+            start = -1;
+          }
+        }
+      }
+    }
+    if (polys.length > 0) this.fillPolys(polys.map((p) => this.tx(p)), "nonzero", col);
+  }
+
+  /** Draw a raster op; y is the image's bottom edge, rotation is about its centre. */
+  private async raster(op: Op): Promise<void> {
+    if (typeof op.data !== "string") return;
+    const img = await decodePngDataUri(op.data);
+    if (!img) return;
+    const aw = Math.abs(op.w), ah = Math.abs(op.h);
+    if (!(aw > 0 && ah > 0)) return;
+    const dx = op.w >= 0 ? op.x : op.x + op.w;
+    const dy = op.y - ah;
+    const cx = (dx + aw / 2) * this.sx, cy = (dy + ah / 2) * this.sy;
+    const hw = (aw / 2) * this.sx, hh = (ah / 2) * this.sy;
+    const a = (-(op.rot || 0) * Math.PI) / 180;
+    const cos = Math.cos(a), sin = Math.sin(a);
+    // Bounding box of the rotated image.
+    const ex = Math.abs(hw * cos) + Math.abs(hh * sin);
+    const ey = Math.abs(hw * sin) + Math.abs(hh * cos);
+    const clip = this.clip;
+    const px0 = Math.max(Math.floor(clip.x0), Math.floor(cx - ex));
+    const px1 = Math.min(Math.ceil(clip.x1), Math.ceil(cx + ex));
+    const py0 = Math.max(Math.floor(clip.y0), Math.floor(cy - ey));
+    const py1 = Math.min(Math.ceil(clip.y1), Math.ceil(cy + ey));
+    const smooth = !!op.interpolate;
+    const col: Color = [0, 0, 0, 0];
+    for (let py = py0; py < py1; py++) {
+      const cover = Math.min(py + 1, clip.y1) - Math.max(py, clip.y0);
+      if (cover <= 0) continue;
+      for (let px = px0; px < px1; px++) {
+        const cov = cover * (Math.min(px + 1, clip.x1) - Math.max(px, clip.x0));
+        if (cov <= 0) continue;
+        // Inverse-rotate the pixel centre into image space.
+        const rx = px + 0.5 - cx, ry = py + 0.5 - cy;
+        const u = ((rx * cos + ry * sin) / (2 * hw) + 0.5) * img.width;
+        const v = ((-rx * sin + ry * cos) / (2 * hh) + 0.5) * img.height;
+        if (u < 0 || v < 0 || u >= img.width || v >= img.height) continue;
+        if (smooth) sampleBilinear(img, u, v, col);
+        else sampleNearest(img, u, v, col);
+        this.blend((py * this.width + px) * 4, col, cov);
+      }
+    }
+  }
+
+  /**
+   * Scanline polygon fill with anti-aliasing.  Each pixel row samples
+   * SUBSAMPLES sub-rows; spans between winding-rule crossings add their
+   * exact horizontal overlap with every pixel, so coverage is exact in x
+   * and quantised to 1/SUBSAMPLES in y.
+   */
+  fillPolys(polys: Poly[], rule: "nonzero" | "evenodd", col: Color): void {
+    const clip = this.clip;
+    if (clip.x1 <= clip.x0 || clip.y1 <= clip.y0) return;
+
+    // Edge table, EDGE_FIELDS numbers per edge: top y, bottom y, x at
+    // top, dx/dy, winding direction.
+    let count = 0;
+    for (const p of polys) if (p.length >= 6) count += p.length / 2;
+    const edges = new Float64Array(count * EDGE_FIELDS);
+    let ne = 0;
+    let ymin = Infinity, ymax = -Infinity;
+    for (const p of polys) {
+      const n = p.length / 2;
+      if (n < 3) continue;
+      for (let i = 0; i < n; i++) {
+        const j = i + 1 === n ? 0 : i + 1;
+        const x0 = p[2 * i], y0 = p[2 * i + 1], x1 = p[2 * j], y1 = p[2 * j + 1];
+        if (y0 === y1 || !(Number.isFinite(x0) && Number.isFinite(y0) && Number.isFinite(x1) && Number.isFinite(y1))) continue;
+        const down = y1 > y0;
+        const o = ne++ * EDGE_FIELDS;
+        edges[o] = down ? y0 : y1;
+        edges[o + 1] = down ? y1 : y0;
+        edges[o + 2] = down ? x0 : x1;
+        edges[o + 3] = (x1 - x0) / (y1 - y0);
+        edges[o + 4] = down ? 1 : -1;
+        if (edges[o] < ymin) ymin = edges[o];
+        if (edges[o + 1] > ymax) ymax = edges[o + 1];
+      }
+    }
+    if (ne === 0) return;
+    const order = new Array<number>(ne);
+    for (let i = 0; i < ne; i++) order[i] = i * EDGE_FIELDS;
+    order.sort((a, b) => edges[a] - edges[b]);
+
+    if (this.xs.length < ne) {
+      this.xs = new Float64Array(ne * 2);
+      this.dirs = new Int8Array(ne * 2);
+      this.active = new Int32Array(ne * 2);
+    }
+    const xs = this.xs, dirs = this.dirs, active = this.active;
+    const acc = this.acc, run = this.run;
+    const rowStart = Math.max(Math.floor(ymin), Math.floor(clip.y0));
+    const rowEnd = Math.min(Math.ceil(ymax), Math.ceil(clip.y1));
+    const weight = 1 / SUBSAMPLES;
+    const evenodd = rule === "evenodd";
+    let nactive = 0;
+    let next = 0;
+    // Skip edges that end above the first row.
+    const firstY = rowStart + 0.5 / SUBSAMPLES;
+
+    for (let py = rowStart; py < rowEnd; py++) {
+      let spanMin = Infinity, spanMax = -Infinity;
+      for (let s = 0; s < SUBSAMPLES; s++) {
+        const ys = py + (s + 0.5) / SUBSAMPLES;
+        while (next < ne && edges[order[next]] <= ys) {
+          const o = order[next++];
+          if (edges[o + 1] > firstY) active[nactive++] = o;
+        }
+        // Drop finished edges and collect crossings, sorted by x.
+        let k = 0, nx = 0;
+        for (let i = 0; i < nactive; i++) {
+          const o = active[i];
+          if (edges[o + 1] <= ys) continue;
+          active[k++] = o;
+          const x = edges[o + 2] + (ys - edges[o]) * edges[o + 3];
+          const d = edges[o + 4];
+          // Insertion sort: crossing lists are short and nearly sorted.
+          let m = nx++;
+          while (m > 0 && xs[m - 1] > x) {
+            xs[m] = xs[m - 1];
+            dirs[m] = dirs[m - 1];
+            m--;
+          }
+          xs[m] = x;
+          dirs[m] = d;
+        }
+        nactive = k;
+        if (ys < clip.y0 || ys >= clip.y1) continue;
+
+        let wind = 0;
+        for (let i = 0; i < nx - 1; i++) {
+          wind += dirs[i];
+          if (evenodd ? (wind & 1) === 0 : wind === 0) continue;
+          const xa = Math.max(xs[i], clip.x0), xb = Math.min(xs[i + 1], clip.x1);
+          if (xb <= xa) continue;
+          const ia = Math.floor(xa), ib = Math.floor(xb);
+          if (ia === ib) {
+            acc[ia] += (xb - xa) * weight;
+          } else {
+            acc[ia] += (ia + 1 - xa) * weight;
+            run[ia + 1] += weight;
+            run[ib] -= weight;
+            acc[ib] += (xb - ib) * weight;
+          }
+          if (ia < spanMin) spanMin = ia;
+          if (ib > spanMax) spanMax = ib;
+        }
+      }
+      if (spanMin > spanMax) continue;
+
+      let full = 0;
+      const rowBase = py * this.width;
+      const last = Math.min(spanMax, this.width - 1);
+      for (let px = spanMin; px <= spanMax + 1; px++) {
+        full += run[px];
+        const cov = acc[px] + full;
+        acc[px] = 0;
+        run[px] = 0;
+        if (px <= last && cov > 1e-4) this.blend((rowBase + px) * 4, col, cov > 1 ? 1 : cov);
+      }
+    }
+  }
+
+  /** Source-over blend of a non-premultiplied colour at coverage cov. */
+  private blend(i: number, col: Color, cov: number): void {
+    const px = this.pixels;
+    const sa = col[3] * cov;
+    if (sa <= 0) return;
+    const da = px[i + 3] / 255;
+    const oa = sa + da * (1 - sa);
+    const kd = (da * (1 - sa)) / oa, ks = sa / oa;
+    px[i] = col[0] * ks + px[i] * kd;
+    px[i + 1] = col[1] * ks + px[i + 1] * kd;
+    px[i + 2] = col[2] * ks + px[i + 2] * kd;
+    px[i + 3] = oa * 255;
+  }
+}
+
+// ---- geometry helpers ----
+
+function positive(v: unknown): number | undefined {
+  return typeof v === "number" && Number.isFinite(v) && v > 0 ? v : undefined;
+}
+
+function xyPairs(x: unknown, y: unknown): number[] {
+  if (!Array.isArray(x) || !Array.isArray(y)) return [];
+  const n = Math.min(x.length, y.length);
+  const out = new Array<number>(n * 2);
+  for (let i = 0; i < n; i++) {
+    out[2 * i] = x[i];
+    out[2 * i + 1] = y[i];
+  }
+  return out;
+}
+
+function rectPoints(o: Op): number[] {
+  return [o.x0, o.y0, o.x1, o.y0, o.x1, o.y1, o.x0, o.y1];
+}
+
+function pathSubpaths(subpaths: unknown): number[][] {
+  if (!Array.isArray(subpaths)) return [];
+  return subpaths.filter(Array.isArray).map((sub: number[][]) => sub.flat());
+}
+
+/** Drop consecutive duplicate points (they have no direction). */
+function dedupe(pts: number[]): number[] {
+  const out: number[] = [];
+  for (let i = 0; i + 1 < pts.length; i += 2) {
+    const x = pts[i], y = pts[i + 1];
+    if (!Number.isFinite(x) || !Number.isFinite(y)) continue;
+    const n = out.length;
+    if (n >= 2 && out[n - 2] === x && out[n - 1] === y) continue;
+    out.push(x, y);
+  }
+  return out;
+}
+
+/** Reverse a polygon if needed so every stroke piece winds the same way. */
+function oriented(p: number[]): number[] {
+  let area = 0;
+  const n = p.length / 2;
+  for (let i = 0; i < n; i++) {
+    const j = (i + 1) % n;
+    area += p[2 * i] * p[2 * j + 1] - p[2 * j] * p[2 * i + 1];
+  }
+  if (area >= 0) return p;
+  const out = new Array<number>(p.length);
+  for (let i = 0; i < n; i++) {
+    out[2 * i] = p[2 * (n - 1 - i)];
+    out[2 * i + 1] = p[2 * (n - 1 - i) + 1];
+  }
+  return out;
+}
+
+/** Segments needed to keep a circle of radius r (output px) within tolerance. */
+function arcSegments(r: number): number {
+  if (!(r > ARC_TOLERANCE)) return 8;
+  const n = Math.ceil(Math.PI / Math.acos(1 - ARC_TOLERANCE / r));
+  return Math.max(8, Math.min(256, n));
+}
+
+/** Split a polyline into dashes following an on/off length pattern. */
+function dashSplit(pts: number[], pattern: number[]): number[][] {
+  const dashes: number[][] = [];
+  let k = 0;
+  let left = pattern[0];
+  let on = true;
+  let cur: number[] | null = [pts[0], pts[1]];
+  for (let i = 2; i < pts.length; i += 2) {
+    let x0 = pts[i - 2], y0 = pts[i - 1];
+    const x1 = pts[i], y1 = pts[i + 1];
+    let len = Math.hypot(x1 - x0, y1 - y0);
+    while (len > left) {
+      const t = left / len;
+      x0 += (x1 - x0) * t;
+      y0 += (y1 - y0) * t;
+      len -= left;
+      if (on && cur) {
+        cur.push(x0, y0);
+        dashes.push(cur);
+        cur = null;
+      } else {
+        cur = [x0, y0];
+      }
+      on = !on;
+      k = (k + 1) % pattern.length;
+      left = pattern[k];
+    }
+    left -= len;
+    if (on && cur) cur.push(x1, y1);
+  }
+  if (on && cur && cur.length >= 4) dashes.push(cur);
+  return dashes.map(dedupe).filter((d) => d.length >= 2);
+}
+
+// ---- colour ----
+
+const colorCache = new Map<string, Color | null>();
+
+/** Parse "rgba(r,g,b,a)", "rgb(r,g,b)" or "#rrggbb[aa]"; null for none. */
+function parseColor(s: unknown): Color | null {
+  if (typeof s !== "string") return null;
+  const cached = colorCache.get(s);
+  if (cached !== undefined) return cached;
+  let col: Color | null = null;
+  const m = /^rgba?\(\s*([\d.]+)\s*,\s*([\d.]+)\s*,\s*([\d.]+)\s*(?:,\s*([\d.]+)\s*)?\)$/.exec(s);
+  if (m) {
+    col = [+m[1], +m[2], +m[3], m[4] === undefined ? 1 : +m[4]];
+  } else if (/^#[0-9a-fA-F]{6}([0-9a-fA-F]{2})?$/.test(s)) {
+    const v = (i: number) => parseInt(s.slice(i, i + 2), 16);
+    col = [v(1), v(3), v(5), s.length === 9 ? v(7) / 255 : 1];
+  } else if (s === "white") {
+    col = [255, 255, 255, 1];
+  } else if (s === "black") {
+    col = [0, 0, 0, 1];
+  }
+  if (col && !(col[3] > 0)) col = null;
+  if (colorCache.size > 1024) colorCache.clear();
+  colorCache.set(s, col);
+  return col;
+}
+
+// ---- 5x7 bitmap font ----
+
+// Printable ASCII 0x20-0x7E, five column bytes per glyph, bit 0 = top row.
+// The glyph cell is 6 columns wide (one blank) and its bottom row sits on
+// the baseline.
+const FONT_5X7 = [
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x5f, 0x00, 0x00, 0x00, 0x07, 0x00, 0x07, 0x00,
+  0x14, 0x7f, 0x14, 0x7f, 0x14, 0x24, 0x2a, 0x7f, 0x2a, 0x12, 0x23, 0x13, 0x08, 0x64, 0x62,
+  0x36, 0x49, 0x55, 0x22, 0x50, 0x00, 0x05, 0x03, 0x00, 0x00, 0x00, 0x1c, 0x22, 0x41, 0x00,
+  0x00, 0x41, 0x22, 0x1c, 0x00, 0x08, 0x2a, 0x1c, 0x2a, 0x08, 0x08, 0x08, 0x3e, 0x08, 0x08,
+  0x00, 0x50, 0x30, 0x00, 0x00, 0x08, 0x08, 0x08, 0x08, 0x08, 0x00, 0x60, 0x60, 0x00, 0x00,
+  0x20, 0x10, 0x08, 0x04, 0x02, 0x3e, 0x51, 0x49, 0x45, 0x3e, 0x00, 0x42, 0x7f, 0x40, 0x00,
+  0x42, 0x61, 0x51, 0x49, 0x46, 0x21, 0x41, 0x45, 0x4b, 0x31, 0x18, 0x14, 0x12, 0x7f, 0x10,
+  0x27, 0x45, 0x45, 0x45, 0x39, 0x3c, 0x4a, 0x49, 0x49, 0x30, 0x01, 0x71, 0x09, 0x05, 0x03,
+  0x36, 0x49, 0x49, 0x49, 0x36, 0x06, 0x49, 0x49, 0x29, 0x1e, 0x00, 0x36, 0x36, 0x00, 0x00,
+  0x00, 0x56, 0x36, 0x00, 0x00, 0x08, 0x14, 0x22, 0x41, 0x00, 0x14, 0x14, 0x14, 0x14, 0x14,
+  0x00, 0x41, 0x22, 0x14, 0x08, 0x02, 0x01, 0x51, 0x09, 0x06, 0x32, 0x49, 0x79, 0x41, 0x3e,
+  0x7e, 0x11, 0x11, 0x11, 0x7e, 0x7f, 0x49, 0x49, 0x49, 0x36, 0x3e, 0x41, 0x41, 0x41, 0x22,
+  0x7f, 0x41, 0x41, 0x22, 0x1c, 0x7f, 0x49, 0x49, 0x49, 0x41, 0x7f, 0x09, 0x09, 0x09, 0x01,
+  0x3e, 0x41, 0x49, 0x49, 0x7a, 0x7f, 0x08, 0x08, 0x08, 0x7f, 0x00, 0x41, 0x7f, 0x41, 0x00,
+  0x20, 0x40, 0x41, 0x3f, 0x01, 0x7f, 0x08, 0x14, 0x22, 0x41, 0x7f, 0x40, 0x40, 0x40, 0x40,
+  0x7f, 0x02, 0x0c, 0x02, 0x7f, 0x7f, 0x04, 0x08, 0x10, 0x7f, 0x3e, 0x41, 0x41, 0x41, 0x3e,
+  0x7f, 0x09, 0x09, 0x09, 0x06, 0x3e, 0x41, 0x51, 0x21, 0x5e, 0x7f, 0x09, 0x19, 0x29, 0x46,
+  0x46, 0x49, 0x49, 0x49, 0x31, 0x01, 0x01, 0x7f, 0x01, 0x01, 0x3f, 0x40, 0x40, 0x40, 0x3f,
+  0x1f, 0x20, 0x40, 0x20, 0x1f, 0x3f, 0x40, 0x38, 0x40, 0x3f, 0x63, 0x14, 0x08, 0x14, 0x63,
+  0x07, 0x08, 0x70, 0x08, 0x07, 0x61, 0x51, 0x49, 0x45, 0x43, 0x00, 0x7f, 0x41, 0x41, 0x00,
+  0x02, 0x04, 0x08, 0x10, 0x20, 0x00, 0x41, 0x41, 0x7f, 0x00, 0x04, 0x02, 0x01, 0x02, 0x04,
+  0x40, 0x40, 0x40, 0x40, 0x40, 0x00, 0x01, 0x02, 0x04, 0x00, 0x20, 0x54, 0x54, 0x54, 0x78,
+  0x7f, 0x48, 0x44, 0x44, 0x38, 0x38, 0x44, 0x44, 0x44, 0x20, 0x38, 0x44, 0x44, 0x48, 0x7f,
+  0x38, 0x54, 0x54, 0x54, 0x18, 0x08, 0x7e, 0x09, 0x01, 0x02, 0x0c, 0x52, 0x52, 0x52, 0x3e,
+  0x7f, 0x08, 0x04, 0x04, 0x78, 0x00, 0x44, 0x7d, 0x40, 0x00, 0x20, 0x40, 0x44, 0x3d, 0x00,
+  0x7f, 0x10, 0x28, 0x44, 0x00, 0x00, 0x41, 0x7f, 0x40, 0x00, 0x7c, 0x04, 0x18, 0x04, 0x78,
+  0x7c, 0x08, 0x04, 0x04, 0x78, 0x38, 0x44, 0x44, 0x44, 0x38, 0x7c, 0x14, 0x14, 0x14, 0x08,
+  0x08, 0x14, 0x14, 0x18, 0x7c, 0x7c, 0x08, 0x04, 0x04, 0x08, 0x48, 0x54, 0x54, 0x54, 0x20,
+  0x04, 0x3f, 0x44, 0x40, 0x20, 0x3c, 0x40, 0x40, 0x20, 0x7c, 0x1c, 0x20, 0x40, 0x20, 0x1c,
+  0x3c, 0x40, 0x30, 0x40, 0x3c, 0x44, 0x28, 0x10, 0x28, 0x44, 0x0c, 0x50, 0x50, 0x50, 0x3c,
+  0x44, 0x64, 0x54, 0x4c, 0x44, 0x00, 0x08, 0x36, 0x41, 0x00, 0x00, 0x00, 0x7f, 0x00, 0x00,
+  0x00, 0x41, 0x36, 0x08, 0x00, 0x02, 0x01, 0x02, 0x04, 0x02,
+];
+
+/** Column bytes for a character; anything outside printable ASCII draws as "?". */
+function glyphColumns(ch: string): number[] {
+  let code = ch.codePointAt(0) ?? 0x3f;
+  if (code < 0x20 || code > 0x7e) code = 0x3f;
+  const base = (code - 0x20) * 5;
+  return FONT_5X7.slice(base, base + 5);
+}
+
+// ---- PNG ----
+
+export interface Image {
+  width: number;
+  height: number;
+  /** Non-premultiplied RGBA. */
+  data: Uint8Array;
+}
+
+async function zlib(data: BufferSource, inflate: boolean): Promise<Uint8Array> {
+  const stream = new Blob([data]).stream().pipeThrough(
+    inflate ? new DecompressionStream("deflate") : new CompressionStream("deflate"),
+  );
+  return new Uint8Array(await new Response(stream).arrayBuffer());
+}
+
+const CRC_TABLE = (() => {
+  const t = new Uint32Array(256);
+  for (let n = 0; n < 256; n++) {
+    let c = n;
+    for (let k = 0; k < 8; k++) c = c & 1 ? 0xedb88320 ^ (c >>> 1) : c >>> 1;
+    t[n] = c >>> 0;
+  }
+  return t;
+})();
+
+function crc32(bytes: Uint8Array, start: number, end: number): number {
+  let c = 0xffffffff;
+  for (let i = start; i < end; i++) c = CRC_TABLE[(c ^ bytes[i]) & 0xff] ^ (c >>> 8);
+  return (c ^ 0xffffffff) >>> 0;
+}
+
+const PNG_SIGNATURE = [137, 80, 78, 71, 13, 10, 26, 10];
+
+/** Encode RGBA pixels as an 8-bit truecolour-with-alpha PNG. */
+export async function encodePng(
+  pixels: Uint8Array | Uint8ClampedArray,
+  width: number,
+  height: number,
+): Promise<ArrayBuffer> {
+  const stride = width * 4;
+  const raw = new Uint8Array((stride + 1) * height);
+  for (let y = 0; y < height; y++) {
+    // Filter 0 (none) per row; deflate handles a plot's flat regions well.
+    raw.set(pixels.subarray(y * stride, (y + 1) * stride), y * (stride + 1) + 1);
+  }
+  const idat = await zlib(raw, false);
+
+  const ihdr = new Uint8Array(13);
+  const hv = new DataView(ihdr.buffer);
+  hv.setUint32(0, width);
+  hv.setUint32(4, height);
+  ihdr.set([8, 6, 0, 0, 0], 8);
+
+  const chunks: Array<[string, Uint8Array]> = [["IHDR", ihdr], ["IDAT", idat], ["IEND", new Uint8Array(0)]];
+  let size = PNG_SIGNATURE.length;
+  for (const [, body] of chunks) size += 12 + body.length;
+  const out = new Uint8Array(size);
+  const view = new DataView(out.buffer);
+  out.set(PNG_SIGNATURE, 0);
+  let p = PNG_SIGNATURE.length;
+  for (const [type, body] of chunks) {
+    view.setUint32(p, body.length);
+    for (let i = 0; i < 4; i++) out[p + 4 + i] = type.charCodeAt(i);
+    out.set(body, p + 8);
+    view.setUint32(p + 8 + body.length, crc32(out, p + 4, p + 8 + body.length));
+    p += 12 + body.length;
+  }
+  return out.buffer as ArrayBuffer;
+}
+
+/** Decode an 8-bit RGB or RGBA PNG data URI (what R's raster ops carry). */
+export async function decodePngDataUri(uri: string): Promise<Image | null> {
+  const prefix = "data:image/png;base64,";
+  if (!uri.startsWith(prefix)) return null;
+  const bin = atob(uri.slice(prefix.length));
+  const bytes = new Uint8Array(bin.length);
+  for (let i = 0; i < bin.length; i++) bytes[i] = bin.charCodeAt(i);
+  for (let i = 0; i < 8; i++) if (bytes[i] !== PNG_SIGNATURE[i]) return null;
+
+  const view = new DataView(bytes.buffer);
+  let width = 0, height = 0, colorType = -1;
+  const idat: Uint8Array[] = [];
+  for (let p = 8; p + 8 <= bytes.length;) {
+    const len = view.getUint32(p);
+    const type = String.fromCharCode(bytes[p + 4], bytes[p + 5], bytes[p + 6], bytes[p + 7]);
+    const body = bytes.subarray(p + 8, p + 8 + len);
+    if (type === "IHDR") {
+      width = view.getUint32(p + 8);
+      height = view.getUint32(p + 12);
+      if (body[8] !== 8 || body[12] !== 0) return null; // 8-bit, not interlaced
+      colorType = body[9];
+    } else if (type === "IDAT") {
+      idat.push(body);
+    } else if (type === "IEND") {
+      break;
+    }
+    p += 12 + len;
+  }
+  const channels = colorType === 6 ? 4 : colorType === 2 ? 3 : 0;
+  if (!channels || width === 0 || height === 0 || width * height > MAX_RASTER_SIZE * MAX_RASTER_SIZE) return null;
+
+  const packed = new Uint8Array(idat.reduce((n, c) => n + c.length, 0));
+  let off = 0;
+  for (const c of idat) {
+    packed.set(c, off);
+    off += c.length;
+  }
+  let raw: Uint8Array;
+  try {
+    raw = await zlib(packed, true);
+  } catch {
+    return null;
+  }
+  const stride = width * channels;
+  if (raw.length < (stride + 1) * height) return null;
+
+  const data = new Uint8Array(width * height * 4);
+  let prev = new Uint8Array(stride);
+  let cur = new Uint8Array(stride);
+  for (let y = 0; y < height; y++) {
+    const filter = raw[y * (stride + 1)];
+    const row = raw.subarray(y * (stride + 1) + 1, (y + 1) * (stride + 1));
+    for (let i = 0; i < stride; i++) {
+      const a = i >= channels ? cur[i - channels] : 0;
+      const b = prev[i];
+      const c = i >= channels ? prev[i - channels] : 0;
+      let v = row[i];
+      switch (filter) {
+        case 1: v += a; break;
+        case 2: v += b; break;
+        case 3: v += (a + b) >> 1; break;
+        case 4: {
+          const pa = Math.abs(b - c), pb = Math.abs(a - c), pc = Math.abs(a + b - 2 * c);
+          v += pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+          break;
+        }
+      }
+      cur[i] = v;
+    }
+    for (let x = 0; x < width; x++) {
+      const o = (y * width + x) * 4, s = x * channels;
+      data[o] = cur[s];
+      data[o + 1] = cur[s + 1];
+      data[o + 2] = cur[s + 2];
+      data[o + 3] = channels === 4 ? cur[s + 3] : 255;
+    }
+    [prev, cur] = [cur, prev];
+  }
+  return { width, height, data };
+}
+
+function sampleNearest(img: Image, u: number, v: number, out: Color): void {
+  const i = (Math.floor(v) * img.width + Math.floor(u)) * 4;
+  out[0] = img.data[i];
+  out[1] = img.data[i + 1];
+  out[2] = img.data[i + 2];
+  out[3] = img.data[i + 3] / 255;
+}
+
+function sampleBilinear(img: Image, u: number, v: number, out: Color): void {
+  const fx = Math.max(0, u - 0.5), fy = Math.max(0, v - 0.5);
+  const x0 = Math.min(Math.floor(fx), img.width - 1), y0 = Math.min(Math.floor(fy), img.height - 1);
+  const x1 = Math.min(x0 + 1, img.width - 1), y1 = Math.min(y0 + 1, img.height - 1);
+  const tx = fx - x0, ty = fy - y0;
+  const d = img.data;
+  const i00 = (y0 * img.width + x0) * 4, i10 = (y0 * img.width + x1) * 4;
+  const i01 = (y1 * img.width + x0) * 4, i11 = (y1 * img.width + x1) * 4;
+  // Interpolate premultiplied so transparent neighbours don't darken edges.
+  let a = 0;
+  const acc = [0, 0, 0];
+  for (const [i, wgt] of [[i00, (1 - tx) * (1 - ty)], [i10, tx * (1 - ty)], [i01, (1 - tx) * ty], [i11, tx * ty]]) {
+    const al = (d[i + 3] / 255) * wgt;
+    a += al;
+    acc[0] += d[i] * al;
+    acc[1] += d[i + 1] * al;
+    acc[2] += d[i + 2] * al;
+  }
+  out[3] = a;
+  if (a > 0) {
+    out[0] = acc[0] / a;
+    out[1] = acc[1] / a;
+    out[2] = acc[2] / a;
+  }
+}
+
+/** Renders queued or running in the worker before new ones are refused. */
+export const MAX_PENDING_RENDERS = 8;
+
+let worker: Worker | null = null;
+let nextJob = 0;
+const jobs = new Map<number, { resolve: (png: ArrayBuffer) => void; reject: (e: Error) => void }>();
+
+function failJobs(err: Error): void {
+  for (const job of jobs.values()) job.reject(err);
+  jobs.clear();
+}
+
+function startWorker(): Worker {
+  const w = new Worker(new URL("./raster_worker.ts", import.meta.url).href, { type: "module" });
+  w.onmessage = (e: MessageEvent) => {
+    const job = jobs.get(e.data.id);
+    if (!job) return;
+    jobs.delete(e.data.id);
+    if (e.data.png) job.resolve(e.data.png);
+    else job.reject(new Error(e.data.error ?? "render failed"));
+  };
+  w.onerror = (e: ErrorEvent) => {
+    e.preventDefault();
+    stopRasterWorker();
+    failJobs(new Error(`render worker failed: ${e.message}`));
+  };
+  return w;
+}
+
+/**
+ * rasterizePlot in a worker, started on first use.  Rejects at once when
+ * MAX_PENDING_RENDERS renders are already waiting.
+ */
+export function rasterizePlotInWorker(
+  // deno-lint-ignore no-explicit-any
+  plot: { device?: Record<string, any>; ops: Op[] },
+  width?: number,
+  height?: number,
+): Promise<ArrayBuffer> {
+  if (jobs.size >= MAX_PENDING_RENDERS) {
+    return Promise.reject(new RenderBusyError());
+  }
+  worker ??= startWorker();
+  const id = ++nextJob;
+  const done = new Promise<ArrayBuffer>((resolve, reject) => jobs.set(id, { resolve, reject }));
+  worker.postMessage({ id, plot, width, height });
+  return done;
+}
+
+/** Stop the render worker; pending renders fail. */
+export function stopRasterWorker(): void {
+  worker?.terminate();
+  worker = null;
+  failJobs(new Error("render worker stopped"));
+}
+
+/** Thrown by rasterizePlotInWorker when too many renders are pending. */
+export class RenderBusyError extends Error {
+  constructor() {
+    super("too many renders in progress");
+  }
+}
@@ -0,0 +1,235 @@
+// Composition of raster patches (options(jgd.raster_delta) in R).
+//
+// A raster op with `slot` and `seq` is an image R may redraw in place.
+// Later rasters in the same slot can arrive as patches: `base` names the
+// image they start from and `tiles` carries only the changed blocks, each
+// a PNG placed at pixel offset (x, y).  Live viewers apply patches
+// themselves.  The plot store keeps patches as they arrive and composes
+// one into a whole raster only when a stored plot is read (rendered,
+// exported, or sent to a new viewer or relay), so a passing frame costs
+// the hub no PNG work.  A composed image is kept, so each patch is
+// composed at most once.
+//
+// SentRasters tracks the images a client has been sent.  A client that
+// joined or switched sessions after a patch's base went out cannot apply
+// it, and is sent the composed raster instead (see Hub.frameFor).
+
+import { decodePngDataUri, encodePng } from "./raster.ts";
+
+// deno-lint-ignore no-explicit-any
+type Op = Record<string, any>;
+
+/**
+ * Images kept per slot, as the renderer keeps.  A complete frame may
+ * resend patches whose base is an image or two behind the latest, so
+ * more than one is kept.
+ */
+const IMAGES_PER_SLOT = 4;
+/** Slots kept per session, as in R (JGD_RASTER_SLOTS). */
+const SLOTS_PER_SESSION = 8;
+/** Sessions SentRasters tracks per client. */
+const SESSIONS_PER_CLIENT = 8;
+
+/**
+ * One image of a slot: its data URI, or for a patch not yet composed,
+ * the patch and the image it applies to.
+ */
+interface SlotImage {
+  data?: string;
+  patch?: Op;
+  base?: SlotImage;
+  /** The composition, once started; null if the patch cannot be applied. */
+  composed?: Promise<string | null>;
+}
+
+/** True if op is a raster patch (tiles against a base image). */
+export function isRasterPatch(op: Op): boolean {
+  return op?.op === "raster" && Array.isArray(op.tiles);
+}
+
+function isSlotted(op: Op): boolean {
+  return op?.op === "raster" && typeof op.slot === "number" && typeof op.seq === "number";
+}
+
+/** True if ops hold a slotted raster (one a later patch may build on). */
+export function hasSlottedRaster(ops: Op[]): boolean {
+  return ops.some(isSlotted);
+}
+
+export class RasterSlots {
+  /** sessionId → slot → seq → image; Map order is oldest first. */
+  private sessions = new Map<string, Map<number, Map<number, SlotImage>>>();
+  /** The image each registered op stands for. */
+  private images = new WeakMap<Op, SlotImage>();
+
+  /**
+   * Register a frame's slotted rasters as bases for later patches.
+   * Nothing is decoded; a patch only records its base image.  A patch
+   * whose base is unknown is not registered and stays a patch.
+   */
+  note(sessionId: string, ops: Op[]): void {
+    for (const op of ops) {
+      if (!isSlotted(op) || this.images.has(op)) continue;
+      const images = this.slot(sessionId, op.slot);
+      const existing = images.get(op.seq);
+      let image: SlotImage;
+      if (isRasterPatch(op)) {
+        // A complete frame repeating a patch names the same image.
+        const base = images.get(op.base);
+        if (existing) image = existing;
+        else if (base) image = { patch: op, base };
+        else continue;
+      } else if (typeof op.data === "string") {
+        image = existing?.data === op.data ? existing : { data: op.data };
+      } else {
+        continue;
+      }
+      this.images.set(op, image);
+      images.delete(op.seq);
+      images.set(op.seq, image);
+      while (images.size > IMAGES_PER_SLOT) {
+        images.delete(images.keys().next().value!);
+      }
+    }
+  }
+
+  /**
+   * ops with each registered patch replaced by a composed copy (ops
+   * itself if there is none).  The originals are left alone; a patch
+   * that cannot be composed is kept as it is.
+   */
+  async resolve(ops: Op[]): Promise<Op[]> {
+    let out: Op[] | null = null;
+    for (let i = 0; i < ops.length; i++) {
+      const op = ops[i];
+      const image = isRasterPatch(op) ? this.images.get(op) : undefined;
+      if (!image) continue;
+      const data = await compose(image);
+      if (data === null) continue;
+      const { base: _base, tiles: _tiles, ...whole } = op;
+      const composed = { ...whole, data };
+      this.images.set(composed, image);
+      out ??= ops.slice();
+      out[i] = composed;
+    }
+    return out ?? ops;
+  }
+
+  /** Forget a session's slots. */
+  drop(sessionId: string): void {
+    this.sessions.delete(sessionId);
+  }
+
+  private slot(sessionId: string, slot: number): Map<number, SlotImage> {
+    let slots = this.sessions.get(sessionId);
+    if (!slots) {
+      slots = new Map();
+      this.sessions.set(sessionId, slots);
+    }
+    let images = slots.get(slot);
+    if (images) {
+      slots.delete(slot);
+    } else {
+      images = new Map();
+    }
+    slots.set(slot, images);
+    while (slots.size > SLOTS_PER_SESSION) {
+      slots.delete(slots.keys().next().value!);
+    }
+    return images;
+  }
+}
+
+/**
+ * The slotted images one client has been sent: the newest
+ * IMAGES_PER_SLOT seqs of each slot, per session.
+ */
+export class SentRasters {
+  /** sessionId → slot → seqs, oldest first; Map order is least recent first. */
+  private sessions = new Map<string, Map<number, number[]>>();
+
+  /**
+   * Record the slotted rasters in ops as sent.  Returns false if a patch
+   * among them builds on an image the client does not have.
+   */
+  add(sessionId: string, ops: Op[]): boolean {
+    let ok = true;
+    for (const op of ops) {
+      if (!isSlotted(op)) continue;
+      let slots = this.sessions.get(sessionId);
+      if (slots) {
+        this.sessions.delete(sessionId);
+      } else {
+        slots = new Map();
+        while (this.sessions.size >= SESSIONS_PER_CLIENT) {
+          this.sessions.delete(this.sessions.keys().next().value!);
+        }
+      }
+      this.sessions.set(sessionId, slots);
+      let seqs = slots.get(op.slot);
+      if (seqs) {
+        slots.delete(op.slot);
+      } else {
+        seqs = [];
+        while (slots.size >= SLOTS_PER_SESSION) {
+          slots.delete(slots.keys().next().value!);
+        }
+      }
+      slots.set(op.slot, seqs);
+      if (isRasterPatch(op) && !seqs.includes(op.base)) ok = false;
+      const at = seqs.indexOf(op.seq);
+      if (at >= 0) seqs.splice(at, 1);
+      seqs.push(op.seq);
+      if (seqs.length > IMAGES_PER_SLOT) seqs.shift();
+    }
+    return ok;
+  }
+}
+
+/** An image's data URI, composing it (and its base, first) if needed. */
+function compose(image: SlotImage): Promise<string | null> {
+  if (image.data !== undefined) return Promise.resolve(image.data);
+  image.composed ??= applyPatch(image.patch!, image.base!).then((data) => {
+    if (data !== null) {
+      // The tiles and base are no longer needed.
+      image.data = data;
+      image.patch = undefined;
+      image.base = undefined;
+    }
+    return data;
+  });
+  return image.composed;
+}
+
+/** Draw a patch's tiles over a copy of its base image. */
+async function applyPatch(op: Op, base: SlotImage): Promise<string | null> {
+  const baseData = await compose(base);
+  if (baseData === null) return null;
+  const img = await decodePngDataUri(baseData);
+  if (!img || img.width !== op.pw || img.height !== op.ph) return null;
+
+  const pixels = img.data;
+  for (const tile of op.tiles) {
+    if (typeof tile?.data !== "string") return null;
+    const t = await decodePngDataUri(tile.data);
+    if (!t) return null;
+    const x0 = tile.x | 0, y0 = tile.y | 0;
+    const w = Math.min(t.width, img.width - x0);
+    const h = Math.min(t.height, img.height - y0);
+    if (x0 < 0 || y0 < 0 || w <= 0 || h <= 0) return null;
+    for (let y = 0; y < h; y++) {
+      const src = t.data.subarray(y * t.width * 4, (y * t.width + w) * 4);
+      pixels.set(src, ((y0 + y) * img.width + x0) * 4);
+    }
+  }
+  return pngDataUri(await encodePng(pixels, img.width, img.height));
+}
+
+function pngDataUri(png: ArrayBuffer): string {
+  const bytes = new Uint8Array(png);
+  let bin = "";
+  for (let i = 0; i < bytes.length; i += 0x8000) {
+    bin += String.fromCharCode(...bytes.subarray(i, i + 0x8000));
+  }
+  return "data:image/png;base64," + btoa(bin);
+}
@@ -0,0 +1,18 @@
+// Worker running the rasterizer (raster.ts) off the hub's event loop, so
+// a large /plot.png render does not hold up frame delivery.  Messages in:
+// {id, plot, width, height}; out: {id, png} or {id, error}.
+
+/// <reference no-default-lib="true" />
+/// <reference lib="deno.worker" />
+
+import { rasterizePlot } from "./raster.ts";
+
+self.onmessage = async (e: MessageEvent) => {
+  const { id, plot, width, height } = e.data;
+  try {
+    const png = await rasterizePlot(plot, width, height);
+    self.postMessage({ id, png }, [png]);
+  } catch (err) {
+    self.postMessage({ id, error: String(err) });
+  }
+};
@@ -0,0 +1,162 @@
+// Relay (mirror) mode: `jgd-server -relay ws://host:port/ws`.
+//
+// A relay connects to another server's /ws endpoint as a relay client
+// (`?relay=1`).  That server sends it the stored plots of every session
+// and then every frame, whatever the relay's viewers subscribe to.  The
+// relay records them in its own hub and serves its own browsers, so the
+// upstream server sends each frame once per relay rather than once per
+// viewer.  Relays accept no R connections and can themselves be relayed.
+//
+// Viewers of a relay watch; they do not steer.  Their resizes reach no R
+// session, and only the first answer to each font-metrics request is
+// passed upstream.  A relay with no viewers answers metrics requests
+// itself with zeros, and the upstream server asks relays only when it has
+// no browser of its own.
+
+import type { Hub } from "./hub.ts";
+import { extractType } from "./types.ts";
+
+const RECONNECT_MIN_MS = 1000;
+const RECONNECT_MAX_MS = 30000;
+/** Matches the hub's metrics fallback timeout; later answers are useless. */
+const METRICS_TIMEOUT_MS = 2000;
+
+/**
+ * Normalise an upstream address: http(s):// becomes ws(s)://, and a
+ * bare host:port or "/" path gets the /ws endpoint.
+ */
+export function upstreamWsUrl(address: string): URL {
+  const url = new URL(/^[a-z]+:\/\//i.test(address) ? address : `ws://${address}`);
+  if (url.protocol === "http:") url.protocol = "ws:";
+  else if (url.protocol === "https:") url.protocol = "wss:";
+  if (url.protocol !== "ws:" && url.protocol !== "wss:") {
+    throw new Error(`relay upstream must be a ws:// or http:// URL: ${address}`);
+  }
+  if (url.pathname === "/" || url.pathname === "") url.pathname = "/ws";
+  url.searchParams.set("relay", "1");
+  return url;
+}
+
+export class Relay {
+  readonly upstream: URL;
+  private hub: Hub;
+  private socket: WebSocket | null = null;
+  private closed = false;
+  private reconnectDelay = RECONNECT_MIN_MS;
+  private reconnectTimer: number | undefined;
+  /** Metrics requests sent to our viewers and not yet answered. */
+  private pendingMetrics = new Set<number>();
+
+  constructor(upstream: string, hub: Hub) {
+    this.upstream = upstreamWsUrl(upstream);
+    this.hub = hub;
+  }
+
+  /** Connect, and keep reconnecting until close(). */
+  start(): void {
+    this.connect();
+  }
+
+  private connect(): void {
+    const socket = new WebSocket(this.upstream);
+    this.socket = socket;
+    socket.onopen = () => {
+      this.reconnectDelay = RECONNECT_MIN_MS;
+      console.error(`relay: connected to ${this.upstream}`);
+    };
+    socket.onmessage = (event: MessageEvent) => {
+      if (typeof event.data === "string") this.handleUpstream(event.data);
+    };
+    socket.onclose = () => {
+      if (this.socket === socket) this.socket = null;
+      this.pendingMetrics.clear();
+      if (this.closed) return;
+      console.error(
+        `relay: upstream closed, reconnecting in ${this.reconnectDelay}ms`,
+      );
+      this.reconnectTimer = setTimeout(() => this.connect(), this.reconnectDelay);
+      this.reconnectDelay = Math.min(this.reconnectDelay * 2, RECONNECT_MAX_MS);
+    };
+    socket.onerror = () => {
+      // onclose follows
+    };
+  }
+
+  /** Route a message from the upstream server to our viewers. */
+  private handleUpstream(line: string): void {
+    switch (extractType(line)) {
+      case "frame":
+        this.hub.relayFrame(line);
+        break;
+
+      case "session_state":
+        this.hub.relaySessionState(line);
+        break;
+
+      case "metrics_request": {
+        const id = metricsId(line);
+        if (id === null) return;
+        // With no viewers nobody would answer, and the upstream server
+        // would wait out its timeout; reply with its zero fallback now.
+        if (this.hub.clients.size === 0) {
+          this.send(JSON.stringify({
+            type: "metrics_response",
+            id,
+            width: 0,
+            ascent: 0,
+            descent: 0,
+          }));
+          return;
+        }
+        this.pendingMetrics.add(id);
+        setTimeout(() => this.pendingMetrics.delete(id), METRICS_TIMEOUT_MS);
+        this.hub.broadcastControlToClients(line);
+        break;
+      }
+
+      case "close":
+        this.hub.broadcastControlToClients(line);
+        break;
+
+      case "pong":
+        break;
+
+      default:
+        this.hub.broadcastToClients(line);
+        break;
+    }
+  }
+
+  /**
+   * Pass a viewer's metrics response upstream if it is the first answer
+   * to a request still outstanding.
+   */
+  forwardMetricsResponse(line: string): void {
+    const id = metricsId(line);
+    if (id === null || !this.pendingMetrics.delete(id)) return;
+    this.send(line);
+  }
+
+  private send(line: string): void {
+    if (this.socket?.readyState === WebSocket.OPEN) this.socket.send(line);
+  }
+
+  /** Disconnect and stop reconnecting. */
+  close(): void {
+    this.closed = true;
+    clearTimeout(this.reconnectTimer);
+    try {
+      this.socket?.close();
+    } catch { /* ignore if already closed */ }
+  }
+}
+
+/** The id of a metrics request or response, or null if it has none. */
+function metricsId(line: string): number | null {
+  try {
+    const id = JSON.parse(line)?.id;
+    return typeof id === "number" ? id : null;
+  } catch {
+    return null;
+  }
+}
@@ -1,4 +1,4 @@
-import { normalize, resolve } from "jsr:@std/path@1";
+import { isAbsolute, normalize, resolve } from "jsr:@std/path@1";
 
 /**
  * Serve static files from a directory.
@@ -38,6 +38,94 @@ export async function serveStaticFile(
   });
 }
 
+const FONT_EXTENSIONS = [".ttf", ".otf", ".ttc", ".otc"];
+/** Font files remembered; the oldest registrations go first. */
+const MAX_FONTS = 1024;
+
+function isFontPath(path: string): boolean {
+  const lower = path.toLowerCase();
+  return FONT_EXTENSIONS.some((ext) => lower.endsWith(ext));
+}
+
+/**
+ * Font files named by `defFont` ops, under opaque ids.  The hub tags each
+ * defFont op it forwards with the id of its file (`fontId`), and /font
+ * serves only registered files, so clients cannot name arbitrary paths.
+ */
+export class FontRegistry {
+  private ids = new Map<string, string>();
+  private paths = new Map<string, string>();
+
+  /** The id of a font file, registering it; null if it cannot be a font. */
+  register(file: unknown): string | null {
+    if (typeof file !== "string" || !isAbsolute(file)) return null;
+    const path = normalize(file);
+    if (!isFontPath(path)) return null;
+    let id = this.ids.get(path);
+    if (id) return id;
+    id = crypto.randomUUID();
+    this.ids.set(path, id);
+    this.paths.set(id, path);
+    if (this.paths.size > MAX_FONTS) {
+      const [oldId, oldPath] = this.paths.entries().next().value!;
+      this.paths.delete(oldId);
+      this.ids.delete(oldPath);
+    }
+    return id;
+  }
+
+  /** Add `fontId` to the defFont ops in ops. */
+  tag(ops: unknown): void {
+    if (!Array.isArray(ops)) return;
+    for (const op of ops) {
+      if (op?.op !== "defFont") continue;
+      const id = this.register(op.file);
+      if (id) op.fontId = id;
+      else delete op.fontId;
+    }
+  }
+
+  path(id: string | null): string | undefined {
+    return id === null ? undefined : this.paths.get(id);
+  }
+}
+
+/**
+ * Serve a font file registered from a `defFont` op so the renderer can
+ * draw glyph runs from the font's own outlines.  The file is resolved
+ * through symlinks and served only if the resolved path is a regular
+ * file with a font extension.
+ */
+export async function serveFontFile(
+  id: string | null,
+  fonts: FontRegistry,
+): Promise<Response> {
+  const registered = fonts.path(id);
+  if (!registered) return new Response("not found", { status: 404 });
+  let f: Deno.FsFile;
+  let path: string;
+  try {
+    path = await Deno.realPath(registered);
+    if (!isFontPath(path) || !(await Deno.lstat(path)).isFile) {
+      return new Response("forbidden", { status: 403 });
+    }
+    f = await Deno.open(path, { read: true });
+    if (!(await f.stat()).isFile) {
+      f.close();
+      return new Response("not found", { status: 404 });
+    }
+  } catch {
+    return new Response("not found", { status: 404 });
+  }
+  const lower = path.toLowerCase();
+  return new Response(f.readable, {
+    headers: {
+      "Content-Type": lower.endsWith(".otf") || lower.endsWith(".otc") ? "font/otf" : "font/ttf",
+      "Cache-Control": "max-age=3600",
+    },
+  });
+}
+
 /** Determine MIME type from file extension. */
 function mimeType(path: string): string {
   if (path.endsWith(".html")) return "text/html; charset=utf-8";
@@ -0,0 +1,90 @@
+import { assert, assertEquals, assertNotEquals } from "@std/assert";
+import { brotliDecompressSync, gunzipSync } from "node:zlib";
+import { buildAssetCache, selectEncoding, serveAsset } from "../asset_cache.ts";
+import { assets } from "../web_assets.ts";
+
+const cache = buildAssetCache(assets);
+
+function get(path: string, headers: Record<string, string> = {}): Response {
+  return serveAsset(new Request(`http://localhost${path}`, { headers }), cache, path)!;
+}
+
+Deno.test("asset cache — encodings", async (t) => {
+  const app = cache.get("/app.js")!;
+
+  await t.step("brotli preferred, then gzip, then identity", () => {
+    assertEquals(selectEncoding("gzip, deflate, br", app), "br");
+    assertEquals(selectEncoding("gzip", app), "gzip");
+    assertEquals(selectEncoding("br;q=0, gzip", app), "gzip");
+    assertEquals(selectEncoding("*", app), "br");
+    assertEquals(selectEncoding("*, br;q=0, gzip;q=0", app), "identity");
+    assertEquals(selectEncoding(null, app), "identity");
+  });
+
+  await t.step("compressed variants decode to the asset", async () => {
+    const br = get("/app.js", { "accept-encoding": "br" });
+    assertEquals(br.headers.get("content-encoding"), "br");
+    const brText = new TextDecoder().decode(brotliDecompressSync(new Uint8Array(await br.arrayBuffer())));
+    assertEquals(brText, assets["/app.js"].body);
+
+    const gz = get("/app.js", { "accept-encoding": "gzip" });
+    assertEquals(gz.headers.get("content-encoding"), "gzip");
+    const gzText = new TextDecoder().decode(gunzipSync(new Uint8Array(await gz.arrayBuffer())));
+    assertEquals(gzText, assets["/app.js"].body);
+
+    const plain = get("/app.js");
+    assertEquals(plain.headers.get("content-encoding"), null);
+    assertEquals(await plain.text(), assets["/app.js"].body);
+    assertEquals(plain.headers.get("vary"), "Accept-Encoding");
+  });
+
+  await t.step("each encoding has its own strong ETag", () => {
+    const tags = ["br", "gzip", "identity"].map((e) =>
+      get("/app.js", { "accept-encoding": e }).headers.get("etag")
+    );
+    assertEquals(new Set(tags).size, 3);
+    for (const tag of tags) assert(tag!.startsWith('"'), `strong ETag expected, got ${tag}`);
+  });
+});
+
+Deno.test("asset cache — validation and hashed URLs", async (t) => {
+  await t.step("If-None-Match answers 304", () => {
+    const etag = get("/renderer.js", { "accept-encoding": "gzip" }).headers.get("etag")!;
+    const res = get("/renderer.js", { "accept-encoding": "gzip", "if-none-match": etag });
+    assertEquals(res.status, 304);
+    assertEquals(res.body, null);
+    assertEquals(res.headers.get("etag"), etag);
+
+    const weak = get("/renderer.js", { "accept-encoding": "gzip", "if-none-match": `W/${etag}` });
+    assertEquals(weak.status, 304);
+
+    const other = get("/renderer.js", { "accept-encoding": "gzip", "if-none-match": '"stale"' });
+    assertEquals(other.status, 200);
+  });
+
+  await t.step("index.html references content-hashed URLs", async () => {
+    const html = await get("/index.html").text();
+    const scripts = [...html.matchAll(/src="([^"]+)"/g)].map((m) => m[1]);
+    const styles = [...html.matchAll(/href="([^"]+\.css)"/g)].map((m) => m[1]);
+    assertEquals(scripts.length, 2);
+    assertEquals(styles.length, 1);
+    for (const url of [...scripts, ...styles]) {
+      assert(/\.[0-9a-f]{12}\.(js|css)$/.test(url), `hashed URL expected, got ${url}`);
+      const res = get("/" + url);
+      assertEquals(res.status, 200);
+      assertEquals(res.headers.get("cache-control"), "public, max-age=31536000, immutable");
+      await res.body?.cancel();
+    }
+    assertNotEquals(get("/index.html").headers.get("cache-control"), "public, max-age=31536000, immutable");
+  });
+
+  await t.step("stable URLs are revalidated", async () => {
+    const res = get("/app.js");
+    assertEquals(res.headers.get("cache-control"), "no-cache");
+    await res.body?.cancel();
+  });
+
+  await t.step("unknown paths are not served", () => {
+    assertEquals(serveAsset(new Request("http://localhost/x.js"), cache, "/x.js"), null);
+  });
+});
@@ -0,0 +1,91 @@
+import { assert, assertEquals } from "@std/assert";
+import { delay } from "@std/async";
+import { TestServer } from "./helpers/server.ts";
+import { RClient } from "./helpers/r_client.ts";
+import { BrowserClient } from "./helpers/browser_client.ts";
+import type { ResizeMessage } from "./helpers/types.ts";
+import { Capture, type CaptureRecord, parseCapture } from "../capture.ts";
+
+Deno.test("traffic capture", async (t) => {
+  const capturePath = Deno.makeTempFileSync({ prefix: "jgd-capture-", suffix: ".jsonl" });
+  const server = new TestServer({ capture: capturePath });
+  const rClient = new RClient();
+  const browser = new BrowserClient();
+  let records: CaptureRecord[] = [];
+
+  try {
+    await server.start();
+    await browser.connect(server.wsUrl);
+    await rClient.connect(server.socketPath);
+    await rClient.waitForWelcome();
+
+    browser.sendResize(640, 480);
+    await rClient.readMessage<ResizeMessage>();
+    await rClient.sendFrame({ sessionId: "cap-session", ops: [], device: {} });
+    await browser.waitForType("frame");
+
+    rClient.close();
+    browser.close();
+    // Capture flushes on a 250 ms timer; give it one tick before
+    // shutdown (SIGTERM on Windows skips the final flush).
+    await delay(400);
+  } finally {
+    await server.shutdown();
+    server.cleanup();
+  }
+
+  try {
+    const parsed = parseCapture(await Deno.readTextFile(capturePath));
+    records = parsed.records;
+    assert(parsed.header.startedAt > 0);
+  } finally {
+    Deno.removeSync(capturePath);
+  }
+
+  const find = (dir: string, type?: string) =>
+    records.find((r) => r.dir === dir && (type === undefined || r.msg?.includes(`"type":"${type}"`)));
+
+  await t.step("connections are recorded", () => {
+    assertEquals(find("r_open")?.conn, "r1");
+    assertEquals(find("b_open")?.conn, "b1");
+  });
+
+  await t.step("messages are recorded in every direction", () => {
+    assert(find("r2s", "ping"), "R ping");
+    assert(find("s2r", "server_info"), "welcome to R");
+    assert(find("b2s", "resize"), "browser resize");
+    assert(find("s2r", "resize"), "resize forwarded to R");
+    assert(find("r2s", "frame"), "R frame");
+    assert(find("s2b", "frame"), "frame forwarded to browser");
+  });
+
+  await t.step("raw R lines are kept verbatim", () => {
+    const frame = JSON.parse(find("r2s", "frame")!.msg!);
+    assertEquals(frame.plot.sessionId, "cap-session");
+  });
+
+  await t.step("timestamps are non-decreasing", () => {
+    for (let i = 1; i < records.length; i++) {
+      assert(records[i].t >= records[i - 1].t, `record ${i} out of order`);
+    }
+  });
+});
+
+Deno.test("capture writes every record before close resolves", async () => {
+  const path = Deno.makeTempFileSync({ prefix: "jgd-capture-", suffix: ".jsonl" });
+  try {
+    const capture = new Capture(path);
+    const conn = capture.newRConn();
+    // Enough to cross the 64 KiB flush threshold several times.
+    const msg = JSON.stringify({ type: "frame", pad: "x".repeat(1000) });
+    for (let i = 0; i < 300; i++) capture.record("r2s", conn, msg);
+    await capture.close();
+    capture.record("r2s", conn, msg);
+
+    const { records } = parseCapture(await Deno.readTextFile(path));
+    assertEquals(records.length, 300);
+    assert(records.every((r) => r.msg === msg));
+  } finally {
+    Deno.removeSync(path);
+  }
+});
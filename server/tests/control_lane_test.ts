@@ -0,0 +1,103 @@
+/**
+ * Server protocol test: the browser's control lane.
+ *
+ * Each browser is sent a `control_lane` token when it connects.  A second
+ * socket opened with `?lane=control&token=<token>` receives metrics
+ * requests and close notices, so they never queue behind frames on the
+ * main socket, and may carry resizes and metrics responses.
+ */
+
+import { assert, assertEquals, assertRejects } from "@std/assert";
+import { delay } from "@std/async";
+import { TestServer } from "./helpers/server.ts";
+import { RClient } from "./helpers/r_client.ts";
+import { BrowserClient } from "./helpers/browser_client.ts";
+import type {
+  ControlLaneMessage,
+  FrameMessage,
+  MetricsRequestMessage,
+  MetricsResponseMessage,
+  ResizeMessage,
+} from "./helpers/types.ts";
+
+Deno.test("control lane carries metrics and resizes", async (t) => {
+  const server = new TestServer();
+  const rClient = new RClient();
+  const main = new BrowserClient();
+  const control = new BrowserClient();
+
+  try {
+    await server.start();
+    await rClient.connect(server.socketPath);
+    await main.connect(server.wsUrl);
+    const { token } = await main.waitForType<ControlLaneMessage>("control_lane");
+    await control.connect(`${server.wsUrl}?lane=control&token=${token}`);
+
+    await t.step("a second lane for the same token is refused", async () => {
+      const intruder = new BrowserClient();
+      await assertRejects(() => intruder.connect(`${server.wsUrl}?lane=control&token=${token}`));
+      intruder.close();
+    });
+
+    await t.step("resize sent on the control lane reaches R", async () => {
+      control.sendResize(640, 480);
+      const msg = await rClient.readMessage<ResizeMessage>();
+      assertEquals(msg.width, 640);
+      assertEquals(msg.height, 480);
+    });
+
+    await t.step("metrics request arrives on the control lane only", async () => {
+      await rClient.sendMetricsRequest(1);
+      const req = await control.waitForType<MetricsRequestMessage>("metrics_request");
+      await assertRejects(() => main.waitForType("metrics_request", 300));
+
+      control.sendMetricsResponse(req.id, 42.5, 10, 3);
+      const resp = await rClient.readMessage<MetricsResponseMessage>();
+      assertEquals(resp.type, "metrics_response");
+      assertEquals(resp.id, 1);
+      assertEquals(resp.width, 42.5);
+    });
+
+    await t.step("frames stay on the main socket", async () => {
+      await rClient.sendFrame(
+        { ops: [{ op: "rect" }], device: { width: 640, height: 480 } },
+      );
+      const frame = await main.waitForType<FrameMessage>("frame");
+      assertEquals(frame.type, "frame");
+      await assertRejects(() => control.waitForType("frame", 300));
+    });
+
+    await t.step("close notices travel on the control lane", async () => {
+      const other = new RClient();
+      await other.connect(server.socketPath);
+      await other.sendClose();
+      await control.waitForType("close");
+      await assertRejects(() => main.waitForType("close", 300));
+      other.close();
+    });
+
+    await t.step("without a control lane, metrics fall back to the main socket", async () => {
+      control.close();
+      await delay(200);
+      await rClient.sendMetricsRequest(2);
+      const req = await main.waitForType<MetricsRequestMessage>("metrics_request");
+      assert(typeof req.id === "number");
+      main.sendMetricsResponse(req.id, 7, 1, 1);
+      const resp = await rClient.readMessage<MetricsResponseMessage>();
+      assertEquals(resp.id, 2);
+    });
+
+    await t.step("control lane for an unknown token is refused", async () => {
+      const stray = new BrowserClient();
+      await assertRejects(() => stray.connect(`${server.wsUrl}?lane=control&token=nobody`));
+      stray.close();
+    });
+  } finally {
+    control.close();
+    main.close();
+    rClient.close();
+    await delay(100);
+    await server.shutdown();
+    server.cleanup();
+  }
+});
@@ -1,5 +1,5 @@
 import { assert, assertEquals, assertRejects } from "@std/assert";
-import { writeDiscovery, removeDiscovery } from "../discovery.ts";
+import { removeDiscovery, updateDiscovery, writeDiscovery } from "../discovery.ts";
 import { join } from "@std/path";
 
 /** Write discovery and assert it succeeded. */
@@ -125,6 +125,50 @@ Deno.test("discovery file lifecycle", async (t) => {
         assert(e instanceof Deno.errors.NotFound);
       }
     });
+
+    await t.step("running servers are listed together with their load", async () => {
+      const otherPid = Deno.pid + 99999;
+      const other = {
+        serverName: "jgd-other",
+        socketPath: "unix:///tmp/other.sock",
+        pid: otherPid,
+        transport: "unix",
+        sessions: 3,
+        load: 12.5,
+        updated: Date.now(),
+      };
+      const dead = { ...other, pid: otherPid + 1, updated: Date.now() - 60_000 };
+      await Deno.mkdir(join(tmpCacheDir, "jgd"), { recursive: true });
+      await Deno.writeTextFile(discPath, JSON.stringify({ ...other, servers: [other, dead] }));
+
+      const path = await writeDiscovery(
+        "unix:///tmp/test.sock",
+        "jgd-test",
+        undefined,
+        tmpCacheDir,
+        { transport: "unix", sessions: 0, load: 0 },
+      );
+      assert(path !== null);
+      let content = JSON.parse(await Deno.readTextFile(discPath));
+      // The newest server is the top-level entry for older clients.
+      assertEquals(content.pid, Deno.pid);
+      assertEquals(content.servers.map((e: { pid: number }) => e.pid), [Deno.pid, otherPid]);
+
+      await updateDiscovery(path, { transport: "unix", sessions: 2, load: 4 });
+      content = JSON.parse(await Deno.readTextFile(discPath));
+      assertEquals(content.servers[0].sessions, 2);
+      assertEquals(content.servers[0].load, 4);
+      assertEquals(content.servers[1].pid, otherPid);
+
+      // Leaving hands the top level to the remaining server.
+      await removeDiscovery(path);
+      content = JSON.parse(await Deno.readTextFile(discPath));
+      assertEquals(content.pid, otherPid);
+      assertEquals(content.socketPath, "unix:///tmp/other.sock");
+      assertEquals(content.servers.length, 1);
+
+      try { await Deno.remove(discPath); } catch { /* ignore */ }
+    });
   } finally {
     try {
       await Deno.remove(tmpCacheDir, { recursive: true });
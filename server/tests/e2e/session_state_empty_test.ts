@@ -0,0 +1,70 @@
+/**
+ * E2E test: a session the hub no longer stores does not wipe the browser's
+ * history.
+ *
+ * The hub keeps plots for a bounded number of sessions (8).  Picking an
+ * evicted session from the session menu gets an empty `session_state`;
+ * the browser must keep the plots it already has for that session and
+ * show a notice instead of "No plots".
+ */
+
+import { TestServer } from "../helpers/server.ts";
+import { RClient } from "../helpers/r_client.ts";
+import { E2EBrowser, waitForPlotInfo } from "../helpers/e2e_browser.ts";
+import { delay } from "@std/async";
+import type { ResizeMessage } from "../helpers/types.ts";
+
+const device = { width: 400, height: 300 };
+
+Deno.test("E2E: an evicted session keeps the browser's history", async (t) => {
+  const server = new TestServer();
+  const rClient = new RClient();
+  const e2e = new E2EBrowser();
+
+  try {
+    await server.start();
+    await rClient.connect(server.socketPath);
+    await e2e.launch();
+
+    const page = await e2e.newPage(server.httpBaseUrl);
+    await rClient.readMessage<ResizeMessage>();
+
+    await t.step("two plots in sess-a", async () => {
+      for (let i = 0; i < 2; i++) {
+        await rClient.sendFrame({
+          sessionId: "sess-a",
+          ops: [{ op: "rect", x0: 0, y0: 0, x1: 400, y1: 300, gc: { fill: "#ff0000" } }],
+          device,
+        }, { newPage: true, plotNumber: i });
+      }
+      await waitForPlotInfo(page, "2 / 2");
+    });
+
+    await t.step("eight other sessions push sess-a out of the hub's store", async () => {
+      for (let i = 1; i <= 8; i++) {
+        await rClient.sendFrame({
+          sessionId: `sess-${i}`,
+          ops: [{ op: "rect", x0: 0, y0: 0, x1: 400, y1: 300, gc: { fill: "#0000ff" } }],
+          device,
+        }, { newPage: true, plotNumber: 0 });
+      }
+      await waitForPlotInfo(page, "1 / 1");
+    });
+
+    await t.step("picking sess-a shows a notice, then its plots", async () => {
+      await page.evaluate(`(function() {
+        var select = document.getElementById('session-select');
+        select.value = 'sess-a';
+        select.dispatchEvent(new Event('change'));
+      })()`);
+      await waitForPlotInfo(page, "No stored plots for sess-a");
+      await waitForPlotInfo(page, "2 / 2", 6000);
+    });
+  } finally {
+    await e2e.close();
+    rClient.close();
+    await delay(100);
+    await server.shutdown();
+    server.cleanup();
+  }
+});
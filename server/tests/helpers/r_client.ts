@@ -62,6 +62,11 @@ export class RClient {
     await this.#writer!.write(data);
   }
 
+  /** Send a pre-serialized JSON line verbatim (newline appended). */
+  async sendLine(line: string): Promise<void> {
+    await this.#writer!.write(this.#encoder.encode(line + "\n"));
+  }
+
   #plotCounter = 0;
 
   /** Send a frame message. */
@@ -10,6 +10,11 @@ export class TestServer {
   socketPath: string;
   readonly tmpDir: string;
   readonly useTcp: boolean;
+  readonly verbose: boolean;
+  /** Path passed to -capture, or "" when not capturing. */
+  readonly capturePath: string;
+  /** Upstream passed to -relay, or "" for a normal server. */
+  readonly relay: string;
 
   httpPort = 0;
   pid = 0;
@@ -19,15 +24,21 @@ export class TestServer {
   #stderrDone: Promise<void> | null = null;
   #stderrBuf: string[] = [];
 
-  constructor(opts?: { tcp?: boolean }) {
+  constructor(opts?: { tcp?: boolean; verbose?: boolean; capture?: string; relay?: string }) {
     this.tmpDir = Deno.makeTempDirSync({ prefix: "jgd-test-" });
     this.useTcp = opts?.tcp ?? false;
+    // Load generation disables -v: per-frame hub logging would dominate
+    // the measurement and grow the captured stderr without bound.
+    this.verbose = opts?.verbose ?? true;
+    this.capturePath = opts?.capture ?? "";
+    // A relay has no R socket.
+    this.relay = opts?.relay ?? "";
     // TCP and named pipe (Windows default) paths are both auto-generated
     // by the server, so we parse them from server output.
-    const needsOutputParsing = this.useTcp || Deno.build.os === "windows";
+    const needsOutputParsing = !this.relay && (this.useTcp || Deno.build.os === "windows");
     const rawPath = join(this.tmpDir, `jgd-${crypto.randomUUID().slice(0, 8)}.sock`);
-    this.socketPath = needsOutputParsing
-      ? ""  // resolved after server starts
+    this.socketPath = needsOutputParsing || this.relay
+      ? ""  // resolved after server starts (or none, for a relay)
       : socketUri.unix(rawPath);
   }
 
@@ -73,7 +84,9 @@ export class TestServer {
     }
 
     const serverArgs = [...prefixArgs];
-    if (this.useTcp) {
+    if (this.relay) {
+      serverArgs.push("-relay", this.relay);
+    } else if (this.useTcp) {
       serverArgs.push("-tcp", "0");
     } else if (this.socketPath) {
       // Unix socket mode only; on Windows socketPath is "" here
@@ -82,7 +95,9 @@ export class TestServer {
       if (addr.transport !== "unix") throw new Error(`Expected unix:///path URI, got: ${this.socketPath}`);
       serverArgs.push("-socket", addr.path);
     }
-    serverArgs.push("-http", "127.0.0.1:0", "-v");
+    serverArgs.push("-http", "127.0.0.1:0");
+    if (this.verbose) serverArgs.push("-v");
+    if (this.capturePath) serverArgs.push("-capture", this.capturePath);
 
     const cmd = new Deno.Command(bin, {
       args: serverArgs,
@@ -161,7 +176,7 @@ export class TestServer {
       throw new Error("Failed to detect HTTP port from server output");
     }
 
-    const needsOutputParsing = this.useTcp || Deno.build.os === "windows";
+    const needsOutputParsing = !this.relay && (this.useTcp || Deno.build.os === "windows");
     if (needsOutputParsing && !this.socketPath) {
       throw new Error("Failed to detect socket path from server output");
     }
@@ -11,6 +11,7 @@ export interface FrameMessage {
   newPage?: boolean;
   resize?: boolean;
   plotIndex?: number;
+  plotNumber?: number;
   resizeReplay?: boolean;
 }
 
@@ -60,6 +61,24 @@ export interface PongMessage {
   type: "pong";
 }
 
+export interface SessionStateMessage {
+  type: "session_state";
+  sessionId: string;
+  plots: Array<{ plotNumber: number; plot: FrameMessage["plot"] }>;
+}
+
+export interface SessionActivityMessage {
+  type: "session_activity";
+  sessionId: string;
+  plotNumber: number | null;
+  ops: number;
+}
+
+export interface ControlLaneMessage {
+  type: "control_lane";
+  token: string;
+}
+
 export interface DiscoveryFile {
   serverName: string;
   socketPath: string;
@@ -74,4 +93,7 @@ export type ServerMessage =
   | MetricsResponseMessage
   | CloseMessage
   | ServerInfoMessage
-  | PongMessage;
+  | PongMessage
+  | SessionStateMessage
+  | SessionActivityMessage
+  | ControlLaneMessage;
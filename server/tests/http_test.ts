@@ -1,5 +1,7 @@
 import { assert, assertEquals } from "@std/assert";
 import { TestServer } from "./helpers/server.ts";
+import { withTestHarness } from "./helpers/harness.ts";
+import type { FrameMessage } from "./helpers/types.ts";
 
 Deno.test("HTTP static file serving", async (t) => {
   const server = new TestServer();
@@ -44,13 +46,87 @@ Deno.test("HTTP static file serving", async (t) => {
       await res.body?.cancel();
     });
 
+    await t.step("GET /app.js revalidates with ETag", async () => {
+      const res = await fetch(`${server.httpBaseUrl}/app.js`);
+      const etag = res.headers.get("etag");
+      assert(etag, "Expected an ETag");
+      await res.body?.cancel();
+
+      const again = await fetch(`${server.httpBaseUrl}/app.js`, {
+        headers: { "if-none-match": etag },
+      });
+      assertEquals(again.status, 304);
+      await again.body?.cancel();
+    });
+
     await t.step("GET /nonexistent returns 404", async () => {
       const res = await fetch(`${server.httpBaseUrl}/nonexistent`);
       assertEquals(res.status, 404);
       await res.body?.cancel();
     });
+
   } finally {
     await server.shutdown();
     server.cleanup();
   }
 });
+
+Deno.test("GET /font serves only fonts the device defined", withTestHarness(async (t, { server, rClient, browser }) => {
+  const dir = Deno.makeTempDirSync({ prefix: "jgd-fonts-" });
+  const fontPath = `${dir}/font.ttf`;
+  const secretPath = `${dir}/secret.txt`;
+  const linkPath = `${dir}/link.ttf`;
+  const symlinks = Deno.build.os !== "windows";
+  Deno.writeFileSync(fontPath, new Uint8Array([0, 1, 0, 0]));
+  Deno.writeTextFileSync(secretPath, "secret");
+  if (symlinks) Deno.symlinkSync(secretPath, linkPath);
+
+  const fontUrl = (id: unknown) => `${server.httpBaseUrl}/font?id=${encodeURIComponent(String(id))}`;
+
+  try {
+    await rClient.sendFrame({
+      sessionId: "font-session",
+      ops: [
+        { op: "defFont", id: 1, file: fontPath, index: 0, size: 12 },
+        { op: "defFont", id: 2, file: linkPath, index: 0, size: 12 },
+        { op: "defFont", id: 3, file: "/etc/hosts", index: 0, size: 12 },
+      ],
+      device: {},
+    });
+    const frame = await browser.waitForType<FrameMessage>("frame");
+    // deno-lint-ignore no-explicit-any
+    const ops = frame.plot.ops as any[];
+
+    await t.step("defined fonts are served under their id", async () => {
+      assertEquals(typeof ops[0].fontId, "string");
+      const res = await fetch(fontUrl(ops[0].fontId));
+      assertEquals(res.status, 200);
+      assertEquals(new Uint8Array(await res.arrayBuffer()).length, 4);
+    });
+
+    await t.step("files that are not fonts get no id", () => {
+      assertEquals(ops[2].fontId, undefined);
+    });
+
+    if (symlinks) {
+      await t.step("a font name linking to another file is refused", async () => {
+        const res = await fetch(fontUrl(ops[1].fontId));
+        assertEquals(res.status, 403);
+        await res.body?.cancel();
+      });
+    }
+
+    await t.step("paths and unknown ids are not served", async () => {
+      for (const url of [
+        `${server.httpBaseUrl}/font?file=${encodeURIComponent(fontPath)}`,
+        fontUrl("not-an-id"),
+      ]) {
+        const res = await fetch(url);
+        assertEquals(res.status, 404);
+        await res.body?.cancel();
+      }
+    });
+  } finally {
+    Deno.removeSync(dir, { recursive: true });
+  }
+}));
@@ -0,0 +1,88 @@
+import { assert, assertEquals } from "@std/assert";
+import { withTestHarness } from "./helpers/harness.ts";
+import type { FrameMessage, ResizeMessage } from "./helpers/types.ts";
+
+type TimedFrame = FrameMessage & { timing: Record<string, number | string> };
+
+Deno.test("frame timing", withTestHarness(async (t, { server, rClient, browser }) => {
+  // Wait for WebSocket registration by sending a resize round-trip
+  browser.sendResize(100, 100);
+  await rClient.readMessage<ResizeMessage>();
+
+  const now = Date.now();
+  const timing = {
+    id: "test-session-1",
+    rSerializeStart: now - 3,
+    rSerializeEnd: now - 2,
+    rSend: now - 2,
+  };
+
+  let received: TimedFrame;
+
+  await t.step("hub adds receive and broadcast stamps", async () => {
+    await rClient.send({
+      type: "frame",
+      plot: { sessionId: "test-session", ops: [], device: {} },
+      timing,
+    });
+
+    received = await browser.waitForType<TimedFrame>("frame");
+    assertEquals(received.timing.id, "test-session-1");
+    assertEquals(received.timing.rSend, timing.rSend);
+    const recv = received.timing.hubRecv as number;
+    const bcast = received.timing.hubBroadcast as number;
+    assert(typeof recv === "number" && typeof bcast === "number");
+    assert(bcast >= recv, "hubBroadcast should not precede hubRecv");
+  });
+
+  await t.step("frames without timing are not stamped", async () => {
+    await rClient.sendFrame({ sessionId: "test-session", ops: [], device: {} });
+    const msg = await browser.waitForType<TimedFrame>("frame");
+    assertEquals(msg.timing, undefined);
+  });
+
+  await t.step("browser reports are aggregated at /latency", async () => {
+    const t0 = received.timing.hubBroadcast as number;
+    browser.send({
+      type: "frame_timing",
+      timing: {
+        ...received.timing,
+        browserParseStart: t0 + 1,
+        browserParseEnd: t0 + 2,
+        browserRenderDone: t0 + 10,
+      },
+    });
+    // Ping round-trip guarantees the report was processed.
+    await browser.sendPing();
+
+    const res = await fetch(`${server.httpBaseUrl}/latency`);
+    assertEquals(res.headers.get("content-type"), "application/json");
+    const body = await res.json();
+    assertEquals(body.frames, 1);
+    for (const stage of ["serialize", "rToHub", "hub", "hubToBrowser", "parse", "render", "total"]) {
+      assertEquals(body.stages[stage].count, 1, `stage ${stage}`);
+    }
+    assert(Math.abs(body.stages.render.max - 8) < 1e-3);
+    assertEquals(body.stages.serialize.max, 1);
+  });
+
+  await t.step("a second viewer's report of the same frame is not counted", async () => {
+    const t0 = received.timing.hubBroadcast as number;
+    browser.send({
+      type: "frame_timing",
+      timing: { ...received.timing, browserParseStart: t0 + 50, browserRenderDone: t0 + 90 },
+    });
+    await browser.sendPing();
+
+    const body = await (await fetch(`${server.httpBaseUrl}/latency`)).json();
+    assertEquals(body.frames, 1);
+    assertEquals(body.stages.total.count, 1);
+  });
+
+  await t.step("/latency?reset clears the histograms", async () => {
+    await (await fetch(`${server.httpBaseUrl}/latency?reset`)).body?.cancel();
+    const body = await (await fetch(`${server.httpBaseUrl}/latency`)).json();
+    assertEquals(body.frames, 0);
+    assertEquals(body.stages.total.count, 0);
+  });
+}));
@@ -0,0 +1,104 @@
+import { assert, assertEquals } from "@std/assert";
+import { withTestHarness } from "./helpers/harness.ts";
+import type { FrameMessage } from "./helpers/types.ts";
+
+const PNG_SIGNATURE = [137, 80, 78, 71, 13, 10, 26, 10];
+
+const gc = { col: "rgba(0,0,0,1)", fill: "rgba(255,0,0,1)", lwd: 1, lty: [] };
+const device = { width: 200, height: 100, dpi: 72, bg: "rgba(255,255,255,1)" };
+
+async function fetchPng(url: string): Promise<{ width: number; height: number }> {
+  const res = await fetch(url);
+  assertEquals(res.status, 200);
+  assertEquals(res.headers.get("content-type"), "image/png");
+  const bytes = new Uint8Array(await res.arrayBuffer());
+  assertEquals([...bytes.subarray(0, 8)], PNG_SIGNATURE);
+  const view = new DataView(bytes.buffer);
+  // IHDR is the first chunk: width and height follow its type.
+  return { width: view.getUint32(16), height: view.getUint32(20) };
+}
+
+Deno.test("server-side PNG rendering", withTestHarness(async (t, { server, rClient, browser }) => {
+  await t.step("404 before any plot arrives", async () => {
+    const res = await fetch(`${server.httpBaseUrl}/plot.png`);
+    assertEquals(res.status, 404);
+    await res.body?.cancel();
+  });
+
+  await rClient.sendFrame({
+    sessionId: "png-session",
+    ops: [{ op: "rect", x0: 10, y0: 10, x1: 190, y1: 90, gc }],
+    device,
+  }, { newPage: true, plotNumber: 0 });
+  await browser.waitForType<FrameMessage>("frame");
+  await rClient.sendFrame({
+    sessionId: "png-session",
+    ops: [
+      { op: "circle", x: 100, y: 50, r: 30, gc },
+      { op: "text", x: 100, y: 95, str: "jgd", rot: 0, hadj: 0.5, gc: { ...gc, font: { size: 12 } } },
+    ],
+    device,
+  }, { newPage: true, plotNumber: 1 });
+  await browser.waitForType<FrameMessage>("frame");
+
+  await t.step("/plots lists stored plots", async () => {
+    const res = await fetch(`${server.httpBaseUrl}/plots`);
+    const body = await res.json();
+    assertEquals(body, [{ sessionId: "png-session", plots: [0, 1] }]);
+  });
+
+  await t.step("latest plot renders at device size", async () => {
+    const size = await fetchPng(`${server.httpBaseUrl}/plot.png`);
+    assertEquals(size, { width: 200, height: 100 });
+  });
+
+  await t.step("one dimension keeps the aspect ratio", async () => {
+    const size = await fetchPng(`${server.httpBaseUrl}/plot.png?session=png-session&plot=0&width=100`);
+    assertEquals(size, { width: 100, height: 50 });
+  });
+
+  await t.step("explicit size is honoured", async () => {
+    const size = await fetchPng(`${server.httpBaseUrl}/plot.png?plot=1&width=64&height=64`);
+    assertEquals(size, { width: 64, height: 64 });
+  });
+
+  await t.step("incremental frames extend the stored plot", async () => {
+    const before = new Uint8Array(await (await fetch(`${server.httpBaseUrl}/plot.png?plot=1`)).arrayBuffer());
+    await rClient.sendFrame({
+      sessionId: "png-session",
+      ops: [{ op: "line", x1: 0, y1: 0, x2: 200, y2: 100, gc: { ...gc, lwd: 4 } }],
+      device,
+    }, { incremental: true });
+    await browser.waitForType<FrameMessage>("frame");
+    const after = new Uint8Array(await (await fetch(`${server.httpBaseUrl}/plot.png?plot=1`)).arrayBuffer());
+    assert(
+      before.length !== after.length || before.some((b, i) => b !== after[i]),
+      "appended ops should change the rendered image",
+    );
+  });
+
+  await t.step("frames keep flowing while a large image renders", async () => {
+    let rendered = false;
+    const big = fetch(`${server.httpBaseUrl}/plot.png?plot=1&width=4096&height=4096`)
+      .then(async (res) => {
+        await res.arrayBuffer();
+        rendered = true;
+        return res.status;
+      });
+    await rClient.sendFrame({ sessionId: "png-session", ops: [], device }, { incremental: true });
+    await browser.waitForType<FrameMessage>("frame");
+    assert(!rendered, "the frame should not wait for the render");
+    assertEquals(await big, 200);
+  });
+
+  await t.step("bad parameters are rejected", async () => {
+    for (const query of ["width=0", "height=abc", "width=100000", "plot=-1"]) {
+      const res = await fetch(`${server.httpBaseUrl}/plot.png?${query}`);
+      assertEquals(res.status, 400, query);
+      await res.body?.cancel();
+    }
+    const res = await fetch(`${server.httpBaseUrl}/plot.png?plot=7`);
+    assertEquals(res.status, 404);
+    await res.body?.cancel();
+  });
+}));
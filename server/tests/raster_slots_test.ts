@@ -0,0 +1,166 @@
+import { assert, assertEquals } from "@std/assert";
+import { delay } from "@std/async";
+import { decodePngDataUri, encodePng } from "../raster.ts";
+import { RasterSlots, SentRasters } from "../raster_slots.ts";
+import { TestServer } from "./helpers/server.ts";
+import { RClient } from "./helpers/r_client.ts";
+import { BrowserClient } from "./helpers/browser_client.ts";
+import type { FrameMessage } from "./helpers/types.ts";
+
+function dataUri(png: ArrayBuffer): string {
+  return "data:image/png;base64," + btoa(String.fromCharCode(...new Uint8Array(png)));
+}
+
+/** A w×h PNG data URI filled with one colour. */
+async function solid(w: number, h: number, rgba: number[]): Promise<string> {
+  const px = new Uint8Array(w * h * 4);
+  for (let i = 0; i < px.length; i += 4) px.set(rgba, i);
+  return dataUri(await encodePng(px, w, h));
+}
+
+async function pixel(uri: string, x: number, y: number): Promise<number[]> {
+  const img = (await decodePngDataUri(uri))!;
+  const i = (y * img.width + x) * 4;
+  return [...img.data.subarray(i, i + 4)];
+}
+
+// deno-lint-ignore no-explicit-any
+type Op = Record<string, any>;
+
+const placement = { op: "raster", x: 0, y: 64, w: 64, h: -64, rot: 0, interpolate: false, pw: 64, ph: 64 };
+const RED = [255, 0, 0, 255];
+const BLUE = [0, 0, 255, 255];
+
+Deno.test("raster patches are composed onto their base image", async () => {
+  const slots = new RasterSlots();
+  const key = { ...placement, slot: 1, seq: 1, data: await solid(64, 64, RED) };
+  slots.note("s", [key]);
+  assertEquals((await slots.resolve([key]))[0], key);
+
+  const patch = {
+    ...placement, slot: 1, seq: 2, base: 1,
+    tiles: [{ x: 32, y: 0, data: await solid(32, 32, BLUE) }],
+  };
+  const ops = [patch];
+  slots.note("s", ops);
+  const [resolved] = await slots.resolve(ops);
+
+  assert(resolved !== patch, "the broadcast op is left alone");
+  assertEquals(ops[0], patch);
+  assertEquals(resolved.tiles, undefined);
+  assertEquals(resolved.base, undefined);
+  assertEquals(resolved.seq, 2);
+  assertEquals(await pixel(resolved.data, 0, 0), RED);
+  assertEquals(await pixel(resolved.data, 40, 10), BLUE);
+  assertEquals(await pixel(resolved.data, 40, 40), RED);
+
+  // A later patch builds on the composed image, and a resent patch
+  // (a complete frame repeating it) still finds its base.
+  const next = {
+    ...placement, slot: 1, seq: 3, base: 2,
+    tiles: [{ x: 0, y: 32, data: await solid(32, 32, BLUE) }],
+  };
+  const again = { ...patch };
+  slots.note("s", [next, again]);
+  const [composed, repeated] = await slots.resolve([next, again]);
+  assertEquals(await pixel(composed.data, 40, 10), BLUE);
+  assertEquals(await pixel(composed.data, 10, 40), BLUE);
+  assertEquals(await pixel(repeated.data, 10, 40), RED);
+});
+
+Deno.test("patches are composed when read, even after their base left the slot", async () => {
+  const slots = new RasterSlots();
+  const frames: Op[][] = [[{ ...placement, slot: 1, seq: 1, data: await solid(64, 64, RED) }]];
+  for (let seq = 2; seq <= 10; seq++) {
+    frames.push([{
+      ...placement, slot: 1, seq, base: seq - 1,
+      tiles: [{ x: (seq % 2) * 32, y: 0, data: await solid(32, 32, seq === 2 ? BLUE : RED) }],
+    }]);
+  }
+  // Noting a frame is all a broadcast costs; nothing is decoded yet.
+  for (const ops of frames) slots.note("s", ops);
+
+  // Seq 4 is no longer among the slot's images, but its patch still
+  // knows what it applies to.
+  const [fourth] = await slots.resolve(frames[3]);
+  assertEquals(await pixel(fourth.data, 0, 0), RED);
+  const [second, third] = [(await slots.resolve(frames[1]))[0], (await slots.resolve(frames[2]))[0]];
+  assertEquals(await pixel(second.data, 0, 0), BLUE);
+  assertEquals(await pixel(third.data, 0, 0), BLUE);
+  assertEquals(await pixel(third.data, 40, 0), RED);
+});
+
+Deno.test("a patch with an unknown base is kept as it is", async () => {
+  const slots = new RasterSlots();
+  const patch = {
+    ...placement, slot: 5, seq: 9, base: 8,
+    tiles: [{ x: 0, y: 0, data: await solid(32, 32, BLUE) }],
+  };
+  const ops = [patch];
+  slots.note("s", ops);
+  assert(await slots.resolve(ops) === ops);
+  const other = [{ ...patch, base: 1 }];
+  slots.note("other", other);
+  assert((await slots.resolve(other))[0].data === undefined);
+});
+
+Deno.test("SentRasters tells which patches a client can apply", () => {
+  const sent = new SentRasters();
+  const whole = { ...placement, slot: 1, seq: 1, data: "" };
+  const patch = { ...placement, slot: 1, seq: 2, base: 1, tiles: [] };
+  assert(!sent.add("s", [patch]), "no base yet");
+  assert(sent.add("s", [whole, { ...patch, seq: 3 }]), "the base comes first in the frame");
+  assert(sent.add("s", [{ ...patch, seq: 4, base: 3 }]));
+  assert(!sent.add("t", [{ ...patch, seq: 4, base: 3 }]), "other sessions have their own slots");
+  assert(sent.add("s", [{ ...patch, seq: 5, base: 1 }]));
+  assert(!sent.add("s", [{ ...patch, seq: 6, base: 2 }]), "only the newest four images are kept");
+});
+
+Deno.test("a viewer that joins mid-animation gets the composed raster", async () => {
+  const server = new TestServer();
+  const rClient = new RClient();
+  const early = new BrowserClient();
+  const late = new BrowserClient();
+  try {
+    await server.start();
+    await rClient.connect(server.socketPath);
+    await early.connect(server.wsUrl);
+
+    const device = { width: 64, height: 64 };
+    const key = { ...placement, slot: 1, seq: 1, data: await solid(64, 64, RED) };
+    await rClient.sendFrame({ sessionId: "s", ops: [key], device }, { newPage: true });
+    await early.waitForType("frame");
+
+    await late.connect(server.wsUrl);
+    await delay(100);
+    const patch = {
+      ...placement, slot: 1, seq: 2, base: 1,
+      tiles: [{ x: 32, y: 0, data: await solid(32, 32, BLUE) }],
+    };
+    await rClient.sendFrame({ sessionId: "s", ops: [patch], device }, { newPage: true });
+
+    // The viewer that has the base gets the patch as R sent it ...
+    const delta = await early.waitForType<FrameMessage>("frame");
+    assertEquals((delta.plot.ops[0] as Op).tiles?.length, 1);
+
+    // ... the one that joined after it gets the whole image.
+    const keyframe = await late.waitForType<FrameMessage>("frame");
+    const op = keyframe.plot.ops[0] as Op;
+    assertEquals(op.tiles, undefined);
+    assertEquals(op.seq, 2);
+    assertEquals(await pixel(op.data, 40, 10), BLUE);
+    assertEquals(await pixel(op.data, 10, 10), RED);
+
+    // From then on it can apply patches itself.
+    await rClient.sendFrame({ sessionId: "s", ops: [{ ...patch, seq: 3, base: 2 }], device }, { newPage: true });
+    const next = await late.waitForType<FrameMessage>("frame");
+    assertEquals((next.plot.ops[0] as Op).base, 2);
+  } finally {
+    early.close();
+    late.close();
+    rClient.close();
+    await delay(100);
+    await server.shutdown();
+    server.cleanup();
+  }
+});
@@ -0,0 +1,145 @@
+/**
+ * Server protocol test: relay mode (`-relay`).
+ *
+ * A relay server mirrors a primary's sessions for its own browsers: it
+ * receives the primary's stored plots when it connects and every frame
+ * after that, and can itself be relayed.  Its viewers answer font-metrics
+ * requests but cannot resize the R session; a relay without viewers
+ * answers them itself so R does not wait for the fallback timeout.
+ */
+
+import { assert, assertEquals, assertRejects } from "@std/assert";
+import { delay } from "@std/async";
+import { TestServer } from "./helpers/server.ts";
+import { RClient } from "./helpers/r_client.ts";
+import { BrowserClient } from "./helpers/browser_client.ts";
+import type {
+  FrameMessage,
+  MetricsRequestMessage,
+  MetricsResponseMessage,
+  SessionStateMessage,
+} from "./helpers/types.ts";
+
+const device = { width: 400, height: 300 };
+
+Deno.test("relay mirrors a primary server", async (t) => {
+  const primary = new TestServer();
+  let relay: TestServer | undefined;
+  let chained: TestServer | undefined;
+  const rClient = new RClient();
+  const direct = new BrowserClient();
+  const viewer = new BrowserClient();
+  const viewer2 = new BrowserClient();
+
+  try {
+    await primary.start();
+    await rClient.connect(primary.socketPath);
+    await direct.connect(primary.wsUrl);
+    await rClient.sendFrame({ sessionId: "live", ops: [{ op: "rect" }], device }, { newPage: true });
+    await direct.waitForType("frame");
+
+    relay = new TestServer({ relay: primary.wsUrl });
+    await relay.start();
+
+    await t.step("a relay viewer is sent the primary's stored plots", async () => {
+      await viewer.connect(relay!.wsUrl);
+      viewer.send({ type: "subscribe", follow: true });
+      const state = await viewer.waitForType<SessionStateMessage>("session_state", 10000);
+      assertEquals(state.sessionId, "live");
+      assertEquals(state.plots[0].plot.ops, [{ op: "rect" }]);
+    });
+
+    await t.step("frames are passed on as they arrive", async () => {
+      await rClient.sendFrame({ sessionId: "live", ops: [{ op: "line" }], device }, { incremental: true });
+      const frame = await viewer.waitForType<FrameMessage>("frame");
+      assertEquals(frame.incremental, true);
+      assertEquals(frame.plot.ops, [{ op: "line" }]);
+    });
+
+    await t.step("relays can be chained", async () => {
+      chained = new TestServer({ relay: relay!.wsUrl });
+      await chained.start();
+      await viewer2.connect(chained.wsUrl);
+      viewer2.send({ type: "subscribe", follow: true });
+      const state = await viewer2.waitForType<SessionStateMessage>("session_state", 10000);
+      assertEquals(state.plots[0].plot.ops, [{ op: "rect" }, { op: "line" }]);
+    });
+
+    await t.step("relay viewers answer metrics requests", async () => {
+      direct.close();
+      await delay(200);
+      await rClient.sendMetricsRequest(5);
+      const req = await viewer.waitForType<MetricsRequestMessage>("metrics_request");
+      viewer.sendMetricsResponse(req.id, 33, 9, 2);
+      const resp = await rClient.readMessage<MetricsResponseMessage>();
+      assertEquals(resp.id, 5);
+      assertEquals(resp.width, 33);
+      // A later answer to the same request goes no further.
+      const req2 = await viewer2.waitForType<MetricsRequestMessage>("metrics_request");
+      viewer2.sendMetricsResponse(req2.id, 99, 9, 2);
+      await assertRejects(() => rClient.readMessage(500));
+    });
+
+    await t.step("relay viewers cannot resize the R session", async () => {
+      viewer.sendResize(123, 45);
+      await assertRejects(() => rClient.readMessage(500));
+    });
+  } finally {
+    viewer2.close();
+    viewer.close();
+    direct.close();
+    rClient.close();
+    await delay(100);
+    for (const server of [chained, relay, primary]) {
+      if (!server) continue;
+      await server.shutdown();
+      server.cleanup();
+    }
+  }
+});
+
+Deno.test("a relay without viewers does not hold up metrics", async (t) => {
+  const primary = new TestServer();
+  let relay: TestServer | undefined;
+  const rClient = new RClient();
+  const direct = new BrowserClient();
+
+  try {
+    await primary.start();
+    await rClient.connect(primary.socketPath);
+    relay = new TestServer({ relay: primary.wsUrl });
+    await relay.start();
+    await rClient.sendFrame({ sessionId: "live", ops: [{ op: "rect" }], device }, { newPage: true });
+    await delay(500);
+
+    await t.step("the relay answers at once when it is the only client", async () => {
+      const start = Date.now();
+      await rClient.sendMetricsRequest(7);
+      const resp = await rClient.readMessage<MetricsResponseMessage>();
+      assertEquals(resp.id, 7);
+      assertEquals(resp.width, 0);
+      // Well inside the primary's 2 s fallback timeout.
+      assert(Date.now() - start < 1000);
+    });
+
+    await t.step("a browser on the primary is asked instead of the relay", async () => {
+      await direct.connect(primary.wsUrl);
+      await delay(200);
+      await rClient.sendMetricsRequest(8);
+      const req = await direct.waitForType<MetricsRequestMessage>("metrics_request");
+      direct.sendMetricsResponse(req.id, 42, 9, 2);
+      const resp = await rClient.readMessage<MetricsResponseMessage>();
+      assertEquals(resp.id, 8);
+      assertEquals(resp.width, 42);
+    });
+  } finally {
+    direct.close();
+    rClient.close();
+    await delay(100);
+    for (const server of [relay, primary]) {
+      if (!server) continue;
+      await server.shutdown();
+      server.cleanup();
+    }
+  }
+});
@@ -0,0 +1,42 @@
+import { assertEquals } from "@std/assert";
+import { withTestHarness } from "./helpers/harness.ts";
+import type { FrameMessage, ResizeMessage } from "./helpers/types.ts";
+
+Deno.test("Scaled sessions only receive explicit re-layout resizes", withTestHarness(async (t, { rClient, browser }) => {
+  // A jgd(resize = "scale") device announces its mode in every frame.
+  await rClient.sendFrame(
+    { ops: [{ op: "text", str: "scaled" }], device: { width: 400, height: 300, resize: "scale" } },
+  );
+  const frame = await browser.waitForType<FrameMessage>("frame");
+  const sessionId = frame.plot.sessionId;
+
+  await t.step("normal resize is not forwarded", async () => {
+    browser.sendResize(800, 600);
+
+    let received = false;
+    try {
+      await rClient.readMessage<ResizeMessage>(1000);
+      received = true;
+    } catch {
+      // Timeout — the renderer scales the plot instead.
+    }
+    assertEquals(received, false, "scaled session should not receive a normal resize");
+  });
+
+  await t.step("relayout resize reaches the named session", async () => {
+    browser.send({ type: "resize", width: 800, height: 600, relayout: true, sessionId });
+
+    const msg = await rClient.readMessage<ResizeMessage>();
+    assertEquals(msg.type, "resize");
+    assertEquals(msg.width, 800);
+    assertEquals(msg.height, 600);
+    assertEquals(msg.plotIndex, undefined);
+  });
+
+  await t.step("a repeated relayout is not deduplicated", async () => {
+    browser.send({ type: "resize", width: 800, height: 600, relayout: true, sessionId });
+
+    const msg = await rClient.readMessage<ResizeMessage>();
+    assertEquals(msg.width, 800);
+  });
+}));
@@ -0,0 +1,133 @@
+/**
+ * Server protocol test: session subscriptions.
+ *
+ * A browser that sends `subscribe` receives full frames only for the
+ * sessions it subscribed to (or, with `follow: true`, the session that
+ * drew last).  Other sessions are announced with lightweight
+ * `session_activity` notices, and opening a session delivers its stored
+ * plots as a `session_state` message.  A follower moved to another
+ * session gets only that session's latest plot.
+ */
+
+import { assert, assertEquals, assertRejects } from "@std/assert";
+import { delay } from "@std/async";
+import { TestServer } from "./helpers/server.ts";
+import { RClient } from "./helpers/r_client.ts";
+import { BrowserClient } from "./helpers/browser_client.ts";
+import type {
+  FrameMessage,
+  SessionActivityMessage,
+  SessionStateMessage,
+} from "./helpers/types.ts";
+
+const device = { width: 400, height: 300 };
+
+Deno.test("session subscriptions", async (t) => {
+  const server = new TestServer();
+  const rA = new RClient();
+  const rB = new RClient();
+  const legacy = new BrowserClient();
+  const pinned = new BrowserClient();
+  const follower = new BrowserClient();
+
+  try {
+    await server.start();
+    await rA.connect(server.socketPath);
+    await rB.connect(server.socketPath);
+    await legacy.connect(server.wsUrl);
+    await pinned.connect(server.wsUrl);
+    await follower.connect(server.wsUrl);
+
+    await rA.sendFrame({ sessionId: "sess-a", ops: [{ op: "rect" }], device }, { newPage: true });
+    await rB.sendFrame({ sessionId: "sess-b", ops: [{ op: "line" }], device }, { newPage: true });
+    for (const b of [legacy, pinned, follower]) {
+      await b.waitForType("frame");
+      await b.waitForType("frame");
+    }
+
+    await t.step("subscribing delivers the session's stored plots", async () => {
+      pinned.send({ type: "subscribe", sessions: ["sess-a"] });
+      const state = await pinned.waitForType<SessionStateMessage>("session_state");
+      assertEquals(state.sessionId, "sess-a");
+      assertEquals(state.plots.length, 1);
+      assertEquals(state.plots[0].plot.ops, [{ op: "rect" }]);
+      const note = await pinned.waitForType<SessionActivityMessage>("session_activity");
+      assertEquals(note.sessionId, "sess-b");
+      assertEquals(note.ops, 1);
+    });
+
+    await t.step("follow without sessions opens the latest session", async () => {
+      follower.send({ type: "subscribe", follow: true });
+      const state = await follower.waitForType<SessionStateMessage>("session_state");
+      assertEquals(state.sessionId, "sess-b");
+      await follower.waitForType<SessionActivityMessage>("session_activity");
+    });
+
+    await t.step("unsubscribed sessions send notices, not frames", async () => {
+      await rB.sendFrame({ sessionId: "sess-b", ops: [{ op: "circle" }], device }, { incremental: true });
+      const note = await pinned.waitForType<SessionActivityMessage>("session_activity");
+      assertEquals(note.sessionId, "sess-b");
+      assertEquals(note.ops, 2);
+      await assertRejects(() => pinned.waitForType("frame", 300));
+
+      // Clients that never subscribed still receive every frame.
+      const frame = await legacy.waitForType<FrameMessage>("frame");
+      assertEquals(frame.plot.sessionId, "sess-b");
+      // The follower is already on sess-b.
+      const followed = await follower.waitForType<FrameMessage>("frame");
+      assertEquals(followed.incremental, true);
+    });
+
+    await t.step("following switches to the session that draws", async () => {
+      await rA.sendFrame({ sessionId: "sess-a", ops: [{ op: "text" }], device }, { newPage: true });
+      // Just the new plot; the session's history is not resent.
+      const switched = await follower.waitForType<FrameMessage>("frame");
+      assertEquals(switched.plot.sessionId, "sess-a");
+      assertEquals(switched.newPage, true);
+      assertEquals(switched.plotNumber, 1);
+      assertEquals(switched.plot.ops, [{ op: "text" }]);
+      await assertRejects(() => follower.waitForType("session_state", 300));
+
+      const frame = await pinned.waitForType<FrameMessage>("frame");
+      assertEquals(frame.plot.ops, [{ op: "text" }]);
+    });
+
+    await t.step("resize replays do not move a follower", async () => {
+      await rB.sendFrame({ sessionId: "sess-b", ops: [{ op: "line" }], device }, { resizeReplay: true });
+      const note = await follower.waitForType<SessionActivityMessage>("session_activity");
+      assertEquals(note.sessionId, "sess-b");
+      await assertRejects(() => follower.waitForType("session_state", 300));
+      const pinnedNote = await pinned.waitForType<SessionActivityMessage>("session_activity");
+      assertEquals(pinnedNote.sessionId, "sess-b");
+    });
+
+    await t.step("a follower switched by an incremental frame gets the whole plot", async () => {
+      await rB.sendFrame({ sessionId: "sess-b", ops: [{ op: "polygon" }], device }, { incremental: true });
+      const switched = await follower.waitForType<FrameMessage>("frame");
+      assertEquals(switched.plot.sessionId, "sess-b");
+      assertEquals(switched.newPage, true);
+      assertEquals(switched.plot.ops, [{ op: "line" }, { op: "polygon" }]);
+      await pinned.waitForType<SessionActivityMessage>("session_activity");
+    });
+
+    await t.step("switching sessions opens the new one", async () => {
+      pinned.send({ type: "subscribe", sessions: ["sess-b"] });
+      const state = await pinned.waitForType<SessionStateMessage>("session_state");
+      assertEquals(state.sessionId, "sess-b");
+      assertEquals(state.plots[0].plot.ops.length, 1);
+      await rA.sendFrame({ sessionId: "sess-a", ops: [{ op: "rect" }], device }, { incremental: true });
+      const note = await pinned.waitForType<SessionActivityMessage>("session_activity");
+      assertEquals(note.sessionId, "sess-a");
+      assert(note.plotNumber !== null);
+    });
+  } finally {
+    follower.close();
+    pinned.close();
+    legacy.close();
+    rB.close();
+    rA.close();
+    await delay(100);
+    await server.shutdown();
+    server.cleanup();
+  }
+});
@@ -1,6 +1,8 @@
 // Message types for the jgd protocol.
 // R → Server → Browser messages and Browser → Server → R messages.
 
+import type { FrameTiming } from "./latency.ts";
+
 export const SERVER_NAME = "jgd-http-server";
 
 /** Frame message containing plot operations. */
@@ -12,6 +14,14 @@ export interface FrameMessage {
     device: Record<string, unknown>;
   };
   incremental?: boolean;
+  /** Present when R has options(jgd.timing = TRUE); see latency.ts. */
+  timing?: FrameTiming;
+}
+
+/** Frame latency report from browser (echo of a frame's `timing`). */
+export interface FrameTimingMessage {
+  type: "frame_timing";
+  timing: FrameTiming;
 }
 
 /** Request from R for font metrics (strWidth or metricInfo). */
@@ -37,8 +47,21 @@ export interface ResizeMessage {
   width: number;
   height: number;
   plotIndex?: number;
-  /** Session that owns the target plot (for plotIndex routing). */
+  /** Session that owns the target plot (for plotIndex and relayout routing). */
   sessionId?: string;
+  /** Explicit re-layout request; the only resize a scaled session receives. */
+  relayout?: boolean;
+}
+
+/**
+ * How a device follows viewport changes (`jgd(resize =)`): R replays the
+ * plot, or the renderer scales it (keeping text size for "reflow").
+ */
+export type ResizeMode = "replay" | "scale" | "reflow";
+
+/** Parse a `resize` mode field; anything unrecognised means "replay". */
+export function parseResizeMode(value: unknown): ResizeMode {
+  return value === "scale" || value === "reflow" ? value : "replay";
 }
 
 /** Device close message from R. */
@@ -75,6 +98,7 @@ export interface PongMessage {
 export type BrowserMessage =
   | ResizeMessage
   | MetricsResponseMessage
+  | FrameTimingMessage
   | PingMessage;
 
 /** Union of all server-to-browser messages. */
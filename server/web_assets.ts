@@ -20,7 +20,11 @@ export const assets: Record<string, { body: string; type: string }> = {
     <button id="btn-prev" title="Previous plot" disabled>&#9664;</button>
     <button id="btn-next" title="Next plot" disabled>&#9654;</button>
     <button id="btn-delete" title="Remove current plot" disabled>&#10005;</button>
+    <button id="btn-relayout" title="Re-layout in R at this size" hidden>&#8635;</button>
     <span id="plot-info">No plots</span>
+    <select id="session-select" title="R session" hidden>
+        <option value="">Latest session</option>
+    </select>
     <select id="export-select" disabled>
         <option value="">Export\u2026</option>
         <option value="png">PNG</option>
@@ -175,6 +179,35 @@ export const assets: Record<string, { body: string; type: string }> = {
         this._activeSessionId = sessionId;
     };
 
+    // Replace a session's history with the hub's copy (session_state),
+    // staying on the viewed plot if the copy still has it.
+    PlotHistory.prototype.loadSession = function(sessionId, plots) {
+        var old = this._sessions.get(sessionId);
+        var viewed = old && old.currentIndex < old.plots.length - 1
+            ? old.plots[old.currentIndex] : null;
+        var session = makeSession();
+        session.plots = plots.slice(-this._maxPlots);
+        session.currentIndex = session.plots.length - 1;
+        if (viewed && viewed._rIndex !== undefined) {
+            for (var i = 0; i < session.plots.length; i++) {
+                if (session.plots[i]._rIndex === viewed._rIndex) session.currentIndex = i;
+            }
+        }
+        this._sessions.set(sessionId, session);
+        this._activeSessionId = sessionId;
+    };
+
+    // Show a session from this history, if it has one.
+    PlotHistory.prototype.activate = function(sessionId) {
+        if (this._sessions.has(sessionId)) this._activeSessionId = sessionId;
+    };
+
+    PlotHistory.prototype.latestRIndex = function(sessionId) {
+        var session = this._sessions.get(sessionId);
+        if (!session || session.plots.length === 0) return undefined;
+        return session.plots[session.plots.length - 1]._rIndex;
+    };
+
     PlotHistory.prototype.activeSessionId = function() {
         return this._activeSessionId;
     };
@@ -203,7 +236,9 @@ export const assets: Record<string, { body: string; type: string }> = {
     var btnPrev = document.getElementById('btn-prev');
     var btnNext = document.getElementById('btn-next');
     var btnDelete = document.getElementById('btn-delete');
+    var btnRelayout = document.getElementById('btn-relayout');
     var exportSelect = document.getElementById('export-select');
+    var sessionSelect = document.getElementById('session-select');
     var plotInfo = document.getElementById('plot-info');
     var wsStatus = document.getElementById('ws-status');
 
@@ -211,27 +246,52 @@ export const assets: Record<string, { body: string; type: string }> = {
 
     var history = new PlotHistory(50);
     var ws = null;
+    // Control lane: a second socket for resizes and font metrics, which
+    // would otherwise queue behind large frames on the main one.
+    var ctl = null;
+    // Session subscription: the hub sends full frames only for the
+    // session shown (the latest one to draw, unless one is picked), and
+    // a session_activity notice for the others.
+    var followLatest = true;
+    var pickedSession = '';
+    var knownSessions = new Map();
 
     // ---- Toolbar updates ----
 
+    // A short message shown in place of the plot counter.
+    var notice = null;
+    var NOTICE_MS = 4000;
+
+    function showNotice(text) {
+        notice = { text: text, until: Date.now() + NOTICE_MS };
+        updateToolbar();
+        setTimeout(updateToolbar, NOTICE_MS);
+    }
+
     function updateToolbar() {
         var idx = history.currentIndex();
         var total = history.count();
-        plotInfo.textContent = total > 0 ? idx + ' / ' + total : 'No plots';
+        if (notice && Date.now() >= notice.until) notice = null;
+        plotInfo.textContent = notice ? notice.text
+            : total > 0 ? idx + ' / ' + total : 'No plots';
         btnPrev.disabled = idx <= 1;
         btnNext.disabled = idx >= total;
         btnDelete.disabled = total === 0;
         exportSelect.disabled = total === 0;
+        // Scaled devices (jgd(resize = "scale")) are not replayed on
+        // resize; offer an explicit re-layout instead.
+        var plot = history.currentPlot();
+        btnRelayout.hidden = !(plot && plot.device.resize);
     }
 
     function replayCurrentPlot() {
         var plot = history.currentPlot();
         if (plot) {
-            replay(canvas, container, plot);
-        } else {
-            var ctx = canvas.getContext('2d');
-            ctx.clearRect(0, 0, canvas.width, canvas.height);
+            return replay(canvas, container, plot);
         }
+        var ctx = canvas.getContext('2d');
+        ctx.clearRect(0, 0, canvas.width, canvas.height);
+        return Promise.resolve();
     }
 
     // ---- Toolbar event handlers ----
@@ -258,6 +318,19 @@ export const assets: Record<string, { body: string; type: string }> = {
         updateToolbar();
     });
 
+    btnRelayout.addEventListener('click', function() {
+        var msg = resizeMessage();
+        msg.relayout = true;
+        msg.sessionId = history.activeSessionId();
+        sendControl(msg);
+    });
+
+    sessionSelect.addEventListener('change', function(e) {
+        followLatest = !e.target.value;
+        pickedSession = e.target.value;
+        sendSubscribe();
+    });
+
     exportSelect.addEventListener('change', function(e) {
         var fmt = e.target.value;
         if (!fmt) return;
@@ -301,22 +374,47 @@ export const assets: Record<string, { body: string; type: string }> = {
     // ---- Message handlers ----
 
     var renderScheduled = false;
+    // Frame timing objects (options(jgd.timing = TRUE)) waiting for the
+    // render that will display them.  Frames coalesced into one render
+    // all report that render's completion time.
+    var pendingTimings = [];
+
+    function nowMs() {
+        return performance.timeOrigin + performance.now();
+    }
 
     function scheduleRender() {
         if (!renderScheduled) {
             renderScheduled = true;
             requestAnimationFrame(function() {
                 renderScheduled = false;
-                replayCurrentPlot();
+                var timings = pendingTimings;
+                pendingTimings = [];
+                var done = replayCurrentPlot();
                 updateToolbar();
+                if (timings.length > 0) {
+                    done.then(function() { reportTimings(timings); });
+                }
             });
         }
     }
 
+    function reportTimings(timings) {
+        var t = nowMs();
+        for (var i = 0; i < timings.length; i++) {
+            timings[i].browserRenderDone = t;
+            if (ws && ws.readyState === WebSocket.OPEN) {
+                ws.send(JSON.stringify({ type: 'frame_timing', timing: timings[i] }));
+            }
+        }
+    }
+
     function handleFrame(msg) {
         var plot = msg.plot;
         plot._frameExt = msg.ext || null;
         var sessionId = plot.sessionId || 'default';
+        noteSession(sessionId);
+        if (Array.isArray(plot.ops)) prepareRasters(sessionId, plot.ops);
         if (msg.resize) {
             if (msg.plotIndex !== undefined) {
                 history.replaceAtIndex(sessionId, msg.plotIndex, plot);
@@ -332,7 +430,13 @@ export const assets: Record<string, { body: string; type: string }> = {
             if (typeof msg.plotNumber === 'number' && Number.isFinite(msg.plotNumber)) {
                 plot._rIndex = msg.plotNumber;
             }
-            history.addPlot(sessionId, plot);
+            // The hub switches a follower to another session with that
+            // session's latest plot, which this history may already hold.
+            if (plot._rIndex !== undefined && history.latestRIndex(sessionId) === plot._rIndex) {
+                history.replaceLatest(sessionId, plot, plot._rIndex);
+            } else {
+                history.addPlot(sessionId, plot);
+            }
         } else {
             // Complete frame for the latest page (e.g. dev.flush() after
             // hold period) — replace the latest plot rather than creating
@@ -343,6 +447,37 @@ export const assets: Record<string, { body: string; type: string }> = {
         scheduleRender();
     }
 
+    function handleSessionState(msg) {
+        noteSession(msg.sessionId);
+        // The hub keeps a bounded number of sessions; one it has evicted
+        // or never seen comes back empty.  Keep whatever is shown.
+        if (msg.plots.length === 0) {
+            history.activate(msg.sessionId);
+            showNotice('No stored plots for ' + msg.sessionId);
+            scheduleRender();
+            return;
+        }
+        var plots = [];
+        for (var i = 0; i < msg.plots.length; i++) {
+            var plot = msg.plots[i].plot;
+            plot._rIndex = msg.plots[i].plotNumber;
+            if (Array.isArray(plot.ops)) prepareRasters(msg.sessionId, plot.ops);
+            plots.push(plot);
+        }
+        history.loadSession(msg.sessionId, plots);
+        scheduleRender();
+    }
+
+    function noteSession(sessionId) {
+        if (knownSessions.has(sessionId)) return;
+        knownSessions.set(sessionId, true);
+        var opt = document.createElement('option');
+        opt.value = sessionId;
+        opt.textContent = sessionId;
+        sessionSelect.appendChild(opt);
+        sessionSelect.hidden = knownSessions.size < 2;
+    }
+
     function handleMetricsRequest(msg) {
         var gc = msg.gc || {};
         var size = gc.font ? gc.font.size || 12 : 12;
@@ -366,48 +501,49 @@ export const assets: Record<string, { body: string; type: string }> = {
             descent = m.actualBoundingBoxDescent || size * 0.25;
         }
 
-        if (ws && ws.readyState === WebSocket.OPEN) {
-            ws.send(JSON.stringify({
-                type: 'metrics_response',
-                id: msg.id,
-                width: width,
-                ascent: ascent,
-                descent: descent
-            }));
-        }
+        sendControl({
+            type: 'metrics_response',
+            id: msg.id,
+            width: width,
+            ascent: ascent,
+            descent: descent
+        });
     }
 
     // ---- Resize ----
 
     var resizeTimer = null;
 
+    function resizeMessage() {
+        var msg = {
+            type: 'resize',
+            width: container.clientWidth,
+            height: container.clientHeight
+        };
+        // Include plotIndex when viewing a historical (non-latest) plot
+        // so R re-renders the specific snapshot at the new dimensions.
+        // Also include plotIndex when the latest plot was deleted:
+        // R's display list still holds the deleted plot, so a normal
+        // resize would replay it.  plotIndex directs R to replay the
+        // correct snapshot for the remaining plot instead.
+        // _rIndex holds the plotNumber assigned by R, which R converts
+        // back to a snapshot_store index internally.
+        var idx = history.currentIndex();
+        var cnt = history.count();
+        if ((idx > 0 && idx < cnt) || (cnt > 0 && history.isLatestDeleted())) {
+            var currentPlot = history.currentPlot();
+            if (currentPlot && currentPlot._rIndex !== undefined) {
+                msg.plotIndex = currentPlot._rIndex;
+                msg.sessionId = history.activeSessionId();
+            }
+        }
+        return msg;
+    }
+
     function scheduleResizeMessage() {
         clearTimeout(resizeTimer);
         resizeTimer = setTimeout(function() {
-            if (!ws || ws.readyState !== WebSocket.OPEN) return;
-            var msg = {
-                type: 'resize',
-                width: container.clientWidth,
-                height: container.clientHeight
-            };
-            // Include plotIndex when viewing a historical (non-latest) plot
-            // so R re-renders the specific snapshot at the new dimensions.
-            // Also include plotIndex when the latest plot was deleted:
-            // R's display list still holds the deleted plot, so a normal
-            // resize would replay it.  plotIndex directs R to replay the
-            // correct snapshot for the remaining plot instead.
-            // _rIndex holds the plotNumber assigned by R, which R converts
-            // back to a snapshot_store index internally.
-            var idx = history.currentIndex();
-            var cnt = history.count();
-            if ((idx > 0 && idx < cnt) || (cnt > 0 && history.isLatestDeleted())) {
-                var currentPlot = history.currentPlot();
-                if (currentPlot && currentPlot._rIndex !== undefined) {
-                    msg.plotIndex = currentPlot._rIndex;
-                    msg.sessionId = history.activeSessionId();
-                }
-            }
-            ws.send(JSON.stringify(msg));
+            sendControl(resizeMessage());
         }, 300);
     }
 
@@ -430,9 +566,39 @@ export const assets: Record<string, { body: string; type: string }> = {
     var reconnectDelay = 2000;
     var maxReconnectDelay = 30000;
 
-    function connect() {
+    function wsUrl(query) {
         var proto = location.protocol === 'https:' ? 'wss:' : 'ws:';
-        ws = new WebSocket(proto + '//' + location.host + '/ws');
+        return proto + '//' + location.host + '/ws' + (query ? '?' + query : '');
+    }
+
+    // Resizes and metrics responses go on the control lane when it is
+    // open, otherwise on the main socket.
+    function sendControl(msg) {
+        var sock = ctl && ctl.readyState === WebSocket.OPEN ? ctl : ws;
+        if (!sock || sock.readyState !== WebSocket.OPEN) return;
+        sock.send(JSON.stringify(msg));
+    }
+
+    function sendSubscribe() {
+        if (!ws || ws.readyState !== WebSocket.OPEN) return;
+        ws.send(JSON.stringify(followLatest
+            ? { type: 'subscribe', follow: true }
+            : { type: 'subscribe', sessions: [pickedSession] }));
+    }
+
+    // The server names the lane to join with a token sent on connect.
+    function connectControl(token) {
+        if (typeof token !== 'string') return;
+        var sock = new WebSocket(wsUrl('lane=control&token=' + encodeURIComponent(token)));
+        ctl = sock;
+        sock.onmessage = handleMessage;
+        sock.onclose = function() {
+            if (ctl === sock) ctl = null;
+        };
+    }
+
+    function connect() {
+        ws = new WebSocket(wsUrl(''));
 
         ws.onopen = function() {
             reconnectDelay = 2000;
@@ -444,11 +610,14 @@ export const assets: Record<string, { body: string; type: string }> = {
                 width: container.clientWidth,
                 height: container.clientHeight
             }));
+            // Also resynchronises the shown session after a reconnect.
+            sendSubscribe();
         };
 
         ws.onclose = function() {
             wsStatus.className = '';
             wsStatus.title = 'Disconnected';
+            if (ctl) ctl.close();
             setTimeout(connect, reconnectDelay);
             reconnectDelay = Math.min(reconnectDelay * 2, maxReconnectDelay);
         };
@@ -457,26 +626,43 @@ export const assets: Record<string, { body: string; type: string }> = {
             // onclose will fire after this
         };
 
-        ws.onmessage = function(e) {
-            var msg;
-            try {
-                msg = JSON.parse(e.data);
-            } catch (err) {
-                return;
-            }
+        ws.onmessage = handleMessage;
+    }
 
-            switch (msg.type) {
-                case 'frame':
-                    handleFrame(msg);
-                    break;
-                case 'metrics_request':
-                    handleMetricsRequest(msg);
-                    break;
-                case 'close':
-                    updateToolbar();
-                    break;
-            }
-        };
+    function handleMessage(e) {
+        var msg;
+        try {
+            var parseStart = nowMs();
+            msg = JSON.parse(e.data);
+        } catch (err) {
+            return;
+        }
+        if (msg.timing && typeof msg.timing === 'object') {
+            msg.timing.browserParseStart = parseStart;
+            msg.timing.browserParseEnd = nowMs();
+            pendingTimings.push(msg.timing);
+        }
+
+        switch (msg.type) {
+            case 'frame':
+                handleFrame(msg);
+                break;
+            case 'metrics_request':
+                handleMetricsRequest(msg);
+                break;
+            case 'session_state':
+                handleSessionState(msg);
+                break;
+            case 'session_activity':
+                noteSession(msg.sessionId);
+                break;
+            case 'close':
+                updateToolbar();
+                break;
+            case 'control_lane':
+                connectControl(msg.token);
+                break;
+        }
     }
 
     connect();
@@ -497,7 +683,23 @@ function mapFontFamily(family) {
     return family + ', sans-serif';
 }
 
-function applyGc(ctx, gc) {
+// CSS font strings keyed by their gc.font object, built once per op.
+var _fontStrings = new WeakMap();
+
+function gcFont(font) {
+    var css = _fontStrings.get(font);
+    if (css === undefined) {
+        var face = font.face || 1;
+        var style = '';
+        if (face === 2 || face === 4) style += 'bold ';
+        if (face === 3 || face === 4) style += 'italic ';
+        css = style + (font.size || 12) + 'px ' + mapFontFamily(font.family);
+        _fontStrings.set(font, css);
+    }
+    return css;
+}
+
+function applyGc(ctx, gc, rc) {
     // Always reset extended Canvas2D state to defaults, even when gc is
     // absent.  This prevents gc.ext fields from leaking into subsequent
     // ops that lack a gc object (e.g. raster ops without gc).
@@ -510,7 +712,8 @@ function applyGc(ctx, gc) {
     ctx.filter = 'none';
     if (!gc) return;
     if (gc.col != null) ctx.strokeStyle = gc.col;
-    if (gc.fill != null) ctx.fillStyle = gc.fill;
+    var fill = gcFill(gc, rc);
+    if (fill != null) ctx.fillStyle = fill;
     ctx.lineWidth = gc.lwd || 1;
     ctx.lineCap = gc.lend || 'round';
     ctx.lineJoin = gc.ljoin || 'round';
@@ -520,15 +723,7 @@ function applyGc(ctx, gc) {
     } else {
         ctx.setLineDash([]);
     }
-    if (gc.font) {
-        var size = gc.font.size || 12;
-        var family = mapFontFamily(gc.font.family);
-        var face = gc.font.face || 1;
-        var style = '';
-        if (face === 2 || face === 4) style += 'bold ';
-        if (face === 3 || face === 4) style += 'italic ';
-        ctx.font = style + size + 'px ' + family;
-    }
+    if (gc.font) ctx.font = gcFont(gc.font);
     // Apply extension fields from gc.ext if present.
     if (gc.ext) {
         if (gc.ext.blendMode != null) ctx.globalCompositeOperation = gc.ext.blendMode;
@@ -545,9 +740,295 @@ function applyGc(ctx, gc) {
 
 // Create a fresh render context for group state.  Each render pass
 // (replay, renderToOffscreen) gets its own context so concurrent
-// async renders cannot corrupt each other's group stack.
-function makeRenderCtx() {
-    return { groupStack: [], currentClip: null };
+// async renders cannot corrupt each other's group stack.  Resources
+// (patterns, clip paths, masks) are shared with nested passes that
+// render a resource's own ops.
+function makeRenderCtx(resources) {
+    return {
+        groupStack: [],
+        currentClip: null,
+        resources: resources || { pattern: {}, clipPath: {}, mask: {}, group: {}, font: {} }
+    };
+}
+
+// Fill style for a gc: a pattern reference wins over the plain colour.
+function gcFill(gc, rc) {
+    if (!gc) return null;
+    if (gc.pattern != null && rc) {
+        var pat = rc.resources.pattern[gc.pattern];
+        if (pat) return pat;
+    }
+    return gc.fill;
+}
+
+function hasFill(gc) {
+    return !!gc && (gc.fill != null || gc.pattern != null);
+}
+
+// Compiled resource objects (CanvasGradient, CanvasPattern, Path2D,
+// mask canvases) keyed by their def* op, and the Path2D of each drawn
+// shape (opShape).  Plots keep their op arrays across replays, so a
+// resize or history switch reuses the compiled object instead of
+// rebuilding it from the op.
+var _resourceCache = new WeakMap();
+
+function transformScale(ctx) {
+    var m = ctx.getTransform();
+    return Math.hypot(m.a, m.b) || 1;
+}
+
+// Run a resource's recorded ops through renderOp on ctx.
+async function renderOpList(ctx, ops, plotH, resources) {
+    var rc = makeRenderCtx(resources);
+    ctx.save();
+    try {
+        for (var i = 0; i < ops.length; i++) {
+            var currentCtx = rc.groupStack.length > 0 ? rc.groupStack[rc.groupStack.length - 1].ctx : ctx;
+            await renderOp(currentCtx, ops[i], plotH, rc);
+        }
+        await closeMaskLayers(rc);
+    } finally {
+        ctx.restore();
+    }
+}
+
+function addGradientStops(grad, stops) {
+    for (var i = 0; i < stops.length; i++) {
+        grad.addColorStop(Math.max(0, Math.min(1, stops[i][0])), stops[i][1]);
+    }
+    return grad;
+}
+
+// Canvas gradients always pad; 'repeat'/'reflect'/'none' extends
+// render as 'pad'.
+async function compilePattern(ctx, def, plotH, rc) {
+    var cached = _resourceCache.get(def);
+    var scale = transformScale(ctx);
+    if (cached && (def.type !== 'tiling' || cached.scale === scale)) return cached.value;
+    var value = null;
+    if (def.type === 'linear') {
+        value = addGradientStops(ctx.createLinearGradient(def.x1, def.y1, def.x2, def.y2), def.stops);
+    } else if (def.type === 'radial') {
+        value = addGradientStops(ctx.createRadialGradient(def.cx1, def.cy1, def.r1, def.cx2, def.cy2, def.r2), def.stops);
+    } else if (def.type === 'tiling') {
+        // Rasterize one tile at the current device scale, then repeat it.
+        var left = Math.min(def.x, def.x + def.w), top = Math.min(def.y, def.y + def.h);
+        var tw = Math.abs(def.w), th = Math.abs(def.h);
+        var tile = document.createElement('canvas');
+        tile.width = Math.max(1, Math.ceil(tw * scale));
+        tile.height = Math.max(1, Math.ceil(th * scale));
+        var tileCtx = tile.getContext('2d');
+        if (!tileCtx) return null;
+        tileCtx.setTransform(scale, 0, 0, scale, -left * scale, -top * scale);
+        await renderOpList(tileCtx, def.ops || [], plotH, rc.resources);
+        value = ctx.createPattern(tile, def.extend === 'none' ? 'no-repeat' : 'repeat');
+        if (value) value.setTransform(new DOMMatrix().translate(left, top).scale(1 / scale));
+    }
+    _resourceCache.set(def, { scale: scale, value: value });
+    return value;
+}
+
+// Union of the shapes drawn by a resource's ops as a single Path2D.
+// Open lines only contribute when the path is stroked.
+function opsToPath2D(ops, withLines) {
+    var path = new Path2D();
+    for (var i = 0; i < ops.length; i++) {
+        var o = ops[i];
+        switch (o.op) {
+            case 'line':
+                if (!withLines) break;
+                path.moveTo(o.x1, o.y1);
+                path.lineTo(o.x2, o.y2);
+                break;
+            case 'polyline':
+                if (!withLines || o.x.length === 0) break;
+                path.moveTo(o.x[0], o.y[0]);
+                for (var j = 1; j < o.x.length; j++) path.lineTo(o.x[j], o.y[j]);
+                break;
+            case 'rect':
+                path.rect(Math.min(o.x0, o.x1), Math.min(o.y0, o.y1),
+                          Math.abs(o.x1 - o.x0), Math.abs(o.y1 - o.y0));
+                break;
+            case 'circle':
+                path.moveTo(o.x + o.r, o.y);
+                path.arc(o.x, o.y, o.r, 0, 2 * Math.PI);
+                break;
+            case 'polygon':
+                if (o.x.length === 0) break;
+                path.moveTo(o.x[0], o.y[0]);
+                for (var j = 1; j < o.x.length; j++) path.lineTo(o.x[j], o.y[j]);
+                path.closePath();
+                break;
+            case 'path':
+                for (var si = 0; si < o.subpaths.length; si++) {
+                    var sub = o.subpaths[si];
+                    if (sub.length === 0) continue;
+                    path.moveTo(sub[0][0], sub[0][1]);
+                    for (var j = 1; j < sub.length; j++) path.lineTo(sub[j][0], sub[j][1]);
+                    path.closePath();
+                }
+                break;
+        }
+    }
+    return path;
+}
+
+function compileClipPath(def) {
+    var cached = _resourceCache.get(def);
+    if (cached) return cached;
+    var compiled = {
+        path: opsToPath2D(def.ops || [], false),
+        rule: def.rule === 'evenodd' ? 'evenodd' : 'nonzero'
+    };
+    _resourceCache.set(def, compiled);
+    return compiled;
+}
+
+// grid compositing operator -> Canvas2D globalCompositeOperation.
+var compositeOps = {
+    'source': 'copy', 'over': 'source-over', 'in': 'source-in',
+    'out': 'source-out', 'atop': 'source-atop',
+    'dest.over': 'destination-over', 'dest.in': 'destination-in',
+    'dest.out': 'destination-out', 'dest.atop': 'destination-atop',
+    'xor': 'xor', 'add': 'lighter', 'multiply': 'multiply',
+    'screen': 'screen', 'overlay': 'overlay', 'darken': 'darken',
+    'lighten': 'lighten', 'color.dodge': 'color-dodge',
+    'color.burn': 'color-burn', 'hard.light': 'hard-light',
+    'soft.light': 'soft-light', 'difference': 'difference',
+    'exclusion': 'exclusion'
+};
+
+// Rasterize a group once into a canvas matching ctx's backing store:
+// draw dst, then composite the src layer onto it.  Every useGroup of
+// the definition draws this canvas.
+async function compileGroup(ctx, def, plotH, rc) {
+    var w = ctx.canvas.width, h = ctx.canvas.height;
+    var m = ctx.getTransform();
+    var key = [w, h, m.a, m.b, m.c, m.d, m.e, m.f].join(',');
+    var cached = _resourceCache.get(def);
+    if (cached && cached.key === key) return cached.canvas;
+    var groupCanvas = document.createElement('canvas');
+    groupCanvas.width = w;
+    groupCanvas.height = h;
+    var groupCtx = groupCanvas.getContext('2d');
+    if (!groupCtx) return null;
+    groupCtx.setTransform(m);
+    if (def.dst) await renderOpList(groupCtx, def.dst, plotH, rc.resources);
+    if (def.composite === 'clear') {
+        groupCtx.save();
+        groupCtx.setTransform(1, 0, 0, 1, 0, 0);
+        groupCtx.clearRect(0, 0, w, h);
+        groupCtx.restore();
+    } else if (def.composite !== 'dest') {
+        var srcCanvas = document.createElement('canvas');
+        srcCanvas.width = w;
+        srcCanvas.height = h;
+        var srcCtx = srcCanvas.getContext('2d');
+        if (!srcCtx) return null;
+        srcCtx.setTransform(m);
+        await renderOpList(srcCtx, def.src || [], plotH, rc.resources);
+        groupCtx.save();
+        groupCtx.setTransform(1, 0, 0, 1, 0, 0);
+        groupCtx.globalCompositeOperation = compositeOps[def.composite] || 'source-over';
+        groupCtx.drawImage(srcCanvas, 0, 0);
+        groupCtx.restore();
+    }
+    _resourceCache.set(def, { key: key, canvas: groupCanvas });
+    return groupCanvas;
+}
+
+function applyClip(ctx, clip) {
+    if (clip.path) {
+        ctx.clip(clip.path.path, clip.path.rule);
+    } else {
+        ctx.beginPath();
+        ctx.rect(clip.x0, clip.y0, clip.x1 - clip.x0, clip.y1 - clip.y0);
+        ctx.clip();
+    }
+}
+
+// Offscreen layer for a group or an active mask, clipped like its parent.
+function pushLayer(ctx, rc, ext, mask, plotH) {
+    var layerCanvas = document.createElement('canvas');
+    layerCanvas.width = ctx.canvas.width;
+    layerCanvas.height = ctx.canvas.height;
+    var layerCtx = layerCanvas.getContext('2d');
+    if (!layerCtx) return;
+    layerCtx.setTransform(ctx.getTransform());
+    layerCtx.save();
+    var activeClip = rc.currentClip;
+    for (var gi = rc.groupStack.length - 1; gi >= 0; gi--) {
+        if (rc.groupStack[gi].clip) { activeClip = rc.groupStack[gi].clip; break; }
+    }
+    if (activeClip) applyClip(layerCtx, activeClip);
+    rc.groupStack.push({
+        parentCtx: ctx,
+        ctx: layerCtx,
+        canvas: layerCanvas,
+        ext: ext,
+        clip: null,
+        mask: mask,
+        plotH: plotH
+    });
+}
+
+// Render a mask's ops to a canvas matching the layer it masks.  The
+// result is cached per mask definition and canvas geometry.
+async function compileMask(def, layer, rc) {
+    var w = layer.canvas.width, h = layer.canvas.height;
+    var m = layer.parentCtx.getTransform();
+    var key = [w, h, m.a, m.b, m.c, m.d, m.e, m.f].join(',');
+    var cached = _resourceCache.get(def);
+    if (cached && cached.key === key) return cached.canvas;
+    var maskCanvas = document.createElement('canvas');
+    maskCanvas.width = w;
+    maskCanvas.height = h;
+    var maskCtx = maskCanvas.getContext('2d', { willReadFrequently: def.type === 'luminance' });
+    if (!maskCtx) return null;
+    maskCtx.setTransform(m);
+    await renderOpList(maskCtx, def.ops || [], layer.plotH, rc.resources);
+    if (def.type === 'luminance') {
+        var img = maskCtx.getImageData(0, 0, w, h);
+        var d = img.data;
+        for (var i = 0; i < d.length; i += 4) {
+            var lum = (0.2126 * d[i] + 0.7152 * d[i + 1] + 0.0722 * d[i + 2]) / 255;
+            d[i + 3] = Math.round(lum * d[i + 3]);
+        }
+        maskCtx.putImageData(img, 0, 0);
+    }
+    _resourceCache.set(def, { key: key, canvas: maskCanvas });
+    return maskCanvas;
+}
+
+// Pop the active mask layer, apply the mask and composite it onto its
+// parent.  Returns the parent context.
+async function finishMask(rc) {
+    var layer = rc.groupStack.pop();
+    var maskCanvas = await compileMask(layer.mask, layer, rc);
+    layer.ctx.restore();
+    layer.ctx.save();
+    layer.ctx.setTransform(1, 0, 0, 1, 0, 0);
+    layer.ctx.globalCompositeOperation = 'destination-in';
+    if (maskCanvas) layer.ctx.drawImage(maskCanvas, 0, 0);
+    layer.ctx.restore();
+    var parentCtx = layer.parentCtx;
+    parentCtx.save();
+    parentCtx.setTransform(1, 0, 0, 1, 0, 0);
+    parentCtx.globalAlpha = 1;
+    parentCtx.globalCompositeOperation = 'source-over';
+    parentCtx.filter = 'none';
+    parentCtx.shadowColor = 'transparent';
+    parentCtx.drawImage(layer.canvas, 0, 0);
+    parentCtx.restore();
+    return parentCtx;
+}
+
+function topIsMask(rc) {
+    return rc.groupStack.length > 0 && !!rc.groupStack[rc.groupStack.length - 1].mask;
+}
+
+async function closeMaskLayers(rc) {
+    while (topIsMask(rc)) await finishMask(rc);
 }
 
 // Convert a postEffect descriptor to a CSS filter string.
@@ -618,6 +1099,87 @@ function applyPostEffects(ctx, effects) {
     }
 }
 
+// Decoded raster images keyed by their op, so replays draw the image
+// instead of decoding its data URI again.  Values are promises of an
+// image or canvas (null if it cannot be built).
+var _rasterImages = new WeakMap();
+// Composed canvases of raster patches, for SVG export.
+var _rasterComposed = new WeakMap();
+// options(jgd.raster_delta): recent images of each raster slot, keyed by
+// session and slot, then by seq.  A patch ({slot, seq, base, tiles})
+// draws its changed tiles over a copy of the base image.
+var _rasterSlots = new Map();
+var RASTER_IMAGES_PER_SLOT = 4;
+
+function decodeRasterData(data) {
+    var img = new Image();
+    img.src = data;
+    return img.decode().then(function () { return img; }, function () { return null; });
+}
+
+function rememberRasterImage(key, seq, promise) {
+    var images = _rasterSlots.get(key);
+    if (!images) {
+        images = new Map();
+        _rasterSlots.set(key, images);
+    }
+    images.delete(seq);
+    images.set(seq, promise);
+    while (images.size > RASTER_IMAGES_PER_SLOT) {
+        images.delete(images.keys().next().value);
+    }
+}
+
+async function composeRasterPatch(op, basePromise) {
+    var base = basePromise ? await basePromise : null;
+    if (!base) return null;
+    var canvas = document.createElement('canvas');
+    canvas.width = op.pw;
+    canvas.height = op.ph;
+    var ctx = canvas.getContext('2d');
+    ctx.drawImage(base, 0, 0);
+    var tiles = await Promise.all(op.tiles.map(function (t) { return decodeRasterData(t.data); }));
+    for (var i = 0; i < tiles.length; i++) {
+        if (!tiles[i]) return null;
+        // Tiles replace their block, alpha included.
+        ctx.clearRect(op.tiles[i].x, op.tiles[i].y, tiles[i].width, tiles[i].height);
+        ctx.drawImage(tiles[i], op.tiles[i].x, op.tiles[i].y);
+    }
+    _rasterComposed.set(op, canvas);
+    return canvas;
+}
+
+// Resolve the slotted rasters of a frame or stored plot.  Called in the
+// order frames arrive, which is the order patches apply in; rendering
+// (possibly much later, for history) then awaits the op's image.
+function prepareRasters(sessionId, ops) {
+    for (var i = 0; i < ops.length; i++) {
+        var op = ops[i];
+        if (!op || op.op !== 'raster' || typeof op.slot !== 'number') continue;
+        var key = sessionId + '\\u0000' + op.slot;
+        var promise;
+        if (Array.isArray(op.tiles)) {
+            var images = _rasterSlots.get(key);
+            promise = composeRasterPatch(op, images ? images.get(op.base) : null);
+        } else if (typeof op.data === 'string') {
+            promise = decodeRasterData(op.data);
+        } else {
+            continue;
+        }
+        _rasterImages.set(op, promise);
+        rememberRasterImage(key, op.seq, promise);
+    }
+}
+
+function rasterImage(op) {
+    var promise = _rasterImages.get(op);
+    if (!promise) {
+        promise = typeof op.data === 'string' ? decodeRasterData(op.data) : Promise.resolve(null);
+        _rasterImages.set(op, promise);
+    }
+    return promise;
+}
+
 // Generation counter to detect superseded renders — incremented each
 // time replay() starts.  If a newer render begins while an async op
 // (raster image decode) is pending, the older render aborts.
@@ -671,12 +1233,16 @@ async function doReplay(canvas, container, plot, gen) {
 
         var ops = plot.ops;
         var rc = makeRenderCtx();
+        // jgd(resize = "reflow"): geometry follows the scaled plot but
+        // text keeps its drawn pixel size.
+        if (plot.device.resize === 'reflow') rc.textScale = 1 / scale;
         for (var i = 0; i < ops.length; i++) {
             if (_renderGen !== gen) return;
             var currentCtx = rc.groupStack.length > 0 ? rc.groupStack[rc.groupStack.length - 1].ctx : ctx;
             await renderOp(currentCtx, ops[i], plotH, rc);
             if (_renderGen !== gen) return;
         }
+        await closeMaskLayers(rc);
 
         // Apply frame-level postEffects if present.
         if (plot._frameExt && plot._frameExt.postEffects) {
@@ -696,10 +1262,123 @@ async function doReplay(canvas, container, plot, gen) {
     }
 }
 
+// Path2D of a polyline, polygon or path op, built on its first draw and
+// kept in _resourceCache like drawPath shapes.
+function opShape(op) {
+    var shape = _resourceCache.get(op);
+    if (shape) return shape;
+    shape = new Path2D();
+    if (op.op === 'path') {
+        for (var si = 0; si < op.subpaths.length; si++) {
+            var subpath = op.subpaths[si];
+            if (subpath.length === 0) continue;
+            shape.moveTo(subpath[0][0], subpath[0][1]);
+            for (var i = 1; i < subpath.length; i++) {
+                shape.lineTo(subpath[i][0], subpath[i][1]);
+            }
+            shape.closePath();
+        }
+    } else if (op.x.length > 0) {
+        shape.moveTo(op.x[0], op.y[0]);
+        for (var j = 1; j < op.x.length; j++) {
+            shape.lineTo(op.x[j], op.y[j]);
+        }
+        if (op.op === 'polygon') shape.closePath();
+    }
+    _resourceCache.set(op, shape);
+    return shape;
+}
+
+// Rendered text labels, keyed by string, font, colour, alignment and
+// device scale, and shared by every op drawing the same label (axis
+// labels repeat across plots).  Drawing the bitmap is much cheaper than
+// fillText.  The least recently drawn labels go first.
+var _textBitmaps = new Map();
+var TEXT_BITMAP_LIMIT = 4096;
+// Labels larger than this (in device pixels) are drawn with fillText.
+var TEXT_BITMAP_MAX_PIXELS = 1 << 18;
+// Per text op: its bitmap key at the scale it was last drawn at.
+var _textKeys = new WeakMap();
+
+function textBitmapKey(op, align, scale) {
+    var k = _textKeys.get(op);
+    if (!k || k.scale !== scale) {
+        k = { scale: scale, key: JSON.stringify([scale, align, op.gc.col, gcFont(op.gc.font), op.str]) };
+        _textKeys.set(op, k);
+    }
+    return k.key;
+}
+
+function renderTextBitmap(ctx, op, align, scale) {
+    var font = gcFont(op.gc.font);
+    // A web font still loading would be cached in its fallback.
+    try {
+        if (document.fonts && !document.fonts.check(font, op.str)) return null;
+    } catch (e) {
+        return null;
+    }
+    ctx.save();
+    ctx.textAlign = align;
+    ctx.textBaseline = 'alphabetic';
+    var m = ctx.measureText(op.str);
+    ctx.restore();
+    var pad = 2;
+    var ox = Math.ceil(m.actualBoundingBoxLeft * scale) + pad;
+    var oy = Math.ceil(m.actualBoundingBoxAscent * scale) + pad;
+    var w = ox + Math.ceil(m.actualBoundingBoxRight * scale) + pad;
+    var h = oy + Math.ceil(m.actualBoundingBoxDescent * scale) + pad;
+    if (!(w > 0 && h > 0) || w * h > TEXT_BITMAP_MAX_PIXELS) return null;
+    var canvas = document.createElement('canvas');
+    canvas.width = w;
+    canvas.height = h;
+    var bctx = canvas.getContext('2d');
+    bctx.setTransform(scale, 0, 0, scale, ox, oy);
+    bctx.font = font;
+    bctx.textAlign = align;
+    bctx.textBaseline = 'alphabetic';
+    bctx.fillStyle = op.gc.col;
+    bctx.fillText(op.str, 0, 0);
+    return { canvas: canvas, ox: ox, oy: oy };
+}
+
+// Draw a text op from its cached bitmap.  Only plain labels at a quarter
+// turn under an unrotated, uniformly scaled transform qualify, so the
+// bitmap lands 1:1 on device pixels; returns false for the rest, which
+// fillText draws.
+function drawCachedText(ctx, op, align, rc) {
+    var rot = op.rot || 0;
+    if (op.gc.ext || !op.gc.font || !op.str || rot % 90 !== 0) return false;
+    var m = ctx.getTransform();
+    if (m.b !== 0 || m.c !== 0 || m.a !== m.d || !(m.a > 0)) return false;
+    var scale = m.a * (rc.textScale || 1);
+    var key = textBitmapKey(op, align, scale);
+    var bmp = _textBitmaps.get(key);
+    if (bmp) {
+        _textBitmaps.delete(key);
+    } else {
+        bmp = renderTextBitmap(ctx, op, align, scale);
+        if (!bmp) return false;
+    }
+    _textBitmaps.set(key, bmp);
+    while (_textBitmaps.size > TEXT_BITMAP_LIMIT) {
+        _textBitmaps.delete(_textBitmaps.keys().next().value);
+    }
+    // Snap the anchor to a device pixel; text moves by under half a pixel.
+    var p = m.transformPoint(new DOMPoint(op.x, op.y));
+    var quarter = ((Math.round(-rot / 90) % 4) + 4) % 4;
+    var cos = [1, 0, -1, 0][quarter];
+    var sin = [0, 1, 0, -1][quarter];
+    ctx.save();
+    ctx.setTransform(cos, sin, -sin, cos, Math.round(p.x), Math.round(p.y));
+    ctx.drawImage(bmp.canvas, -bmp.ox, -bmp.oy);
+    ctx.restore();
+    return true;
+}
+
 async function renderOp(ctx, op, plotH, rc) {
     switch (op.op) {
         case 'line': {
-            applyGc(ctx, op.gc);
+            applyGc(ctx, op.gc, rc);
             if (op.gc && op.gc.col != null) {
                 ctx.beginPath();
                 ctx.moveTo(op.x1, op.y1);
@@ -709,36 +1388,26 @@ async function renderOp(ctx, op, plotH, rc) {
             break;
         }
         case 'polyline': {
-            applyGc(ctx, op.gc);
+            applyGc(ctx, op.gc, rc);
             if (op.x.length < 2) break;
-            ctx.beginPath();
-            ctx.moveTo(op.x[0], op.y[0]);
-            for (var i = 1; i < op.x.length; i++) {
-                ctx.lineTo(op.x[i], op.y[i]);
-            }
-            if (op.gc && op.gc.col != null) ctx.stroke();
+            if (op.gc && op.gc.col != null) ctx.stroke(opShape(op));
             break;
         }
         case 'polygon': {
-            applyGc(ctx, op.gc);
-            ctx.beginPath();
-            ctx.moveTo(op.x[0], op.y[0]);
-            for (var i = 1; i < op.x.length; i++) {
-                ctx.lineTo(op.x[i], op.y[i]);
-            }
-            ctx.closePath();
-            if (op.gc && op.gc.fill != null) ctx.fill();
-            if (op.gc && op.gc.col != null) ctx.stroke();
+            applyGc(ctx, op.gc, rc);
+            var polygon = opShape(op);
+            if (hasFill(op.gc)) ctx.fill(polygon);
+            if (op.gc && op.gc.col != null) ctx.stroke(polygon);
             break;
         }
         case 'rect': {
-            applyGc(ctx, op.gc);
+            applyGc(ctx, op.gc, rc);
             var rx = Math.min(op.x0, op.x1);
             var ry = Math.min(op.y0, op.y1);
             var rw = Math.abs(op.x1 - op.x0);
             var rh = Math.abs(op.y1 - op.y0);
-            if (op.gc && op.gc.fill != null) {
-                ctx.fillStyle = op.gc.fill;
+            if (hasFill(op.gc)) {
+                ctx.fillStyle = gcFill(op.gc, rc);
                 ctx.fillRect(rx, ry, rw, rh);
             }
             if (op.gc && op.gc.col != null) {
@@ -748,27 +1417,28 @@ async function renderOp(ctx, op, plotH, rc) {
             break;
         }
         case 'circle': {
-            applyGc(ctx, op.gc);
+            applyGc(ctx, op.gc, rc);
             ctx.beginPath();
             ctx.arc(op.x, op.y, op.r, 0, 2 * Math.PI);
-            if (op.gc && op.gc.fill != null) ctx.fill();
+            if (hasFill(op.gc)) ctx.fill();
             if (op.gc && op.gc.col != null) ctx.stroke();
             break;
         }
         case 'text': {
-            applyGc(ctx, op.gc);
+            applyGc(ctx, op.gc, rc);
+            if (!op.gc || op.gc.col == null) break;
+            var align = 'left';
+            if (op.hadj === 0.5) align = 'center';
+            else if (op.hadj === 1) align = 'right';
+            if (drawCachedText(ctx, op, align, rc)) break;
             ctx.save();
             ctx.translate(op.x, op.y);
             if (op.rot) ctx.rotate(-op.rot * Math.PI / 180);
+            if (rc.textScale) ctx.scale(rc.textScale, rc.textScale);
             ctx.textBaseline = 'alphabetic';
-            var align = 'left';
-            if (op.hadj === 0.5) align = 'center';
-            else if (op.hadj === 1) align = 'right';
             ctx.textAlign = align;
-            if (op.gc && op.gc.col != null) {
-                ctx.fillStyle = op.gc.col;
-                ctx.fillText(op.str, 0, 0);
-            }
+            ctx.fillStyle = op.gc.col;
+            ctx.fillText(op.str, 0, 0);
             ctx.restore();
             break;
         }
@@ -781,40 +1451,98 @@ async function renderOp(ctx, op, plotH, rc) {
             }
             ctx.restore();
             ctx.save();
-            ctx.beginPath();
-            ctx.rect(op.x0, op.y0, op.x1 - op.x0, op.y1 - op.y0);
-            ctx.clip();
+            applyClip(ctx, clipRect);
+            break;
+        }
+        case 'defPattern': {
+            var pat = await compilePattern(ctx, op, plotH, rc);
+            if (pat) rc.resources.pattern[op.id] = pat;
             break;
         }
-        case 'beginGroup': {
-            var groupCanvas = document.createElement('canvas');
-            groupCanvas.width = ctx.canvas.width;
-            groupCanvas.height = ctx.canvas.height;
-            var groupCtx = groupCanvas.getContext('2d');
-            if (!groupCtx) break;
-            groupCtx.setTransform(ctx.getTransform());
-            groupCtx.save();
-            var activeClip = rc.currentClip;
-            for (var gi = rc.groupStack.length - 1; gi >= 0; gi--) {
-                if (rc.groupStack[gi].clip) { activeClip = rc.groupStack[gi].clip; break; }
+        case 'defClipPath':
+            rc.resources.clipPath[op.id] = op;
+            break;
+        case 'clipPath': {
+            var clipDef = rc.resources.clipPath[op.id];
+            if (!clipDef) break;
+            var pathClip = { path: compileClipPath(clipDef) };
+            if (rc.groupStack.length > 0) {
+                rc.groupStack[rc.groupStack.length - 1].clip = pathClip;
+            } else {
+                rc.currentClip = pathClip;
             }
-            if (activeClip) {
-                groupCtx.beginPath();
-                groupCtx.rect(activeClip.x0, activeClip.y0,
-                              activeClip.x1 - activeClip.x0,
-                              activeClip.y1 - activeClip.y0);
-                groupCtx.clip();
+            ctx.restore();
+            ctx.save();
+            applyClip(ctx, pathClip);
+            break;
+        }
+        case 'defMask':
+            rc.resources.mask[op.id] = op;
+            break;
+        case 'mask': {
+            // Drawing under a mask goes to a layer that is masked and
+            // composited when the mask is cleared or replaced.
+            var maskParent = ctx;
+            if (topIsMask(rc)) maskParent = await finishMask(rc);
+            var maskDef = op.id != null ? rc.resources.mask[op.id] : null;
+            if (maskDef) pushLayer(maskParent, rc, null, maskDef, plotH);
+            break;
+        }
+        case 'release':
+            if (rc.resources[op.kind]) delete rc.resources[op.kind][op.id];
+            break;
+        case 'defGroup':
+            rc.resources.group[op.id] = op;
+            break;
+        case 'defFont':
+            rc.resources.font[op.id] = op;
+            break;
+        case 'glyphs': {
+            var fontDef = rc.resources.font[op.font];
+            if (!fontDef || op.col == null) break;
+            var glyphFont = await loadGlyphFont(fontDef);
+            applyGc(ctx, null, rc);
+            ctx.fillStyle = op.col;
+            drawGlyphRun(ctx, op, fontDef, glyphFont);
+            break;
+        }
+        case 'useGroup': {
+            var groupDef = rc.resources.group[op.id];
+            if (!groupDef) break;
+            var groupImage = await compileGroup(ctx, groupDef, plotH, rc);
+            if (!groupImage) break;
+            // The group was rasterized in device space; apply its
+            // transform in device space too: T * M * T^-1.
+            var base = ctx.getTransform();
+            var t = op.transform;
+            var dev = t ? base.multiply(new DOMMatrix([t[0], t[1], t[2], t[3], t[4], t[5]])).multiply(base.inverse()) : new DOMMatrix();
+            ctx.save();
+            ctx.setTransform(dev);
+            ctx.globalAlpha = 1;
+            ctx.globalCompositeOperation = 'source-over';
+            ctx.filter = 'none';
+            ctx.shadowColor = 'transparent';
+            ctx.drawImage(groupImage, 0, 0);
+            ctx.restore();
+            break;
+        }
+        case 'drawPath': {
+            var shape = _resourceCache.get(op);
+            if (!shape) {
+                shape = opsToPath2D(op.ops || [], op.mode !== 'fill');
+                _resourceCache.set(op, shape);
             }
-            rc.groupStack.push({
-                parentCtx: ctx,
-                ctx: groupCtx,
-                canvas: groupCanvas,
-                ext: op.ext || null,
-                clip: null
-            });
+            applyGc(ctx, op.gc, rc);
+            var pathRule = op.rule === 'evenodd' ? 'evenodd' : 'nonzero';
+            if (op.mode !== 'stroke' && hasFill(op.gc)) ctx.fill(shape, pathRule);
+            if (op.mode !== 'fill' && op.gc && op.gc.col != null) ctx.stroke(shape);
             break;
         }
+        case 'beginGroup':
+            pushLayer(ctx, rc, op.ext || null, null, plotH);
+            break;
         case 'endGroup': {
+            await closeMaskLayers(rc);
             if (rc.groupStack.length === 0) break;
             var group = rc.groupStack.pop();
             var parentCtx = group.parentCtx;
@@ -836,27 +1564,17 @@ async function renderOp(ctx, op, plotH, rc) {
             break;
         }
         case 'path': {
-            applyGc(ctx, op.gc);
-            ctx.beginPath();
-            for (var si = 0; si < op.subpaths.length; si++) {
-                var subpath = op.subpaths[si];
-                if (subpath.length === 0) continue;
-                ctx.moveTo(subpath[0][0], subpath[0][1]);
-                for (var i = 1; i < subpath.length; i++) {
-                    ctx.lineTo(subpath[i][0], subpath[i][1]);
-                }
-                ctx.closePath();
-            }
+            applyGc(ctx, op.gc, rc);
+            var pathShape = opShape(op);
             var rule = op.winding === 'evenodd' ? 'evenodd' : 'nonzero';
-            if (op.gc && op.gc.fill != null) ctx.fill(rule);
-            if (op.gc && op.gc.col != null) ctx.stroke();
+            if (hasFill(op.gc)) ctx.fill(pathShape, rule);
+            if (op.gc && op.gc.col != null) ctx.stroke(pathShape);
             break;
         }
         case 'raster': {
-            applyGc(ctx, op.gc);
-            var img = new Image();
-            img.src = op.data;
-            await img.decode();
+            applyGc(ctx, op.gc, rc);
+            var img = await rasterImage(op);
+            if (!img) break;
             ctx.save();
             var dw = op.w;
             var dh = op.h;
@@ -879,6 +1597,257 @@ async function renderOp(ctx, op, plotH, rc) {
     }
 }
 
+// Glyph-run fonts, keyed by "fontId#index".  Each entry is a promise of a
+// parsed sfnt font (see parseSfnt) or null when the file cannot be
+// fetched from the server's /font endpoint.  The server tags defFont ops
+// with the fontId it serves the file under.
+var _glyphFonts = {};
+
+function loadGlyphFont(fontDef) {
+    if (typeof fontDef.fontId !== 'string') return Promise.resolve(null);
+    var index = fontDef.index;
+    var key = fontDef.fontId + '#' + index;
+    if (!_glyphFonts[key]) {
+        _glyphFonts[key] = fetch('/font?id=' + encodeURIComponent(fontDef.fontId))
+            .then(function(res) { return res.ok ? res.arrayBuffer() : null; })
+            .then(function(buf) { return buf ? parseSfnt(buf, index) : null; })
+            .catch(function() { return null; });
+    }
+    return _glyphFonts[key];
+}
+
+// Minimal sfnt reader: TrueType outlines from glyf/loca, plus a reverse
+// cmap so fonts without glyf (CFF) can fall back to canvas text.
+function parseSfnt(buf, index) {
+    var dv = new DataView(buf);
+    var base = 0;
+    if (dv.getUint32(0) === 0x74746366) { // 'ttcf'
+        var numFonts = dv.getUint32(8);
+        base = dv.getUint32(12 + 4 * Math.min(index || 0, numFonts - 1));
+    }
+    var tables = {};
+    var numTables = dv.getUint16(base + 4);
+    for (var i = 0; i < numTables; i++) {
+        var rec = base + 12 + 16 * i;
+        var tag = String.fromCharCode(dv.getUint8(rec), dv.getUint8(rec + 1), dv.getUint8(rec + 2), dv.getUint8(rec + 3));
+        tables[tag] = dv.getUint32(rec + 8);
+    }
+    if (tables.head == null) return null;
+    var font = {
+        dv: dv,
+        unitsPerEm: dv.getUint16(tables.head + 18) || 1000,
+        longLoca: dv.getInt16(tables.head + 50) === 1,
+        numGlyphs: tables.maxp != null ? dv.getUint16(tables.maxp + 4) : 0,
+        glyf: tables.glyf,
+        loca: tables.loca,
+        cmap: tables.cmap,
+        paths: {},
+        chars: null
+    };
+    if (font.glyf == null || font.loca == null) font.glyf = null;
+    return font;
+}
+
+function glyphRange(font, gid) {
+    var dv = font.dv;
+    if (font.longLoca) return [dv.getUint32(font.loca + 4 * gid), dv.getUint32(font.loca + 4 * gid + 4)];
+    return [dv.getUint16(font.loca + 2 * gid) * 2, dv.getUint16(font.loca + 2 * gid + 2) * 2];
+}
+
+// Append glyph gid's outline to path, transformed by m = [a, b, c, d, e, f]
+// (font units in, font units out).
+function appendGlyph(font, gid, path, m, depth) {
+    if (gid < 0 || gid >= font.numGlyphs || depth > 8) return;
+    var dv = font.dv;
+    var range = glyphRange(font, gid);
+    if (range[1] <= range[0]) return;
+    var p = font.glyf + range[0];
+    var nContours = dv.getInt16(p);
+    p += 10;
+    var tx = function(x, y) { return m[0] * x + m[2] * y + m[4]; };
+    var ty = function(x, y) { return m[1] * x + m[3] * y + m[5]; };
+    if (nContours < 0) {
+        // Composite glyph: components with offsets and optional scale.
+        var flags;
+        do {
+            flags = dv.getUint16(p);
+            var comp = dv.getUint16(p + 2);
+            p += 4;
+            var dx = 0, dy = 0;
+            if (flags & 1) {
+                if (flags & 2) { dx = dv.getInt16(p); dy = dv.getInt16(p + 2); }
+                p += 4;
+            } else {
+                if (flags & 2) { dx = dv.getInt8(p); dy = dv.getInt8(p + 1); }
+                p += 2;
+            }
+            var a = 1, b = 0, c = 0, d = 1;
+            if (flags & 8) {
+                a = d = dv.getInt16(p) / 16384; p += 2;
+            } else if (flags & 0x40) {
+                a = dv.getInt16(p) / 16384; d = dv.getInt16(p + 2) / 16384; p += 4;
+            } else if (flags & 0x80) {
+                a = dv.getInt16(p) / 16384; b = dv.getInt16(p + 2) / 16384;
+                c = dv.getInt16(p + 4) / 16384; d = dv.getInt16(p + 6) / 16384; p += 8;
+            }
+            var cm = [
+                m[0] * a + m[2] * b, m[1] * a + m[3] * b,
+                m[0] * c + m[2] * d, m[1] * c + m[3] * d,
+                tx(dx, dy), ty(dx, dy)
+            ];
+            appendGlyph(font, comp, path, cm, depth + 1);
+        } while (flags & 0x20);
+        return;
+    }
+    var endPts = [];
+    for (var i = 0; i < nContours; i++) { endPts.push(dv.getUint16(p)); p += 2; }
+    var nPoints = nContours > 0 ? endPts[nContours - 1] + 1 : 0;
+    p += 2 + dv.getUint16(p); // skip instructions
+    var fl = new Uint8Array(nPoints);
+    for (var i = 0; i < nPoints;) {
+        var f = dv.getUint8(p++);
+        fl[i++] = f;
+        if (f & 8) {
+            var rep = dv.getUint8(p++);
+            while (rep-- > 0 && i < nPoints) fl[i++] = f;
+        }
+    }
+    var xs = new Float64Array(nPoints), ys = new Float64Array(nPoints);
+    var v = 0;
+    for (var i = 0; i < nPoints; i++) {
+        if (fl[i] & 2) { var dxs = dv.getUint8(p++); v += (fl[i] & 16) ? dxs : -dxs; }
+        else if (!(fl[i] & 16)) { v += dv.getInt16(p); p += 2; }
+        xs[i] = v;
+    }
+    v = 0;
+    for (var i = 0; i < nPoints; i++) {
+        if (fl[i] & 4) { var dys = dv.getUint8(p++); v += (fl[i] & 32) ? dys : -dys; }
+        else if (!(fl[i] & 32)) { v += dv.getInt16(p); p += 2; }
+        ys[i] = v;
+    }
+    // Quadratic contours; consecutive off-curve points imply an
+    // on-curve midpoint between them.
+    var start = 0;
+    for (var ci = 0; ci < nContours; ci++) {
+        var end = endPts[ci], n = end - start + 1;
+        if (n > 1) {
+            var first = start;
+            while (first <= end && !(fl[first] & 1)) first++;
+            var sx, sy;
+            if (first > end) {
+                sx = (xs[start] + xs[end]) / 2; sy = (ys[start] + ys[end]) / 2; first = start - 1;
+            } else {
+                sx = xs[first]; sy = ys[first];
+            }
+            path.moveTo(tx(sx, sy), ty(sx, sy));
+            var cx = null, cy = null;
+            for (var k = 1; k <= n; k++) {
+                var idx = start + ((first - start + k) % n + n) % n;
+                var px = xs[idx], py = ys[idx];
+                if (fl[idx] & 1) {
+                    if (cx === null) path.lineTo(tx(px, py), ty(px, py));
+                    else path.quadraticCurveTo(tx(cx, cy), ty(cx, cy), tx(px, py), ty(px, py));
+                    cx = null;
+                } else {
+                    if (cx !== null) {
+                        var mx = (cx + px) / 2, my = (cy + py) / 2;
+                        path.quadraticCurveTo(tx(cx, cy), ty(cx, cy), tx(mx, my), ty(mx, my));
+                    }
+                    cx = px; cy = py;
+                }
+            }
+            if (cx !== null) path.quadraticCurveTo(tx(cx, cy), ty(cx, cy), tx(sx, sy), ty(sx, sy));
+            path.closePath();
+        }
+        start = end + 1;
+    }
+}
+
+// Path2D for a glyph in font units (y up), cached per font.
+function glyphPath(font, gid) {
+    var path = font.paths[gid];
+    if (path === undefined) {
+        path = new Path2D();
+        try {
+            appendGlyph(font, gid, path, [1, 0, 0, 1, 0, 0], 0);
+        } catch (e) {
+            path = null;
+        }
+        font.paths[gid] = path;
+    }
+    return path;
+}
+
+// Reverse cmap (glyph id -> code point) from format 4 and 12 subtables.
+function glyphChars(font) {
+    if (font.chars) return font.chars;
+    var chars = {};
+    font.chars = chars;
+    if (font.cmap == null) return chars;
+    var dv = font.dv, base = font.cmap;
+    var n = dv.getUint16(base + 2);
+    for (var i = 0; i < n; i++) {
+        var sub = base + dv.getUint32(base + 4 + 8 * i + 4);
+        var format = dv.getUint16(sub);
+        if (format === 4) {
+            var segX2 = dv.getUint16(sub + 6);
+            var ends = sub + 14, starts = ends + segX2 + 2;
+            var deltas = starts + segX2, ranges = deltas + segX2;
+            for (var s = 0; s < segX2; s += 2) {
+                var startCode = dv.getUint16(starts + s), endCode = dv.getUint16(ends + s);
+                var delta = dv.getInt16(deltas + s), ro = dv.getUint16(ranges + s);
+                for (var cp = startCode; cp <= endCode && cp !== 0xFFFF; cp++) {
+                    var g = ro === 0 ? (cp + delta) & 0xFFFF
+                        : dv.getUint16(ranges + s + ro + 2 * (cp - startCode));
+                    if (ro !== 0 && g !== 0) g = (g + delta) & 0xFFFF;
+                    if (g && chars[g] === undefined) chars[g] = cp;
+                }
+            }
+        } else if (format === 12) {
+            var groups = dv.getUint32(sub + 12);
+            for (var gi = 0; gi < groups; gi++) {
+                var grp = sub + 16 + 12 * gi;
+                var sc = dv.getUint32(grp), ec = dv.getUint32(grp + 4), sg = dv.getUint32(grp + 8);
+                for (var cp = sc; cp <= ec && cp - sc < 0x10000; cp++) {
+                    if (chars[sg + cp - sc] === undefined) chars[sg + cp - sc] = cp;
+                }
+            }
+        }
+    }
+    return chars;
+}
+
+// Draw a glyph run: outlines from the font file when it has TrueType
+// outlines, otherwise canvas text for glyphs the cmap maps back to a
+// character.
+function drawGlyphRun(ctx, op, fontDef, font) {
+    var base = ctx.getTransform();
+    var rot = op.rot ? -op.rot * Math.PI / 180 : 0;
+    var k = font ? fontDef.size / font.unitsPerEm : 1;
+    var chars = font && !font.glyf ? glyphChars(font) : null;
+    if (!font || chars) {
+        var weight = fontDef.weight >= 600 ? 'bold ' : '';
+        var style = fontDef.style !== 'normal' ? 'italic ' : '';
+        ctx.font = style + weight + fontDef.size + 'px ' + mapFontFamily(fontDef.family);
+        ctx.textAlign = 'left';
+        ctx.textBaseline = 'alphabetic';
+    }
+    for (var i = 0; i < op.glyphs.length; i++) {
+        ctx.setTransform(base);
+        ctx.translate(op.x[i], op.y[i]);
+        if (rot) ctx.rotate(rot);
+        if (font && font.glyf) {
+            var path = glyphPath(font, op.glyphs[i]);
+            if (!path) continue;
+            ctx.scale(k, -k);
+            ctx.fill(path);
+        } else if (chars && chars[op.glyphs[i]] !== undefined) {
+            ctx.fillText(String.fromCodePoint(chars[op.glyphs[i]]), 0, 0);
+        }
+    }
+    ctx.setTransform(base);
+}
+
 // Render a plot to an offscreen canvas and return a PNG Blob.
 function renderToOffscreen(plot, width, height) {
     var offscreen = document.createElement('canvas');
@@ -895,10 +1864,14 @@ function renderToOffscreen(plot, width, height) {
     }
     return (async function() {
         var rc = makeRenderCtx();
+        // Match the on-screen reflow: export sizes include the device
+        // pixel ratio, which text should keep.
+        if (plot.device.resize === 'reflow') rc.textScale = (window.devicePixelRatio || 1) / scale;
         for (var i = 0; i < plot.ops.length; i++) {
             var currentCtx = rc.groupStack.length > 0 ? rc.groupStack[rc.groupStack.length - 1].ctx : offCtx;
             await renderOp(currentCtx, plot.ops[i], plotH, rc);
         }
+        await closeMaskLayers(rc);
         // Apply frame-level post-effects on a fresh, unclipped canvas
         // to avoid any residual clipping region from the ops replay.
         var exportCanvas = offscreen;
@@ -953,7 +1926,10 @@ function svgGcStroke(gc) {
     return s;
 }
 
-function svgGcFill(gc) {
+function svgGcFill(gc, patterns) {
+    if (gc && gc.pattern != null && patterns && patterns[gc.pattern]) {
+        return ' fill="url(#' + patterns[gc.pattern] + ')"';
+    }
     if (!gc || gc.fill == null) return ' fill="none"';
     return ' fill="' + svgEsc(gc.fill) + '"';
 }
@@ -971,6 +1947,28 @@ function svgFont(gc) {
     };
 }
 
+// Gradient definition for a defPattern op, or '' for tiling patterns,
+// which SVG export does not support.
+function svgGradient(op, id) {
+    var spread = op.extend === 'repeat' ? 'repeat' : op.extend === 'reflect' ? 'reflect' : 'pad';
+    var attrs = ' id="' + id + '" gradientUnits="userSpaceOnUse" spreadMethod="' + spread + '"';
+    var name;
+    if (op.type === 'linear') {
+        name = 'linearGradient';
+        attrs += ' x1="' + op.x1 + '" y1="' + op.y1 + '" x2="' + op.x2 + '" y2="' + op.y2 + '"';
+    } else if (op.type === 'radial') {
+        name = 'radialGradient';
+        attrs += ' fx="' + op.cx1 + '" fy="' + op.cy1 + '" fr="' + op.r1 + '" cx="' + op.cx2 + '" cy="' + op.cy2 + '" r="' + op.r2 + '"';
+    } else {
+        return '';
+    }
+    var stops = '';
+    for (var i = 0; i < op.stops.length; i++) {
+        stops += svgTag('stop', ' offset="' + (+op.stops[i][0] || 0) + '" stop-color="' + svgEsc(String(op.stops[i][1])) + '"', true);
+    }
+    return svgTag('defs') + svgTag(name, attrs) + stops + svgClose(name) + svgClose('defs') + '\\n';
+}
+
 function plotToSvg(plot, exportW, exportH) {
     var w = plot.device.width;
     var h = plot.device.height;
@@ -984,6 +1982,7 @@ function plotToSvg(plot, exportW, exportH) {
 
     var clipId = 0;
     var elementStack = []; /* {kind:'clip'|'group', attrs:string} */
+    var patterns = {};     /* defPattern id -> SVG gradient id */
 
     for (var oi = 0; oi < plot.ops.length; oi++) {
         var op = plot.ops[oi];
@@ -1007,17 +2006,25 @@ function plotToSvg(plot, exportW, exportH) {
                 elementStack.push({kind: 'clip', attrs: ''});
                 break;
             }
+            case 'defPattern': {
+                var grad = svgGradient(op, 'g' + op.id);
+                if (grad) {
+                    s += grad;
+                    patterns[op.id] = 'g' + op.id;
+                }
+                break;
+            }
             case 'line':
                 s += svgTag('line', ' x1="' + op.x1 + '" y1="' + op.y1 + '" x2="' + op.x2 + '" y2="' + op.y2 + '"' + svgGcStroke(op.gc) + ' fill="none"', true) + '\\n';
                 break;
             case 'rect': {
                 var rx = Math.min(op.x0, op.x1), ry = Math.min(op.y0, op.y1);
                 var rw = Math.abs(op.x1 - op.x0), rh = Math.abs(op.y1 - op.y0);
-                s += svgTag('rect', ' x="' + rx + '" y="' + ry + '" width="' + rw + '" height="' + rh + '"' + svgGcFill(op.gc) + svgGcStroke(op.gc), true) + '\\n';
+                s += svgTag('rect', ' x="' + rx + '" y="' + ry + '" width="' + rw + '" height="' + rh + '"' + svgGcFill(op.gc, patterns) + svgGcStroke(op.gc), true) + '\\n';
                 break;
             }
             case 'circle':
-                s += svgTag('circle', ' cx="' + op.x + '" cy="' + op.y + '" r="' + op.r + '"' + svgGcFill(op.gc) + svgGcStroke(op.gc), true) + '\\n';
+                s += svgTag('circle', ' cx="' + op.x + '" cy="' + op.y + '" r="' + op.r + '"' + svgGcFill(op.gc, patterns) + svgGcStroke(op.gc), true) + '\\n';
                 break;
             case 'polyline': {
                 if (op.x.length < 2) break;
@@ -1029,7 +2036,7 @@ function plotToSvg(plot, exportW, exportH) {
             case 'polygon': {
                 var pts = '';
                 for (var i = 0; i < op.x.length; i++) pts += op.x[i] + ',' + op.y[i] + ' ';
-                s += svgTag('polygon', ' points="' + pts.trim() + '"' + svgGcFill(op.gc) + svgGcStroke(op.gc), true) + '\\n';
+                s += svgTag('polygon', ' points="' + pts.trim() + '"' + svgGcFill(op.gc, patterns) + svgGcStroke(op.gc), true) + '\\n';
                 break;
             }
             case 'path': {
@@ -1042,7 +2049,7 @@ function plotToSvg(plot, exportW, exportH) {
                     d += 'Z';
                 }
                 var rule = op.winding === 'evenodd' ? 'evenodd' : 'nonzero';
-                s += svgTag('path', ' d="' + d + '" fill-rule="' + rule + '"' + svgGcFill(op.gc) + svgGcStroke(op.gc), true) + '\\n';
+                s += svgTag('path', ' d="' + d + '" fill-rule="' + rule + '"' + svgGcFill(op.gc, patterns) + svgGcStroke(op.gc), true) + '\\n';
                 break;
             }
             case 'text': {
@@ -1065,7 +2072,11 @@ function plotToSvg(plot, exportW, exportH) {
                     var cx = dx + aw / 2, cy = dy + ah / 2;
                     transform = ' transform="rotate(' + (-op.rot) + ',' + cx + ',' + cy + ')"';
                 }
-                var safeHref = /^data:image\\/png[;,]/.test(op.data) ? svgEsc(op.data) : '';
+                var href = op.data;
+                if (typeof href !== 'string' && _rasterComposed.has(op)) {
+                    href = _rasterComposed.get(op).toDataURL('image/png');
+                }
+                var safeHref = /^data:image\\/png[;,]/.test(href) ? svgEsc(href) : '';
                 s += svgTag('image', ' x="' + dx + '" y="' + dy + '" width="' + aw + '" height="' + ah + '" href="' + safeHref + '"' + transform, true) + '\\n';
                 break;
             }
@@ -1,30 +1,82 @@
 import type { Hub, BrowserClient } from "./hub.ts";
 import { extractType } from "./types.ts";
 
+/**
+ * Browser connections by the control-lane token each was sent when it
+ * connected, so a second socket (`?lane=control&token=<token>`) can join
+ * it.  Tokens are random and issued here, so one browser cannot take
+ * over another's lane.
+ */
+const laneTokens = new Map<string, WebSocketClient>();
+
 /**
  * Upgrade an HTTP request to a WebSocket connection and register
  * the resulting client with the hub.
+ *
+ * Each browser is sent a `control_lane` message with a token on connect,
+ * and may open a second socket to the same endpoint with
+ * `lane=control&token=<token>`.  Metrics requests and `close` notices
+ * are sent to it instead of the main socket, so they never wait behind a
+ * large frame being written to the main socket; the browser sends
+ * resizes and metrics responses on it for the same reason.  Browsers
+ * that never open one get everything on the main socket.
+ *
+ * A relay server connects with `relay=1` and is sent the stored state of
+ * every session when it connects.
  */
 export function handleWebSocket(req: Request, hub: Hub): Response {
+  const url = new URL(req.url);
+  // A relay server mirroring this one (see relay.ts).
+  const isRelay = url.searchParams.get("relay") === "1";
+
+  if (url.searchParams.get("lane") === "control") {
+    const token = url.searchParams.get("token");
+    const owner = token ? laneTokens.get(token) : undefined;
+    if (!owner) return new Response("no such client", { status: 404 });
+    if (owner.hasControl()) return new Response("control lane already open", { status: 409 });
+    const { socket, response } = Deno.upgradeWebSocket(req, {
+      idleTimeout: 60,
+    });
+    owner.attachControl(socket);
+    return response;
+  }
+
   const { socket, response } = Deno.upgradeWebSocket(req, {
     idleTimeout: 60,
   });
 
-  const client = new WebSocketClient(socket, hub);
+  const client = new WebSocketClient(socket, hub, isRelay);
   hub.registerClient(client);
+  const token = isRelay ? null : crypto.randomUUID();
+  if (token) laneTokens.set(token, client);
+  const forget = () => {
+    if (token) laneTokens.delete(token);
+  };
+  // The socket is not open yet; record the connection on open so the
+  // replayer sees it before any messages in either direction.
+  socket.onopen = () => {
+    hub.capture?.record("b_open", hub.capture.browserConn(client));
+    if (isRelay) hub.sendStoredState(client);
+    if (token) client.send(JSON.stringify({ type: "control_lane", token }));
+  };
 
   socket.onmessage = (event: MessageEvent) => {
     if (typeof event.data !== "string") return;
+    hub.capture?.record("b2s", hub.capture.browserConn(client), event.data);
     client.handleMessage(event.data);
   };
 
   socket.onclose = () => {
+    hub.capture?.record("b_close", hub.capture.browserConn(client));
     hub.unregisterClient(client);
+    forget();
+    client.close();
   };
 
   socket.onerror = (e) => {
     console.error(`WebSocket error: ${e}`);
     hub.unregisterClient(client);
+    forget();
   };
 
   return response;
@@ -37,26 +89,74 @@ export function handleWebSocket(req: Request, hub: Hub): Response {
 class WebSocketClient implements BrowserClient {
   private socket: WebSocket;
   private hub: Hub;
+  /** The client's control-lane socket, if it opened one. */
+  private control: WebSocket | null = null;
+  readonly relay: boolean;
 
-  constructor(socket: WebSocket, hub: Hub) {
+  constructor(socket: WebSocket, hub: Hub, relay = false) {
     this.socket = socket;
     this.hub = hub;
+    this.relay = relay;
   }
 
   send(data: string): void {
-    if (this.socket.readyState === WebSocket.OPEN) {
-      this.socket.send(data);
+    this.sendOn(this.socket, data);
+  }
+
+  sendControl(data: string): void {
+    this.sendOn(this.control?.readyState === WebSocket.OPEN ? this.control : this.socket, data);
+  }
+
+  private sendOn(socket: WebSocket, data: string): void {
+    if (socket.readyState === WebSocket.OPEN) {
+      this.hub.capture?.record("s2b", this.hub.capture.browserConn(this), data);
+      socket.send(data);
     }
   }
 
+  /** True while a control-lane socket is attached and not closed. */
+  hasControl(): boolean {
+    return this.control !== null && this.control.readyState !== WebSocket.CLOSED &&
+      this.control.readyState !== WebSocket.CLOSING;
+  }
+
+  /** Adopt a control-lane socket (see hasControl). */
+  attachControl(socket: WebSocket): void {
+    this.closeControl();
+    this.control = socket;
+    socket.onmessage = (event: MessageEvent) => {
+      if (typeof event.data !== "string") return;
+      this.hub.capture?.record("b2s", this.hub.capture.browserConn(this), event.data);
+      this.handleMessage(event.data, socket);
+    };
+    socket.onclose = () => {
+      if (this.control === socket) this.control = null;
+    };
+    socket.onerror = () => {
+      if (this.control === socket) this.control = null;
+    };
+  }
+
+  private closeControl(): void {
+    const control = this.control;
+    this.control = null;
+    try {
+      control?.close();
+    } catch { /* ignore if already closed */ }
+  }
+
   close(): void {
+    this.closeControl();
     try {
       this.socket.close();
     } catch { /* ignore if already closed */ }
   }
 
-  /** Route an incoming message from the browser by type. */
-  handleMessage(data: string): void {
+  /**
+   * Route an incoming message from the browser by type.  `from` is the
+   * socket it arrived on, for replies (defaults to the main socket).
+   */
+  handleMessage(data: string, from: WebSocket = this.socket): void {
     const type = extractType(data);
 
     switch (type) {
@@ -68,11 +168,19 @@ class WebSocketClient implements BrowserClient {
         this.hub.handleMetricsResponse(data);
         break;
 
+      case "frame_timing":
+        this.hub.recordFrameTiming(data);
+        break;
+
+      case "subscribe":
+        this.hub.subscribe(this, data);
+        break;
+
       case "ping":
         // Echo back as pong.  Used for client-side ordering probes (tests
         // verify non-delivery by racing a frame waiter against the pong)
         // and as a lightweight health-check for monitoring.
-        this.send(JSON.stringify({ type: "pong" }));
+        this.sendOn(from, JSON.stringify({ type: "pong" }));
         break;
 
       default:
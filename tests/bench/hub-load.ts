@@ -0,0 +1,481 @@
+#!/usr/bin/env -S deno run --allow-all
+/**
+ * Load generator for the jgd hub.
+ *
+ * Starts a server, then drives it with many synthetic R sessions
+ * (RClient) and browser clients (BrowserClient) for a fixed duration.
+ * Each R session streams frames of a configurable size at a configurable
+ * rate and issues metrics requests; each browser answers metrics
+ * requests (optionally after an injected delay) and periodically sends
+ * resizes.  The report covers hub throughput, end-to-end latency
+ * percentiles for frames and metrics round-trips, and memory.
+ *
+ * Every client runs in this process, so frame latency is measured with a
+ * single clock: R sessions stamp each frame with performance.now() in the
+ * frame-level ext object (the same slot jgd_frame_ext() uses), and
+ * browsers subtract on receipt.
+ *
+ * Usage:
+ *   deno run --allow-all hub-load.ts                          # defaults
+ *   deno run --allow-all hub-load.ts --sessions 200 --browsers 20
+ *   deno run --allow-all hub-load.ts --ops 2000 --rate 2 --slow-browsers 5
+ *   deno run --allow-all hub-load.ts --json > result.json     # machine-readable
+ *
+ * Options:
+ *   --sessions N          concurrent R sessions (default 50)
+ *   --browsers N          concurrent browser clients (default 5)
+ *   --duration S          measurement window in seconds (default 10)
+ *   --rate F              frames per second per R session (default 5)
+ *   --ops N               ops per frame (default 100)
+ *   --incremental F       fraction of frames sent as incremental (default 0.5)
+ *   --metrics-rate F      metrics requests per second per R session (default 1)
+ *   --slow-browsers N     browsers that delay every message (default 0)
+ *   --slow-ms MS          delay applied by slow browsers (default 50)
+ *   --resize-every MS     interval between browser resizes, 0 = never (default 2000)
+ *   --tcp                 connect R sessions over TCP instead of the local socket
+ *   --json                print the report as JSON
+ */
+
+import { parseArgs } from "@std/cli/parse-args";
+import { delay } from "@std/async";
+import { TestServer } from "../../server/tests/helpers/server.ts";
+import { RClient } from "../../server/tests/helpers/r_client.ts";
+import { BrowserClient } from "../../server/tests/helpers/browser_client.ts";
+import type {
+  FrameMessage,
+  MetricsRequestMessage,
+  MetricsResponseMessage,
+  ServerMessage,
+} from "../../server/tests/helpers/types.ts";
+
+export interface LoadConfig {
+  sessions: number;
+  browsers: number;
+  durationMs: number;
+  rate: number;
+  ops: number;
+  incremental: number;
+  metricsRate: number;
+  slowBrowsers: number;
+  slowMs: number;
+  resizeEveryMs: number;
+  tcp: boolean;
+}
+
+export interface LatencySummary {
+  count: number;
+  p50: number;
+  p90: number;
+  p99: number;
+  max: number;
+}
+
+export interface LoadReport {
+  config: LoadConfig;
+  elapsedMs: number;
+  framesSent: number;
+  framesDelivered: number;
+  bytesSent: number;
+  sendErrors: number;
+  framesPerSec: number;
+  deliveriesPerSec: number;
+  mbPerSec: number;
+  frameLatencyMs: LatencySummary;
+  metricsRequests: number;
+  metricsLatencyMs: LatencySummary;
+  metricsFallbacks: number;
+  resizesSent: number;
+  resizesReceived: number;
+  hubRssPeakMb: number | null;
+  hubRssEndMb: number | null;
+  generatorHeapMb: number;
+}
+
+/**
+ * Nearest-rank percentile over an already sorted array.
+ * Returns 0 for an empty sample.
+ */
+export function percentile(sorted: number[], p: number): number {
+  if (sorted.length === 0) return 0;
+  const rank = Math.ceil((p / 100) * sorted.length);
+  return sorted[Math.min(sorted.length, Math.max(1, rank)) - 1];
+}
+
+/** Summarize a latency sample (sorts in place). */
+export function summarize(samples: number[]): LatencySummary {
+  samples.sort((a, b) => a - b);
+  return {
+    count: samples.length,
+    p50: percentile(samples, 50),
+    p90: percentile(samples, 90),
+    p99: percentile(samples, 99),
+    max: samples.length > 0 ? samples[samples.length - 1] : 0,
+  };
+}
+
+/**
+ * Build a synthetic plot with `n` ops cycling through the common op
+ * types, so payload shape resembles real device output.
+ */
+export function syntheticPlot(n: number): FrameMessage["plot"] {
+  const gc = { col: "rgba(0,0,0,1)", fill: null, lwd: 1, lty: [], font: { family: "sans", face: 1, size: 12 } };
+  const ops: Array<Record<string, unknown>> = [];
+  for (let i = 0; i < n; i++) {
+    const x = (i * 7) % 640;
+    const y = (i * 13) % 480;
+    switch (i % 4) {
+      case 0:
+        ops.push({ op: "line", x1: x, y1: y, x2: x + 10, y2: y + 10, gc });
+        break;
+      case 1:
+        ops.push({ op: "rect", x0: x, y0: y, x1: x + 5, y1: y + 5, gc });
+        break;
+      case 2:
+        ops.push({ op: "circle", x, y, r: 3, gc });
+        break;
+      default:
+        ops.push({ op: "text", x, y, str: `label ${i}`, rot: 0, hadj: 0, gc });
+        break;
+    }
+  }
+  return {
+    device: { width: 640, height: 480, dpi: 72, bg: "rgba(255,255,255,1)" },
+    ops,
+  };
+}
+
+/** Resident set size of a process in MB, or null where /proc is unavailable. */
+export function readRssMb(pid: number): number | null {
+  if (Deno.build.os !== "linux" || pid <= 0) return null;
+  try {
+    const status = Deno.readTextFileSync(`/proc/${pid}/status`);
+    const m = status.match(/^VmRSS:\s+(\d+)\s+kB/m);
+    return m ? parseInt(m[1], 10) / 1024 : null;
+  } catch {
+    return null;
+  }
+}
+
+/** Shared counters mutated by all simulated clients. */
+class LoadStats {
+  framesSent = 0;
+  framesDelivered = 0;
+  bytesSent = 0;
+  sendErrors = 0;
+  metricsRequests = 0;
+  metricsFallbacks = 0;
+  resizesSent = 0;
+  resizesReceived = 0;
+  frameLatencies: number[] = [];
+  metricsLatencies: number[] = [];
+  hubRssPeakMb: number | null = null;
+}
+
+/** One simulated R session: streams frames and metrics, drains replies. */
+async function runRSession(
+  uri: string,
+  cfg: LoadConfig,
+  stats: LoadStats,
+  stopAt: number,
+): Promise<void> {
+  const client = new RClient();
+  await client.connect(uri);
+  const pendingMetrics = new Map<number, number>();
+  let running = true;
+
+  // Drain inbound traffic (resizes, metrics responses) so the hub's
+  // write queue for this session never backs up.
+  const reader = (async () => {
+    while (running) {
+      let msg: ServerMessage;
+      try {
+        msg = await client.readMessage(250);
+      } catch {
+        continue;
+      }
+      if (msg.type === "resize") {
+        stats.resizesReceived++;
+      } else if (msg.type === "metrics_response") {
+        const resp = msg as MetricsResponseMessage;
+        const sentAt = pendingMetrics.get(resp.id);
+        if (sentAt !== undefined) {
+          pendingMetrics.delete(resp.id);
+          stats.metricsLatencies.push(performance.now() - sentAt);
+          if (resp.width === 0 && resp.ascent === 0 && resp.descent === 0) {
+            stats.metricsFallbacks++;
+          }
+        }
+      }
+    }
+  })();
+
+  const frameInterval = cfg.rate > 0 ? 1000 / cfg.rate : Infinity;
+  const metricsInterval = cfg.metricsRate > 0 ? 1000 / cfg.metricsRate : Infinity;
+  // Stagger start so sessions don't fire in lockstep.
+  let nextFrame = performance.now() + Math.random() * Math.min(frameInterval, 1000);
+  let nextMetrics = performance.now() + Math.random() * Math.min(metricsInterval, 1000);
+  let seq = 0;
+  let plotNumber = 0;
+  let metricsId = 0;
+
+  try {
+    while (performance.now() < stopAt) {
+      const now = performance.now();
+      if (now >= nextFrame) {
+        nextFrame += frameInterval;
+        const incremental = seq > 0 && Math.random() < cfg.incremental;
+        const msg: Record<string, unknown> = {
+          type: "frame",
+          plot: syntheticPlot(cfg.ops),
+          incremental,
+          ext: { loadSeq: seq, loadSentAt: performance.now() },
+        };
+        if (!incremental) {
+          msg.newPage = true;
+          msg.plotNumber = plotNumber++;
+        }
+        seq++;
+        try {
+          const line = JSON.stringify(msg);
+          await client.send(msg);
+          stats.framesSent++;
+          stats.bytesSent += line.length + 1;
+        } catch {
+          stats.sendErrors++;
+        }
+      }
+      if (now >= nextMetrics) {
+        nextMetrics += metricsInterval;
+        const id = ++metricsId;
+        pendingMetrics.set(id, performance.now());
+        try {
+          await client.sendMetricsRequest(id);
+          stats.metricsRequests++;
+        } catch {
+          pendingMetrics.delete(id);
+          stats.sendErrors++;
+        }
+      }
+      const wait = Math.min(nextFrame, nextMetrics) - performance.now();
+      await delay(Math.max(0, Math.min(wait, stopAt - performance.now())));
+    }
+  } finally {
+    running = false;
+    await reader;
+    try {
+      await client.sendClose();
+    } catch {
+      // Hub may already be gone.
+    }
+    client.close();
+  }
+}
+
+/** One simulated browser: records frame latency, answers metrics, resizes. */
+async function runBrowser(
+  wsUrl: string,
+  cfg: LoadConfig,
+  stats: LoadStats,
+  stopAt: number,
+  slowMs: number,
+): Promise<void> {
+  const browser = new BrowserClient();
+  await browser.connect(wsUrl);
+  browser.sendResize(800, 600);
+
+  let resizeTimer: ReturnType<typeof setInterval> | undefined;
+  if (cfg.resizeEveryMs > 0) {
+    let toggle = false;
+    resizeTimer = setInterval(() => {
+      toggle = !toggle;
+      try {
+        browser.sendResize(toggle ? 820 : 800, toggle ? 610 : 600);
+        stats.resizesSent++;
+      } catch {
+        // Socket closing.
+      }
+    }, cfg.resizeEveryMs);
+  }
+
+  try {
+    while (performance.now() < stopAt) {
+      let msg: ServerMessage;
+      try {
+        msg = await browser.waitForMessage(
+          () => true,
+          Math.max(1, Math.min(250, stopAt - performance.now())),
+        );
+      } catch {
+        continue;
+      }
+      if (slowMs > 0) await delay(slowMs);
+      if (msg.type === "frame") {
+        const ext = (msg as FrameMessage & { ext?: { loadSentAt?: number } }).ext;
+        if (typeof ext?.loadSentAt === "number") {
+          stats.framesDelivered++;
+          stats.frameLatencies.push(performance.now() - ext.loadSentAt);
+        }
+      } else if (msg.type === "metrics_request") {
+        const req = msg as MetricsRequestMessage;
+        browser.sendMetricsResponse(req.id, 8 * (req.str?.length ?? 1), 10, 3);
+      }
+    }
+  } finally {
+    if (resizeTimer !== undefined) clearInterval(resizeTimer);
+    browser.close();
+  }
+}
+
+/** Run a load scenario against a fresh server and return the report. */
+export async function runLoad(cfg: LoadConfig): Promise<LoadReport> {
+  const server = new TestServer({ tcp: cfg.tcp, verbose: false });
+  await server.start();
+  const stats = new LoadStats();
+
+  const sampler = setInterval(() => {
+    const rss = readRssMb(server.pid);
+    if (rss !== null && (stats.hubRssPeakMb === null || rss > stats.hubRssPeakMb)) {
+      stats.hubRssPeakMb = rss;
+    }
+  }, 250);
+
+  let elapsedMs = 0;
+  let hubRssEndMb: number | null = null;
+  try {
+    // Browsers first, so the earliest frames have somewhere to go.
+    const startAt = performance.now();
+    const stopAt = startAt + cfg.durationMs;
+    const browsers: Promise<void>[] = [];
+    for (let i = 0; i < cfg.browsers; i++) {
+      const slow = i < cfg.slowBrowsers ? cfg.slowMs : 0;
+      browsers.push(runBrowser(server.wsUrl, cfg, stats, stopAt, slow));
+    }
+    await delay(100);
+
+    const sessions: Promise<void>[] = [];
+    for (let i = 0; i < cfg.sessions; i++) {
+      sessions.push(runRSession(server.socketPath, cfg, stats, stopAt));
+    }
+
+    const results = await Promise.allSettled([...sessions, ...browsers]);
+    elapsedMs = performance.now() - startAt;
+    for (const r of results) {
+      if (r.status === "rejected") {
+        stats.sendErrors++;
+        console.error(`client failed: ${r.reason}`);
+      }
+    }
+    hubRssEndMb = readRssMb(server.pid);
+  } finally {
+    clearInterval(sampler);
+    await server.shutdown();
+    server.cleanup();
+  }
+
+  const secs = elapsedMs / 1000;
+  return {
+    config: cfg,
+    elapsedMs,
+    framesSent: stats.framesSent,
+    framesDelivered: stats.framesDelivered,
+    bytesSent: stats.bytesSent,
+    sendErrors: stats.sendErrors,
+    framesPerSec: stats.framesSent / secs,
+    deliveriesPerSec: stats.framesDelivered / secs,
+    mbPerSec: stats.bytesSent / secs / (1024 * 1024),
+    frameLatencyMs: summarize(stats.frameLatencies),
+    metricsRequests: stats.metricsRequests,
+    metricsLatencyMs: summarize(stats.metricsLatencies),
+    metricsFallbacks: stats.metricsFallbacks,
+    resizesSent: stats.resizesSent,
+    resizesReceived: stats.resizesReceived,
+    hubRssPeakMb: stats.hubRssPeakMb,
+    hubRssEndMb,
+    generatorHeapMb: Deno.memoryUsage().heapUsed / (1024 * 1024),
+  };
+}
+
+function fmtLatency(s: LatencySummary): string {
+  return `n=${s.count} p50=${s.p50.toFixed(1)} p90=${s.p90.toFixed(1)} ` +
+    `p99=${s.p99.toFixed(1)} max=${s.max.toFixed(1)}`;
+}
+
+function fmtMb(v: number | null): string {
+  return v === null ? "n/a" : `${v.toFixed(1)} MB`;
+}
+
+function printReport(r: LoadReport): void {
+  const c = r.config;
+  console.log(`\n${"=".repeat(60)}`);
+  console.log("  jgd Hub Load Report");
+  console.log(`${"=".repeat(60)}`);
+  console.log(
+    `sessions=${c.sessions} browsers=${c.browsers} (slow=${c.slowBrowsers}@${c.slowMs}ms) ` +
+      `rate=${c.rate}/s ops=${c.ops} incremental=${c.incremental} ` +
+      `metrics=${c.metricsRate}/s resize=${c.resizeEveryMs}ms transport=${c.tcp ? "tcp" : "local"}`,
+  );
+  console.log(`elapsed:          ${(r.elapsedMs / 1000).toFixed(2)} s`);
+  console.log(`frames sent:      ${r.framesSent} (${r.framesPerSec.toFixed(1)}/s, ${r.mbPerSec.toFixed(2)} MB/s)`);
+  console.log(`frames delivered: ${r.framesDelivered} (${r.deliveriesPerSec.toFixed(1)}/s across all browsers)`);
+  console.log(`frame latency:    ${fmtLatency(r.frameLatencyMs)} ms`);
+  console.log(`metrics:          ${r.metricsRequests} requests, ${r.metricsFallbacks} fallbacks`);
+  console.log(`metrics latency:  ${fmtLatency(r.metricsLatencyMs)} ms`);
+  console.log(`resizes:          ${r.resizesSent} sent, ${r.resizesReceived} forwarded to R`);
+  console.log(`send errors:      ${r.sendErrors}`);
+  console.log(`hub RSS:          peak ${fmtMb(r.hubRssPeakMb)}, end ${fmtMb(r.hubRssEndMb)}`);
+  console.log(`generator heap:   ${r.generatorHeapMb.toFixed(1)} MB`);
+}
+
+function parseConfig(argv: string[]): { cfg: LoadConfig; json: boolean } {
+  const args = parseArgs(argv, {
+    boolean: ["tcp", "json"],
+    string: [
+      "sessions",
+      "browsers",
+      "duration",
+      "rate",
+      "ops",
+      "incremental",
+      "metrics-rate",
+      "slow-browsers",
+      "slow-ms",
+      "resize-every",
+    ],
+    default: { tcp: false, json: false },
+  });
+
+  const num = (name: string, fallback: number, min = 0): number => {
+    const raw = args[name as keyof typeof args];
+    if (raw === undefined) return fallback;
+    const v = Number(raw);
+    if (!Number.isFinite(v) || v < min) {
+      throw new Error(`Invalid --${name}="${raw}". Expected a number >= ${min}.`);
+    }
+    return v;
+  };
+
+  const cfg: LoadConfig = {
+    sessions: Math.floor(num("sessions", 50, 1)),
+    browsers: Math.floor(num("browsers", 5)),
+    durationMs: num("duration", 10, 0.1) * 1000,
+    rate: num("rate", 5),
+    ops: Math.floor(num("ops", 100)),
+    incremental: Math.min(1, num("incremental", 0.5)),
+    metricsRate: num("metrics-rate", 1),
+    slowBrowsers: Math.floor(num("slow-browsers", 0)),
+    slowMs: num("slow-ms", 50),
+    resizeEveryMs: num("resize-every", 2000),
+    tcp: args.tcp,
+  };
+  return { cfg, json: args.json };
+}
+
+if (import.meta.main) {
+  const { cfg, json } = parseConfig(Deno.args);
+  const report = await runLoad(cfg);
+  if (json) {
+    console.log(JSON.stringify(report, null, 2));
+  } else {
+    printReport(report);
+  }
+}
@@ -0,0 +1,377 @@
+#!/usr/bin/env -S deno run --allow-all
+/**
+ * Replay a captured jgd session against a fresh server.
+ *
+ * Reads a capture written by `jgd-server -capture <file>` and reproduces
+ * the recorded R and browser traffic: every R connection becomes an
+ * RClient that sends its recorded lines verbatim, and every browser
+ * becomes a BrowserClient that sends its recorded resizes and pings.
+ * Connections open and close at their recorded times, scaled by --speed.
+ *
+ * Metrics responses cannot be replayed verbatim because the hub assigns
+ * fresh request ids; instead each replayed browser answers a live
+ * metrics_request with the response recorded for an identical request.
+ *
+ * The report compares what the server sent in the replay against the
+ * capture (per direction and message type) and gives frame delivery
+ * latency from the R send to each browser's receipt, so hub, protocol
+ * and renderer changes can be benchmarked on production traffic without
+ * R installed.
+ *
+ * Usage:
+ *   deno run --allow-all replay.ts capture.jsonl              # original pacing
+ *   deno run --allow-all replay.ts capture.jsonl --speed 10   # 10x faster
+ *   deno run --allow-all replay.ts capture.jsonl --speed 0    # no pacing
+ *   deno run --allow-all replay.ts capture.jsonl --json > result.json
+ *
+ * Options:
+ *   --speed F    pacing multiplier; 0 sends as fast as possible (default 1)
+ *   --settle MS  wait after the last record for in-flight traffic (default 500)
+ *   --tcp        connect R sessions over TCP instead of the local socket
+ *   --json       print the report as JSON
+ */
+
+import { parseArgs } from "@std/cli/parse-args";
+import { delay } from "@std/async";
+import { TestServer } from "../../server/tests/helpers/server.ts";
+import { RClient } from "../../server/tests/helpers/r_client.ts";
+import { BrowserClient } from "../../server/tests/helpers/browser_client.ts";
+import type { MetricsRequestMessage, ServerMessage } from "../../server/tests/helpers/types.ts";
+import { type CaptureRecord, parseCapture } from "../../server/capture.ts";
+import { type LatencySummary, readRssMb, summarize } from "./hub-load.ts";
+
+export interface ReplayConfig {
+  file: string;
+  speed: number;
+  settleMs: number;
+  tcp: boolean;
+}
+
+export interface ReplayReport {
+  config: ReplayConfig;
+  capturedMs: number;
+  elapsedMs: number;
+  rConnections: number;
+  browserConnections: number;
+  /** Messages the replayer sent, by direction. */
+  sent: { r2s: number; b2s: number; bytes: number };
+  /** Server output by direction and message type: captured vs replayed. */
+  received: Record<string, { captured: number; replayed: number }>;
+  mismatches: string[];
+  frameLatencyMs: LatencySummary;
+  metricsAnswered: number;
+  metricsUnmatched: number;
+  sendErrors: number;
+  hubRssPeakMb: number | null;
+}
+
+/** Key identifying a metrics request independent of its id. */
+function metricsKey(req: Record<string, unknown>): string {
+  const { id: _id, type: _type, ...rest } = req;
+  return JSON.stringify(rest);
+}
+
+function typeOf(line: string): string {
+  const m = line.match(/^\s*\{[^{}]*"type"\s*:\s*"([^"]+)"/);
+  return m ? m[1] : "?";
+}
+
+/**
+ * Recorded metrics answers, keyed by request content.  Built by pairing
+ * each s2b metrics_request with the b2s metrics_response carrying the
+ * same (server-assigned) id on the same browser connection.
+ */
+function recordedMetrics(records: CaptureRecord[]): Map<string, Array<Record<string, unknown>>> {
+  const requests = new Map<string, string>(); // `${conn}:${id}` -> key
+  const answers = new Map<string, Array<Record<string, unknown>>>();
+  for (const r of records) {
+    if (!r.msg) continue;
+    if (r.dir === "s2b" && typeOf(r.msg) === "metrics_request") {
+      const req = JSON.parse(r.msg);
+      requests.set(`${r.conn}:${req.id}`, metricsKey(req));
+    } else if (r.dir === "b2s" && typeOf(r.msg) === "metrics_response") {
+      const resp = JSON.parse(r.msg);
+      const key = requests.get(`${r.conn}:${resp.id}`);
+      if (key === undefined) continue;
+      requests.delete(`${r.conn}:${resp.id}`);
+      const list = answers.get(key) ?? [];
+      list.push(resp);
+      answers.set(key, list);
+    }
+  }
+  return answers;
+}
+
+class ReplayStats {
+  r2s = 0;
+  b2s = 0;
+  bytes = 0;
+  sendErrors = 0;
+  metricsAnswered = 0;
+  metricsUnmatched = 0;
+  received = new Map<string, number>();
+  frameLatencies: number[] = [];
+  hubRssPeakMb: number | null = null;
+
+  count(dir: string, type: string): void {
+    const k = `${dir} ${type}`;
+    this.received.set(k, (this.received.get(k) ?? 0) + 1);
+  }
+}
+
+/** Replay a capture against a fresh server and return the report. */
+export async function runReplay(cfg: ReplayConfig): Promise<ReplayReport> {
+  const { records } = parseCapture(await Deno.readTextFile(cfg.file));
+  const answers = recordedMetrics(records);
+  const capturedMs = records.length > 0 ? records[records.length - 1].t : 0;
+
+  const server = new TestServer({ tcp: cfg.tcp, verbose: false });
+  await server.start();
+  const stats = new ReplayStats();
+  const sampler = setInterval(() => {
+    const rss = readRssMb(server.pid);
+    if (rss !== null && (stats.hubRssPeakMb === null || rss > stats.hubRssPeakMb)) {
+      stats.hubRssPeakMb = rss;
+    }
+  }, 250);
+
+  const rClients = new Map<string, { client: RClient; done: Promise<void>; open: boolean }>();
+  const browsers = new Map<string, { client: BrowserClient; done: Promise<void>; open: boolean }>();
+  // Frame send times per R sessionId, so browsers can compute delivery
+  // latency for the n-th frame of each session they receive.
+  const frameSentAt = new Map<string, number[]>();
+  let rConnections = 0;
+  let browserConnections = 0;
+
+  const drainR = async (entry: { client: RClient; open: boolean }) => {
+    while (entry.open) {
+      let msg: ServerMessage;
+      try {
+        msg = await entry.client.readMessage(250);
+      } catch {
+        continue;
+      }
+      stats.count("s2r", msg.type);
+    }
+  };
+
+  const drainBrowser = async (entry: { client: BrowserClient; open: boolean }) => {
+    // Frames sent before this browser connected never reach it.
+    const nextFrame = new Map<string, number>();
+    for (const [sid, times] of frameSentAt) nextFrame.set(sid, times.length);
+    while (entry.open) {
+      let msg: ServerMessage;
+      try {
+        msg = await entry.client.waitForMessage(() => true, 250);
+      } catch {
+        continue;
+      }
+      const now = performance.now();
+      stats.count("s2b", msg.type);
+      if (msg.type === "frame") {
+        const sid = (msg as { plot?: { sessionId?: string } }).plot?.sessionId ?? "";
+        const i = nextFrame.get(sid) ?? 0;
+        nextFrame.set(sid, i + 1);
+        const sentAt = frameSentAt.get(sid)?.[i];
+        if (sentAt !== undefined) stats.frameLatencies.push(now - sentAt);
+      } else if (msg.type === "metrics_request") {
+        const req = msg as MetricsRequestMessage;
+        const resp = answers.get(metricsKey(req as unknown as Record<string, unknown>))?.shift();
+        if (resp) {
+          entry.client.send({ ...resp, id: req.id });
+          stats.metricsAnswered++;
+        } else {
+          stats.metricsUnmatched++;
+        }
+      }
+    }
+  };
+
+  let elapsedMs = 0;
+  try {
+    const startAt = performance.now();
+    for (const rec of records) {
+      if (cfg.speed > 0) {
+        const wait = startAt + rec.t / cfg.speed - performance.now();
+        if (wait > 0) await delay(wait);
+      }
+      try {
+        switch (rec.dir) {
+          case "r_open": {
+            const client = new RClient();
+            await client.connect(server.socketPath);
+            const entry = { client, open: true, done: Promise.resolve() };
+            entry.done = drainR(entry);
+            rClients.set(rec.conn, entry);
+            rConnections++;
+            break;
+          }
+          case "r2s": {
+            const entry = rClients.get(rec.conn);
+            if (!entry || rec.msg === undefined) break;
+            if (typeOf(rec.msg) === "frame") {
+              const sid = JSON.parse(rec.msg)?.plot?.sessionId ?? "";
+              const times = frameSentAt.get(sid) ?? [];
+              times.push(performance.now());
+              frameSentAt.set(sid, times);
+            }
+            await entry.client.sendLine(rec.msg);
+            stats.r2s++;
+            stats.bytes += rec.msg.length + 1;
+            break;
+          }
+          case "r_close": {
+            const entry = rClients.get(rec.conn);
+            if (!entry) break;
+            entry.open = false;
+            await entry.done;
+            entry.client.close();
+            rClients.delete(rec.conn);
+            break;
+          }
+          case "b_open": {
+            const client = new BrowserClient();
+            await client.connect(server.wsUrl);
+            const entry = { client, open: true, done: Promise.resolve() };
+            entry.done = drainBrowser(entry);
+            browsers.set(rec.conn, entry);
+            browserConnections++;
+            break;
+          }
+          case "b2s": {
+            const entry = browsers.get(rec.conn);
+            if (!entry || rec.msg === undefined) break;
+            // Answered live in drainBrowser (ids differ between runs).
+            if (typeOf(rec.msg) === "metrics_response") break;
+            entry.client.send(JSON.parse(rec.msg));
+            stats.b2s++;
+            stats.bytes += rec.msg.length;
+            break;
+          }
+          case "b_close": {
+            const entry = browsers.get(rec.conn);
+            if (!entry) break;
+            entry.open = false;
+            await entry.done;
+            entry.client.close();
+            browsers.delete(rec.conn);
+            break;
+          }
+        }
+      } catch (e) {
+        stats.sendErrors++;
+        console.error(`replay ${rec.dir} ${rec.conn} failed: ${e}`);
+      }
+    }
+    await delay(cfg.settleMs);
+    elapsedMs = performance.now() - startAt;
+  } finally {
+    for (const entry of [...rClients.values(), ...browsers.values()]) entry.open = false;
+    await Promise.allSettled([...rClients.values(), ...browsers.values()].map((e) => e.done));
+    for (const entry of rClients.values()) entry.client.close();
+    for (const entry of browsers.values()) entry.client.close();
+    clearInterval(sampler);
+    await server.shutdown();
+    server.cleanup();
+  }
+
+  // Compare server output against the capture.
+  const captured = new Map<string, number>();
+  for (const r of records) {
+    if ((r.dir === "s2r" || r.dir === "s2b") && r.msg !== undefined) {
+      const k = `${r.dir} ${typeOf(r.msg)}`;
+      captured.set(k, (captured.get(k) ?? 0) + 1);
+    }
+  }
+  const received: ReplayReport["received"] = {};
+  const mismatches: string[] = [];
+  for (const k of new Set([...captured.keys(), ...stats.received.keys()])) {
+    const c = captured.get(k) ?? 0;
+    const r = stats.received.get(k) ?? 0;
+    received[k] = { captured: c, replayed: r };
+    if (c !== r) mismatches.push(`${k}: captured ${c}, replayed ${r}`);
+  }
+
+  return {
+    config: cfg,
+    capturedMs,
+    elapsedMs,
+    rConnections,
+    browserConnections,
+    sent: { r2s: stats.r2s, b2s: stats.b2s, bytes: stats.bytes },
+    received,
+    mismatches,
+    frameLatencyMs: summarize(stats.frameLatencies),
+    metricsAnswered: stats.metricsAnswered,
+    metricsUnmatched: stats.metricsUnmatched,
+    sendErrors: stats.sendErrors,
+    hubRssPeakMb: stats.hubRssPeakMb,
+  };
+}
+
+function printReport(r: ReplayReport): void {
+  const l = r.frameLatencyMs;
+  console.log(`\n${"=".repeat(60)}`);
+  console.log("  jgd Capture Replay Report");
+  console.log(`${"=".repeat(60)}`);
+  console.log(`capture:        ${r.config.file}`);
+  console.log(
+    `duration:       ${(r.capturedMs / 1000).toFixed(2)} s captured, ` +
+      `${(r.elapsedMs / 1000).toFixed(2)} s replayed (speed=${r.config.speed || "max"})`,
+  );
+  console.log(`connections:    ${r.rConnections} R, ${r.browserConnections} browser`);
+  console.log(
+    `sent:           ${r.sent.r2s} R lines, ${r.sent.b2s} browser messages, ` +
+      `${(r.sent.bytes / (1024 * 1024)).toFixed(2)} MB`,
+  );
+  console.log(
+    `frame latency:  n=${l.count} p50=${l.p50.toFixed(1)} p90=${l.p90.toFixed(1)} ` +
+      `p99=${l.p99.toFixed(1)} max=${l.max.toFixed(1)} ms`,
+  );
+  console.log(`metrics:        ${r.metricsAnswered} answered, ${r.metricsUnmatched} without a recorded answer`);
+  console.log(`send errors:    ${r.sendErrors}`);
+  console.log(`hub RSS peak:   ${r.hubRssPeakMb === null ? "n/a" : `${r.hubRssPeakMb.toFixed(1)} MB`}`);
+  console.log("server output (captured / replayed):");
+  for (const k of Object.keys(r.received).sort()) {
+    const v = r.received[k];
+    console.log(`  ${k.padEnd(28)} ${String(v.captured).padStart(7)} / ${v.replayed}`);
+  }
+  if (r.mismatches.length > 0) {
+    console.log(`${r.mismatches.length} mismatch(es) -- timing-dependent types (e.g. resize dedup) may differ at other speeds`);
+  }
+}
+
+function parseConfig(argv: string[]): { cfg: ReplayConfig; json: boolean } {
+  const args = parseArgs(argv, {
+    boolean: ["tcp", "json"],
+    string: ["speed", "settle"],
+    default: { tcp: false, json: false },
+  });
+  const file = args._[0];
+  if (typeof file !== "string") {
+    throw new Error("Usage: replay.ts <capture.jsonl> [--speed F] [--settle MS] [--tcp] [--json]");
+  }
+  const num = (name: "speed" | "settle", fallback: number): number => {
+    const raw = args[name];
+    if (raw === undefined) return fallback;
+    const v = Number(raw);
+    if (!Number.isFinite(v) || v < 0) {
+      throw new Error(`Invalid --${name}="${raw}". Expected a number >= 0.`);
+    }
+    return v;
+  };
+  return {
+    cfg: { file, speed: num("speed", 1), settleMs: num("settle", 500), tcp: args.tcp },
+    json: args.json,
+  };
+}
+
+if (import.meta.main) {
+  const { cfg, json } = parseConfig(Deno.args);
+  const report = await runReplay(cfg);
+  if (json) {
+    console.log(JSON.stringify(report, null, 2));
+  } else {
+    printReport(report);
+  }
+}